@@ -0,0 +1,80 @@
+#!/bin/bash
+# Compare the epoll and io_uring network backends under chat_loadgen.
+#
+# Needs a ChatServer configured with -DCHAT_IO_URING=ON and chat_loadgen.
+# One server binary covers both runs: CHAT_IO_URING=0 in its environment
+# keeps it on epoll.
+#
+#   SERVER=_build/ChatServer LOADGEN=_build/chat_loadgen ./bench_io_backends.sh
+#
+# Settings come from the environment: CONNECTIONS (100000), SENDERS (0.01),
+# RATE (2000 messages/s in total), ROOMS (100), WARMUP (5) and DURATION (30)
+# seconds. One source address runs out of local ports near 28k connections,
+# so the load is spread over 127.0.0.x, one address per 25k connections.
+# Both processes need an open file limit above CONNECTIONS; the script
+# raises the soft limit and stops if the hard limit is too low.
+
+set -eu
+
+SERVER=${SERVER:-_build/ChatServer}
+LOADGEN=${LOADGEN:-_build/chat_loadgen}
+CONNECTIONS=${CONNECTIONS:-100000}
+SENDERS=${SENDERS:-0.01}
+RATE=${RATE:-2000}
+ROOMS=${ROOMS:-100}
+WARMUP=${WARMUP:-5}
+DURATION=${DURATION:-30}
+ADMIN_PORT=${ADMIN_PORT:-9100}
+
+SERVER=$(readlink -f "$SERVER")
+LOADGEN=$(readlink -f "$LOADGEN")
+
+if ! ulimit -n $((CONNECTIONS + 1024)) 2>/dev/null; then
+    echo "open file limit $(ulimit -Hn) is too low for $CONNECTIONS connections; raise it (ulimit -Hn, nofile)" >&2
+    exit 1
+fi
+
+BIND=""
+for ((i = 1; i <= (CONNECTIONS + 24999) / 25000; ++i)); do
+    BIND="${BIND:+$BIND,}127.0.0.$i"
+done
+
+cpuTicks() {
+    awk '{ print $14 + $15 }' "/proc/$1/stat"
+}
+
+run() {
+    local backend=$1 uring=$2
+    local dir
+    dir=$(mktemp -d)
+    mkdir -p "$dir/build"
+
+    (cd "$dir" && CHAT_IO_URING=$uring CHAT_ADMIN_PORT=$ADMIN_PORT exec "$SERVER" > server.log 2>&1) &
+    local pid=$!
+    until (exec 3<>/dev/tcp/127.0.0.1/8080) 2>/dev/null; do
+        sleep 0.2
+    done
+
+    local before
+    before=$(cpuTicks "$pid")
+    "$LOADGEN" --connections "$CONNECTIONS" --bind "$BIND" --rooms "$ROOMS" --senders "$SENDERS" \
+        --open-loop --rate "$RATE" --warmup "$WARMUP" --duration "$DURATION" > "$dir/loadgen.log" 2>&1 || true
+    local after rss
+    after=$(cpuTicks "$pid")
+    rss=$(awk '/VmRSS/ { print $2 / 1024 " MB" }' "/proc/$pid/status")
+
+    echo "== $backend"
+    sed -n '/^chat_loadgen:/,$p' "$dir/loadgen.log"
+    echo "server cpu $(( (after - before) / $(getconf CLK_TCK) )) s over the run, rss $rss"
+    if command -v curl > /dev/null; then
+        curl -s "http://127.0.0.1:$ADMIN_PORT/metrics" | grep '^chat_uring' || true
+    fi
+    echo
+
+    kill "$pid"
+    wait "$pid" 2>/dev/null || true
+    rm -rf "$dir"
+}
+
+run epoll 0
+run io_uring 1
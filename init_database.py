@@ -40,11 +40,17 @@ def init_database():
         user_id TEXT,
         content TEXT,
         timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+        seq INTEGER,
         FOREIGN KEY (room_id) REFERENCES chat_rooms(room_id),
         FOREIGN KEY (user_id) REFERENCES users(user_id)
     )
     ''')
     
+    # Per-room sequence numbers; history pages seek on (room_id, seq)
+    cursor.execute('''
+    CREATE INDEX IF NOT EXISTS idx_messages_room_seq ON messages (room_id, seq)
+    ''')
+    
     # Create Room Members table
     cursor.execute('''
     CREATE TABLE IF NOT EXISTS room_members (
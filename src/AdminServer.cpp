@@ -0,0 +1,167 @@
+/**
+ * @file AdminServer.cpp
+ * @brief Implementation of the admin HTTP listener.
+ */
+
+#include "AdminServer.hpp"
+#include "Logging.hpp"
+#include "StallWatchdog.hpp"
+
+#include <sstream>
+
+namespace ChatServer {
+
+namespace {
+
+// Admin requests are a request line and a few headers
+const std::size_t kMaxRequestBytes = 8192;
+
+const char* reasonPhrase(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 202: return "Accepted";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 503: return "Service Unavailable";
+    default: return "Error";
+    }
+}
+
+} // namespace
+
+class AdminServer::Connection : public std::enable_shared_from_this<Connection> {
+public:
+    Connection(boost::asio::ip::tcp::socket socket, const AdminServer& server)
+        : socket_(std::move(socket)), server_(server), buffer_(kMaxRequestBytes) {}
+
+    void start() {
+        boost::asio::async_read_until(socket_, buffer_, "\r\n\r\n",
+            [this, self = shared_from_this()](boost::system::error_code ec, std::size_t /*length*/) {
+                AdminResponse response;
+                AdminRequest request;
+                if (ec || !parse(request)) {
+                    response.status = 400;
+                    response.body = "Bad request\n";
+                } else {
+                    response = server_.dispatch(request);
+                }
+                write(response);
+            });
+    }
+
+private:
+    bool parse(AdminRequest& request) {
+        std::istream stream(&buffer_);
+        std::string line;
+        if (!std::getline(stream, line)) {
+            return false;
+        }
+        std::istringstream requestLine(line);
+        std::string target;
+        if (!(requestLine >> request.method >> target)) {
+            return false;
+        }
+        auto question = target.find('?');
+        request.path = target.substr(0, question);
+        if (question != std::string::npos) {
+            request.query = target.substr(question + 1);
+        }
+        return true;
+    }
+
+    void write(const AdminResponse& response) {
+        std::ostringstream out;
+        out << "HTTP/1.1 " << response.status << ' ' << reasonPhrase(response.status) << "\r\n"
+            << "Content-Type: " << response.contentType << "\r\n"
+            << "Content-Length: " << response.body.size() << "\r\n"
+            << "Connection: close\r\n\r\n"
+            << response.body;
+        output_ = out.str();
+        boost::asio::async_write(socket_, boost::asio::buffer(output_),
+            [this, self = shared_from_this()](boost::system::error_code /*ec*/, std::size_t /*length*/) {
+                boost::system::error_code ignored;
+                socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+            });
+    }
+
+    boost::asio::ip::tcp::socket socket_;
+    const AdminServer& server_;
+    boost::asio::streambuf buffer_;
+    std::string output_;
+};
+
+AdminServer::AdminServer(boost::asio::io_context& io_context, const std::string& address, unsigned short port)
+    : acceptor_(io_context),
+      endpoint_(boost::asio::ip::make_address(address), port) {}
+
+void AdminServer::addRoute(const std::string& method, const std::string& path, Handler handler) {
+    std::lock_guard<std::mutex> lock(routesMutex_);
+    routes_[{method, path}] = std::move(handler);
+}
+
+bool AdminServer::start() {
+    boost::system::error_code ec;
+    acceptor_.open(endpoint_.protocol(), ec);
+    if (!ec) {
+        acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true), ec);
+        acceptor_.bind(endpoint_, ec);
+    }
+    if (!ec) {
+        acceptor_.listen(boost::asio::socket_base::max_listen_connections, ec);
+    }
+    if (ec) {
+        Logging::error("Admin listener could not open " + endpoint_.address().to_string() + ":" +
+                       std::to_string(endpoint_.port()) + ": " + ec.message());
+        acceptor_.close(ec);
+        return false;
+    }
+
+    Logging::info("Admin listener on " + endpoint_.address().to_string() + ":" + std::to_string(endpoint_.port()));
+    doAccept();
+    return true;
+}
+
+void AdminServer::stop() {
+    boost::system::error_code ignored;
+    acceptor_.close(ignored);
+}
+
+void AdminServer::doAccept() {
+    acceptor_.async_accept([this](boost::system::error_code ec, boost::asio::ip::tcp::socket socket) {
+        if (ec == boost::asio::error::operation_aborted) {
+            return;
+        }
+        if (!ec) {
+            std::make_shared<Connection>(std::move(socket), *this)->start();
+        }
+        doAccept();
+    });
+}
+
+AdminResponse AdminServer::dispatch(const AdminRequest& request) const {
+    StallWatchdog::HandlerScope scope(StallWatchdog::Handler::Admin);
+    Handler handler;
+    bool pathKnown = false;
+    {
+        std::lock_guard<std::mutex> lock(routesMutex_);
+        auto it = routes_.find({request.method, request.path});
+        if (it != routes_.end()) {
+            handler = it->second;
+        } else {
+            for (const auto& route : routes_) {
+                pathKnown = pathKnown || route.first.second == request.path;
+            }
+        }
+    }
+
+    if (!handler) {
+        AdminResponse response;
+        response.status = pathKnown ? 405 : 404;
+        response.body = pathKnown ? "Method not allowed\n" : "Not found\n";
+        return response;
+    }
+    return handler(request);
+}
+
+} // namespace ChatServer
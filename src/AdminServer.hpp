@@ -0,0 +1,63 @@
+/**
+ * @file AdminServer.hpp
+ * @brief Minimal HTTP listener for operational endpoints such as /metrics.
+ */
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <boost/asio.hpp>
+
+namespace ChatServer {
+
+struct AdminRequest {
+    std::string method;
+    std::string path;    // without the query string
+    std::string query;
+};
+
+struct AdminResponse {
+    int status = 200;
+    std::string contentType = "text/plain; charset=utf-8";
+    std::string body;
+};
+
+/**
+ * @brief Serves a few fixed routes over HTTP/1.0-style one-shot connections.
+ *
+ * Meant for a loopback admin port scraped by Prometheus or poked by
+ * operators, not for untrusted clients: requests are read up to a small
+ * size limit, answered once and the connection is closed. Handlers run on
+ * the io_context the listener was created with.
+ */
+class AdminServer {
+public:
+    using Handler = std::function<AdminResponse(const AdminRequest&)>;
+
+    AdminServer(boost::asio::io_context& io_context, const std::string& address, unsigned short port);
+
+    // Register a handler for a method and exact path, e.g. ("GET", "/metrics")
+    void addRoute(const std::string& method, const std::string& path, Handler handler);
+
+    // Bind and start accepting; false if the port could not be opened
+    bool start();
+
+    void stop();
+
+private:
+    class Connection;
+
+    void doAccept();
+    AdminResponse dispatch(const AdminRequest& request) const;
+
+    boost::asio::ip::tcp::acceptor acceptor_;
+    boost::asio::ip::tcp::endpoint endpoint_;
+    std::map<std::pair<std::string, std::string>, Handler> routes_;
+    mutable std::mutex routesMutex_;
+};
+
+} // namespace ChatServer
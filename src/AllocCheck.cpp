@@ -0,0 +1,164 @@
+/**
+ * @file AllocCheck.cpp
+ * @brief chat_alloc_check: fails if a session's steady-state read, write and
+ *        post path allocates.
+ *
+ * The global operator new is replaced with one that counts. A Session is
+ * connected to a client over a loopback socket pair, and its message handler
+ * answers every message with the same prebuilt frame, so each round trip
+ * goes through the session's read, the post from sendFrame and the gathered
+ * write. The warm-up lets the handler memory blocks, the per-thread post
+ * cache and the session's buffers reach their steady size; every allocation
+ * on any thread during the measured round trips after it is counted.
+ *
+ * Exits 1 if any allocation was counted, so a change that brings a malloc
+ * back onto the per-message path shows up as a failed run.
+ */
+
+#include "Logging.hpp"
+#include "Session.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <boost/asio.hpp>
+
+namespace {
+
+std::atomic<std::uint64_t> allocations{0};
+
+void* countedAllocate(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void* countedAllocate(std::size_t size, std::align_val_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    auto align = static_cast<std::size_t>(alignment);
+    return std::aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    if (void* pointer = countedAllocate(size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    if (void* pointer = countedAllocate(size, alignment)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return ::operator new(size, alignment);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size);
+}
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+
+using namespace ChatServer;
+using boost::asio::ip::tcp;
+
+namespace {
+
+void printUsage() {
+    std::cerr << "usage: chat_alloc_check [--messages N] [--warmup N]\n"
+                 "  --messages N  measured round trips (default 10000)\n"
+                 "  --warmup N    round trips before measuring (default 1000)\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::uint64_t messages = 10000;
+    std::uint64_t warmup = 1000;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--messages" && i + 1 < argc) {
+            messages = std::stoull(argv[++i]);
+        } else if (arg == "--warmup" && i + 1 < argc) {
+            warmup = std::stoull(argv[++i]);
+        } else {
+            printUsage();
+            return arg == "--help" || arg == "-h" ? 0 : 2;
+        }
+    }
+
+    // Filtered log calls cost what they cost in a quiet deployment
+    Logging::detail::Logger::getInstance().setLevel(Logging::detail::FATAL_LEVEL);
+
+    // A session on one end of a loopback connection, the client on the other
+    boost::asio::io_context io;
+    tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+    tcp::socket client(io);
+    client.connect(acceptor.local_endpoint());
+    tcp::socket served(io);
+    acceptor.accept(served);
+    client.set_option(tcp::no_delay(true));
+    served.set_option(tcp::no_delay(true));
+
+    const auto reply = Session::makeFrame("pong");
+    auto session = std::make_shared<Session>(std::move(served), "alloc_check");
+    session->setMessageHandler([reply](const std::string&, std::shared_ptr<Session> sender) {
+        sender->sendFrame(reply);
+    });
+    session->start();
+
+    auto work = boost::asio::make_work_guard(io);
+    std::thread ioThread([&io]() { io.run(); });
+
+    const std::string request = "ping";
+    std::array<char, 64> answer;
+    auto roundTrip = [&]() {
+        boost::asio::write(client, boost::asio::buffer(request));
+        boost::asio::read(client, boost::asio::buffer(answer.data(), reply->size()));
+    };
+
+    for (std::uint64_t i = 0; i < warmup; ++i) {
+        roundTrip();
+    }
+    std::uint64_t before = allocations.load();
+    for (std::uint64_t i = 0; i < messages; ++i) {
+        roundTrip();
+    }
+    std::uint64_t counted = allocations.load() - before;
+
+    boost::system::error_code ignored;
+    client.close(ignored);
+    work.reset();
+    ioThread.join();
+
+    std::cout << "chat_alloc_check: " << counted << " allocations over " << messages << " messages ("
+              << static_cast<double>(counted) / static_cast<double>(messages ? messages : 1) << " per message)"
+              << std::endl;
+    return counted == 0 ? 0 : 1;
+}
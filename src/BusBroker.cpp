@@ -0,0 +1,56 @@
+/**
+ * @file BusBroker.cpp
+ * @brief chat_bus_broker: relays room traffic between the nodes of a cluster.
+ *
+ * Nodes started with CHAT_BUS_SOCKET set to the broker's socket send it one
+ * batch of room messages per tick; the broker passes every batch on to each
+ * other node, and messages addressed to one node to that node only. Run one
+ * broker per host, before or after the nodes; they reconnect on their own.
+ */
+
+#include "UnixSocketBus.hpp"
+
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <boost/asio.hpp>
+
+namespace {
+
+void printUsage() {
+    std::cerr << "usage: chat_bus_broker [--socket PATH]\n"
+                 "  --socket PATH  Unix socket the nodes connect to (default /tmp/chat-bus.sock)\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string path = "/tmp/chat-bus.sock";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) {
+            path = argv[++i];
+        } else {
+            printUsage();
+            return arg == "--help" || arg == "-h" ? 0 : 2;
+        }
+    }
+
+    boost::asio::io_context io;
+    ChatServer::BusBroker broker(io, path);
+    if (!broker.start()) {
+        std::cerr << "chat_bus_broker: cannot listen on " << path << "\n";
+        return 1;
+    }
+    std::cout << "chat_bus_broker: listening on " << path << std::endl;
+
+    boost::asio::signal_set signals(io, SIGINT, SIGTERM);
+    signals.async_wait([&](boost::system::error_code, int) {
+        broker.stop();
+        io.stop();
+    });
+    io.run();
+
+    std::cout << "chat_bus_broker: relayed " << broker.framesRelayed() << " frames" << std::endl;
+    return 0;
+}
@@ -0,0 +1,51 @@
+/**
+ * @file BusCodec.hpp
+ * @brief Varint-prefixed fields of the messages nodes exchange over the bus.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ChatServer {
+namespace BusCodec {
+
+inline void putVarint(std::string& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+inline void putString(std::string& out, const std::string& value) {
+    putVarint(out, value.size());
+    out.append(value);
+}
+
+inline bool getVarint(const std::string& in, std::size_t& pos, std::uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+        auto byte = static_cast<unsigned char>(in[pos++]);
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool getString(const std::string& in, std::size_t& pos, std::string& value) {
+    std::uint64_t size = 0;
+    if (!getVarint(in, pos, size) || size > in.size() - pos) {
+        return false;
+    }
+    value.assign(in, pos, size);
+    pos += size;
+    return true;
+}
+
+} // namespace BusCodec
+} // namespace ChatServer
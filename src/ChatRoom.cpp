@@ -6,50 +6,322 @@
 #include "ChatRoom.hpp"
 #include "Session.hpp"
 #include "SessionManager.hpp"
+#include "StateStore.hpp"
+#include "MessageBus.hpp"
 #include "Logging.hpp"
 #include <algorithm>
+#include <chrono>
 #include <mutex>
 
 namespace ChatServer {
 
+// RoomHistory implementation
+RoomHistory::RoomHistory(std::size_t maxMessages, std::size_t maxBytes)
+    : capacity_(std::max<std::size_t>(maxMessages, 1)), head_(0), count_(0), bytes_(0), maxBytes_(maxBytes) {}
+
+void RoomHistory::append(std::uint64_t seq, Frame frame) {
+    if (!frame || frame->size() > maxBytes_) {
+        return;
+    }
+    
+    if (slots_.empty()) {
+        slots_.resize(capacity_);
+    }
+    if (count_ == slots_.size()) {
+        evictOldest();
+    }
+    while (count_ > 0 && bytes_ + frame->size() > maxBytes_) {
+        evictOldest();
+    }
+    
+    bytes_ += frame->size();
+    Entry& slot = slots_[(head_ + count_) % slots_.size()];
+    slot.seq = seq;
+    slot.frame = std::move(frame);
+    ++count_;
+}
+
+std::vector<RoomHistory::Frame> RoomHistory::recent(std::size_t count) const {
+    count = std::min(count, count_);
+    std::vector<Frame> frames;
+    frames.reserve(count);
+    
+    for (std::size_t i = count_ - count; i < count_; ++i) {
+        frames.push_back(at(i).frame);
+    }
+    return frames;
+}
+
+std::vector<RoomHistory::Entry> RoomHistory::before(std::uint64_t beforeSeq, std::size_t count) const {
+    std::size_t end = lowerBound(beforeSeq);
+    std::size_t start = end - std::min(count, end);
+    std::vector<Entry> entries;
+    entries.reserve(end - start);
+    for (std::size_t i = start; i < end; ++i) {
+        entries.push_back(at(i));
+    }
+    return entries;
+}
+
+std::vector<RoomHistory::Entry> RoomHistory::after(std::uint64_t afterSeq, std::size_t count) const {
+    std::size_t start = afterSeq < UINT64_MAX ? lowerBound(afterSeq + 1) : count_;
+    start = std::max(start, count_ - std::min(count, count_));
+    std::vector<Entry> entries;
+    entries.reserve(count_ - start);
+    for (std::size_t i = start; i < count_; ++i) {
+        entries.push_back(at(i));
+    }
+    return entries;
+}
+
+std::uint64_t RoomHistory::oldestSeq() const {
+    return count_ > 0 ? at(0).seq : 0;
+}
+
+void RoomHistory::clear() {
+    while (count_ > 0) {
+        evictOldest();
+    }
+}
+
+// First logical index whose seq is not below seq
+std::size_t RoomHistory::lowerBound(std::uint64_t seq) const {
+    std::size_t low = 0;
+    std::size_t high = count_;
+    while (low < high) {
+        std::size_t mid = low + (high - low) / 2;
+        if (at(mid).seq < seq) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void RoomHistory::evictOldest() {
+    bytes_ -= slots_[head_].frame->size();
+    slots_[head_].frame.reset();
+    head_ = (head_ + 1) % slots_.size();
+    --count_;
+}
+
 // ChatRoom implementation
-ChatRoom::ChatRoom(const std::string& name) : name(name) {
-    Logging::info("Created chat room: " + name);
+ChatRoom::ChatRoom(const std::string& name, const HistoryLimits& limits)
+    : name(name),
+      history(limits.maxMessages, limits.maxBytes),
+      replayCount(limits.replayCount),
+      lastSeq(0) {
+    Logging::debug("Created chat room: " + name);
 }
 
 void ChatRoom::addSession(const std::string& sessionId) {
-    std::lock_guard<std::mutex> lock(mutex);
-    sessions.insert(sessionId);
+    std::shared_ptr<StateJournal> journalCopy;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex);
+        sessions.insert(sessionId);
+        journalCopy = journal;
+    }
+    if (journalCopy) {
+        journalCopy->memberJoined(name, sessionId);
+    }
+    memberChanged(sessionId, true);
+    Logging::info("Session " + sessionId + " added to room " + name);
+}
+
+void ChatRoom::join(const std::string& sessionId, const std::function<void(const Frame&)>& deliver) {
+    std::shared_ptr<StateJournal> journalCopy;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex);
+        sessions.insert(sessionId);
+        for (const auto& frame : history.recent(replayCount)) {
+            deliver(frame);
+        }
+        journalCopy = journal;
+    }
+    if (journalCopy) {
+        journalCopy->memberJoined(name, sessionId);
+    }
+    memberChanged(sessionId, true);
     Logging::info("Session " + sessionId + " added to room " + name);
 }
 
 void ChatRoom::removeSession(const std::string& sessionId) {
-    std::lock_guard<std::mutex> lock(mutex);
-    sessions.erase(sessionId);
+    std::shared_ptr<StateJournal> journalCopy;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex);
+        sessions.erase(sessionId);
+        suspended.erase(sessionId);
+        journalCopy = journal;
+    }
+    if (journalCopy) {
+        journalCopy->memberLeft(name, sessionId);
+    }
+    memberChanged(sessionId, false);
     Logging::info("Session " + sessionId + " removed from room " + name);
 }
 
-void ChatRoom::broadcastMessage(const std::string& message, const std::string& senderSessionId) {
-    std::set<std::string> sessionsCopy;
+bool ChatRoom::suspendSession(const std::string& sessionId, std::uint64_t& lastSeq) {
+    std::lock_guard<ProfiledMutex> lock(mutex);
+    if (sessions.count(sessionId) == 0) {
+        return false;
+    }
+    suspended.insert(sessionId);
+    lastSeq = this->lastSeq;
+    return true;
+}
+
+CatchUp ChatRoom::resumeSession(const std::string& sessionId, std::uint64_t afterSeq, std::size_t limit,
+                                const std::function<void(const Frame&)>& deliver) {
+    CatchUp result;
+    std::lock_guard<ProfiledMutex> lock(mutex);
+    suspended.erase(sessionId);
+    sessions.insert(sessionId);
+    if (afterSeq >= lastSeq) {
+        return result;
+    }
+    
+    auto entries = history.after(afterSeq, limit);
+    for (const auto& entry : entries) {
+        deliver(entry.frame);
+    }
+    result.replayed = entries.size();
+    
+    // The ring no longer reaches back to the first missed message
+    std::uint64_t firstReplayed = entries.empty() ? lastSeq + 1 : entries.front().seq;
+    if (firstReplayed > afterSeq + 1) {
+        result.missedBefore = firstReplayed;
+    }
+    return result;
+}
+
+std::uint64_t ChatRoom::broadcastMessage(const std::string& message, const std::string& senderSessionId,
+                                         const SequencedCallback& onSequenced) {
+    // Frame once; every recipient and the history ring share the same buffer
+    auto frame = Session::makeFrame(message);
+    
+    std::uint64_t seq;
+    std::set<std::string> recipients;
     {
-        std::lock_guard<std::mutex> lock(mutex);
-        sessionsCopy = sessions;
+        std::lock_guard<ProfiledMutex> lock(mutex);
+        if (!sequencing) {
+            return 0;
+        }
+        seq = ++lastSeq;
+        history.append(seq, frame);
+        if (onSequenced) {
+            onSequenced(seq);
+        }
+        if (bus) {
+            bus->publish(name, seq, senderSessionId, message);
+        }
+        recipients = deliverableLocked();
     }
     
+    fanOut(frame, recipients, senderSessionId);
+    Logging::info("Message broadcast in room " + name + " by session " + senderSessionId);
+    return seq;
+}
+
+void ChatRoom::deliverRemote(std::uint64_t seq, const std::string& senderSessionId, const std::string& message) {
+    auto frame = Session::makeFrame(message);
+    std::set<std::string> recipients;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex);
+        if (seq <= lastSeq) {
+            return; // already delivered; a reconnecting bus can send it again
+        }
+        lastSeq = seq;
+        history.append(seq, frame);
+        recipients = deliverableLocked();
+    }
+    fanOut(frame, recipients, senderSessionId);
+}
+
+// Caller holds mutex
+std::set<std::string> ChatRoom::deliverableLocked() const {
+    std::set<std::string> recipients = sessions;
+    for (const auto& sessionId : suspended) {
+        recipients.erase(sessionId);
+    }
+    return recipients;
+}
+
+void ChatRoom::fanOut(const Frame& frame, const std::set<std::string>& recipients, const std::string& senderSessionId) {
     // Get the SessionManager instance to access sessions
     auto sessionManager = SessionManager::getInstance();
+    auto fanout = Session::fanoutFor(recipients.size());
+    auto queuedAt = std::chrono::steady_clock::now();
     
-    for (const auto& sessionId : sessionsCopy) {
+    for (const auto& sessionId : recipients) {
         // Don't send the message back to the sender
         if (sessionId != senderSessionId) {
             auto session = sessionManager->getSession(sessionId);
             if (session) {
-                session->sendMessage(message);
+                session->sendFrame(frame, fanout, queuedAt);
             }
         }
     }
+}
+
+RoomSnapshot ChatRoom::handOver() {
+    RoomSnapshot snapshot;
+    std::lock_guard<ProfiledMutex> lock(mutex);
+    sequencing = false;
+    snapshot.lastSeq = lastSeq;
+    snapshot.recent = history.after(0, history.size());
+    return snapshot;
+}
+
+void ChatRoom::resumeSequencing() {
+    std::lock_guard<ProfiledMutex> lock(mutex);
+    sequencing = true;
+}
+
+void ChatRoom::takeOver(const RoomSnapshot& snapshot) {
+    std::lock_guard<ProfiledMutex> lock(mutex);
+    if (snapshot.lastSeq > lastSeq) {
+        history.clear();
+        for (const auto& entry : snapshot.recent) {
+            history.append(entry.seq, entry.frame);
+        }
+        lastSeq = snapshot.lastSeq;
+    }
+    sequencing = true;
+}
+
+HistoryPage ChatRoom::historyBefore(std::uint64_t beforeSeq, std::size_t limit) const {
+    HistoryPage page;
+    std::lock_guard<ProfiledMutex> lock(mutex);
+    page.entries = history.before(beforeSeq, limit);
+    if (page.entries.size() == limit) {
+        return page;
+    }
     
-    Logging::info("Message broadcast in room " + name + " by session " + senderSessionId);
+    // Whatever is older than the ring's part of the page is only in the store
+    std::uint64_t lowest;
+    if (!page.entries.empty()) {
+        lowest = page.entries.front().seq;
+    } else if (history.size() > 0) {
+        lowest = std::min(beforeSeq, history.oldestSeq());
+    } else {
+        lowest = std::min(beforeSeq, lastSeq + 1);
+    }
+    if (lowest > 1) {
+        page.olderBefore = lowest;
+        page.missing = limit - page.entries.size();
+    }
+    return page;
+}
+
+std::uint64_t ChatRoom::getLastSeq() const {
+    std::lock_guard<ProfiledMutex> lock(mutex);
+    return lastSeq;
+}
+
+void ChatRoom::seedSequence(std::uint64_t seq) {
+    std::lock_guard<ProfiledMutex> lock(mutex);
+    lastSeq = std::max(lastSeq, seq);
 }
 
 const std::string& ChatRoom::getName() const {
@@ -57,17 +329,48 @@ const std::string& ChatRoom::getName() const {
 }
 
 std::set<std::string> ChatRoom::getSessions() const {
-    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<ProfiledMutex> lock(mutex);
     return sessions;
 }
 
+void ChatRoom::setJournal(std::shared_ptr<StateJournal> journal) {
+    std::lock_guard<ProfiledMutex> lock(mutex);
+    this->journal = std::move(journal);
+}
+
+void ChatRoom::restoreSessions(std::set<std::string> members) {
+    std::lock_guard<ProfiledMutex> lock(mutex);
+    sessions = std::move(members);
+}
+
+void ChatRoom::setBus(std::shared_ptr<MessageBus> bus) {
+    std::lock_guard<ProfiledMutex> lock(mutex);
+    this->bus = std::move(bus);
+}
+
+void ChatRoom::setMembershipObserver(std::shared_ptr<const MembershipObserver> observer) {
+    std::lock_guard<ProfiledMutex> lock(mutex);
+    membershipObserver = std::move(observer);
+}
+
+void ChatRoom::memberChanged(const std::string& sessionId, bool joined) {
+    std::shared_ptr<const MembershipObserver> observer;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex);
+        observer = membershipObserver;
+    }
+    if (observer) {
+        (*observer)(name, sessionId, joined);
+    }
+}
+
 // ChatRoomManager implementation
 ChatRoomManager::ChatRoomManager() {
     Logging::info("ChatRoomManager initialized");
 }
 
 std::shared_ptr<ChatRoom> ChatRoomManager::createChatRoom(const std::string& name) {
-    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<ProfiledMutex> lock(mutex);
     
     // Check if the room already exists
     auto it = chatRooms.find(name);
@@ -76,15 +379,25 @@ std::shared_ptr<ChatRoom> ChatRoomManager::createChatRoom(const std::string& nam
     }
     
     // Create a new chat room
-    auto room = std::make_shared<ChatRoom>(name);
+    auto room = std::make_shared<ChatRoom>(name, historyLimits);
+    auto seed = sequenceSeeds.find(name);
+    if (seed != sequenceSeeds.end()) {
+        room->seedSequence(seed->second);
+    }
+    room->setJournal(journal);
+    room->setBus(bus);
+    room->setMembershipObserver(membershipObserver);
     chatRooms[name] = room;
     
+    if (journal) {
+        journal->roomCreated(name);
+    }
     Logging::info("Chat room created: " + name);
     return room;
 }
 
 std::shared_ptr<ChatRoom> ChatRoomManager::getChatRoom(const std::string& name) {
-    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<ProfiledMutex> lock(mutex);
     
     auto it = chatRooms.find(name);
     if (it != chatRooms.end()) {
@@ -95,17 +408,22 @@ std::shared_ptr<ChatRoom> ChatRoomManager::getChatRoom(const std::string& name)
 }
 
 void ChatRoomManager::removeChatRoom(const std::string& name) {
-    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<ProfiledMutex> lock(mutex);
     
     auto it = chatRooms.find(name);
     if (it != chatRooms.end()) {
+        // A room recreated under this name keeps numbering where this one stopped
+        sequenceSeeds[name] = it->second->getLastSeq();
         chatRooms.erase(it);
+        if (journal) {
+            journal->roomRemoved(name);
+        }
         Logging::info("Chat room removed: " + name);
     }
 }
 
 std::vector<std::shared_ptr<ChatRoom>> ChatRoomManager::getAllRooms() const {
-    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<ProfiledMutex> lock(mutex);
     
     std::vector<std::shared_ptr<ChatRoom>> rooms;
     rooms.reserve(chatRooms.size());
@@ -117,5 +435,61 @@ std::vector<std::shared_ptr<ChatRoom>> ChatRoomManager::getAllRooms() const {
     return rooms;
 }
 
+void ChatRoomManager::setHistoryLimits(const HistoryLimits& limits) {
+    std::lock_guard<ProfiledMutex> lock(mutex);
+    historyLimits = limits;
+}
+
+void ChatRoomManager::setJournal(std::shared_ptr<StateJournal> journal) {
+    std::lock_guard<ProfiledMutex> lock(mutex);
+    this->journal = journal;
+    for (auto& pair : chatRooms) {
+        pair.second->setJournal(journal);
+    }
+}
+
+void ChatRoomManager::setBus(std::shared_ptr<MessageBus> bus) {
+    std::lock_guard<ProfiledMutex> lock(mutex);
+    this->bus = bus;
+    for (auto& pair : chatRooms) {
+        pair.second->setBus(bus);
+    }
+}
+
+void ChatRoomManager::setMembershipObserver(ChatRoom::MembershipObserver observer) {
+    std::lock_guard<ProfiledMutex> lock(mutex);
+    membershipObserver = observer ? std::make_shared<const ChatRoom::MembershipObserver>(std::move(observer)) : nullptr;
+    for (auto& pair : chatRooms) {
+        pair.second->setMembershipObserver(membershipObserver);
+    }
+}
+
+void ChatRoomManager::restoreChatRoom(const std::string& name, std::set<std::string> members) {
+    auto room = std::make_shared<ChatRoom>(name, historyLimits);
+    room->restoreSessions(std::move(members));
+    
+    std::lock_guard<ProfiledMutex> lock(mutex);
+    auto seed = sequenceSeeds.find(name);
+    if (seed != sequenceSeeds.end()) {
+        room->seedSequence(seed->second);
+    }
+    room->setJournal(journal);
+    room->setBus(bus);
+    room->setMembershipObserver(membershipObserver);
+    chatRooms[name] = std::move(room);
+}
+
+void ChatRoomManager::seedSequences(const std::unordered_map<std::string, std::uint64_t>& lastSeqs) {
+    std::lock_guard<ProfiledMutex> lock(mutex);
+    for (const auto& [name, seq] : lastSeqs) {
+        auto& seed = sequenceSeeds[name];
+        seed = std::max(seed, seq);
+        auto it = chatRooms.find(name);
+        if (it != chatRooms.end()) {
+            it->second->seedSequence(seq);
+        }
+    }
+}
+
 } // namespace ChatServer
  
\ No newline at end of file
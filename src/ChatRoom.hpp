@@ -5,45 +5,220 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <set>
 #include <map>
 #include <memory>
 #include <mutex>
 
+#include "ProfiledMutex.hpp"
+
 namespace ChatServer {
 
 class Session;
 class SessionManager;
+class StateJournal;
+class MessageBus;
+
+/**
+ * @brief Bounds for a room's recent-message history.
+ */
+struct HistoryLimits {
+    std::size_t maxMessages = 200;      // ring capacity in messages
+    std::size_t maxBytes = 256 * 1024;  // total framed bytes kept
+    std::size_t replayCount = 50;       // messages replayed to a new joiner
+};
+
+/**
+ * @brief Fixed-capacity ring of recent framed messages.
+ *
+ * Frames are shared with the sessions they were delivered to, so keeping
+ * and replaying them never copies or reformats message text. Appending and
+ * evicting are O(1); entries are in ascending sequence order, so paging by
+ * sequence is a binary search. Not thread-safe; ChatRoom guards it with its
+ * mutex.
+ */
+class RoomHistory {
+public:
+    using Frame = std::shared_ptr<const std::string>;
+
+    struct Entry {
+        std::uint64_t seq = 0;
+        Frame frame;
+    };
+
+    RoomHistory(std::size_t maxMessages, std::size_t maxBytes);
+
+    // Append a frame, evicting the oldest entries to stay within both limits
+    void append(std::uint64_t seq, Frame frame);
+
+    // The newest count frames, oldest first
+    std::vector<Frame> recent(std::size_t count) const;
+
+    // Up to count entries with seq < beforeSeq, oldest first
+    std::vector<Entry> before(std::uint64_t beforeSeq, std::size_t count) const;
+
+    // The newest count entries with seq > afterSeq, oldest first
+    std::vector<Entry> after(std::uint64_t afterSeq, std::size_t count) const;
+
+    // Sequence of the oldest entry, or 0 when empty
+    std::uint64_t oldestSeq() const;
+
+    // Drop every entry
+    void clear();
+
+    std::size_t size() const { return count_; }
+    std::size_t bytes() const { return bytes_; }
+
+private:
+    void evictOldest();
+    std::size_t lowerBound(std::uint64_t seq) const;
+    const Entry& at(std::size_t i) const { return slots_[(head_ + i) % slots_.size()]; }
+
+    std::vector<Entry> slots_; // sized on first append; idle rooms cost nothing
+    std::size_t capacity_;
+    std::size_t head_;   // index of the oldest entry
+    std::size_t count_;
+    std::size_t bytes_;
+    std::size_t maxBytes_;
+};
+
+/**
+ * @brief A page of a room's history served from its ring.
+ */
+struct HistoryPage {
+    std::vector<RoomHistory::Entry> entries; // oldest first
+    std::uint64_t olderBefore = 0;           // remaining older messages are below this seq; 0 if none
+    std::size_t missing = 0;                 // how many of them the page still wants
+};
+
+/**
+ * @brief What a resumed member was replayed from the ring.
+ */
+struct CatchUp {
+    std::size_t replayed = 0;
+    std::uint64_t missedBefore = 0; // older missed messages are below this seq; 0 if none
+};
+
+/**
+ * @brief What a room's next owner needs to continue it.
+ */
+struct RoomSnapshot {
+    std::uint64_t lastSeq = 0;
+    std::vector<RoomHistory::Entry> recent; // the ring, oldest first
+};
 
 /**
  * @brief Represents a chat room for client sessions.
  */
 class ChatRoom {
 public:
-    ChatRoom(const std::string& name);
+    using Frame = RoomHistory::Frame;
+    using SequencedCallback = std::function<void(std::uint64_t seq)>;
+    // Told after a member joins or leaves, outside the room lock
+    using MembershipObserver = std::function<void(const std::string& room, const std::string& sessionId, bool joined)>;
+
+    ChatRoom(const std::string& name, const HistoryLimits& limits = HistoryLimits());
     ~ChatRoom() = default;
 
     // Add a session to the chat room
     void addSession(const std::string& sessionId);
     
+    // Add a session and pass the backlog it should be replayed to deliver.
+    // Delivered under the same lock as broadcasts take their sequence, so a
+    // message is either in the backlog or delivered live, never both, and
+    // the backlog arrives first.
+    void join(const std::string& sessionId, const std::function<void(const Frame&)>& deliver);
+    
     // Remove a session from the chat room
     void removeSession(const std::string& sessionId);
     
-    // Broadcast a message to all sessions in the chat room
-    void broadcastMessage(const std::string& message, const std::string& senderSessionId);
+    // Stop delivering to a member whose connection dropped, keeping the
+    // membership. Returns false if not a member; lastSeq gets the last
+    // message the member was sent.
+    bool suspendSession(const std::string& sessionId, std::uint64_t& lastSeq);
+    
+    // Deliver again to a suspended member. Messages after afterSeq still in
+    // the ring (at most limit) are passed to deliver under the room lock, so
+    // they arrive before, and never duplicate, live messages.
+    CatchUp resumeSession(const std::string& sessionId, std::uint64_t afterSeq, std::size_t limit,
+                          const std::function<void(const Frame&)>& deliver);
+    
+    // Broadcast a message to all sessions in the chat room and return its
+    // sequence number. onSequenced runs under the room lock, so anything it
+    // hands off (e.g. to persistence) is handed off in sequence order.
+    // Returns 0 without sending anything while the room is handed over.
+    std::uint64_t broadcastMessage(const std::string& message, const std::string& senderSessionId,
+                                   const SequencedCallback& onSequenced = nullptr);
+    
+    // Deliver a message the room's owner on another node numbered seq to
+    // this node's members, without publishing it again. The ring keeps it
+    // under the owner's number; one numbered no higher than the last seen
+    // is a duplicate and is dropped.
+    void deliverRemote(std::uint64_t seq, const std::string& senderSessionId, const std::string& message);
+    
+    // Stop numbering messages, for another node to continue the room from
+    // the returned state; broadcastMessage returns 0 from now on
+    RoomSnapshot handOver();
+    
+    // Number messages again after a hand-over that did not complete
+    void resumeSequencing();
+    
+    // Continue the room from its previous owner's state. Its ring replaces
+    // this one unless this one is as new.
+    void takeOver(const RoomSnapshot& snapshot);
+    
+    // Up to limit messages with seq < beforeSeq from the ring, plus where the
+    // persistent store has to take over if the ring runs out
+    HistoryPage historyBefore(std::uint64_t beforeSeq, std::size_t limit) const;
+    
+    // Sequence number of the last message, 0 if none yet
+    std::uint64_t getLastSeq() const;
+    
+    // Continue numbering after seq (messages persisted before a restart)
+    void seedSequence(std::uint64_t seq);
     
     // Get the name of the chat room
     const std::string& getName() const;
     
     // Get all sessions in the chat room
     std::set<std::string> getSessions() const;
+    
+    // Record membership changes to a journal from now on
+    void setJournal(std::shared_ptr<StateJournal> journal);
+    
+    // Replace the member set wholesale (state restore; not journaled or logged)
+    void restoreSessions(std::set<std::string> members);
+    
+    // Publish broadcasts to the other nodes of a cluster from now on
+    void setBus(std::shared_ptr<MessageBus> bus);
+    
+    // Report joins and leaves from now on (not restores)
+    void setMembershipObserver(std::shared_ptr<const MembershipObserver> observer);
 
 private:
+    // Members not suspended; caller holds mutex
+    std::set<std::string> deliverableLocked() const;
+    // Send frame to recipients, except the sender, outside the lock
+    void fanOut(const Frame& frame, const std::set<std::string>& recipients, const std::string& senderSessionId);
+    void memberChanged(const std::string& sessionId, bool joined);
+
     std::string name;
     std::set<std::string> sessions;
-    mutable std::mutex mutex;
+    std::set<std::string> suspended;   // members not currently delivered to
+    RoomHistory history;
+    std::size_t replayCount;
+    std::uint64_t lastSeq;
+    std::shared_ptr<StateJournal> journal;
+    std::shared_ptr<MessageBus> bus;
+    std::shared_ptr<const MembershipObserver> membershipObserver;
+    bool sequencing = true;            // false while handed over to another node
+    mutable ProfiledMutex mutex{"ChatRoom::mutex"};
 };
 
 class ChatRoomManager {
@@ -62,10 +237,35 @@ public:
     
     // Get all chat rooms
     std::vector<std::shared_ptr<ChatRoom>> getAllRooms() const;
+    
+    // History bounds applied to rooms created from now on
+    void setHistoryLimits(const HistoryLimits& limits);
+    
+    // Record room and membership changes to a journal from now on
+    void setJournal(std::shared_ptr<StateJournal> journal);
+    
+    // Publish every room's broadcasts to the other nodes of a cluster from now on
+    void setBus(std::shared_ptr<MessageBus> bus);
+    
+    // Report every room's joins and leaves from now on
+    void setMembershipObserver(ChatRoom::MembershipObserver observer);
+    
+    // Recreate a room with its members during state restore, without
+    // journaling or per-room logging
+    void restoreChatRoom(const std::string& name, std::set<std::string> members);
+    
+    // Last persisted sequence number per room; rooms continue numbering
+    // after it, including rooms created later
+    void seedSequences(const std::unordered_map<std::string, std::uint64_t>& lastSeqs);
 
 private:
     std::map<std::string, std::shared_ptr<ChatRoom>> chatRooms;
-    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::uint64_t> sequenceSeeds; // also remembers removed rooms
+    HistoryLimits historyLimits;
+    std::shared_ptr<StateJournal> journal;
+    std::shared_ptr<MessageBus> bus;
+    std::shared_ptr<const ChatRoom::MembershipObserver> membershipObserver;
+    mutable ProfiledMutex mutex{"ChatRoomManager::mutex"};
 };
 
 } // namespace ChatServer
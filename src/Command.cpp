@@ -2,8 +2,11 @@
 #include "ChatRoom.hpp"
 #include "UserManager.hpp"
 #include "Logging.hpp"
+#include "Metrics.hpp"
 #include <sstream>
+#include <chrono>
 #include <algorithm>
+#include <cctype>
 
 namespace ChatServer {
 
@@ -32,7 +35,11 @@ std::string CommandManager::processCommand(std::shared_ptr<Session> session, con
     }
     
     try {
-        return it->second->execute(session, args);
+        // Asynchronous commands are timed up to handing their work off
+        auto started = std::chrono::steady_clock::now();
+        std::string response = it->second->execute(session, args);
+        commandLatency.find(commandName)->second->record(std::chrono::steady_clock::now() - started);
+        return response;
     } catch (const std::exception& e) {
         Logging::error("Error executing command '" + commandName + "': " + e.what());
         return "Error executing command: " + std::string(e.what());
@@ -46,6 +53,8 @@ void CommandManager::registerCommand(const std::string& name, std::shared_ptr<Co
                   [](unsigned char c) { return std::tolower(c); });
     
     commands[lowerName] = command;
+    commandLatency[lowerName] = &MetricsRegistry::getInstance().latency(
+        "chat_command_seconds", "Time to execute a command", "command=\"" + lowerName + "\"");
 }
 
 std::string CommandManager::getHelp() const {
@@ -72,9 +81,9 @@ std::pair<std::string, std::vector<std::string>> CommandManager::parseCommand(co
     std::string buffer;
     bool inQuotes = false;
     
-    while (iss >> std::ws) {
-        char c = iss.get();
-        
+    // Read character by character; skipping whitespace here would merge arguments
+    char c;
+    while (iss.get(c)) {
         if (c == '"') {
             if (inQuotes) {
                 // End of quoted argument
@@ -85,7 +94,7 @@ std::pair<std::string, std::vector<std::string>> CommandManager::parseCommand(co
                 // Start of quoted argument
                 inQuotes = true;
             }
-        } else if (c == ' ' && !inQuotes) {
+        } else if (std::isspace(static_cast<unsigned char>(c)) && !inQuotes) {
             // Space outside quotes - end of argument
             if (!buffer.empty()) {
                 args.push_back(buffer);
@@ -94,10 +103,6 @@ std::pair<std::string, std::vector<std::string>> CommandManager::parseCommand(co
         } else {
             buffer += c;
         }
-        
-        if (iss.eof()) {
-            break;
-        }
     }
     
     // Add the last argument if any
@@ -13,6 +13,7 @@ namespace ChatServer {
 class Session;
 class ChatRoomManager;
 class UserManager;
+class LatencyHistogram;
 
 /**
  * @brief Base class for all commands
@@ -64,11 +65,6 @@ public:
      * @return Help text
      */
     std::string getHelp() const;
-
-private:
-    std::unordered_map<std::string, std::shared_ptr<Command>> commands;
-    std::shared_ptr<ChatRoomManager> chatRoomManager;
-    std::shared_ptr<UserManager> userManager;
     
     /**
      * @brief Parse a command string into command name and arguments
@@ -76,6 +72,12 @@ private:
      * @return Pair of command name and arguments vector
      */
     std::pair<std::string, std::vector<std::string>> parseCommand(const std::string& commandStr);
+
+private:
+    std::unordered_map<std::string, std::shared_ptr<Command>> commands;
+    std::unordered_map<std::string, LatencyHistogram*> commandLatency; // per command, from the metrics registry
+    std::shared_ptr<ChatRoomManager> chatRoomManager;
+    std::shared_ptr<UserManager> userManager;
 };
 
 } // namespace ChatServer
@@ -2,6 +2,8 @@
 #include "Session.hpp"
 #include "Logging.hpp"
 #include <sstream>
+#include <algorithm>
+#include <chrono>
 
 namespace ChatServer {
 
@@ -21,7 +23,10 @@ std::string JoinCommand::execute(std::shared_ptr<Session> session, const std::ve
         return "Chat room '" + roomName + "' does not exist. Use /createroom to create a new room.";
     }
     
-    room->addSession(session->getSessionId());
+    // Stream the room's recent history straight from the shared frames
+    room->join(session->getSessionId(), [&session](const Session::Frame& frame) {
+        session->sendFrame(frame);
+    });
     Logging::info("Session " + session->getSessionId() + " joined room " + roomName);
     
     return "You have joined the chat room: " + roomName;
@@ -108,8 +113,9 @@ std::string CreateRoomCommand::getUsage() const {
 }
 
 // WhisperCommand implementation
-WhisperCommand::WhisperCommand(std::shared_ptr<SessionManager> sessionManager)
-    : sessionManager(sessionManager) {}
+WhisperCommand::WhisperCommand(std::shared_ptr<SessionManager> sessionManager,
+                               std::shared_ptr<SessionDirectory> sessionDirectory)
+    : sessionManager(sessionManager), sessionDirectory(sessionDirectory) {}
 
 std::string WhisperCommand::execute(std::shared_ptr<Session> session, const std::vector<std::string>& args) {
     if (args.size() < 2) {
@@ -119,7 +125,7 @@ std::string WhisperCommand::execute(std::shared_ptr<Session> session, const std:
     const std::string& targetSessionId = args[0];
     auto targetSession = sessionManager->getSession(targetSessionId);
     
-    if (!targetSession) {
+    if (!targetSession && !sessionDirectory) {
         return "User with session ID '" + targetSessionId + "' not found.";
     }
     
@@ -133,6 +139,26 @@ std::string WhisperCommand::execute(std::shared_ptr<Session> session, const std:
     std::string message = messageStream.str();
     std::string whisperMessage = "[Whisper from " + session->getSessionId() + "]: " + message;
     
+    if (!targetSession) {
+        // Served by another node, if any; answer once it has the message
+        std::weak_ptr<Session> weakSession = session;
+        std::string senderId = session->getSessionId();
+        sessionDirectory->deliver(targetSessionId, whisperMessage,
+                                  [weakSession, senderId, targetSessionId, message](bool delivered) {
+            auto sender = weakSession.lock();
+            if (!sender) {
+                return;
+            }
+            if (!delivered) {
+                sender->sendMessage("User with session ID '" + targetSessionId + "' not found.");
+                return;
+            }
+            Logging::info("Session " + senderId + " whispered to " + targetSessionId + " on another node");
+            sender->sendMessage("Whisper sent to " + targetSessionId + ": " + message);
+        });
+        return "";
+    }
+    
     targetSession->sendMessage(whisperMessage);
     Logging::info("Session " + session->getSessionId() + " whispered to " + targetSessionId);
     
@@ -143,6 +169,45 @@ std::string WhisperCommand::getUsage() const {
     return "whisper <session_id> <message> - Send a private message to another user";
 }
 
+// WhoisCommand implementation
+WhoisCommand::WhoisCommand(std::shared_ptr<SessionManager> sessionManager,
+                           std::shared_ptr<SessionDirectory> sessionDirectory)
+    : sessionManager(sessionManager), sessionDirectory(sessionDirectory) {}
+
+std::string WhoisCommand::execute(std::shared_ptr<Session> session, const std::vector<std::string>& args) {
+    if (args.empty()) {
+        return "Usage: " + getUsage();
+    }
+    
+    const std::string& targetSessionId = args[0];
+    if (!sessionDirectory) {
+        return sessionManager->getSession(targetSessionId)
+            ? targetSessionId + " is online."
+            : targetSessionId + " is not online.";
+    }
+    
+    std::weak_ptr<Session> weakSession = session;
+    auto directory = sessionDirectory;
+    directory->lookup(targetSessionId, [weakSession, directory, targetSessionId](const std::string& node) {
+        auto target = weakSession.lock();
+        if (!target) {
+            return;
+        }
+        if (node.empty()) {
+            target->sendMessage(targetSessionId + " is not online.");
+        } else if (node == directory->nodeId()) {
+            target->sendMessage(targetSessionId + " is online on this node (" + node + ").");
+        } else {
+            target->sendMessage(targetSessionId + " is online on node " + node + ".");
+        }
+    });
+    return "";
+}
+
+std::string WhoisCommand::getUsage() const {
+    return "whois <session_id> - Tell whether a user is online, and on which node";
+}
+
 // ListUsersCommand implementation
 ListUsersCommand::ListUsersCommand(std::shared_ptr<ChatRoomManager> chatRoomManager, 
                                  std::shared_ptr<SessionManager> sessionManager)
@@ -194,8 +259,9 @@ std::string NicknameCommand::execute(std::shared_ptr<Session> session, const std
     
     const std::string& newNickname = args[0];
     
-    // In a real implementation, you would update the user's nickname in the UserManager
-    // For now, we'll just log it
+    if (!userManager->updateNickname(session->getSessionId(), newNickname)) {
+        userManager->createUser(session->getSessionId(), newNickname);
+    }
     Logging::info("Session " + session->getSessionId() + " changed nickname to " + newNickname);
     
     return "Your nickname has been changed to: " + newNickname;
@@ -205,20 +271,305 @@ std::string NicknameCommand::getUsage() const {
     return "nickname <new_nickname> - Change your display name";
 }
 
+// SearchCommand implementation
+SearchCommand::SearchCommand(std::shared_ptr<ChatRoomManager> chatRoomManager,
+                             std::shared_ptr<SearchIndex> searchIndex,
+                             std::shared_ptr<HistoryStore> historyStore,
+                             std::shared_ptr<ThreadPool> queryPool)
+    : chatRoomManager(chatRoomManager), searchIndex(searchIndex),
+      historyStore(historyStore), queryPool(queryPool) {}
+
+std::string SearchCommand::execute(std::shared_ptr<Session> session, const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        return "Usage: " + getUsage();
+    }
+    
+    const std::string& roomName = args[0];
+    if (!chatRoomManager->getChatRoom(roomName)) {
+        return "Chat room '" + roomName + "' does not exist.";
+    }
+    
+    std::string query;
+    for (size_t i = 1; i < args.size(); ++i) {
+        query += (i > 1 ? " " : "") + args[i];
+    }
+    
+    // Index lookups and store reads can touch disk; keep them off the io threads
+    std::weak_ptr<Session> weakSession = session;
+    queryPool->enqueue([weakSession, roomName, query,
+                        index = searchIndex, store = historyStore]() {
+        const size_t maxResults = 20;
+        auto start = std::chrono::steady_clock::now();
+        std::vector<uint64_t> ids;
+        std::vector<std::string> lines;
+        try {
+            ids = index->search(roomName, query, maxResults);
+            
+            // Newest first, as ranked by the index
+            lines.resize(ids.size());
+            std::vector<uint64_t> sorted(ids.rbegin(), ids.rend());
+            store->readIds(roomName, sorted, [&ids, &lines](const HistoryEntry& entry) {
+                auto it = std::find(ids.begin(), ids.end(), entry.id);
+                if (it != ids.end()) {
+                    lines[it - ids.begin()] = "[" + std::string(entry.userId) + "]: " + std::string(entry.content);
+                }
+            });
+        } catch (const std::exception& e) {
+            Logging::error("Search of " + roomName + " failed: " + e.what());
+            if (auto target = weakSession.lock()) {
+                target->sendMessage("Error searching " + roomName + ": " + e.what());
+            }
+            return;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+        
+        auto target = weakSession.lock();
+        if (!target) {
+            return;
+        }
+        std::stringstream ss;
+        ss << "Search results in " << roomName << " for '" << query << "' ("
+           << ids.size() << " found, " << elapsed.count() / 1000.0 << " ms):";
+        for (const auto& line : lines) {
+            if (!line.empty()) {
+                ss << "\n" << line;
+            }
+        }
+        target->sendMessage(ss.str());
+    });
+    
+    return "";
+}
+
+std::string SearchCommand::getUsage() const {
+    return "search <room_name> <terms> - Search a room's history";
+}
+
+// HistoryCommand implementation
+HistoryCommand::HistoryCommand(std::shared_ptr<ChatRoomManager> chatRoomManager,
+                               std::shared_ptr<HistoryStore> historyStore,
+                               std::shared_ptr<ThreadPool> queryPool)
+    : chatRoomManager(chatRoomManager), historyStore(historyStore), queryPool(queryPool) {}
+
+std::string HistoryCommand::execute(std::shared_ptr<Session> session, const std::vector<std::string>& args) {
+    const size_t defaultLimit = 50;
+    const size_t maxLimit = 200;
+    
+    if (args.empty() || args.size() > 3) {
+        return "Usage: " + getUsage();
+    }
+    
+    const std::string& roomName = args[0];
+    auto room = chatRoomManager->getChatRoom(roomName);
+    if (!room) {
+        return "Chat room '" + roomName + "' does not exist.";
+    }
+    
+    uint64_t beforeSeq = HistoryStore::kLatest;
+    size_t limit = defaultLimit;
+    try {
+        if (args.size() > 1) {
+            beforeSeq = std::stoull(args[1]);
+        }
+        if (args.size() > 2) {
+            limit = std::min<size_t>(std::stoul(args[2]), maxLimit);
+        }
+    } catch (const std::exception&) {
+        return "Usage: " + getUsage();
+    }
+    if (limit == 0) {
+        return "Usage: " + getUsage();
+    }
+    
+    // Tells the client where the next page starts
+    auto footer = [roomName, limit](uint64_t oldestShown) {
+        if (oldestShown <= 1) {
+            return std::string("(start of history)");
+        }
+        return "(older: /history " + roomName + " " + std::to_string(oldestShown) + " " +
+               std::to_string(limit) + ")";
+    };
+    
+    HistoryPage page = room->historyBefore(beforeSeq, limit);
+    
+    if (page.missing == 0) {
+        // The ring covers the page: resend the shared frames as they are
+        session->sendMessage("History of " + roomName + ":");
+        for (const auto& entry : page.entries) {
+            session->sendFrame(entry.frame);
+        }
+        return footer(page.entries.empty() ? 0 : page.entries.front().seq);
+    }
+    
+    // The older part of the page is only in the store; read it off the io threads
+    std::weak_ptr<Session> weakSession = session;
+    queryPool->enqueue([weakSession, roomName, page = std::move(page),
+                        store = historyStore, footer]() {
+        std::vector<std::string> older;
+        uint64_t oldestShown = page.entries.empty() ? page.olderBefore : page.entries.front().seq;
+        try {
+            store->readBefore(roomName, page.olderBefore, page.missing,
+                              [&older, &oldestShown](const HistoryEntry& entry) {
+                if (older.empty()) {
+                    oldestShown = entry.seq;
+                }
+                older.push_back("[" + std::string(entry.userId) + "]: " + std::string(entry.content));
+            });
+        } catch (const std::exception& e) {
+            Logging::error("Reading history of " + roomName + " failed: " + e.what());
+            if (auto target = weakSession.lock()) {
+                target->sendMessage("Error reading history of " + roomName + ": " + e.what());
+            }
+            return;
+        }
+        
+        auto target = weakSession.lock();
+        if (!target) {
+            return;
+        }
+        target->sendMessage("History of " + roomName + ":");
+        for (const auto& line : older) {
+            target->sendMessage(line);
+        }
+        for (const auto& entry : page.entries) {
+            target->sendFrame(entry.frame);
+        }
+        target->sendMessage(footer(older.empty() ? 0 : oldestShown));
+    });
+    
+    return "";
+}
+
+std::string HistoryCommand::getUsage() const {
+    return "history <room_name> [before_seq] [limit] - Show messages older than before_seq";
+}
+
+// ResumeCommand implementation
+ResumeCommand::ResumeCommand(std::shared_ptr<ChatRoomManager> chatRoomManager,
+                             std::shared_ptr<UserManager> userManager,
+                             std::shared_ptr<SessionManager> sessionManager,
+                             std::shared_ptr<ResumeRegistry> resumeRegistry)
+    : chatRoomManager(chatRoomManager), userManager(userManager),
+      sessionManager(sessionManager), resumeRegistry(resumeRegistry) {}
+
+std::string ResumeCommand::execute(std::shared_ptr<Session> session, const std::vector<std::string>& args) {
+    if (args.empty()) {
+        return "Usage: " + getUsage();
+    }
+    
+    // Optional room:seq pairs override the server's record of what was sent
+    std::map<std::string, std::uint64_t> lastSeen;
+    for (std::size_t i = 1; i < args.size(); ++i) {
+        auto colon = args[i].rfind(':');
+        if (colon == std::string::npos || colon == 0) {
+            return "Usage: " + getUsage();
+        }
+        try {
+            lastSeen[args[i].substr(0, colon)] = std::stoull(args[i].substr(colon + 1));
+        } catch (const std::exception&) {
+            return "Usage: " + getUsage();
+        }
+    }
+    
+    const std::string claimantId = session->getSessionId();
+    auto rooms = chatRoomManager->getAllRooms();
+    auto claim = resumeRegistry->claim(args[0], claimantId, session.get(),
+        [&rooms](const std::string& sessionId, ResumeRegistry::RoomSeqs& lastSeqs) {
+            for (const auto& room : rooms) {
+                std::uint64_t seq;
+                if (room->suspendSession(sessionId, seq)) {
+                    lastSeqs[room->getName()] = seq;
+                }
+            }
+        });
+    if (!claim) {
+        return "Resume token is invalid or has expired.";
+    }
+    
+    // Undo the fresh setup this connection may already have had
+    if (claim->claimantSettled) {
+        for (const auto& room : rooms) {
+            if (room->getSessions().count(claimantId) > 0) {
+                room->removeSession(claimantId);
+            }
+        }
+        userManager->removeUser(claimantId);
+    }
+    
+    // Rebind under the old id; a connection still holding it is dropped
+    auto previous = sessionManager->getSession(claim->sessionId);
+    sessionManager->removeSession(session);
+    session->resumeAs(claim->sessionId);
+    sessionManager->addSession(session);
+    if (previous && previous != session) {
+        previous->close();
+    }
+    
+    session->sendMessage("Resuming session " + claim->sessionId + ".");
+    std::size_t replayed = 0;
+    std::stringstream notes;
+    for (const auto& [roomName, sentSeq] : claim->lastSeqs) {
+        auto room = chatRoomManager->getChatRoom(roomName);
+        if (!room) {
+            continue;
+        }
+        auto seen = lastSeen.find(roomName);
+        std::uint64_t afterSeq = seen != lastSeen.end() ? seen->second : sentSeq;
+        CatchUp catchUp = room->resumeSession(claim->sessionId, afterSeq,
+                                              resumeRegistry->config().maxCatchUp,
+                                              [&session](const Session::Frame& frame) {
+                                                  session->sendFrame(frame);
+                                              });
+        replayed += catchUp.replayed;
+        if (catchUp.missedBefore > 0) {
+            notes << "\nOlder missed messages in " << roomName
+                  << ": /history " << roomName << " " << catchUp.missedBefore;
+        }
+    }
+    
+    Logging::info("Session " + claimantId + " resumed " + claim->sessionId + ", replayed " +
+                  std::to_string(replayed) + " messages");
+    return "Resumed session " + claim->sessionId + " in " + std::to_string(claim->lastSeqs.size()) +
+           " rooms; " + std::to_string(replayed) + " missed messages replayed. New resume token: " +
+           claim->token + notes.str();
+}
+
+std::string ResumeCommand::getUsage() const {
+    return "resume <token> [room:last_seq ...] - Resume a dropped session, catching up on missed messages";
+}
+
 // Register all commands
 void registerCommands(CommandManager& commandManager,
                      std::shared_ptr<ChatRoomManager> chatRoomManager,
                      std::shared_ptr<UserManager> userManager,
-                     std::shared_ptr<SessionManager> sessionManager) {
+                     std::shared_ptr<SessionManager> sessionManager,
+                     const HistoryServices& history,
+                     std::shared_ptr<ResumeRegistry> resumeRegistry,
+                     std::shared_ptr<SessionDirectory> sessionDirectory) {
     
     commandManager.registerCommand("join", std::make_shared<JoinCommand>(chatRoomManager));
     commandManager.registerCommand("leave", std::make_shared<LeaveCommand>(chatRoomManager));
     commandManager.registerCommand("listrooms", std::make_shared<ListRoomsCommand>(chatRoomManager));
     commandManager.registerCommand("createroom", std::make_shared<CreateRoomCommand>(chatRoomManager));
-    commandManager.registerCommand("whisper", std::make_shared<WhisperCommand>(sessionManager));
+    commandManager.registerCommand("whisper", std::make_shared<WhisperCommand>(sessionManager, sessionDirectory));
+    commandManager.registerCommand("whois", std::make_shared<WhoisCommand>(sessionManager, sessionDirectory));
     commandManager.registerCommand("listusers", std::make_shared<ListUsersCommand>(chatRoomManager, sessionManager));
     commandManager.registerCommand("nickname", std::make_shared<NicknameCommand>(userManager));
     
+    if (history.historyStore && history.queryPool) {
+        commandManager.registerCommand("history", std::make_shared<HistoryCommand>(
+            chatRoomManager, history.historyStore, history.queryPool));
+    }
+    if (history.historyStore && history.searchIndex && history.queryPool) {
+        commandManager.registerCommand("search", std::make_shared<SearchCommand>(
+            chatRoomManager, history.searchIndex, history.historyStore, history.queryPool));
+    }
+    if (resumeRegistry) {
+        commandManager.registerCommand("resume", std::make_shared<ResumeCommand>(
+            chatRoomManager, userManager, sessionManager, resumeRegistry));
+    }
+    
     Logging::info("Registered all commands");
 }
 
@@ -5,6 +5,11 @@
 #include "ChatRoom.hpp"
 #include "UserManager.hpp"
 #include "SessionManager.hpp"
+#include "HistoryStore.hpp"
+#include "SearchIndex.hpp"
+#include "ThreadPool.hpp"
+#include "ResumeRegistry.hpp"
+#include "SessionDirectory.hpp"
 
 namespace ChatServer {
 
@@ -66,16 +71,37 @@ private:
 
 /**
  * @brief Command to send a private message to another user
+ *
+ * Users served by another node of the cluster are reached through the
+ * session directory; the confirmation is sent once that node acknowledges.
  */
 class WhisperCommand : public Command {
 public:
-    WhisperCommand(std::shared_ptr<SessionManager> sessionManager);
+    WhisperCommand(std::shared_ptr<SessionManager> sessionManager,
+                   std::shared_ptr<SessionDirectory> sessionDirectory = nullptr);
     
     std::string execute(std::shared_ptr<Session> session, const std::vector<std::string>& args) override;
     std::string getUsage() const override;
     
 private:
     std::shared_ptr<SessionManager> sessionManager;
+    std::shared_ptr<SessionDirectory> sessionDirectory;
+};
+
+/**
+ * @brief Command to tell whether a user is online, and on which node
+ */
+class WhoisCommand : public Command {
+public:
+    WhoisCommand(std::shared_ptr<SessionManager> sessionManager,
+                 std::shared_ptr<SessionDirectory> sessionDirectory = nullptr);
+    
+    std::string execute(std::shared_ptr<Session> session, const std::vector<std::string>& args) override;
+    std::string getUsage() const override;
+    
+private:
+    std::shared_ptr<SessionManager> sessionManager;
+    std::shared_ptr<SessionDirectory> sessionDirectory;
 };
 
 /**
@@ -108,17 +134,102 @@ private:
     std::shared_ptr<UserManager> userManager;
 };
 
+/**
+ * @brief Command to search a room's history
+ *
+ * The query runs on the background pool and the results are sent to the
+ * session when ready, so execute() itself returns nothing.
+ */
+class SearchCommand : public Command {
+public:
+    SearchCommand(std::shared_ptr<ChatRoomManager> chatRoomManager,
+                  std::shared_ptr<SearchIndex> searchIndex,
+                  std::shared_ptr<HistoryStore> historyStore,
+                  std::shared_ptr<ThreadPool> queryPool);
+    
+    std::string execute(std::shared_ptr<Session> session, const std::vector<std::string>& args) override;
+    std::string getUsage() const override;
+    
+private:
+    std::shared_ptr<ChatRoomManager> chatRoomManager;
+    std::shared_ptr<SearchIndex> searchIndex;
+    std::shared_ptr<HistoryStore> historyStore;
+    std::shared_ptr<ThreadPool> queryPool;
+};
+
+/**
+ * @brief Command to page backwards through a room's history
+ *
+ * Pages come from the room's ring when it covers them; older messages are
+ * read from the history store on the background pool.
+ */
+class HistoryCommand : public Command {
+public:
+    HistoryCommand(std::shared_ptr<ChatRoomManager> chatRoomManager,
+                   std::shared_ptr<HistoryStore> historyStore,
+                   std::shared_ptr<ThreadPool> queryPool);
+    
+    std::string execute(std::shared_ptr<Session> session, const std::vector<std::string>& args) override;
+    std::string getUsage() const override;
+    
+private:
+    std::shared_ptr<ChatRoomManager> chatRoomManager;
+    std::shared_ptr<HistoryStore> historyStore;
+    std::shared_ptr<ThreadPool> queryPool;
+};
+
+/**
+ * @brief Command to take back a dropped session's identity
+ *
+ * The new connection adopts the old session id, nickname and room
+ * memberships, and is sent only the messages it missed in each room: those
+ * after the sequence numbers the client reports, or else after the last
+ * message the old connection was sent.
+ */
+class ResumeCommand : public Command {
+public:
+    ResumeCommand(std::shared_ptr<ChatRoomManager> chatRoomManager,
+                  std::shared_ptr<UserManager> userManager,
+                  std::shared_ptr<SessionManager> sessionManager,
+                  std::shared_ptr<ResumeRegistry> resumeRegistry);
+    
+    std::string execute(std::shared_ptr<Session> session, const std::vector<std::string>& args) override;
+    std::string getUsage() const override;
+    
+private:
+    std::shared_ptr<ChatRoomManager> chatRoomManager;
+    std::shared_ptr<UserManager> userManager;
+    std::shared_ptr<SessionManager> sessionManager;
+    std::shared_ptr<ResumeRegistry> resumeRegistry;
+};
+
+/**
+ * @brief Services used by the history commands; unset members disable them
+ */
+struct HistoryServices {
+    std::shared_ptr<HistoryStore> historyStore;
+    std::shared_ptr<SearchIndex> searchIndex;
+    std::shared_ptr<ThreadPool> queryPool;
+};
+
 /**
  * @brief Initialize and register all commands
  * @param commandManager The command manager to register commands with
  * @param chatRoomManager Chat room manager instance
  * @param userManager User manager instance
  * @param sessionManager Session manager instance
+ * @param history History store, search index and query pool
+ * @param resumeRegistry Resume tokens; /resume is only registered with one
+ * @param sessionDirectory Cluster session directory; without one /whisper
+ *        and /whois only see this node's users
  */
 void registerCommands(CommandManager& commandManager,
                      std::shared_ptr<ChatRoomManager> chatRoomManager,
                      std::shared_ptr<UserManager> userManager,
-                     std::shared_ptr<SessionManager> sessionManager);
+                     std::shared_ptr<SessionManager> sessionManager,
+                     const HistoryServices& history = HistoryServices(),
+                     std::shared_ptr<ResumeRegistry> resumeRegistry = nullptr,
+                     std::shared_ptr<SessionDirectory> sessionDirectory = nullptr);
 
 } // namespace ChatServer
 
@@ -26,6 +26,8 @@ bool Database::open() {
 }
 
 void Database::close() {
+    // Statements must be finalized before the connection can close
+    statements.clear();
     if (db) {
         sqlite3_close(db);
         db = nullptr;
@@ -45,7 +47,8 @@ bool Database::executeQuery(const std::string& query) {
 
 bool Database::executePreparedQuery(const std::string& query) {
     try {
-        PreparedStatement stmt(db, query);
+        PreparedStatement& stmt = statement(query);
+        StatementReset reset(stmt);
         if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
             std::cerr << "Failed to execute prepared statement: " << sqlite3_errmsg(db) << std::endl;
             return false;
@@ -57,4 +60,15 @@ bool Database::executePreparedQuery(const std::string& query) {
     return true;
 }
 
+PreparedStatement& Database::statement(std::string_view sql) {
+    auto it = statements.find(sql);
+    if (it != statements.end()) {
+        return *it->second;
+    }
+
+    auto stmt = std::make_unique<PreparedStatement>(db, std::string(sql));
+    std::string_view key = stmt->getSql();
+    return *statements.emplace(key, std::move(stmt)).first->second;
+}
+
 } // namespace ChatServer
@@ -6,8 +6,13 @@
 #ifndef DATABASE_HPP
 #define DATABASE_HPP
 
+#include <iostream>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <sqlite3.h>
+#include "PreparedStatement.hpp"
 
 namespace ChatServer {
 
@@ -26,11 +31,44 @@ public:
     // New method: Execute a prepared statement query.
     bool executePreparedQuery(const std::string& query);
 
+    /**
+     * @brief Get a compiled statement for sql, preparing it only on first use.
+     *
+     * The statement comes back reset and stays owned by the connection's
+     * cache; callers bind, step and reset it (see StatementReset).
+     * @throws std::runtime_error if the SQL does not compile
+     */
+    PreparedStatement& statement(std::string_view sql);
+
+    // Bind args to the cached statement for sql and run it to completion.
+    template <typename... Args>
+    bool execute(std::string_view sql, const Args&... args);
+
+    // Raw connection handle for callers that drive statements themselves.
+    sqlite3* getHandle() const { return db; }
+
 private:
     std::string dbFile;
     sqlite3* db;
+    // Keys view the SQL text owned by each statement, so lookups never copy
+    std::unordered_map<std::string_view, std::unique_ptr<PreparedStatement>> statements;
 };
 
+template <typename... Args>
+bool Database::execute(std::string_view sql, const Args&... args) {
+    try {
+        PreparedStatement& stmt = statement(sql);
+        StatementReset reset(stmt);
+        stmt.bind(args...);
+        while (stmt.step()) {
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "SQL Exception: " << ex.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
 } // namespace ChatServer
 
 #endif // DATABASE_HPP
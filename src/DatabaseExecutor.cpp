@@ -0,0 +1,130 @@
+/**
+ * @file DatabaseExecutor.cpp
+ * @brief Implementation of the DatabaseExecutor connection pool.
+ */
+
+#include "DatabaseExecutor.hpp"
+#include "Database.hpp"
+#include "Logging.hpp"
+#include <exception>
+
+namespace ChatServer {
+
+namespace {
+
+const char* synchronousPragma(Durability durability) {
+    switch (durability) {
+        case Durability::Relaxed: return "PRAGMA synchronous=OFF;";
+        case Durability::Full:    return "PRAGMA synchronous=FULL;";
+        case Durability::Normal:
+        default:                  return "PRAGMA synchronous=NORMAL;";
+    }
+}
+
+} // namespace
+
+DatabaseExecutor::DatabaseExecutor(const DatabaseConfig& config)
+    : config_(config), running_(false) {}
+
+DatabaseExecutor::~DatabaseExecutor() {
+    stop();
+}
+
+bool DatabaseExecutor::start() {
+    if (running_) {
+        return true;
+    }
+
+    // The writer switches the file to WAL before any reader attaches
+    if (!openLane(writer_, 1, false)) {
+        Logging::error("Database executor: cannot open writer connection to " + config_.dbFile);
+        stopLane(writer_);
+        return false;
+    }
+    if (!openLane(readers_, config_.readerCount, true)) {
+        Logging::warning("Database executor: reader pool unavailable, reads will fail");
+    }
+
+    running_ = true;
+    Logging::info("Database executor started on " + config_.dbFile + " with " +
+                  std::to_string(readers_.connections.size()) + " readers");
+    return true;
+}
+
+void DatabaseExecutor::stop() {
+    if (!running_) {
+        return;
+    }
+    running_ = false;
+
+    stopLane(readers_);
+    stopLane(writer_);
+    Logging::info("Database executor stopped");
+}
+
+bool DatabaseExecutor::openLane(Lane& lane, std::size_t count, bool readOnly) {
+    for (std::size_t i = 0; i < count; ++i) {
+        auto db = std::make_unique<Database>(config_.dbFile);
+        if (!db->open() ||
+            !db->executeQuery("PRAGMA busy_timeout=5000;") ||
+            !db->executeQuery("PRAGMA journal_mode=WAL;") ||
+            !db->executeQuery(synchronousPragma(config_.durability)) ||
+            (readOnly && !db->executeQuery("PRAGMA query_only=1;"))) {
+            lane.connections.clear();
+            return false;
+        }
+        lane.connections.push_back(std::move(db));
+    }
+
+    lane.stop = false;
+    for (auto& connection : lane.connections) {
+        Database* db = connection.get();
+        lane.threads.emplace_back([&lane, db] {
+            while (true) {
+                Task task;
+                {
+                    std::unique_lock<std::mutex> lock(lane.mutex);
+                    lane.condition.wait(lock, [&lane] {
+                        return lane.stop || !lane.tasks.empty();
+                    });
+                    if (lane.stop && lane.tasks.empty())
+                        return;
+                    task = std::move(lane.tasks.front());
+                    lane.tasks.pop();
+                }
+                try {
+                    task(*db);
+                } catch (const std::exception& e) {
+                    Logging::error(std::string("Database task failed: ") + e.what());
+                }
+            }
+        });
+    }
+    return !lane.connections.empty();
+}
+
+void DatabaseExecutor::stopLane(Lane& lane) {
+    {
+        std::lock_guard<std::mutex> lock(lane.mutex);
+        lane.stop = true;
+    }
+    lane.condition.notify_all();
+    for (auto& thread : lane.threads) {
+        thread.join();
+    }
+    lane.threads.clear();
+    lane.connections.clear();
+}
+
+void DatabaseExecutor::enqueue(Lane& lane, Task task) {
+    {
+        std::lock_guard<std::mutex> lock(lane.mutex);
+        if (lane.stop || lane.connections.empty()) {
+            throw std::runtime_error("database executor is not running");
+        }
+        lane.tasks.push(std::move(task));
+    }
+    lane.condition.notify_one();
+}
+
+} // namespace ChatServer
@@ -0,0 +1,174 @@
+/**
+ * @file DatabaseExecutor.hpp
+ * @brief Declaration of the DatabaseExecutor connection pool.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <boost/asio/post.hpp>
+
+namespace ChatServer {
+
+class Database;
+
+/**
+ * @brief How hard SQLite works to make a committed transaction survive a crash.
+ */
+enum class Durability {
+    Relaxed, // synchronous=OFF: fastest, a power loss may drop recent commits
+    Normal,  // synchronous=NORMAL: WAL stays consistent, last commits may roll back
+    Full     // synchronous=FULL: every commit is fsynced before returning
+};
+
+struct DatabaseConfig {
+    std::string dbFile = "chat.db";
+    std::size_t readerCount = 2;
+    Durability durability = Durability::Normal;
+};
+
+/**
+ * @brief Runs database work on dedicated threads, off the io threads.
+ *
+ * One writer connection serializes every write; a pool of read-only
+ * connections serves queries concurrently. All connections use WAL, so
+ * readers never wait for the writer. Each connection is only ever touched
+ * by its own thread, so callers get thread safety without locking SQLite.
+ *
+ * Work is a callable taking Database&. Results come back either as a
+ * std::future or through a callback posted to a caller-chosen executor
+ * (typically the session's io executor).
+ */
+class DatabaseExecutor {
+public:
+    explicit DatabaseExecutor(const DatabaseConfig& config = DatabaseConfig());
+    ~DatabaseExecutor();
+
+    DatabaseExecutor(const DatabaseExecutor&) = delete;
+    DatabaseExecutor& operator=(const DatabaseExecutor&) = delete;
+
+    // Open every connection and start the lanes; false if the writer fails
+    bool start();
+
+    // Finish queued work, then close all connections
+    void stop();
+
+    bool isRunning() const { return running_; }
+
+    /**
+     * @brief Run f on the writer connection.
+     * @return std::future for f's result
+     */
+    template <class F>
+    auto write(F&& f) -> std::future<typename std::result_of<F(Database&)>::type> {
+        return submit(writer_, std::forward<F>(f));
+    }
+
+    /**
+     * @brief Run f on any reader connection.
+     * @return std::future for f's result
+     */
+    template <class F>
+    auto read(F&& f) -> std::future<typename std::result_of<F(Database&)>::type> {
+        return submit(readers_, std::forward<F>(f));
+    }
+
+    /**
+     * @brief Run f on a reader and post callback(error, result) to executor.
+     *
+     * error holds what f threw, with result default constructed; for a void
+     * f the callback takes only error.
+     */
+    template <class F, class Executor, class Callback>
+    void read(F&& f, const Executor& executor, Callback&& callback) {
+        post(readers_, std::forward<F>(f), executor, std::forward<Callback>(callback));
+    }
+
+    /**
+     * @brief Run f on the writer and post callback(error, result) to executor.
+     */
+    template <class F, class Executor, class Callback>
+    void write(F&& f, const Executor& executor, Callback&& callback) {
+        post(writer_, std::forward<F>(f), executor, std::forward<Callback>(callback));
+    }
+
+private:
+    using Task = std::function<void(Database&)>;
+
+    /**
+     * @brief A task queue served by one or more threads, each owning a connection.
+     */
+    struct Lane {
+        std::vector<std::thread> threads;
+        std::vector<std::unique_ptr<Database>> connections;
+        std::queue<Task> tasks;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stop = false;
+    };
+
+    bool openLane(Lane& lane, std::size_t count, bool readOnly);
+    void stopLane(Lane& lane);
+    void enqueue(Lane& lane, Task task);
+
+    template <class F>
+    auto submit(Lane& lane, F&& f) -> std::future<typename std::result_of<F(Database&)>::type> {
+        using return_type = typename std::result_of<F(Database&)>::type;
+
+        auto task = std::make_shared<std::packaged_task<return_type(Database&)>>(std::forward<F>(f));
+        std::future<return_type> res = task->get_future();
+        enqueue(lane, [task](Database& db) { (*task)(db); });
+        return res;
+    }
+
+    template <class F, class Executor, class Callback>
+    void post(Lane& lane, F&& f, const Executor& executor, Callback&& callback) {
+        using return_type = typename std::result_of<F(Database&)>::type;
+
+        // The callback runs even if f throws, so a waiting session always hears back
+        enqueue(lane, [f = std::forward<F>(f), executor,
+                       callback = std::forward<Callback>(callback)](Database& db) mutable {
+            std::exception_ptr error;
+            if constexpr (std::is_void<return_type>::value) {
+                try {
+                    f(db);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                boost::asio::post(executor, [callback = std::move(callback), error]() mutable {
+                    callback(error);
+                });
+            } else {
+                return_type result{};
+                try {
+                    result = f(db);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                boost::asio::post(executor,
+                    [callback = std::move(callback), error, result = std::move(result)]() mutable {
+                        callback(error, std::move(result));
+                    });
+            }
+        });
+    }
+
+    DatabaseConfig config_;
+    Lane writer_;
+    Lane readers_;
+    bool running_;
+};
+
+} // namespace ChatServer
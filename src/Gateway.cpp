@@ -0,0 +1,378 @@
+/**
+ * @file Gateway.cpp
+ * @brief Implementation of the edge gateway.
+ */
+
+#include "Gateway.hpp"
+#include "Logging.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace ChatServer {
+
+using namespace GatewayProtocol;
+using boost::asio::ip::tcp;
+
+struct Gateway::Link {
+    Link(boost::asio::io_context& io, std::string host, std::string port)
+        : host(std::move(host)), port(std::move(port)), resolver(io), socket(io), retry(io) {}
+
+    std::string name() const { return host + ":" + port; }
+
+    std::string host;
+    std::string port;
+    tcp::resolver resolver;
+    tcp::socket socket;
+    boost::asio::steady_timer retry;
+    bool connected = false;
+    std::uint8_t header[kHeaderBytes];
+    std::string body;
+    std::string pending;       // queued while a write is in flight
+    std::string writing;       // owned by the write in flight
+    bool isWriting = false;
+    std::vector<std::shared_ptr<Client>> paused;  // not read until pending drains
+};
+
+struct Gateway::Client {
+    Client(tcp::socket socket, std::uint32_t channel, std::shared_ptr<Link> link)
+        : socket(std::move(socket)), channel(channel), link(std::move(link)) {}
+
+    tcp::socket socket;
+    std::uint32_t channel;
+    std::shared_ptr<Link> link;
+    std::array<char, 4096> readBuffer;
+    std::string pending;
+    std::string writing;
+    bool isWriting = false;
+    bool open = true;
+    bool closing = false;      // close once pending is written
+};
+
+Gateway::Gateway(boost::asio::io_context& io, const GatewayConfig& config)
+    : io_(io), config_(config), acceptor_(io) {}
+
+bool Gateway::start() {
+    for (const auto& server : config_.servers) {
+        auto colon = server.rfind(':');
+        if (colon == std::string::npos || colon == 0 || colon + 1 == server.size()) {
+            Logging::error("Gateway server address " + server + " is not host:port");
+            return false;
+        }
+        for (int i = 0; i < std::max(config_.linksPerServer, 1); ++i) {
+            links_.push_back(std::make_shared<Link>(io_, server.substr(0, colon), server.substr(colon + 1)));
+        }
+    }
+    if (links_.empty()) {
+        Logging::error("Gateway has no servers to forward to");
+        return false;
+    }
+
+    tcp::endpoint endpoint(tcp::v4(), config_.port);
+    boost::system::error_code ec;
+    acceptor_.open(endpoint.protocol(), ec);
+    if (!ec) {
+        acceptor_.set_option(tcp::acceptor::reuse_address(true), ec);
+        acceptor_.bind(endpoint, ec);
+    }
+    if (!ec) {
+        acceptor_.listen(boost::asio::socket_base::max_listen_connections, ec);
+    }
+    if (ec) {
+        Logging::error("Gateway could not listen on port " + std::to_string(config_.port) + ": " + ec.message());
+        acceptor_.close(ec);
+        return false;
+    }
+
+    for (const auto& link : links_) {
+        connect(link);
+    }
+    doAccept();
+    return true;
+}
+
+void Gateway::stop() {
+    stopped_ = true;
+    boost::system::error_code ignored;
+    acceptor_.close(ignored);
+    for (const auto& link : links_) {
+        link->resolver.cancel();
+        link->retry.cancel();
+        link->socket.close(ignored);
+    }
+    for (const auto& pair : clients_) {
+        pair.second->socket.close(ignored);
+    }
+}
+
+void Gateway::doAccept() {
+    acceptor_.async_accept([this](boost::system::error_code ec, tcp::socket socket) {
+        if (ec == boost::asio::error::operation_aborted || stopped_) {
+            return;
+        }
+        if (ec) {
+            Logging::error("Gateway accept error: " + ec.message());
+            doAccept();
+            return;
+        }
+
+        // Round robin over the links that are up
+        std::shared_ptr<Link> link;
+        for (std::size_t i = 0; i < links_.size() && !link; ++i) {
+            auto& candidate = links_[(nextLink_ + i) % links_.size()];
+            if (candidate->connected) {
+                link = candidate;
+                nextLink_ = (nextLink_ + i + 1) % links_.size();
+            }
+        }
+        if (!link) {
+            auto notice = std::make_shared<std::string>("No chat server is reachable; try again shortly\n");
+            auto client = std::make_shared<tcp::socket>(std::move(socket));
+            boost::asio::async_write(*client, boost::asio::buffer(*notice),
+                [notice, client](boost::system::error_code, std::size_t) {
+                    boost::system::error_code ignored;
+                    client->close(ignored);
+                });
+            doAccept();
+            return;
+        }
+
+        while (nextChannel_ == 0 || clients_.count(nextChannel_)) {
+            ++nextChannel_;
+        }
+        boost::system::error_code ignored;
+        socket.set_option(tcp::no_delay(true), ignored);
+        auto remote = socket.remote_endpoint(ignored);
+        std::string address = remote.address().to_string() + ":" + std::to_string(remote.port());
+
+        auto client = std::make_shared<Client>(std::move(socket), nextChannel_++, link);
+        clients_[client->channel] = client;
+        ++clientsAccepted_;
+        queue(link, Open, client->channel, address.data(), address.size());
+        readClient(client);
+        doAccept();
+    });
+}
+
+// Resolved on every attempt, so a server that moves is found again
+void Gateway::connect(const std::shared_ptr<Link>& link) {
+    link->resolver.async_resolve(link->host, link->port,
+        [this, link](boost::system::error_code ec, tcp::resolver::results_type endpoints) {
+            if (stopped_) {
+                return;
+            }
+            if (ec) {
+                Logging::error("Gateway cannot resolve " + link->name() + ": " + ec.message());
+                reconnect(link);
+                return;
+            }
+            boost::asio::async_connect(link->socket, endpoints,
+                [this, link](boost::system::error_code ec, const tcp::endpoint&) {
+                    if (stopped_) {
+                        return;
+                    }
+                    if (ec) {
+                        boost::system::error_code ignored;
+                        link->socket.close(ignored);
+                        reconnect(link);
+                        return;
+                    }
+                    boost::system::error_code ignored;
+                    link->socket.set_option(tcp::no_delay(true), ignored);
+                    link->connected = true;
+                    Logging::info("Gateway linked to " + link->name());
+                    readHeader(link);
+                });
+        });
+}
+
+void Gateway::linkLost(const std::shared_ptr<Link>& link) {
+    if (!link->connected) {
+        return;
+    }
+    link->connected = false;
+    boost::system::error_code ignored;
+    link->socket.close(ignored);
+    link->pending.clear();
+    link->paused.clear();
+
+    // The server has lost these sessions; the clients can reconnect and /resume
+    std::vector<std::shared_ptr<Client>> dropped;
+    for (const auto& pair : clients_) {
+        if (pair.second->link == link) {
+            dropped.push_back(pair.second);
+        }
+    }
+    for (const auto& client : dropped) {
+        dropClient(client, false);
+    }
+    Logging::error("Gateway link to " + link->name() + " lost with " + std::to_string(dropped.size()) + " clients");
+    reconnect(link);
+}
+
+void Gateway::reconnect(const std::shared_ptr<Link>& link) {
+    if (stopped_) {
+        return;
+    }
+    link->retry.expires_after(config_.reconnectDelay);
+    link->retry.async_wait([this, link](boost::system::error_code ec) {
+        if (!ec && !stopped_) {
+            connect(link);
+        }
+    });
+}
+
+void Gateway::readHeader(const std::shared_ptr<Link>& link) {
+    boost::asio::async_read(link->socket, boost::asio::buffer(link->header),
+        [this, link](boost::system::error_code ec, std::size_t) {
+            std::uint32_t size = ec ? 0 : getUint32(link->header);
+            if (ec || size < 5 || size > kMaxFrameBytes) {
+                linkLost(link);
+                return;
+            }
+            readBody(link, size);
+        });
+}
+
+void Gateway::readBody(const std::shared_ptr<Link>& link, std::uint32_t size) {
+    link->body.resize(size);
+    boost::asio::async_read(link->socket, boost::asio::buffer(&link->body[0], size),
+        [this, link](boost::system::error_code ec, std::size_t) {
+            char type = 0;
+            std::uint32_t channel = 0;
+            if (ec || !parseBody(link->body, type, channel)) {
+                linkLost(link);
+                return;
+            }
+            received(link, type, channel);
+            readHeader(link);
+        });
+}
+
+void Gateway::received(const std::shared_ptr<Link>& link, char type, std::uint32_t channel) {
+    auto it = clients_.find(channel);
+    if (it == clients_.end() || it->second->link != link) {
+        return; // disconnected while the frame was on its way
+    }
+    auto client = it->second;
+    if (type == Close) {
+        client->closing = true; // after what the server sent before it
+        writeClient(client);
+        return;
+    }
+    if (type != Data) {
+        return;
+    }
+    client->pending.append(link->body, 5, std::string::npos);
+    ++framesForwarded_;
+    if (client->pending.size() > config_.maxClientQueuedBytes) {
+        Logging::error("Gateway client on channel " + std::to_string(channel) + " fell behind; dropped");
+        dropClient(client, true);
+        return;
+    }
+    writeClient(client);
+}
+
+void Gateway::queue(const std::shared_ptr<Link>& link, char type, std::uint32_t channel, const char* data,
+                    std::size_t size) {
+    if (!link->connected) {
+        return;
+    }
+    putFrame(link->pending, type, channel, data, size);
+    writeLink(link);
+}
+
+// Whatever was queued for the link while a write was in flight goes out in
+// the next one
+void Gateway::writeLink(const std::shared_ptr<Link>& link) {
+    if (link->isWriting || link->pending.empty()) {
+        return;
+    }
+    link->isWriting = true;
+    link->writing.swap(link->pending);
+    ++linkWrites_;
+    boost::asio::async_write(link->socket, boost::asio::buffer(link->writing),
+        [this, link](boost::system::error_code ec, std::size_t) {
+            link->isWriting = false;
+            link->writing.clear();
+            if (ec) {
+                linkLost(link);
+                return;
+            }
+            writeLink(link);
+            resumeReads(link);
+        });
+}
+
+// Clients paused on a full link are read again once its backlog is under the bound
+void Gateway::resumeReads(const std::shared_ptr<Link>& link) {
+    if (link->pending.size() >= config_.maxLinkQueuedBytes || link->paused.empty()) {
+        return;
+    }
+    std::vector<std::shared_ptr<Client>> paused;
+    paused.swap(link->paused);
+    for (const auto& client : paused) {
+        if (client->open) {
+            readClient(client);
+        }
+    }
+}
+
+void Gateway::readClient(const std::shared_ptr<Client>& client) {
+    client->socket.async_read_some(boost::asio::buffer(client->readBuffer),
+        [this, client](boost::system::error_code ec, std::size_t length) {
+            if (!client->open) {
+                return;
+            }
+            if (ec) {
+                dropClient(client, true);
+                return;
+            }
+            ++framesForwarded_;
+            queue(client->link, Data, client->channel, client->readBuffer.data(), length);
+            if (client->link->pending.size() >= config_.maxLinkQueuedBytes) {
+                client->link->paused.push_back(client);
+                return;
+            }
+            readClient(client);
+        });
+}
+
+void Gateway::writeClient(const std::shared_ptr<Client>& client) {
+    if (client->isWriting || !client->open) {
+        return;
+    }
+    if (client->pending.empty()) {
+        if (client->closing) {
+            dropClient(client, false);
+        }
+        return;
+    }
+    client->isWriting = true;
+    client->writing.swap(client->pending);
+    boost::asio::async_write(client->socket, boost::asio::buffer(client->writing),
+        [this, client](boost::system::error_code ec, std::size_t) {
+            client->isWriting = false;
+            client->writing.clear();
+            if (ec) {
+                dropClient(client, true);
+                return;
+            }
+            writeClient(client);
+        });
+}
+
+void Gateway::dropClient(const std::shared_ptr<Client>& client, bool tellServer) {
+    if (!client->open) {
+        return;
+    }
+    client->open = false;
+    boost::system::error_code ignored;
+    client->socket.close(ignored);
+    clients_.erase(client->channel);
+    if (tellServer) {
+        queue(client->link, Close, client->channel, "", 0);
+    }
+}
+
+} // namespace ChatServer
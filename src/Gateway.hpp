@@ -0,0 +1,89 @@
+/**
+ * @file Gateway.hpp
+ * @brief The edge tier: terminates client connections and forwards their
+ * traffic to chat servers over a few shared links.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/asio.hpp>
+
+#include "GatewayProtocol.hpp"
+
+namespace ChatServer {
+
+struct GatewayConfig {
+    unsigned short port = 8080;                    // clients connect here
+    std::vector<std::string> servers;              // host:port of each server's CHAT_GATEWAY_PORT
+    int linksPerServer = 2;
+    std::size_t maxClientQueuedBytes = 4 * 1024 * 1024;  // a client further behind is dropped
+    std::size_t maxLinkQueuedBytes = 1024 * 1024;        // clients are not read while a link is further behind
+    std::chrono::milliseconds reconnectDelay{1000};
+};
+
+/**
+ * @brief Accepts clients and multiplexes them over links to chat servers.
+ *
+ * Each client is assigned a link, round robin over the connected ones, and
+ * a channel number on it; its reads are forwarded as they arrive and
+ * whatever the server sends it is written back. The gateway parses nothing
+ * but the link framing, so it does no room or command work and keeps one
+ * buffer per client. While more than maxLinkQueuedBytes wait for a link,
+ * its clients are not read, so a slow server pushes back on them through
+ * TCP. A link that drops disconnects its clients, which can reconnect and
+ * /resume, and is dialled again after reconnectDelay.
+ *
+ * Runs in chat_gateway, on a single thread; run more gateways to take on
+ * more connections.
+ */
+class Gateway {
+public:
+    Gateway(boost::asio::io_context& io, const GatewayConfig& config);
+
+    bool start();
+    void stop();
+
+    std::uint64_t clientsAccepted() const { return clientsAccepted_; }
+    std::uint64_t linkWrites() const { return linkWrites_; }
+    std::uint64_t framesForwarded() const { return framesForwarded_; }
+
+private:
+    struct Link;
+    struct Client;
+
+    void doAccept();
+    void connect(const std::shared_ptr<Link>& link);
+    void resumeReads(const std::shared_ptr<Link>& link);
+    void reconnect(const std::shared_ptr<Link>& link);
+    void linkLost(const std::shared_ptr<Link>& link);
+    void readHeader(const std::shared_ptr<Link>& link);
+    void readBody(const std::shared_ptr<Link>& link, std::uint32_t size);
+    void received(const std::shared_ptr<Link>& link, char type, std::uint32_t channel);
+    void queue(const std::shared_ptr<Link>& link, char type, std::uint32_t channel, const char* data,
+               std::size_t size);
+    void writeLink(const std::shared_ptr<Link>& link);
+    void readClient(const std::shared_ptr<Client>& client);
+    void writeClient(const std::shared_ptr<Client>& client);
+    void dropClient(const std::shared_ptr<Client>& client, bool tellServer);
+
+    boost::asio::io_context& io_;
+    GatewayConfig config_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    std::vector<std::shared_ptr<Link>> links_;
+    std::size_t nextLink_ = 0;
+    std::unordered_map<std::uint32_t, std::shared_ptr<Client>> clients_;
+    std::uint32_t nextChannel_ = 1;
+    bool stopped_ = false;
+
+    std::uint64_t clientsAccepted_ = 0;
+    std::uint64_t linkWrites_ = 0;
+    std::uint64_t framesForwarded_ = 0;
+};
+
+} // namespace ChatServer
@@ -0,0 +1,255 @@
+/**
+ * @file GatewayLink.cpp
+ * @brief Implementation of the server's end of gateway links.
+ */
+
+#include "GatewayLink.hpp"
+#include "Logging.hpp"
+#include "Metrics.hpp"
+#include "StallWatchdog.hpp"
+
+#include <vector>
+
+namespace ChatServer {
+
+using namespace GatewayProtocol;
+
+// GatewayLink implementation
+GatewayLink::GatewayLink(boost::asio::ip::tcp::socket socket, SessionFactory factory)
+    : socket_(std::move(socket)),
+      factory_(std::move(factory)),
+      writes_(MetricsRegistry::getInstance().counter(
+          "chat_gateway_link_writes_total", "Writes to gateway links, each carrying frames for any of their clients")),
+      frames_(MetricsRegistry::getInstance().counter(
+          "chat_gateway_frames_sent_total", "Frames sent to clients through gateway links")) {
+    boost::system::error_code ec;
+    auto endpoint = socket_.remote_endpoint(ec);
+    peer_ = ec ? "unknown" : endpoint.address().to_string() + ":" + std::to_string(endpoint.port());
+}
+
+void GatewayLink::start() {
+    boost::system::error_code ignored;
+    socket_.set_option(boost::asio::ip::tcp::no_delay(true), ignored);
+    Logging::info("Gateway link from " + peer_);
+    readHeader();
+}
+
+void GatewayLink::send(std::uint32_t channel, const Session::Frame& frame) {
+    std::lock_guard<ProfiledMutex> lock(mutex_);
+    if (closed_ || !channels_.count(channel)) {
+        return;
+    }
+    queue(Data, channel, frame->data(), frame->size());
+    frames_.inc();
+}
+
+void GatewayLink::closeChannel(std::uint32_t channel) {
+    std::lock_guard<ProfiledMutex> lock(mutex_);
+    if (!closed_ && channels_.erase(channel)) {
+        queue(Close, channel, "", 0);
+    }
+}
+
+bool GatewayLink::isIdle() {
+    std::lock_guard<ProfiledMutex> lock(mutex_);
+    return closed_ || !isWriting_;
+}
+
+void GatewayLink::close() {
+    boost::system::error_code ignored;
+    socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+    socket_.close(ignored);
+}
+
+void GatewayLink::readHeader() {
+    boost::asio::async_read(socket_, boost::asio::buffer(header_),
+        [self = shared_from_this()](boost::system::error_code ec, std::size_t) {
+            std::uint32_t size = ec ? 0 : getUint32(self->header_);
+            if (ec || size < 5 || size > kMaxFrameBytes) {
+                if (!ec) {
+                    Logging::error("Gateway link from " + self->peer_ + " sent a malformed frame; closing it");
+                }
+                self->lost();
+                return;
+            }
+            self->readBody(size);
+        });
+}
+
+void GatewayLink::readBody(std::uint32_t size) {
+    body_.resize(size);
+    boost::asio::async_read(socket_, boost::asio::buffer(&body_[0], size),
+        [self = shared_from_this()](boost::system::error_code ec, std::size_t) {
+            char type = 0;
+            std::uint32_t channel = 0;
+            if (ec || !parseBody(self->body_, type, channel)) {
+                self->lost();
+                return;
+            }
+            StallWatchdog::HandlerScope scope(StallWatchdog::Handler::Read);
+            self->received(type, channel);
+            self->readHeader();
+        });
+}
+
+void GatewayLink::received(char type, std::uint32_t channel) {
+    std::shared_ptr<Session> session;
+    switch (type) {
+    case Open: {
+        {
+            // Registered first, so the welcome the factory sends gets through
+            std::lock_guard<ProfiledMutex> lock(mutex_);
+            channels_[channel];
+        }
+        session = factory_(shared_from_this(), channel);
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        auto it = channels_.find(channel);
+        if (it == channels_.end()) {
+            return; // closed again while being set up
+        }
+        if (session) {
+            it->second = session;
+        } else {
+            channels_.erase(it);
+            queue(Close, channel, "", 0);
+        }
+        return;
+    }
+    case Data: {
+        {
+            std::lock_guard<ProfiledMutex> lock(mutex_);
+            auto it = channels_.find(channel);
+            if (it != channels_.end()) {
+                session = it->second.lock();
+            }
+        }
+        if (session) {
+            session->gatewayInput(body_.data() + 5, body_.size() - 5);
+        }
+        return;
+    }
+    case Close: {
+        {
+            std::lock_guard<ProfiledMutex> lock(mutex_);
+            auto it = channels_.find(channel);
+            if (it != channels_.end()) {
+                session = it->second.lock();
+                channels_.erase(it);
+            }
+        }
+        if (session) {
+            session->gatewayClosed();
+        }
+        return;
+    }
+    }
+    Logging::error("Gateway link from " + peer_ + " sent an unknown frame type; ignored");
+}
+
+// Must be called with mutex_ held
+void GatewayLink::queue(char type, std::uint32_t channel, const char* data, std::size_t size) {
+    putFrame(pending_, type, channel, data, size);
+    if (isWriting_) {
+        return;
+    }
+    isWriting_ = true; // a write is scheduled; later frames join it
+    boost::asio::post(socket_.get_executor(), [self = shared_from_this()]() {
+        std::lock_guard<ProfiledMutex> lock(self->mutex_);
+        self->writePending();
+    });
+}
+
+// Must be called with mutex_ held
+void GatewayLink::writePending() {
+    if (pending_.empty() || closed_) {
+        isWriting_ = false;
+        return;
+    }
+    writing_.swap(pending_);
+    writes_.inc();
+    boost::asio::async_write(socket_, boost::asio::buffer(writing_),
+        [self = shared_from_this()](boost::system::error_code ec, std::size_t) {
+            std::lock_guard<ProfiledMutex> lock(self->mutex_);
+            self->writing_.clear();
+            if (ec) {
+                self->isWriting_ = false;
+                self->pending_.clear();
+                self->close(); // the pending read reports the loss
+                return;
+            }
+            self->writePending();
+        });
+}
+
+void GatewayLink::lost() {
+    std::vector<std::shared_ptr<Session>> sessions;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+        closed_ = true;
+        for (const auto& pair : channels_) {
+            if (auto session = pair.second.lock()) {
+                sessions.push_back(session);
+            }
+        }
+        channels_.clear();
+        pending_.clear();
+    }
+    close();
+    Logging::info("Gateway link from " + peer_ + " closed with " + std::to_string(sessions.size()) + " clients");
+    for (const auto& session : sessions) {
+        session->gatewayClosed();
+    }
+}
+
+// GatewayListener implementation
+GatewayListener::GatewayListener(boost::asio::io_context& io, const std::string& address, unsigned short port,
+                                 GatewayLink::SessionFactory factory)
+    : acceptor_(io),
+      endpoint_(boost::asio::ip::make_address(address), port),
+      factory_(std::move(factory)) {}
+
+bool GatewayListener::start() {
+    boost::system::error_code ec;
+    acceptor_.open(endpoint_.protocol(), ec);
+    if (!ec) {
+        acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true), ec);
+        acceptor_.bind(endpoint_, ec);
+    }
+    if (!ec) {
+        acceptor_.listen(boost::asio::socket_base::max_listen_connections, ec);
+    }
+    if (ec) {
+        Logging::error("Gateway listener could not open " + endpoint_.address().to_string() + ":" +
+                       std::to_string(endpoint_.port()) + ": " + ec.message());
+        acceptor_.close(ec);
+        return false;
+    }
+
+    Logging::info("Gateway listener on " + endpoint_.address().to_string() + ":" + std::to_string(endpoint_.port()));
+    doAccept();
+    return true;
+}
+
+void GatewayListener::stop() {
+    boost::system::error_code ignored;
+    acceptor_.close(ignored);
+}
+
+void GatewayListener::doAccept() {
+    acceptor_.async_accept([this](boost::system::error_code ec, boost::asio::ip::tcp::socket socket) {
+        if (ec == boost::asio::error::operation_aborted) {
+            return;
+        }
+        if (!ec) {
+            std::make_shared<GatewayLink>(std::move(socket), factory_)->start();
+        } else {
+            Logging::error("Gateway link accept error: " + ec.message());
+        }
+        doAccept();
+    });
+}
+
+} // namespace ChatServer
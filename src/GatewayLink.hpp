@@ -0,0 +1,99 @@
+/**
+ * @file GatewayLink.hpp
+ * @brief The server's end of the links chat_gateway multiplexes clients over.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <boost/asio.hpp>
+
+#include "GatewayProtocol.hpp"
+#include "ProfiledMutex.hpp"
+#include "Session.hpp"
+
+namespace ChatServer {
+
+class Counter;
+
+/**
+ * @brief One connection from a gateway, carrying the traffic of many clients.
+ *
+ * Each client the gateway accepts becomes a Session here that reads and
+ * writes through the link instead of a socket of its own. Frames queued for
+ * any of the link's clients while a write is in flight go out together in
+ * the next one. When the link drops, all of its sessions close.
+ */
+class GatewayLink : public std::enable_shared_from_this<GatewayLink> {
+public:
+    // Make and start the session of a client the gateway accepted; null to
+    // turn the client away
+    using SessionFactory =
+        std::function<std::shared_ptr<Session>(const std::shared_ptr<GatewayLink>& link, std::uint32_t channel)>;
+
+    GatewayLink(boost::asio::ip::tcp::socket socket, SessionFactory factory);
+
+    void start();
+
+    // Queue a frame for a client of this link
+    void send(std::uint32_t channel, const Session::Frame& frame);
+
+    // Disconnect a client; nothing more is sent to it
+    void closeChannel(std::uint32_t channel);
+
+    // Nothing is queued or being written
+    bool isIdle();
+
+    void close();
+
+private:
+    void readHeader();
+    void readBody(std::uint32_t size);
+    void received(char type, std::uint32_t channel);
+    void queue(char type, std::uint32_t channel, const char* data, std::size_t size);
+    void writePending();
+    void lost();
+
+    boost::asio::ip::tcp::socket socket_;
+    SessionFactory factory_;
+    std::string peer_;
+    std::uint8_t header_[GatewayProtocol::kHeaderBytes];
+    std::string body_;
+
+    ProfiledMutex mutex_{"GatewayLink::mutex_"};
+    std::unordered_map<std::uint32_t, std::weak_ptr<Session>> channels_;
+    std::string pending_;      // queued while a write is in flight
+    std::string writing_;      // owned by the write in flight
+    bool isWriting_ = false;   // a write is in flight or scheduled
+    bool closed_ = false;
+
+    Counter& writes_;
+    Counter& frames_;
+};
+
+/**
+ * @brief Accepts links from gateways (CHAT_GATEWAY_PORT).
+ */
+class GatewayListener {
+public:
+    GatewayListener(boost::asio::io_context& io, const std::string& address, unsigned short port,
+                    GatewayLink::SessionFactory factory);
+
+    bool start();
+
+    // Stop accepting links; those open stay up until the process exits
+    void stop();
+
+private:
+    void doAccept();
+
+    boost::asio::ip::tcp::acceptor acceptor_;
+    boost::asio::ip::tcp::endpoint endpoint_;
+    GatewayLink::SessionFactory factory_;
+};
+
+} // namespace ChatServer
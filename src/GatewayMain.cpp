@@ -0,0 +1,72 @@
+/**
+ * @file GatewayMain.cpp
+ * @brief chat_gateway: the edge tier in front of one or more chat servers.
+ *
+ * Clients connect to the gateway as they would to a server. Each server it
+ * forwards to is started with CHAT_GATEWAY_PORT set to the port given here
+ * with --server; the gateway holds a few links to each and spreads its
+ * clients over them. Gateways and servers can be started in either order.
+ */
+
+#include "Gateway.hpp"
+
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <boost/asio.hpp>
+
+namespace {
+
+void printUsage() {
+    std::cerr << "usage: chat_gateway [--port N] [--server HOST:PORT]... [--links N]\n"
+                 "  --port N            port clients connect to (default 8080)\n"
+                 "  --server HOST:PORT  a server's CHAT_GATEWAY_PORT; repeat for more (default 127.0.0.1:9200)\n"
+                 "  --links N           links kept open to each server (default 2)\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    ChatServer::GatewayConfig config;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--port" && i + 1 < argc) {
+                config.port = static_cast<unsigned short>(std::stoi(argv[++i]));
+            } else if (arg == "--server" && i + 1 < argc) {
+                config.servers.push_back(argv[++i]);
+            } else if (arg == "--links" && i + 1 < argc) {
+                config.linksPerServer = std::stoi(argv[++i]);
+            } else {
+                printUsage();
+                return arg == "--help" || arg == "-h" ? 0 : 2;
+            }
+        }
+    } catch (const std::exception&) {
+        printUsage();
+        return 2;
+    }
+    if (config.servers.empty()) {
+        config.servers.push_back("127.0.0.1:9200");
+    }
+
+    boost::asio::io_context io;
+    ChatServer::Gateway gateway(io, config);
+    if (!gateway.start()) {
+        std::cerr << "chat_gateway: cannot start on port " << config.port << "\n";
+        return 1;
+    }
+    std::cout << "chat_gateway: listening on port " << config.port << std::endl;
+
+    boost::asio::signal_set signals(io, SIGINT, SIGTERM);
+    signals.async_wait([&](boost::system::error_code, int) {
+        gateway.stop();
+        io.stop();
+    });
+    io.run();
+
+    std::cout << "chat_gateway: accepted " << gateway.clientsAccepted() << " clients, "
+              << gateway.linkWrites() << " link writes, " << gateway.framesForwarded() << " frames forwarded"
+              << std::endl;
+    return 0;
+}
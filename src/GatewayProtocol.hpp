@@ -0,0 +1,63 @@
+/**
+ * @file GatewayProtocol.hpp
+ * @brief Frames exchanged between chat_gateway and the servers behind it.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ChatServer {
+namespace GatewayProtocol {
+
+/*
+ * A link carries the traffic of many clients. Every frame is a 4-byte
+ * little-endian length, then that many bytes: a type byte, the client's
+ * 4-byte little-endian channel number and the payload.
+ *
+ *   'O' gateway -> server   a client connected; payload is its address
+ *   'D' gateway -> server   one read of the client's input
+ *   'D' server -> gateway   bytes to write to the client
+ *   'C' either way          the client disconnected, or is to be
+ */
+
+const char Open = 'O';
+const char Data = 'D';
+const char Close = 'C';
+
+const std::size_t kHeaderBytes = 4;
+const std::uint32_t kMaxFrameBytes = 16 * 1024 * 1024;
+
+inline std::uint32_t getUint32(const std::uint8_t* bytes) {
+    return static_cast<std::uint32_t>(bytes[0]) | static_cast<std::uint32_t>(bytes[1]) << 8 |
+           static_cast<std::uint32_t>(bytes[2]) << 16 | static_cast<std::uint32_t>(bytes[3]) << 24;
+}
+
+inline void putUint32(std::string& out, std::uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+inline void putFrame(std::string& out, char type, std::uint32_t channel, const char* data, std::size_t size) {
+    putUint32(out, static_cast<std::uint32_t>(size + 5));
+    out.push_back(type);
+    putUint32(out, channel);
+    out.append(data, size);
+}
+
+// Split a frame body read after its length into its parts; false if it is
+// too short to have them
+inline bool parseBody(const std::string& body, char& type, std::uint32_t& channel) {
+    if (body.size() < 5) {
+        return false;
+    }
+    type = body[0];
+    channel = getUint32(reinterpret_cast<const std::uint8_t*>(body.data() + 1));
+    return true;
+}
+
+} // namespace GatewayProtocol
+} // namespace ChatServer
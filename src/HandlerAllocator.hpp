@@ -0,0 +1,238 @@
+/**
+ * @file HandlerAllocator.hpp
+ * @brief Recycling allocators for Boost.Asio completion handlers.
+ *
+ * Asio asks a handler's associated allocator for the storage of every
+ * pending operation. HandlerMemory gives a session one reusable block per
+ * in-flight operation (read, write), and RecyclingAllocator keeps a small
+ * per-thread cache of blocks for tasks handed to boost::asio::post().
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace ChatServer {
+
+/**
+ * @brief Fixed-size block owned by one asynchronous operation at a time.
+ *
+ * Only one operation of a given kind is outstanding per session, so a
+ * single block is enough; oversized or overlapping requests fall back to
+ * the global heap.
+ */
+class HandlerMemory {
+public:
+    HandlerMemory() : inUse_(false) {}
+    HandlerMemory(const HandlerMemory&) = delete;
+    HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+    void* allocate(std::size_t size) {
+        if (!inUse_ && size <= sizeof(storage_)) {
+            inUse_ = true;
+            return &storage_;
+        }
+        return ::operator new(size);
+    }
+
+    void deallocate(void* pointer) {
+        if (pointer == &storage_) {
+            inUse_ = false;
+        } else {
+            ::operator delete(pointer);
+        }
+    }
+
+private:
+    typename std::aligned_storage<512>::type storage_;
+    bool inUse_;
+};
+
+/**
+ * @brief Standard allocator adaptor over a HandlerMemory block.
+ */
+template <typename T>
+class HandlerAllocator {
+public:
+    using value_type = T;
+
+    explicit HandlerAllocator(HandlerMemory& memory) : memory_(memory) {}
+
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) noexcept : memory_(other.memory_) {}
+
+    bool operator==(const HandlerAllocator& other) const noexcept {
+        return &memory_ == &other.memory_;
+    }
+
+    bool operator!=(const HandlerAllocator& other) const noexcept {
+        return &memory_ != &other.memory_;
+    }
+
+    T* allocate(std::size_t n) const {
+        return static_cast<T*>(memory_.allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* pointer, std::size_t /*n*/) const {
+        memory_.deallocate(pointer);
+    }
+
+private:
+    template <typename> friend class HandlerAllocator;
+    HandlerMemory& memory_;
+};
+
+/**
+ * @brief Wraps a completion handler so asio allocates it from a HandlerMemory.
+ */
+template <typename Handler>
+class CustomAllocHandler {
+public:
+    using allocator_type = HandlerAllocator<Handler>;
+
+    CustomAllocHandler(HandlerMemory& memory, Handler handler)
+        : memory_(memory), handler_(std::move(handler)) {}
+
+    allocator_type get_allocator() const noexcept {
+        return allocator_type(memory_);
+    }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        handler_(std::forward<Args>(args)...);
+    }
+
+private:
+    HandlerMemory& memory_;
+    Handler handler_;
+};
+
+template <typename Handler>
+inline CustomAllocHandler<Handler> makeCustomAllocHandler(HandlerMemory& memory, Handler handler) {
+    return CustomAllocHandler<Handler>(memory, std::move(handler));
+}
+
+namespace detail {
+
+/**
+ * @brief Per-thread free lists of small blocks, bucketed by 64-byte size class.
+ *
+ * Blocks may be released on a different thread than the one that allocated
+ * them; they simply join that thread's cache.
+ */
+class ThreadBlockCache {
+public:
+    static constexpr std::size_t kGranularity = 64;
+    static constexpr std::size_t kClasses = 8;        // blocks up to 512 bytes
+    static constexpr std::size_t kBlocksPerClass = 16;
+
+    static void* allocate(std::size_t size) {
+        std::size_t cls = sizeClass(size);
+        if (cls < kClasses) {
+            Bucket& bucket = instance().buckets_[cls];
+            if (bucket.count > 0) {
+                return bucket.blocks[--bucket.count];
+            }
+            return ::operator new((cls + 1) * kGranularity);
+        }
+        return ::operator new(size);
+    }
+
+    static void deallocate(void* pointer, std::size_t size) {
+        std::size_t cls = sizeClass(size);
+        if (cls < kClasses) {
+            Bucket& bucket = instance().buckets_[cls];
+            if (bucket.count < kBlocksPerClass) {
+                bucket.blocks[bucket.count++] = pointer;
+                return;
+            }
+        }
+        ::operator delete(pointer);
+    }
+
+private:
+    struct Bucket {
+        std::array<void*, kBlocksPerClass> blocks{};
+        std::size_t count = 0;
+    };
+
+    ~ThreadBlockCache() {
+        for (auto& bucket : buckets_) {
+            while (bucket.count > 0) {
+                ::operator delete(bucket.blocks[--bucket.count]);
+            }
+        }
+    }
+
+    static std::size_t sizeClass(std::size_t size) {
+        return size == 0 ? 0 : (size - 1) / kGranularity;
+    }
+
+    static ThreadBlockCache& instance() {
+        thread_local ThreadBlockCache cache;
+        return cache;
+    }
+
+    std::array<Bucket, kClasses> buckets_;
+};
+
+} // namespace detail
+
+/**
+ * @brief Stateless allocator backed by the calling thread's block cache.
+ */
+template <typename T>
+class RecyclingAllocator {
+public:
+    using value_type = T;
+
+    RecyclingAllocator() noexcept = default;
+
+    template <typename U>
+    RecyclingAllocator(const RecyclingAllocator<U>&) noexcept {}
+
+    bool operator==(const RecyclingAllocator&) const noexcept { return true; }
+    bool operator!=(const RecyclingAllocator&) const noexcept { return false; }
+
+    T* allocate(std::size_t n) const {
+        return static_cast<T*>(detail::ThreadBlockCache::allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* pointer, std::size_t n) const {
+        detail::ThreadBlockCache::deallocate(pointer, sizeof(T) * n);
+    }
+};
+
+/**
+ * @brief Wraps a task so boost::asio::post() allocates it from the thread cache.
+ */
+template <typename Handler>
+class RecyclingHandler {
+public:
+    using allocator_type = RecyclingAllocator<Handler>;
+
+    explicit RecyclingHandler(Handler handler) : handler_(std::move(handler)) {}
+
+    allocator_type get_allocator() const noexcept {
+        return allocator_type();
+    }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        handler_(std::forward<Args>(args)...);
+    }
+
+private:
+    Handler handler_;
+};
+
+template <typename Handler>
+inline RecyclingHandler<Handler> makeRecyclingHandler(Handler handler) {
+    return RecyclingHandler<Handler>(std::move(handler));
+}
+
+} // namespace ChatServer
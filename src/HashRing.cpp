@@ -0,0 +1,58 @@
+/**
+ * @file HashRing.cpp
+ * @brief Implementation of the consistent-hash ring.
+ */
+
+#include "HashRing.hpp"
+
+#include <algorithm>
+
+namespace ChatServer {
+
+HashRing::HashRing(int virtualNodes) : virtualNodes_(std::max(virtualNodes, 1)) {}
+
+void HashRing::assign(std::vector<std::string> nodes) {
+    std::sort(nodes.begin(), nodes.end());
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+    nodes_ = std::move(nodes);
+
+    points_.clear();
+    points_.reserve(nodes_.size() * virtualNodes_);
+    for (const auto& node : nodes_) {
+        for (int i = 0; i < virtualNodes_; ++i) {
+            points_.emplace_back(hash(node + "#" + std::to_string(i)), node);
+        }
+    }
+    std::sort(points_.begin(), points_.end());
+}
+
+const std::string& HashRing::ownerOf(const std::string& key, const std::string& fallback) const {
+    if (points_.empty()) {
+        return fallback;
+    }
+    auto it = std::lower_bound(points_.begin(), points_.end(), std::make_pair(hash(key), std::string()));
+    return it == points_.end() ? points_.front().second : it->second;
+}
+
+bool HashRing::contains(const std::string& node) const {
+    return std::binary_search(nodes_.begin(), nodes_.end(), node);
+}
+
+// FNV-1a alone clusters keys that differ only in their last characters, as
+// user_N ids and room names often do; the splitmix64 finalizer spreads them
+// around the ring
+std::uint64_t HashRing::hash(const std::string& key) {
+    std::uint64_t h = 1469598103934665603ull;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h;
+}
+
+} // namespace ChatServer
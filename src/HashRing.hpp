@@ -0,0 +1,44 @@
+/**
+ * @file HashRing.hpp
+ * @brief Consistent hashing of keys onto the nodes of a cluster.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ChatServer {
+
+/**
+ * @brief Maps keys to nodes so that adding or removing a node only moves
+ * the keys that node gains or loses.
+ *
+ * Each node is placed on the ring at virtualNodes points; a key belongs to
+ * the node at the first point at or after its hash. Not thread-safe.
+ */
+class HashRing {
+public:
+    explicit HashRing(int virtualNodes = 64);
+
+    // Replace the nodes on the ring
+    void assign(std::vector<std::string> nodes);
+
+    // The node a key belongs to, or fallback while the ring is empty
+    const std::string& ownerOf(const std::string& key, const std::string& fallback) const;
+
+    bool contains(const std::string& node) const;
+    bool empty() const { return nodes_.empty(); }
+    const std::vector<std::string>& nodes() const { return nodes_; }
+
+    static std::uint64_t hash(const std::string& key);
+
+private:
+    int virtualNodes_;
+    std::vector<std::string> nodes_;                            // sorted
+    std::vector<std::pair<std::uint64_t, std::string>> points_; // sorted by point
+};
+
+} // namespace ChatServer
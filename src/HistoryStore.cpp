@@ -0,0 +1,148 @@
+/**
+ * @file HistoryStore.cpp
+ * @brief SQLite history backend and backend selection.
+ */
+
+#include "HistoryStore.hpp"
+#include "SegmentLog.hpp"
+#include "Database.hpp"
+#include "DatabaseExecutor.hpp"
+#include "Logging.hpp"
+#include <algorithm>
+
+namespace ChatServer {
+
+namespace {
+
+// Newest rows below the cursor through the (room_id, seq) index, re-ordered oldest first
+const char* const kSelectBefore =
+    "SELECT message_id, seq, CAST(strftime('%s', timestamp) AS INTEGER), user_id, content FROM ("
+    "  SELECT m.message_id, m.seq, m.timestamp, m.user_id, m.content FROM messages m"
+    "  WHERE m.room_id = (SELECT room_id FROM chat_rooms WHERE name = ?) AND m.seq < ?"
+    "  ORDER BY m.seq DESC LIMIT ?"
+    ") ORDER BY seq ASC";
+
+const char* const kSelectRooms = "SELECT room_id, name FROM chat_rooms";
+const char* const kSelectLastSeq = "SELECT MAX(seq) FROM messages WHERE room_id = ?";
+
+const char* const kSelectById =
+    "SELECT message_id, seq, CAST(strftime('%s', timestamp) AS INTEGER), user_id, content "
+    "FROM messages WHERE message_id = ?";
+
+const char* const kSelectAll =
+    "SELECT r.name, m.message_id, m.seq, CAST(strftime('%s', m.timestamp) AS INTEGER), m.user_id, m.content "
+    "FROM messages m JOIN chat_rooms r ON r.room_id = m.room_id ORDER BY m.message_id";
+
+HistoryEntry entryFromRow(const Row& row, int first) {
+    HistoryEntry entry;
+    entry.id = static_cast<std::uint64_t>(row.int64(first));
+    entry.seq = static_cast<std::uint64_t>(row.int64(first + 1));
+    entry.timestamp = row.int64(first + 2);
+    entry.userId = row.text(first + 3);
+    entry.content = row.text(first + 4);
+    return entry;
+}
+
+} // namespace
+
+SqliteHistoryStore::SqliteHistoryStore(std::shared_ptr<DatabaseExecutor> executor,
+                                       const PersisterConfig& config)
+    : executor_(executor), persister_(executor, config) {
+    persister_.setStoredCallback([this](const StoredMessage& message, std::int64_t messageId) {
+        messagePersisted(message, messageId);
+    });
+}
+
+bool SqliteHistoryStore::start() {
+    return persister_.start();
+}
+
+void SqliteHistoryStore::stop() {
+    persister_.stop();
+}
+
+bool SqliteHistoryStore::append(StoredMessage message) {
+    return persister_.enqueue(std::move(message));
+}
+
+void SqliteHistoryStore::readBefore(const std::string& room, std::uint64_t beforeSeq, std::size_t limit,
+                                    const HistoryVisitor& visit) {
+    executor_->read([&room, beforeSeq, limit, &visit](Database& db) {
+        PreparedStatement& select = db.statement(kSelectBefore);
+        StatementReset reset(select);
+        select.bind(room, std::min(beforeSeq, kLatest), static_cast<std::int64_t>(limit));
+        select.forEachRow([&visit](const Row& row) {
+            visit(entryFromRow(row, 0));
+        });
+    }).get();
+}
+
+std::unordered_map<std::string, std::uint64_t> SqliteHistoryStore::lastSequences() {
+    return executor_->read([](Database& db) {
+        std::unordered_map<std::string, std::uint64_t> lastSeqs;
+        PreparedStatement& rooms = db.statement(kSelectRooms);
+        PreparedStatement& lastSeq = db.statement(kSelectLastSeq);
+        StatementReset resetRooms(rooms);
+        // One index probe per room instead of grouping the whole table
+        rooms.forEachRow([&](const Row& row) {
+            StatementReset resetLast(lastSeq);
+            lastSeq.bind(row.int64(0));
+            if (lastSeq.step() && !lastSeq.row().isNull(0)) {
+                lastSeqs[std::string(row.text(1))] = static_cast<std::uint64_t>(lastSeq.row().int64(0));
+            }
+        });
+        return lastSeqs;
+    }).get();
+}
+
+void SqliteHistoryStore::readIds(const std::string& room, const std::vector<std::uint64_t>& ids,
+                                 const HistoryVisitor& visit) {
+    // Ids are global here, so the room needs no filter
+    (void)room;
+    executor_->read([&ids, &visit](Database& db) {
+        PreparedStatement& select = db.statement(kSelectById);
+        for (std::uint64_t id : ids) {
+            StatementReset reset(select);
+            select.bind(static_cast<std::int64_t>(id));
+            select.forEachRow([&visit](const Row& row) {
+                visit(entryFromRow(row, 0));
+            });
+        }
+    }).get();
+}
+
+void SqliteHistoryStore::scan(const HistoryScanVisitor& visit) {
+    executor_->read([&visit](Database& db) {
+        PreparedStatement& select = db.statement(kSelectAll);
+        StatementReset reset(select);
+        std::string room;
+        select.forEachRow([&visit, &room](const Row& row) {
+            room.assign(row.text(0));
+            visit(room, entryFromRow(row, 1));
+        });
+    }).get();
+}
+
+void SqliteHistoryStore::messagePersisted(const StoredMessage& message, std::int64_t messageId) {
+    HistoryEntry entry;
+    entry.id = static_cast<std::uint64_t>(messageId);
+    entry.seq = message.seq;
+    entry.timestamp = message.timestamp;
+    entry.userId = message.userId;
+    entry.content = message.content;
+    notifyStored(message.room, entry);
+}
+
+std::unique_ptr<HistoryStore> createHistoryStore(const std::string& backend,
+                                                 std::shared_ptr<DatabaseExecutor> executor) {
+    if (backend == "sqlite") {
+        return std::make_unique<SqliteHistoryStore>(std::move(executor));
+    }
+    if (backend == "segment") {
+        return std::make_unique<SegmentLogStore>();
+    }
+    Logging::error("Unknown history backend: " + backend);
+    return nullptr;
+}
+
+} // namespace ChatServer
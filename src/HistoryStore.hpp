@@ -0,0 +1,143 @@
+/**
+ * @file HistoryStore.hpp
+ * @brief Pluggable durable chat history and its SQLite implementation.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "MessagePersister.hpp"
+
+namespace ChatServer {
+
+class DatabaseExecutor;
+
+/**
+ * @brief One stored message as seen by a history reader.
+ *
+ * The views point into the backend's storage (a SQLite row or a mapped
+ * segment) and are only valid for the duration of the visitor call.
+ */
+struct HistoryEntry {
+    std::uint64_t id = 0;         // store-specific message id
+    std::uint64_t seq = 0;        // per-room sequence number
+    std::int64_t timestamp = 0;
+    std::string_view userId;
+    std::string_view content;
+};
+
+using HistoryVisitor = std::function<void(const HistoryEntry&)>;
+using HistoryScanVisitor = std::function<void(const std::string& room, const HistoryEntry&)>;
+
+/**
+ * @brief Told about every message once the store has made it durable.
+ *
+ * Called on the store's writer thread; implementations must not block.
+ */
+class HistoryObserver {
+public:
+    virtual ~HistoryObserver() = default;
+
+    virtual void messageStored(const std::string& room, const HistoryEntry& entry) = 0;
+};
+
+/**
+ * @brief Durable, append-only chat history.
+ *
+ * append() is called from io threads and must never block. Reads may touch
+ * disk and are meant to run on a background thread.
+ */
+class HistoryStore {
+public:
+    virtual ~HistoryStore() = default;
+
+    virtual bool start() = 0;
+
+    // Make everything appended so far durable, then stop
+    virtual void stop() = 0;
+
+    // Queue a message for storage; returns false if it had to be dropped
+    virtual bool append(StoredMessage message) = 0;
+
+    // Visit up to limit of the room's messages with seq < beforeSeq, oldest first
+    virtual void readBefore(const std::string& room, std::uint64_t beforeSeq, std::size_t limit,
+                            const HistoryVisitor& visit) = 0;
+
+    // Visit up to limit of the room's newest messages, oldest first
+    void readRecent(const std::string& room, std::size_t limit, const HistoryVisitor& visit) {
+        readBefore(room, kLatest, limit, visit);
+    }
+
+    // Highest stored sequence number of every room, for numbering after a restart
+    virtual std::unordered_map<std::string, std::uint64_t> lastSequences() = 0;
+
+    // Visit the room's messages with the given ids, in ascending id order
+    virtual void readIds(const std::string& room, const std::vector<std::uint64_t>& ids,
+                         const HistoryVisitor& visit) = 0;
+
+    // Visit every stored message of every room; used to rebuild derived indexes
+    virtual void scan(const HistoryScanVisitor& visit) = 0;
+
+    // Short backend name for logs and benchmarks
+    virtual const char* backendName() const = 0;
+
+    // A beforeSeq that is past every message
+    static constexpr std::uint64_t kLatest = INT64_MAX;
+
+    void setObserver(std::shared_ptr<HistoryObserver> observer) {
+        std::atomic_store(&observer_, std::move(observer));
+    }
+
+protected:
+    void notifyStored(const std::string& room, const HistoryEntry& entry) {
+        if (auto observer = std::atomic_load(&observer_)) {
+            observer->messageStored(room, entry);
+        }
+    }
+
+private:
+    std::shared_ptr<HistoryObserver> observer_;
+};
+
+/**
+ * @brief HistoryStore over the messages table, via MessagePersister.
+ */
+class SqliteHistoryStore : public HistoryStore {
+public:
+    SqliteHistoryStore(std::shared_ptr<DatabaseExecutor> executor,
+                       const PersisterConfig& config = PersisterConfig());
+
+    bool start() override;
+    void stop() override;
+    bool append(StoredMessage message) override;
+    void readBefore(const std::string& room, std::uint64_t beforeSeq, std::size_t limit,
+                    const HistoryVisitor& visit) override;
+    std::unordered_map<std::string, std::uint64_t> lastSequences() override;
+    void readIds(const std::string& room, const std::vector<std::uint64_t>& ids,
+                 const HistoryVisitor& visit) override;
+    void scan(const HistoryScanVisitor& visit) override;
+    const char* backendName() const override { return "sqlite"; }
+
+private:
+    void messagePersisted(const StoredMessage& message, std::int64_t messageId);
+
+    std::shared_ptr<DatabaseExecutor> executor_;
+    MessagePersister persister_;
+};
+
+/**
+ * @brief Select a backend by name ("sqlite" or "segment").
+ * @return nullptr for an unknown name
+ */
+std::unique_ptr<HistoryStore> createHistoryStore(const std::string& backend,
+                                                 std::shared_ptr<DatabaseExecutor> executor);
+
+} // namespace ChatServer
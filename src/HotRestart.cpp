@@ -0,0 +1,371 @@
+/**
+ * @file HotRestart.cpp
+ * @brief Implementation of the hot restart handoff.
+ */
+
+#include "HotRestart.hpp"
+#include "Logging.hpp"
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace ChatServer {
+
+namespace {
+
+const char kHello[] = "CHATHANDOFF1";
+const char kReady[] = "READY";
+const std::uint64_t kVersion = 1;
+const std::size_t kChunkBytes = 32 * 1024;
+const std::size_t kFdsPerMessage = 250;    // the kernel accepts at most 253 per message
+
+void putVarint(std::string& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+void putString(std::string& out, const std::string& value) {
+    putVarint(out, value.size());
+    out.append(value);
+}
+
+class Reader {
+public:
+    explicit Reader(const std::string& data) : data_(data) {}
+
+    bool varint(std::uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && pos_ < data_.size(); shift += 7) {
+            auto byte = static_cast<unsigned char>(data_[pos_++]);
+            value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool string(std::string& value) {
+        std::uint64_t size = 0;
+        if (!varint(size) || size > data_.size() - pos_) {
+            return false;
+        }
+        value.assign(data_, pos_, size);
+        pos_ += size;
+        return true;
+    }
+
+private:
+    const std::string& data_;
+    std::size_t pos_ = 0;
+};
+
+std::string encode(const HandoffState& state) {
+    std::string out;
+    putVarint(out, kVersion);
+    putVarint(out, static_cast<std::uint64_t>(state.nextSessionId));
+    putVarint(out, state.sessions.size());
+    for (const auto& session : state.sessions) {
+        putString(out, session.sessionId);
+    }
+    putVarint(out, state.identities.size());
+    for (const auto& identity : state.identities) {
+        putString(out, identity.sessionId);
+        putString(out, identity.tokenHash);
+        putVarint(out, static_cast<std::uint64_t>(identity.state));
+        putVarint(out, static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            identity.parkedAt.time_since_epoch()).count()));
+        putVarint(out, identity.lastSeqs.size());
+        for (const auto& [room, seq] : identity.lastSeqs) {
+            putString(out, room);
+            putVarint(out, seq);
+        }
+    }
+    return out;
+}
+
+bool decode(const std::string& data, HandoffState& state) {
+    Reader in(data);
+    std::uint64_t version = 0;
+    std::uint64_t value = 0;
+    std::uint64_t count = 0;
+    if (!in.varint(version) || version != kVersion || !in.varint(value) || !in.varint(count)) {
+        return false;
+    }
+    state.nextSessionId = static_cast<int>(value);
+    state.sessions.resize(count);
+    for (auto& session : state.sessions) {
+        if (!in.string(session.sessionId)) {
+            return false;
+        }
+    }
+    if (!in.varint(count)) {
+        return false;
+    }
+    state.identities.resize(count);
+    for (auto& identity : state.identities) {
+        std::uint64_t stateValue = 0;
+        std::uint64_t parkedAt = 0;
+        std::uint64_t rooms = 0;
+        if (!in.string(identity.sessionId) || !in.string(identity.tokenHash) || !in.varint(stateValue) ||
+            stateValue > static_cast<std::uint64_t>(ResumeRegistry::State::Parked) ||
+            !in.varint(parkedAt) || !in.varint(rooms)) {
+            return false;
+        }
+        identity.state = static_cast<ResumeRegistry::State>(stateValue);
+        // steady_clock is CLOCK_MONOTONIC, which every process on the host shares
+        identity.parkedAt = std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(parkedAt)));
+        for (std::uint64_t i = 0; i < rooms; ++i) {
+            std::string room;
+            std::uint64_t seq = 0;
+            if (!in.string(room) || !in.varint(seq)) {
+                return false;
+            }
+            identity.lastSeqs[room] = seq;
+        }
+    }
+    return true;
+}
+
+bool sendAll(int fd, const std::string& message) {
+    return ::send(fd, message.data(), message.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(message.size());
+}
+
+bool sendFds(int fd, const int* fds, std::size_t count) {
+    char type = 'F';
+    iovec iov{&type, 1};
+    std::vector<char> control(CMSG_SPACE(count * sizeof(int)));
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), fds, count * sizeof(int));
+    return ::sendmsg(fd, &message, MSG_NOSIGNAL) == 1;
+}
+
+void closeAll(const std::vector<int>& fds) {
+    for (int fd : fds) {
+        ::close(fd);
+    }
+}
+
+} // namespace
+
+HandoffListener::HandoffListener(boost::asio::io_context& io_context, const std::string& path)
+    : acceptor_(io_context), path_(path) {}
+
+bool HandoffListener::start(RequestHandler handler) {
+    handler_ = std::move(handler);
+    ::unlink(path_.c_str());
+
+    boost::asio::generic::seq_packet_protocol::endpoint endpoint{boost::asio::local::stream_protocol::endpoint(path_)};
+    boost::system::error_code ec;
+    acceptor_.open(boost::asio::generic::seq_packet_protocol(AF_UNIX, 0), ec);
+    if (!ec) {
+        acceptor_.bind(endpoint, ec);
+    }
+    if (!ec) {
+        acceptor_.listen(1, ec);
+    }
+    if (ec) {
+        Logging::error("Cannot listen for hot restart on " + path_ + ": " + ec.message());
+        acceptor_.close(ec);
+        return false;
+    }
+    Logging::info("Hot restart handoff socket at " + path_);
+    doAccept();
+    return true;
+}
+
+void HandoffListener::stop(bool removeFile) {
+    boost::system::error_code ignored;
+    acceptor_.close(ignored);
+    if (removeFile) {
+        ::unlink(path_.c_str());
+    }
+}
+
+void HandoffListener::doAccept() {
+    acceptor_.async_accept([this](boost::system::error_code ec, Channel socket) {
+        if (ec == boost::asio::error::operation_aborted) {
+            return;
+        }
+        if (!ec) {
+            auto channel = std::make_shared<Channel>(std::move(socket));
+            auto hello = std::make_shared<std::array<char, 64>>();
+            auto flags = std::make_shared<boost::asio::socket_base::message_flags>();
+            channel->async_receive(boost::asio::buffer(*hello), *flags,
+                [this, channel, hello, flags](boost::system::error_code ec, std::size_t length) {
+                    if (!ec && std::string(hello->data(), length) == kHello) {
+                        handler_(channel);
+                    } else {
+                        Logging::warning("Ignoring a malformed hot restart request");
+                    }
+                });
+        }
+        doAccept();
+    });
+}
+
+bool HandoffListener::send(Channel& channel, const HandoffState& state) {
+    int fd = channel.native_handle();
+
+    // Send blocking, but never wait more than a few seconds on a stuck
+    // successor; asio expects the descriptor non-blocking again afterwards
+    int flags = ::fcntl(fd, F_GETFL);
+    ::fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+    timeval timeout{10, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    std::string data = encode(state);
+    std::vector<int> fds;
+    fds.reserve(state.sessions.size() + 1);
+    fds.push_back(state.listenFd);
+    for (const auto& session : state.sessions) {
+        fds.push_back(session.fd);
+    }
+
+    bool ok = true;
+    for (std::size_t offset = 0; ok && offset < data.size(); offset += kChunkBytes) {
+        ok = sendAll(fd, "D" + data.substr(offset, kChunkBytes));
+    }
+    for (std::size_t offset = 0; ok && offset < fds.size(); offset += kFdsPerMessage) {
+        ok = sendFds(fd, fds.data() + offset, std::min(kFdsPerMessage, fds.size() - offset));
+    }
+    if (ok) {
+        std::string end = "E";
+        putVarint(end, data.size());
+        putVarint(end, fds.size());
+        ok = sendAll(fd, end);
+    }
+    if (!ok) {
+        Logging::error(std::string("Hot restart transfer failed: ") + std::strerror(errno));
+    }
+
+    ::fcntl(fd, F_SETFL, flags);
+    return ok;
+}
+
+void HandoffListener::awaitReady(const std::shared_ptr<Channel>& channel, std::chrono::seconds timeout,
+                                 std::function<void(bool)> done) {
+    struct Wait {
+        explicit Wait(const Channel::executor_type& executor) : strand(executor), timer(strand) {}
+        boost::asio::strand<Channel::executor_type> strand;
+        boost::asio::steady_timer timer;
+        std::array<char, 16> reply;
+        boost::asio::socket_base::message_flags flags = 0;
+        std::function<void(bool)> done;
+    };
+    auto wait = std::make_shared<Wait>(channel->get_executor());
+    wait->done = std::move(done);
+
+    wait->timer.expires_after(timeout);
+    wait->timer.async_wait(boost::asio::bind_executor(wait->strand, [channel, wait](boost::system::error_code ec) {
+        if (!ec) {
+            channel->cancel(ec);
+        }
+    }));
+    channel->async_receive(boost::asio::buffer(wait->reply), wait->flags,
+        boost::asio::bind_executor(wait->strand, [channel, wait](boost::system::error_code ec, std::size_t length) {
+            wait->timer.cancel();
+            wait->done(!ec && std::string(wait->reply.data(), length) == kReady);
+        }));
+}
+
+HandoffClient::~HandoffClient() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+bool HandoffClient::connect(const std::string& path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    fd_ = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd_ < 0 || ::connect(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+        return false;
+    }
+    // The predecessor first lets in-flight writes finish, which can take a while
+    timeval timeout{60, 0};
+    ::setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return sendAll(fd_, std::string(kHello));
+}
+
+bool HandoffClient::receive(HandoffState& state) {
+    std::string data;
+    std::vector<int> fds;
+    std::vector<char> buffer(kChunkBytes + 1);
+    std::vector<char> control(CMSG_SPACE(kFdsPerMessage * sizeof(int)));
+    for (;;) {
+        iovec iov{buffer.data(), buffer.size()};
+        msghdr message{};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control.data();
+        message.msg_controllen = control.size();
+        ssize_t length = ::recvmsg(fd_, &message, MSG_CMSG_CLOEXEC);
+        if (length <= 0 || (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+            Logging::error("Hot restart transfer from the running server was cut short");
+            closeAll(fds);
+            return false;
+        }
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                std::size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                const int* received = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+                fds.insert(fds.end(), received, received + count);
+            }
+        }
+
+        if (buffer[0] == 'D') {
+            data.append(buffer.data() + 1, static_cast<std::size_t>(length) - 1);
+        } else if (buffer[0] == 'E') {
+            std::string end(buffer.data() + 1, static_cast<std::size_t>(length) - 1);
+            Reader in(end);
+            std::uint64_t bytes = 0;
+            std::uint64_t count = 0;
+            if (!in.varint(bytes) || !in.varint(count) || bytes != data.size() || count != fds.size() ||
+                !decode(data, state) || fds.size() != state.sessions.size() + 1) {
+                Logging::error("Hot restart state from the running server is inconsistent");
+                closeAll(fds);
+                return false;
+            }
+            state.listenFd = fds[0];
+            for (std::size_t i = 0; i < state.sessions.size(); ++i) {
+                state.sessions[i].fd = fds[i + 1];
+            }
+            return true;
+        }
+    }
+}
+
+void HandoffClient::confirm() {
+    if (fd_ >= 0) {
+        sendAll(fd_, kReady);
+    }
+}
+
+} // namespace ChatServer
@@ -0,0 +1,110 @@
+/**
+ * @file HotRestart.hpp
+ * @brief Handing the listening socket, live connections and session state to a new process.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+
+#include "ResumeRegistry.hpp"
+
+namespace ChatServer {
+
+struct HandoffSession {
+    std::string sessionId;
+    int fd = -1;               // the connection, valid in the receiving process
+};
+
+/**
+ * @brief Everything a successor needs beyond what StateStore and the
+ * history backend already keep on disk.
+ *
+ * Rooms, users and memberships travel through the state journal, which the
+ * predecessor flushes before handing off; this carries the descriptors and
+ * the in-memory session state.
+ */
+struct HandoffState {
+    int listenFd = -1;
+    int nextSessionId = 1;
+    std::vector<HandoffSession> sessions;
+    std::vector<ResumeRegistry::IdentitySnapshot> identities;
+};
+
+/*
+ * The exchange runs over a SOCK_SEQPACKET Unix socket, so every message
+ * arrives whole and descriptors stay attached to the message they were
+ * sent with:
+ *
+ *   successor:   "CHATHANDOFF1"
+ *   predecessor: 'D' state bytes          (repeated; at most 32 KB each)
+ *                'F' + up to 250 fds      (repeated; listener first, then sessions in order)
+ *                'E' total bytes, fd count
+ *   successor:   "READY" once it serves the connections
+ *
+ * If the successor goes away before READY, the predecessor resumes service.
+ */
+
+/**
+ * @brief Predecessor side: waits on a Unix socket for a successor.
+ */
+class HandoffListener {
+public:
+    using Channel = boost::asio::generic::seq_packet_protocol::socket;
+    // Called on the io_context with a successor that has asked to take over
+    using RequestHandler = std::function<void(std::shared_ptr<Channel>)>;
+
+    HandoffListener(boost::asio::io_context& io_context, const std::string& path);
+
+    // Bind path (replacing a stale socket file) and start listening
+    bool start(RequestHandler handler);
+
+    // Stop listening; removeFile is false once a successor owns the path
+    void stop(bool removeFile = true);
+
+    // Send state and its descriptors; blocks until written or the channel fails
+    static bool send(Channel& channel, const HandoffState& state);
+
+    // Wait for the successor to confirm; done(false) if it fails or times out
+    static void awaitReady(const std::shared_ptr<Channel>& channel, std::chrono::seconds timeout,
+                           std::function<void(bool)> done);
+
+private:
+    void doAccept();
+
+    // generic::seq_packet_protocol has no acceptor typedef of its own
+    boost::asio::basic_socket_acceptor<boost::asio::generic::seq_packet_protocol> acceptor_;
+    std::string path_;
+    RequestHandler handler_;
+};
+
+/**
+ * @brief Successor side: asks a running predecessor for its connections.
+ */
+class HandoffClient {
+public:
+    HandoffClient() = default;
+    ~HandoffClient();
+
+    HandoffClient(const HandoffClient&) = delete;
+    HandoffClient& operator=(const HandoffClient&) = delete;
+
+    // False if no predecessor listens on path
+    bool connect(const std::string& path);
+
+    // Receive the predecessor's state; false if the transfer failed
+    bool receive(HandoffState& state);
+
+    // Tell the predecessor the connections are served here now
+    void confirm();
+
+private:
+    int fd_ = -1;
+};
+
+} // namespace ChatServer
@@ -0,0 +1,916 @@
+/**
+ * @file LoadGen.cpp
+ * @brief chat_loadgen: drives many connections against the chat server and
+ *        reports throughput and delivery latency.
+ *
+ * Connections are spread over a few threads, each running its own
+ * io_context. Every connection waits to be settled into 'general', leaves it
+ * (unless --keep-general), joins its rooms from the chosen topology and then
+ * takes part in the load phase. Sending connections pick an action from the
+ * scripted mix for each send. A chat message carries a stamp
+ * ~<sender>.<seq>.<nanos>~ that every receiver parses to measure delivery
+ * latency. A command is timed until its reply.
+ *
+ * Closed loop: each sender has one action outstanding. A message counts as
+ * done at its first delivery anywhere, a command at its reply; then the
+ * sender thinks for --think-ms and sends again.
+ * Open loop: actions are scheduled at --rate per second regardless of
+ * progress. Stamps carry the scheduled time, so latency includes any time
+ * spent waiting for an idle sender (no coordinated omission).
+ *
+ * The server reads chat input unframed, one read per message. Two sends on
+ * one connection that reach the server in the same read become one message,
+ * so a connection never has more than one send in flight, and delivery
+ * lines are scanned for every stamp they contain.
+ */
+
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using boost::asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+    std::string host = "127.0.0.1";
+    unsigned short port = 8080;
+    std::size_t connections = 1000;
+    std::size_t threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+    std::vector<std::string> bindAddresses;  // local source addresses, round-robin
+    double connectRate = 2000;               // new connections per second
+
+    std::size_t rooms = 10;
+    std::string topology = "uniform";        // uniform, zipf or overlap
+    std::size_t roomsPerConnection = 2;      // overlap only
+    double zipfExponent = 1.0;               // zipf only
+    bool keepGeneral = false;
+
+    double senderFraction = 1.0;             // the rest only listen
+    bool openLoop = false;
+    double rate = 1000;                      // open loop, actions per second in total
+    std::chrono::milliseconds think{0};      // closed loop pause between actions
+    std::chrono::milliseconds ackTimeout{1000};
+    std::size_t payloadBytes = 64;
+    std::string mix = "msg:100";
+
+    std::chrono::seconds warmup{5};
+    std::chrono::seconds duration{30};
+    std::chrono::seconds setupTimeout{120};
+};
+
+// One entry of the scripted mix; an empty command is a chat message
+struct Action {
+    std::string command;
+    double weight = 0;
+    std::unique_ptr<ChatServer::LatencyHistogram> latency;
+    std::unique_ptr<ChatServer::Counter> sent;
+};
+
+struct Stats {
+    ChatServer::Counter connected;
+    ChatServer::Counter connectFailed;
+    ChatServer::Counter ready;
+    ChatServer::Counter dropped;
+    ChatServer::Counter messagesSent;
+    ChatServer::Counter commandsSent;
+    ChatServer::Counter deliveries;
+    ChatServer::Counter ackTimeouts;
+    ChatServer::LatencyHistogram delivery;
+};
+
+class Worker;
+class Connection;
+
+struct Run {
+    explicit Run(const Options& opts) : options(opts) {}
+
+    std::uint64_t nanosNow() const {
+        return static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - origin).count());
+    }
+
+    const Options& options;
+    Clock::time_point origin = Clock::now();
+    std::vector<Action> actions;
+    std::vector<double> actionCdf;
+    std::vector<std::string> roomNames;
+    std::atomic<bool> loadStarted{false};
+    std::atomic<bool> recording{false};
+    Stats stats;
+
+    // Declared in this order so connections are destroyed before the
+    // io_contexts their sockets belong to
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::unique_ptr<Connection>> connections;
+};
+
+std::string formatNanos(std::uint64_t nanos) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(nanos < 10000 ? 2 : 1);
+    if (nanos < 1000000) {
+        out << nanos / 1e3 << " us";
+    } else if (nanos < 1000000000) {
+        out << nanos / 1e6 << " ms";
+    } else {
+        out << nanos / 1e9 << " s";
+    }
+    return out.str();
+}
+
+std::string formatPercentiles(const ChatServer::LatencyHistogram::Snapshot& snapshot) {
+    std::ostringstream out;
+    out << "p50 " << formatNanos(snapshot.quantile(0.5))
+        << "  p90 " << formatNanos(snapshot.quantile(0.9))
+        << "  p99 " << formatNanos(snapshot.quantile(0.99))
+        << "  p99.9 " << formatNanos(snapshot.quantile(0.999))
+        << "  max " << formatNanos(snapshot.maxNanos);
+    return out.str();
+}
+
+/**
+ * @brief An io_context and thread owning a slice of the connections.
+ *
+ * Connections are only touched from their worker's thread; other threads
+ * post to it.
+ */
+class Worker {
+public:
+    Worker(Run& run, std::size_t index)
+        : run_(run), ticker_(io), guard_(boost::asio::make_work_guard(io)), random_(index + 1) {}
+
+    void start() {
+        thread_ = std::thread([this]() { io.run(); });
+    }
+
+    // Begin the load phase; runs on this worker's thread
+    void startLoad();
+
+    void stop();
+
+    void join() {
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    std::uint64_t behindSchedule() const { return behind_.load(std::memory_order_relaxed); }
+
+    const Action& pickAction() {
+        if (run_.actions.size() == 1) {
+            return run_.actions.front();
+        }
+        double point = std::uniform_real_distribution<double>(0, run_.actionCdf.back())(random_);
+        auto it = std::upper_bound(run_.actionCdf.begin(), run_.actionCdf.end(), point);
+        std::size_t index = std::min<std::size_t>(it - run_.actionCdf.begin(), run_.actions.size() - 1);
+        return run_.actions[index];
+    }
+
+    boost::asio::io_context io;
+    std::vector<Connection*> connections;
+    std::vector<Connection*> senders;
+
+private:
+    void scheduleTick();
+    void tick();
+    Connection* nextIdleSender();
+
+    Run& run_;
+    boost::asio::steady_timer ticker_;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> guard_;
+    std::mt19937_64 random_;
+    std::thread thread_;
+
+    Clock::time_point loadStart_;
+    std::uint64_t loadStartNanos_ = 0;
+    double rate_ = 0;               // this worker's share of the open-loop rate
+    std::uint64_t scheduled_ = 0;
+    std::size_t nextSender_ = 0;
+    std::atomic<std::uint64_t> behind_{0};
+    bool stopping_ = false;
+};
+
+class Connection {
+public:
+    Connection(Run& run, Worker& worker, std::size_t index, std::vector<std::uint32_t> rooms, bool sender)
+        : run_(run), worker_(worker), socket_(worker.io), thinkTimer_(worker.io), index_(index),
+          rooms_(std::move(rooms)), sender_(sender) {}
+
+    bool sender() const { return sender_; }
+
+    bool idle() const {
+        return phase_ == Phase::Ready && !writing_ && !awaitingReply_ &&
+               awaitingAck_.load(std::memory_order_relaxed) == 0;
+    }
+
+    void connect(const tcp::endpoint& server, const std::string& localAddress) {
+        boost::system::error_code ec;
+        socket_.open(server.protocol(), ec);
+        if (!ec && !localAddress.empty()) {
+            socket_.bind(tcp::endpoint(boost::asio::ip::make_address(localAddress), 0), ec);
+        }
+        if (ec) {
+            run_.stats.connectFailed.inc();
+            phase_ = Phase::Closed;
+            return;
+        }
+        socket_.async_connect(server, [this](boost::system::error_code connectEc) {
+            if (connectEc) {
+                run_.stats.connectFailed.inc();
+                phase_ = Phase::Closed;
+                return;
+            }
+            socket_.set_option(tcp::no_delay(true), connectEc);
+            run_.stats.connected.inc();
+            phase_ = Phase::Settling;
+            read();
+        });
+    }
+
+    // Send the next action of the mix, stamped with its scheduled time
+    void fire(std::uint64_t stampNanos) {
+        const Action& action = worker_.pickAction();
+        std::string out;
+        if (action.command.empty()) {
+            std::uint64_t seq = nextSeq_++;
+            out = "~" + std::to_string(index_) + "." + std::to_string(seq) + "." +
+                  std::to_string(stampNanos) + "~";
+            if (out.size() < run_.options.payloadBytes) {
+                out.append(run_.options.payloadBytes - out.size(), 'x');
+            }
+            if (!run_.options.openLoop) {
+                awaitingAck_.store(seq, std::memory_order_relaxed);
+                ackDeadline_ = Clock::now() + run_.options.ackTimeout;
+            }
+            if (run_.recording.load(std::memory_order_relaxed)) {
+                run_.stats.messagesSent.inc();
+            }
+        } else {
+            out = "/" + action.command;
+            awaitingReply_ = true;
+            pendingAction_ = &action;
+            commandStamp_ = stampNanos;
+            if (run_.recording.load(std::memory_order_relaxed)) {
+                run_.stats.commandsSent.inc();
+                action.sent->inc();
+            }
+        }
+        write(std::move(out));
+    }
+
+    // A receiver saw this sender's message; called from any worker thread
+    void acknowledge(std::uint64_t seq) {
+        std::uint64_t expected = seq;
+        if (awaitingAck_.compare_exchange_strong(expected, 0, std::memory_order_relaxed)) {
+            boost::asio::post(worker_.io, [this]() { next(); });
+        }
+    }
+
+    // Give up on a message nobody received; runs on the worker's thread
+    void checkAckTimeout(Clock::time_point now) {
+        if (awaitingAck_.load(std::memory_order_relaxed) != 0 && now >= ackDeadline_ &&
+            awaitingAck_.exchange(0, std::memory_order_relaxed) != 0) {
+            if (run_.recording.load(std::memory_order_relaxed)) {
+                run_.stats.ackTimeouts.inc();
+            }
+            next();
+        }
+    }
+
+    // Closed loop only: the previous action finished
+    void next() {
+        if (phase_ != Phase::Ready || !sender_ || run_.options.openLoop) {
+            return;
+        }
+        if (run_.options.think.count() == 0) {
+            fire(run_.nanosNow());
+            return;
+        }
+        thinkTimer_.expires_after(run_.options.think);
+        thinkTimer_.async_wait([this](boost::system::error_code ec) {
+            if (!ec && phase_ == Phase::Ready) {
+                fire(run_.nanosNow());
+            }
+        });
+    }
+
+    void close() {
+        phase_ = Phase::Closed;
+        boost::system::error_code ignored;
+        thinkTimer_.cancel();
+        socket_.shutdown(tcp::socket::shutdown_both, ignored);
+        socket_.close(ignored);
+    }
+
+private:
+    enum class Phase { Connecting, Settling, Setup, Ready, Closed };
+
+    void read() {
+        socket_.async_read_some(boost::asio::buffer(readBuffer_),
+            [this](boost::system::error_code ec, std::size_t length) {
+                if (ec) {
+                    fail();
+                    return;
+                }
+                carry_.append(readBuffer_.data(), length);
+                bool replied = false;
+                std::size_t start = 0;
+                for (std::size_t end; (end = carry_.find('\n', start)) != std::string::npos; start = end + 1) {
+                    onLine(std::string_view(carry_).substr(start, end - start), replied);
+                }
+                carry_.erase(0, start);
+                read();
+            });
+    }
+
+    void write(std::string out) {
+        writing_ = true;
+        outbox_ = std::move(out);
+        boost::asio::async_write(socket_, boost::asio::buffer(outbox_),
+            [this](boost::system::error_code ec, std::size_t /*length*/) {
+                writing_ = false;
+                if (ec) {
+                    fail();
+                }
+            });
+    }
+
+    void fail() {
+        if (phase_ != Phase::Closed) {
+            run_.stats.dropped.inc();
+            close();
+        }
+    }
+
+    // replied is shared by the lines of one read: a multi-line reply such as
+    // /listrooms arrives in one frame, so only its first line completes the
+    // pending command and the rest are skipped
+    void onLine(std::string_view line, bool& replied) {
+        if (line.find('~') != std::string_view::npos) {
+            onDelivery(line);
+            return;
+        }
+        if (line.empty() || replied) {
+            return;
+        }
+
+        switch (phase_) {
+        case Phase::Settling:
+            if (line.rfind("You have been added to the 'general'", 0) == 0) {
+                phase_ = Phase::Setup;
+                setupStep_ = run_.options.keepGeneral ? 1 : 0;
+                nextSetupStep();
+            }
+            break;
+        case Phase::Setup:
+            replied = true;
+            if (creating_) {
+                creating_ = false; // created, or someone else was first; join again
+            } else if (line.find("does not exist") != std::string_view::npos && setupStep_ > 0) {
+                creating_ = true;
+                write("/createroom " + run_.roomNames[rooms_[setupStep_ - 1]]);
+                return;
+            } else {
+                ++setupStep_;
+            }
+            nextSetupStep();
+            break;
+        case Phase::Ready:
+            if (awaitingReply_) {
+                replied = true;
+                awaitingReply_ = false;
+                if (run_.recording.load(std::memory_order_relaxed)) {
+                    pendingAction_->latency->record(std::chrono::nanoseconds(run_.nanosNow() - commandStamp_));
+                }
+                next();
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Step 0 leaves 'general', step i joins the (i-1)th room
+    void nextSetupStep() {
+        if (setupStep_ == 0) {
+            write("/leave general");
+            return;
+        }
+        if (setupStep_ <= rooms_.size()) {
+            write("/join " + run_.roomNames[rooms_[setupStep_ - 1]]);
+            return;
+        }
+        phase_ = Phase::Ready;
+        run_.stats.ready.inc();
+        if (run_.loadStarted.load(std::memory_order_acquire)) {
+            next();
+        }
+    }
+
+    void onDelivery(std::string_view line) {
+        bool recording = phase_ == Phase::Ready && run_.recording.load(std::memory_order_relaxed);
+        std::uint64_t now = recording ? run_.nanosNow() : 0;
+        for (std::size_t open = line.find('~'); open != std::string_view::npos;) {
+            std::size_t close = line.find('~', open + 1);
+            if (close == std::string_view::npos) {
+                break;
+            }
+            std::uint64_t fields[3];
+            if (parseStamp(line.substr(open + 1, close - open - 1), fields) &&
+                fields[0] < run_.connections.size()) {
+                if (recording) {
+                    run_.stats.deliveries.inc();
+                    if (now > fields[2]) {
+                        run_.stats.delivery.record(std::chrono::nanoseconds(now - fields[2]));
+                    }
+                }
+                run_.connections[fields[0]]->acknowledge(fields[1]);
+                open = line.find('~', close + 1);
+            } else {
+                open = close;
+            }
+        }
+    }
+
+    // sender.seq.nanos
+    static bool parseStamp(std::string_view stamp, std::uint64_t (&fields)[3]) {
+        std::size_t field = 0;
+        fields[0] = fields[1] = fields[2] = 0;
+        bool digits = false;
+        for (char c : stamp) {
+            if (c == '.') {
+                if (!digits || ++field > 2) {
+                    return false;
+                }
+                digits = false;
+            } else if (c >= '0' && c <= '9') {
+                fields[field] = fields[field] * 10 + static_cast<std::uint64_t>(c - '0');
+                digits = true;
+            } else {
+                return false;
+            }
+        }
+        return field == 2 && digits;
+    }
+
+    Run& run_;
+    Worker& worker_;
+    tcp::socket socket_;
+    boost::asio::steady_timer thinkTimer_;
+    std::size_t index_;
+    std::vector<std::uint32_t> rooms_;
+    bool sender_;
+
+    Phase phase_ = Phase::Connecting;
+    std::size_t setupStep_ = 0;
+    bool creating_ = false;
+
+    std::array<char, 512> readBuffer_;
+    std::string carry_;
+    std::string outbox_;
+    bool writing_ = false;
+
+    std::uint64_t nextSeq_ = 1;
+    std::atomic<std::uint64_t> awaitingAck_{0};
+    Clock::time_point ackDeadline_;
+    bool awaitingReply_ = false;
+    const Action* pendingAction_ = nullptr;
+    std::uint64_t commandStamp_ = 0;
+};
+
+void Worker::startLoad() {
+    loadStart_ = Clock::now();
+    loadStartNanos_ = run_.nanosNow();
+    if (run_.options.openLoop) {
+        rate_ = run_.options.rate / static_cast<double>(run_.workers.size());
+    } else {
+        for (Connection* connection : senders) {
+            connection->next();
+        }
+    }
+    scheduleTick();
+}
+
+void Worker::stop() {
+    boost::asio::post(io, [this]() {
+        stopping_ = true;
+        ticker_.cancel();
+        for (Connection* connection : connections) {
+            connection->close();
+        }
+        guard_.reset();
+    });
+}
+
+// Open loop releases due actions every millisecond; closed loop only needs
+// to sweep for lost messages
+void Worker::scheduleTick() {
+    ticker_.expires_after(run_.options.openLoop ? std::chrono::milliseconds(1) : std::chrono::milliseconds(100));
+    ticker_.async_wait([this](boost::system::error_code ec) {
+        if (!ec && !stopping_) {
+            tick();
+            scheduleTick();
+        }
+    });
+}
+
+void Worker::tick() {
+    auto now = Clock::now();
+    if (!run_.options.openLoop) {
+        for (Connection* connection : senders) {
+            connection->checkAckTimeout(now);
+        }
+        return;
+    }
+
+    double elapsed = std::chrono::duration<double>(now - loadStart_).count();
+    auto due = static_cast<std::uint64_t>(elapsed * rate_);
+    while (scheduled_ < due) {
+        Connection* connection = nextIdleSender();
+        if (!connection) {
+            break; // every sender is busy; the rest stays due and ages
+        }
+        auto offset = static_cast<std::uint64_t>(static_cast<double>(scheduled_) / rate_ * 1e9);
+        connection->fire(loadStartNanos_ + offset);
+        ++scheduled_;
+    }
+    behind_.store(due - scheduled_, std::memory_order_relaxed);
+}
+
+Connection* Worker::nextIdleSender() {
+    // Bounded scan so a saturated worker does not walk every sender each tick
+    std::size_t limit = std::min<std::size_t>(senders.size(), 1024);
+    for (std::size_t i = 0; i < limit; ++i) {
+        Connection* connection = senders[nextSender_];
+        nextSender_ = (nextSender_ + 1) % senders.size();
+        if (connection->idle()) {
+            return connection;
+        }
+    }
+    return nullptr;
+}
+
+void printUsage() {
+    std::cout <<
+        "Usage: chat_loadgen [options]\n"
+        "  --host ADDR             server address (127.0.0.1)\n"
+        "  --port N                server port (8080)\n"
+        "  --connections N         connections to open (1000)\n"
+        "  --threads N             io threads (half the cores)\n"
+        "  --bind A,B,...          local source addresses, to get past one address's port range\n"
+        "  --connect-rate N        new connections per second (2000)\n"
+        "  --rooms N               rooms lg0..lgN-1 (10)\n"
+        "  --topology T            uniform: connection i joins room i%N\n"
+        "                          zipf: one room each, popularity ~ 1/rank^s\n"
+        "                          overlap: --rooms-per-conn distinct random rooms each\n"
+        "  --rooms-per-conn N      rooms per connection for overlap (2)\n"
+        "  --zipf-s S              zipf exponent (1.0)\n"
+        "  --keep-general          stay in 'general' as well\n"
+        "  --senders F             fraction of connections that send (1.0)\n"
+        "  --open-loop             send at --rate instead of one outstanding action per sender\n"
+        "  --rate N                open loop actions per second, all senders together (1000)\n"
+        "  --think-ms N            closed loop pause after each action (0)\n"
+        "  --ack-timeout-ms N      closed loop wait for a message's first delivery (1000)\n"
+        "  --payload N             chat message size in bytes (64)\n"
+        "  --mix SPEC              weighted actions, e.g. 'msg:90,listrooms:5,listusers:5' (msg:100)\n"
+        "  --warmup S              seconds of load before measuring (5)\n"
+        "  --duration S            seconds measured (30)\n"
+        "  --setup-timeout S       seconds to wait for connections to get ready (120)\n";
+}
+
+std::vector<std::string> split(const std::string& text, char separator) {
+    std::vector<std::string> parts;
+    std::string part;
+    std::istringstream stream(text);
+    while (std::getline(stream, part, separator)) {
+        if (!part.empty()) {
+            parts.push_back(part);
+        }
+    }
+    return parts;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument(arg + " needs a value");
+            }
+            return argv[++i];
+        };
+        if (arg == "--help" || arg == "-h") {
+            printUsage();
+            return false;
+        } else if (arg == "--host") {
+            options.host = value();
+        } else if (arg == "--port") {
+            options.port = static_cast<unsigned short>(std::stoul(value()));
+        } else if (arg == "--connections") {
+            options.connections = std::stoul(value());
+        } else if (arg == "--threads") {
+            options.threads = std::max<std::size_t>(1, std::stoul(value()));
+        } else if (arg == "--bind") {
+            options.bindAddresses = split(value(), ',');
+        } else if (arg == "--connect-rate") {
+            options.connectRate = std::max(1.0, std::stod(value()));
+        } else if (arg == "--rooms") {
+            options.rooms = std::max<std::size_t>(1, std::stoul(value()));
+        } else if (arg == "--topology") {
+            options.topology = value();
+        } else if (arg == "--rooms-per-conn") {
+            options.roomsPerConnection = std::max<std::size_t>(1, std::stoul(value()));
+        } else if (arg == "--zipf-s") {
+            options.zipfExponent = std::stod(value());
+        } else if (arg == "--keep-general") {
+            options.keepGeneral = true;
+        } else if (arg == "--senders") {
+            options.senderFraction = std::min(1.0, std::max(0.0, std::stod(value())));
+        } else if (arg == "--open-loop") {
+            options.openLoop = true;
+        } else if (arg == "--rate") {
+            options.rate = std::max(1.0, std::stod(value()));
+        } else if (arg == "--think-ms") {
+            options.think = std::chrono::milliseconds(std::stoul(value()));
+        } else if (arg == "--ack-timeout-ms") {
+            options.ackTimeout = std::chrono::milliseconds(std::stoul(value()));
+        } else if (arg == "--payload") {
+            options.payloadBytes = std::stoul(value());
+        } else if (arg == "--mix") {
+            options.mix = value();
+        } else if (arg == "--warmup") {
+            options.warmup = std::chrono::seconds(std::stoul(value()));
+        } else if (arg == "--duration") {
+            options.duration = std::chrono::seconds(std::max(1ul, std::stoul(value())));
+        } else if (arg == "--setup-timeout") {
+            options.setupTimeout = std::chrono::seconds(std::stoul(value()));
+        } else {
+            throw std::invalid_argument("unknown option " + arg);
+        }
+    }
+    if (options.topology != "uniform" && options.topology != "zipf" && options.topology != "overlap") {
+        throw std::invalid_argument("unknown topology " + options.topology);
+    }
+    return true;
+}
+
+// "msg:90,listrooms:5" -> actions with cumulative weights
+void buildMix(Run& run) {
+    for (const auto& entry : split(run.options.mix, ',')) {
+        auto colon = entry.rfind(':');
+        Action action;
+        std::string name = entry.substr(0, colon);
+        action.command = name == "msg" ? "" : name;
+        action.weight = colon == std::string::npos ? 1.0 : std::stod(entry.substr(colon + 1));
+        action.latency = std::make_unique<ChatServer::LatencyHistogram>();
+        action.sent = std::make_unique<ChatServer::Counter>();
+        if (action.weight > 0) {
+            run.actions.push_back(std::move(action));
+        }
+    }
+    if (run.actions.empty()) {
+        throw std::invalid_argument("empty mix");
+    }
+    double total = 0;
+    for (const auto& action : run.actions) {
+        total += action.weight;
+        run.actionCdf.push_back(total);
+    }
+}
+
+std::vector<std::vector<std::uint32_t>> assignRooms(const Options& options) {
+    std::vector<std::vector<std::uint32_t>> assignment(options.connections);
+    std::mt19937_64 random(42);
+    auto roomCount = static_cast<std::uint32_t>(options.rooms);
+
+    if (options.topology == "uniform") {
+        for (std::size_t i = 0; i < options.connections; ++i) {
+            assignment[i].push_back(static_cast<std::uint32_t>(i % roomCount));
+        }
+    } else if (options.topology == "zipf") {
+        std::vector<double> weights;
+        for (std::uint32_t rank = 0; rank < roomCount; ++rank) {
+            weights.push_back(1.0 / std::pow(rank + 1.0, options.zipfExponent));
+        }
+        std::discrete_distribution<std::uint32_t> pick(weights.begin(), weights.end());
+        for (auto& rooms : assignment) {
+            rooms.push_back(pick(random));
+        }
+    } else {
+        std::size_t perConnection = std::min<std::size_t>(options.roomsPerConnection, roomCount);
+        std::uniform_int_distribution<std::uint32_t> pick(0, roomCount - 1);
+        for (auto& rooms : assignment) {
+            while (rooms.size() < perConnection) {
+                std::uint32_t room = pick(random);
+                if (std::find(rooms.begin(), rooms.end(), room) == rooms.end()) {
+                    rooms.push_back(room);
+                }
+            }
+        }
+    }
+    return assignment;
+}
+
+// A million sockets need a million descriptors
+void raiseDescriptorLimit(std::size_t wanted) {
+#ifndef _WIN32
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < wanted + 64) {
+        limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, wanted + 64);
+        setrlimit(RLIMIT_NOFILE, &limit);
+        if (limit.rlim_cur < wanted + 64) {
+            std::cerr << "warning: descriptor limit is " << limit.rlim_cur << ", raise it (ulimit -n) for "
+                      << wanted << " connections\n";
+        }
+    }
+#else
+    (void)wanted;
+#endif
+}
+
+void report(Run& run, double seconds) {
+    const Options& options = run.options;
+    Stats& stats = run.stats;
+    std::uint64_t messages = stats.messagesSent.value();
+    std::uint64_t deliveries = stats.deliveries.value();
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "\nchat_loadgen: " << stats.connected.value() << " connections (" << stats.connectFailed.value()
+              << " failed, " << stats.dropped.value() << " dropped), " << options.rooms << " rooms, "
+              << options.topology << ", " << (options.openLoop ? "open" : "closed") << " loop\n";
+    std::cout << "measured " << seconds << " s after " << options.warmup.count() << " s warmup\n";
+    std::cout << "  messages sent   " << std::setw(12) << messages << "  " << messages / seconds << "/s\n";
+    std::cout << "  commands sent   " << std::setw(12) << stats.commandsSent.value() << "  "
+              << stats.commandsSent.value() / seconds << "/s\n";
+    std::cout << "  deliveries      " << std::setw(12) << deliveries << "  " << deliveries / seconds << "/s";
+    if (messages > 0) {
+        std::cout << "  (fan-out " << static_cast<double>(deliveries) / static_cast<double>(messages) << ")";
+    }
+    std::cout << '\n';
+    if (options.openLoop) {
+        std::uint64_t behind = 0;
+        for (const auto& worker : run.workers) {
+            behind += worker->behindSchedule();
+        }
+        std::cout << "  behind schedule " << std::setw(12) << behind << "  (no idle sender at the end)\n";
+    } else {
+        std::cout << "  ack timeouts    " << std::setw(12) << stats.ackTimeouts.value() << '\n';
+    }
+
+    auto delivery = stats.delivery.snapshot();
+    std::cout << "delivery latency, " << delivery.count << " samples\n  " << formatPercentiles(delivery) << '\n';
+    for (const auto& action : run.actions) {
+        if (action.command.empty()) {
+            continue;
+        }
+        auto snapshot = action.latency->snapshot();
+        std::cout << "/" << action.command << " reply latency, " << snapshot.count << " of "
+                  << action.sent->value() << " replied\n  " << formatPercentiles(snapshot) << '\n';
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    try {
+        if (!parseOptions(argc, argv, options)) {
+            return 0;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "chat_loadgen: " << e.what() << "\n";
+        printUsage();
+        return 2;
+    }
+
+    Run run(options);
+    try {
+        buildMix(run);
+    } catch (const std::exception& e) {
+        std::cerr << "chat_loadgen: bad --mix: " << e.what() << "\n";
+        return 2;
+    }
+    raiseDescriptorLimit(options.connections);
+
+    tcp::endpoint server;
+    try {
+        boost::asio::io_context resolverContext;
+        tcp::resolver resolver(resolverContext);
+        server = *resolver.resolve(options.host, std::to_string(options.port)).begin();
+    } catch (const std::exception& e) {
+        std::cerr << "chat_loadgen: cannot resolve " << options.host << ": " << e.what() << "\n";
+        return 1;
+    }
+
+    for (std::size_t i = 0; i < options.rooms; ++i) {
+        run.roomNames.push_back("lg" + std::to_string(i));
+    }
+    for (std::size_t i = 0; i < options.threads; ++i) {
+        run.workers.push_back(std::make_unique<Worker>(run, i));
+    }
+
+    auto assignment = assignRooms(options);
+    auto senderCount = static_cast<std::size_t>(std::ceil(options.senderFraction * options.connections));
+    run.connections.reserve(options.connections);
+    for (std::size_t i = 0; i < options.connections; ++i) {
+        Worker& worker = *run.workers[i % run.workers.size()];
+        run.connections.push_back(std::make_unique<Connection>(run, worker, i, std::move(assignment[i]), i < senderCount));
+        worker.connections.push_back(run.connections.back().get());
+        if (run.connections.back()->sender()) {
+            worker.senders.push_back(run.connections.back().get());
+        }
+    }
+    for (auto& worker : run.workers) {
+        worker->start();
+    }
+
+    // Ramp up at the connect rate, then wait for every connection to settle
+    std::cerr << "connecting " << options.connections << " to " << server << " from " << options.threads
+              << " threads\n";
+    auto rampStart = Clock::now();
+    for (std::size_t i = 0; i < options.connections; ++i) {
+        auto due = rampStart + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(static_cast<double>(i) / options.connectRate));
+        std::this_thread::sleep_until(due);
+        Connection* connection = run.connections[i].get();
+        std::string local = options.bindAddresses.empty() ? "" : options.bindAddresses[i % options.bindAddresses.size()];
+        boost::asio::post(run.workers[i % run.workers.size()]->io, [connection, server, local]() {
+            connection->connect(server, local);
+        });
+    }
+    auto setupDeadline = Clock::now() + options.setupTimeout;
+    while (Clock::now() < setupDeadline) {
+        std::uint64_t settled = run.stats.ready.value() + run.stats.connectFailed.value() + run.stats.dropped.value();
+        std::cerr << "\r  " << run.stats.connected.value() << " connected, " << run.stats.ready.value() << " ready, "
+                  << run.stats.connectFailed.value() << " failed   " << std::flush;
+        if (settled >= options.connections) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    }
+    std::cerr << "\n";
+    if (run.stats.ready.value() == 0) {
+        std::cerr << "chat_loadgen: no connection got ready\n";
+        for (auto& worker : run.workers) {
+            worker->stop();
+            worker->join();
+        }
+        return 1;
+    }
+
+    run.loadStarted.store(true, std::memory_order_release);
+    for (auto& worker : run.workers) {
+        Worker* target = worker.get();
+        boost::asio::post(target->io, [target]() { target->startLoad(); });
+    }
+    std::this_thread::sleep_for(options.warmup);
+
+    // Measured window, with a progress line per second
+    run.recording.store(true, std::memory_order_relaxed);
+    auto windowStart = Clock::now();
+    std::uint64_t lastMessages = 0;
+    std::uint64_t lastDeliveries = 0;
+    for (long second = 1; second <= options.duration.count(); ++second) {
+        std::this_thread::sleep_until(windowStart + std::chrono::seconds(second));
+        std::uint64_t messages = run.stats.messagesSent.value();
+        std::uint64_t deliveries = run.stats.deliveries.value();
+        std::cerr << "[" << std::setw(3) << second << "s] " << (messages - lastMessages) << " msg/s, "
+                  << (deliveries - lastDeliveries) << " deliveries/s, p99 "
+                  << formatNanos(run.stats.delivery.snapshot().quantile(0.99)) << "\n";
+        lastMessages = messages;
+        lastDeliveries = deliveries;
+    }
+    run.recording.store(false, std::memory_order_relaxed);
+    double seconds = std::chrono::duration<double>(Clock::now() - windowStart).count();
+
+    for (auto& worker : run.workers) {
+        worker->stop();
+    }
+    for (auto& worker : run.workers) {
+        worker->join();
+    }
+    report(run, seconds);
+    return 0;
+}
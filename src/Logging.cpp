@@ -21,7 +21,7 @@ Logger& Logger::getInstance() {
 }
 
 void Logger::init(const std::string& logFilePath) {
-    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<ChatServer::ProfiledMutex> lock(mutex);
     if (!initialized) {
         logFile.open(logFilePath, std::ios::app);
         if (!logFile.is_open()) {
@@ -32,7 +32,7 @@ void Logger::init(const std::string& logFilePath) {
 }
 
 void Logger::setLevel(LogLevel level) {
-    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<ChatServer::ProfiledMutex> lock(mutex);
     currentLevel = level;
 }
 
@@ -41,7 +41,7 @@ void Logger::log(LogLevel level, const std::string& message) {
         return;
     }
 
-    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<ChatServer::ProfiledMutex> lock(mutex);
     std::string timestamp = getCurrentTime();
     std::string levelStr = levelToString(level);
     
@@ -110,4 +110,8 @@ void fatal(const std::string& message) {
     detail::Logger::getInstance().log(detail::FATAL_LEVEL, message);
 }
 
+bool debugEnabled() {
+    return detail::Logger::getInstance().isEnabled(detail::DEBUG_LEVEL);
+}
+
 } // namespace Logging
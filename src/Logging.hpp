@@ -7,6 +7,8 @@
 #include <mutex>
 #include <ctime>
 
+#include "ProfiledMutex.hpp"
+
 namespace Logging {
 
 // Simple logging functions
@@ -18,6 +20,9 @@ void warning(const std::string& message);
 void error(const std::string& message);
 void fatal(const std::string& message);
 
+// True when debug messages would be emitted; lets hot paths skip building them
+bool debugEnabled();
+
 // Implementation details
 namespace detail {
 
@@ -34,6 +39,7 @@ public:
     static Logger& getInstance();
     void setLevel(LogLevel level);
     void log(LogLevel level, const std::string& message);
+    bool isEnabled(LogLevel level) const { return level >= currentLevel; }
     void init(const std::string& logFile = "server.log");
 
 private:
@@ -44,7 +50,7 @@ private:
 
     std::ofstream logFile;
     LogLevel currentLevel;
-    std::mutex mutex;
+    ChatServer::ProfiledMutex mutex{"Logger::mutex"};
     bool initialized;
 
     std::string levelToString(LogLevel level);
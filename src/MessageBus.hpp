@@ -0,0 +1,62 @@
+/**
+ * @file MessageBus.hpp
+ * @brief Pluggable pub/sub transport carrying room traffic between server nodes.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace ChatServer {
+
+/**
+ * @brief Carries room broadcasts, and messages for one node, between the
+ * nodes of a cluster.
+ *
+ * Every node serves its own connections and fans a room's messages out to
+ * its own members. A broadcast is published once, by the node that owns the
+ * room and numbers its messages; the bus delivers it once to every other
+ * node, which fans it out locally and keeps the room's recent history under
+ * the owner's sequence numbers. Only the owner stores it persistently.
+ */
+class MessageBus {
+public:
+    // Called on an io thread with a message another node published
+    using DeliveryHandler = std::function<void(const std::string& room, std::uint64_t seq,
+                                               const std::string& senderSessionId, const std::string& message)>;
+    // Called on an io thread with a message another node sent to this one
+    using DirectHandler = std::function<void(const std::string& fromNode, const std::string& payload)>;
+    // Called on an io thread with every node now on the bus, this one included
+    using MembershipHandler = std::function<void(const std::vector<std::string>& nodes)>;
+
+    struct Handlers {
+        DeliveryHandler deliver;
+        DirectHandler direct;
+        MembershipHandler membership;
+    };
+
+    virtual ~MessageBus() = default;
+
+    virtual bool start(Handlers handlers) = 0;
+
+    // Stop publishing and delivering; anything not yet sent is dropped
+    virtual void stop() = 0;
+
+    // This node's name on the bus, unique in the cluster
+    virtual const std::string& nodeId() const = 0;
+
+    // Queue a message for the other nodes. Called under the room lock, so
+    // messages are published in sequence order; must not block.
+    virtual void publish(const std::string& room, std::uint64_t seq, const std::string& senderSessionId,
+                         const std::string& message) = 0;
+
+    // Queue a message for one other node only; must not block. Dropped if
+    // that node is not on the bus. Arrives after everything this node
+    // published or sent to it before.
+    virtual void sendTo(const std::string& node, const std::string& payload) = 0;
+};
+
+} // namespace ChatServer
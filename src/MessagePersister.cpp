@@ -0,0 +1,281 @@
+/**
+ * @file MessagePersister.cpp
+ * @brief Implementation of the MessagePersister group-commit pipeline.
+ */
+
+#include "MessagePersister.hpp"
+#include "Database.hpp"
+#include "PreparedStatement.hpp"
+#include "Logging.hpp"
+#include <exception>
+
+namespace ChatServer {
+
+namespace {
+
+// Same layout as init_database.py, so the server also works on a fresh file.
+const char* const kSchema =
+    "CREATE TABLE IF NOT EXISTS chat_rooms ("
+    "  room_id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "  name TEXT UNIQUE NOT NULL,"
+    "  created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP);"
+    "CREATE TABLE IF NOT EXISTS messages ("
+    "  message_id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "  room_id INTEGER,"
+    "  user_id TEXT,"
+    "  content TEXT,"
+    "  timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP,"
+    "  seq INTEGER,"
+    "  FOREIGN KEY (room_id) REFERENCES chat_rooms(room_id),"
+    "  FOREIGN KEY (user_id) REFERENCES users(user_id));";
+
+// Databases created before per-room sequence numbers get the column, with
+// existing rows numbered per room in insertion order.
+const char* const kHasSeqColumn =
+    "SELECT COUNT(*) FROM pragma_table_info('messages') WHERE name = 'seq'";
+const char* const kAddSeqColumn =
+    "ALTER TABLE messages ADD COLUMN seq INTEGER;"
+    "UPDATE messages SET seq = (SELECT n.rn FROM ("
+    "  SELECT message_id, ROW_NUMBER() OVER (PARTITION BY room_id ORDER BY message_id) AS rn"
+    "  FROM messages) n WHERE n.message_id = messages.message_id);";
+
+// Pages are (room_id, seq) range seeks, never OFFSET scans
+const char* const kSeqIndex =
+    "CREATE INDEX IF NOT EXISTS idx_messages_room_seq ON messages (room_id, seq);";
+
+const char* const kInsertMessage =
+    "INSERT INTO messages (room_id, user_id, content, timestamp, seq) "
+    "VALUES (?, ?, ?, datetime(?, 'unixepoch'), ?)";
+const char* const kInsertRoom = "INSERT OR IGNORE INTO chat_rooms (name) VALUES (?)";
+const char* const kSelectRoom = "SELECT room_id FROM chat_rooms WHERE name = ?";
+
+} // namespace
+
+MessagePersister::MessagePersister(std::shared_ptr<DatabaseExecutor> executor, const PersisterConfig& config)
+    : config_(config),
+      executor_(std::move(executor)),
+      queue_(config.queueCapacity),
+      running_(false),
+      persisted_(0),
+      dropped_(0) {
+    batch_.reserve(config_.maxBatch);
+}
+
+MessagePersister::~MessagePersister() {
+    stop();
+}
+
+bool MessagePersister::start() {
+    if (running_) {
+        return true;
+    }
+
+    bool prepared = false;
+    try {
+        prepared = executor_->write([this](Database& db) { return prepare(db); }).get();
+    } catch (const std::exception& e) {
+        Logging::error(std::string("Message persistence disabled: ") + e.what());
+    }
+    if (!prepared) {
+        return false;
+    }
+
+    running_ = true;
+    batcher_ = std::thread([this]() { run(); });
+    Logging::info("Message persistence started");
+    return true;
+}
+
+void MessagePersister::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+
+    wake_.notify_one();
+    if (batcher_.joinable()) {
+        batcher_.join();
+    }
+
+    // Wait for the last batch to commit before reporting
+    try {
+        executor_->write([](Database&) {}).get();
+    } catch (const std::exception&) {
+    }
+    Logging::info("Message persistence stopped after " + std::to_string(persistedCount()) +
+                  " messages (" + std::to_string(droppedCount()) + " dropped)");
+}
+
+bool MessagePersister::enqueue(StoredMessage message) {
+    if (!running_.load(std::memory_order_relaxed) || !queue_.tryPush(std::move(message))) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Only wake the writer early once a full batch is waiting; otherwise it
+    // picks the message up at the end of its flush window.
+    if (queue_.sizeApprox() == config_.maxBatch) {
+        wake_.notify_one();
+    }
+    return true;
+}
+
+bool MessagePersister::prepare(Database& db) {
+    if (!db.executeQuery(kSchema)) {
+        return false;
+    }
+
+    try {
+        PreparedStatement& hasSeq = db.statement(kHasSeqColumn);
+        StatementReset reset(hasSeq);
+        if (hasSeq.step() && hasSeq.row().int64(0) == 0) {
+            Logging::info("Adding per-room sequence numbers to existing messages");
+            if (!db.executeQuery("BEGIN;")) {
+                return false;
+            }
+            if (!db.executeQuery(kAddSeqColumn) || !db.executeQuery("COMMIT;")) {
+                db.executeQuery("ROLLBACK;");
+                return false;
+            }
+        }
+    } catch (const std::exception& e) {
+        Logging::error(std::string("Failed to migrate messages table: ") + e.what());
+        return false;
+    }
+    if (!db.executeQuery(kSeqIndex)) {
+        return false;
+    }
+
+    // Compile the hot statements up front so a bad schema fails at startup
+    try {
+        db.statement(kInsertMessage);
+        db.statement(kInsertRoom);
+        db.statement(kSelectRoom);
+    } catch (const std::exception& e) {
+        Logging::error(std::string("Failed to prepare persistence statements: ") + e.what());
+        return false;
+    }
+    return true;
+}
+
+void MessagePersister::run() {
+    auto lastFlush = std::chrono::steady_clock::now();
+
+    for (;;) {
+        bool stopping = !running_.load();
+
+        StoredMessage message;
+        while (batch_.size() < config_.maxBatch && queue_.tryPop(message)) {
+            batch_.push_back(std::move(message));
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        bool windowElapsed = now - lastFlush >= config_.flushInterval;
+        if (!batch_.empty() && (batch_.size() >= config_.maxBatch || windowElapsed || stopping)) {
+            flush();
+            lastFlush = now;
+            continue; // more may be queued behind a full batch
+        }
+
+        if (stopping) {
+            break;
+        }
+
+        auto deadline = batch_.empty() ? now + config_.flushInterval : lastFlush + config_.flushInterval;
+        std::unique_lock<std::mutex> lock(wakeMutex_);
+        wake_.wait_until(lock, deadline);
+    }
+}
+
+void MessagePersister::flush() {
+    // One batch in flight at a time: while SQLite is behind, messages wait
+    // in the bounded queue, and are dropped and counted once it is full,
+    // rather than piling up in the writer lane
+    if (inFlight_.valid()) {
+        try {
+            inFlight_.get();
+        } catch (const std::exception& e) {
+            Logging::error(std::string("Message batch failed: ") + e.what());
+        }
+    }
+
+    // The batch travels to the writer connection; keep a fresh buffer here
+    std::vector<StoredMessage> batch;
+    batch.reserve(config_.maxBatch);
+    batch.swap(batch_);
+
+    try {
+        auto shared = std::make_shared<std::vector<StoredMessage>>(std::move(batch));
+        inFlight_ = executor_->write([this, shared](Database& db) { writeBatch(db, *shared); });
+    } catch (const std::exception& e) {
+        Logging::error(std::string("Failed to submit message batch: ") + e.what());
+    }
+}
+
+void MessagePersister::writeBatch(Database& db, const std::vector<StoredMessage>& batch) {
+    if (!db.executeQuery("BEGIN;")) {
+        dropped_.fetch_add(batch.size(), std::memory_order_relaxed);
+        return;
+    }
+
+    PreparedStatement& insert = db.statement(kInsertMessage);
+    std::size_t written = 0;
+    batchIds_.assign(batch.size(), -1);
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        const auto& message = batch[i];
+        std::int64_t id = roomId(db, message.room);
+        if (id < 0) {
+            continue;
+        }
+        try {
+            StatementReset reset(insert);
+            insert.bind(id, message.userId, message.content, message.timestamp, message.seq).step();
+            batchIds_[i] = sqlite3_last_insert_rowid(db.getHandle());
+            ++written;
+        } catch (const std::exception& e) {
+            Logging::error(std::string("Failed to persist message: ") + e.what());
+        }
+    }
+
+    if (db.executeQuery("COMMIT;")) {
+        persisted_.fetch_add(written, std::memory_order_relaxed);
+        dropped_.fetch_add(batch.size() - written, std::memory_order_relaxed);
+        if (storedCallback_) {
+            for (std::size_t i = 0; i < batch.size(); ++i) {
+                if (batchIds_[i] >= 0) {
+                    storedCallback_(batch[i], batchIds_[i]);
+                }
+            }
+        }
+    } else {
+        db.executeQuery("ROLLBACK;");
+        dropped_.fetch_add(batch.size(), std::memory_order_relaxed);
+    }
+}
+
+std::int64_t MessagePersister::roomId(Database& db, const std::string& room) {
+    auto it = roomIds_.find(room);
+    if (it != roomIds_.end()) {
+        return it->second;
+    }
+
+    std::int64_t id = -1;
+    try {
+        PreparedStatement& insert = db.statement(kInsertRoom);
+        {
+            StatementReset reset(insert);
+            insert.bind(room).step();
+        }
+
+        PreparedStatement& select = db.statement(kSelectRoom);
+        StatementReset reset(select);
+        if (select.bind(room).step()) {
+            id = select.row().int64(0);
+            roomIds_.emplace(room, id);
+        }
+    } catch (const std::exception& e) {
+        Logging::error("Failed to resolve room '" + room + "': " + e.what());
+    }
+    return id;
+}
+
+} // namespace ChatServer
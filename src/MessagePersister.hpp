@@ -0,0 +1,106 @@
+/**
+ * @file MessagePersister.hpp
+ * @brief Declaration of the MessagePersister group-commit pipeline.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "LockFreeQueue.hpp"
+#include "DatabaseExecutor.hpp"
+
+namespace ChatServer {
+
+class Database;
+
+/**
+ * @brief A chat message waiting to be written to the messages table.
+ */
+struct StoredMessage {
+    std::string room;
+    std::string userId;
+    std::string content;
+    std::int64_t timestamp = 0; // seconds since the Unix epoch
+    std::uint64_t seq = 0;      // per-room sequence number from ChatRoom
+};
+
+struct PersisterConfig {
+    std::size_t queueCapacity = 65536;
+    std::size_t maxBatch = 512;
+    std::chrono::milliseconds flushInterval{50};
+};
+
+/**
+ * @brief Moves chat messages from io threads to SQLite in batched transactions.
+ *
+ * enqueue() is lock-free and never waits; when the queue is full the message
+ * is dropped and counted. A batching thread drains the queue and hands one
+ * transaction per batch to the executor's writer connection, flushing when
+ * either maxBatch messages are pending or flushInterval has elapsed. It
+ * waits for a batch to commit before handing over the next, so memory stays
+ * bounded by the queue when SQLite falls behind.
+ */
+class MessagePersister {
+public:
+    // Called on the writer connection's thread for each committed message
+    using StoredCallback = std::function<void(const StoredMessage&, std::int64_t messageId)>;
+
+    MessagePersister(std::shared_ptr<DatabaseExecutor> executor,
+                     const PersisterConfig& config = PersisterConfig());
+    ~MessagePersister();
+
+    MessagePersister(const MessagePersister&) = delete;
+    MessagePersister& operator=(const MessagePersister&) = delete;
+
+    // Create the schema and start the batching thread
+    bool start();
+
+    // Flush everything queued so far and stop the batching thread
+    void stop();
+
+    // Queue a message for persistence; returns false if it had to be dropped
+    bool enqueue(StoredMessage message);
+
+    // Install before start()
+    void setStoredCallback(StoredCallback callback) { storedCallback_ = std::move(callback); }
+
+    std::uint64_t persistedCount() const { return persisted_.load(std::memory_order_relaxed); }
+    std::uint64_t droppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    void run();
+    bool prepare(Database& db);
+    void flush();
+    void writeBatch(Database& db, const std::vector<StoredMessage>& batch);
+    std::int64_t roomId(Database& db, const std::string& room);
+
+    PersisterConfig config_;
+    std::shared_ptr<DatabaseExecutor> executor_;
+    LockFreeQueue<StoredMessage> queue_;
+    std::unordered_map<std::string, std::int64_t> roomIds_; // executor writer thread only
+    std::vector<StoredMessage> batch_;                      // batching thread only
+    std::future<void> inFlight_;                            // batching thread only
+    std::vector<std::int64_t> batchIds_;                    // executor writer thread only
+    StoredCallback storedCallback_;
+
+    std::thread batcher_;
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    std::atomic<bool> running_;
+    std::atomic<std::uint64_t> persisted_;
+    std::atomic<std::uint64_t> dropped_;
+};
+
+} // namespace ChatServer
@@ -0,0 +1,297 @@
+/**
+ * @file Metrics.cpp
+ * @brief Implementation of the metrics registry.
+ */
+
+#include "Metrics.hpp"
+#include "Logging.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+namespace ChatServer {
+
+namespace {
+
+std::atomic<std::size_t> nextShard{0};
+
+void writeSample(std::ostringstream& out, const std::string& name, const std::string& labels,
+                 const std::string& extraLabel = "") {
+    out << name;
+    if (!labels.empty() || !extraLabel.empty()) {
+        out << '{' << labels;
+        if (!labels.empty() && !extraLabel.empty()) {
+            out << ',';
+        }
+        out << extraLabel << '}';
+    }
+    out << ' ';
+}
+
+} // namespace
+
+std::size_t metricShard() {
+    thread_local const std::size_t shard = nextShard.fetch_add(1, std::memory_order_relaxed) % kMetricShards;
+    return shard;
+}
+
+std::uint64_t Counter::value() const {
+    std::uint64_t total = 0;
+    for (const auto& slot : shards_) {
+        total += slot.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+Histogram::Histogram(std::vector<double> bounds)
+    : bounds_(std::move(bounds)) {
+    std::sort(bounds_.begin(), bounds_.end());
+    for (auto& shard : shards_) {
+        shard.counts.reset(new std::atomic<std::uint64_t>[bounds_.size() + 1]);
+        for (std::size_t i = 0; i <= bounds_.size(); ++i) {
+            shard.counts[i].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void Histogram::observe(double value) {
+    std::size_t bucket = std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin();
+    Shard& shard = shards_[metricShard()];
+    shard.counts[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    // Shards are per thread, so this loop practically never retries
+    double sum = shard.sum.load(std::memory_order_relaxed);
+    while (!shard.sum.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed)) {
+    }
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot snapshot;
+    snapshot.bounds = bounds_;
+    snapshot.counts.assign(bounds_.size() + 1, 0);
+    for (const auto& shard : shards_) {
+        for (std::size_t i = 0; i <= bounds_.size(); ++i) {
+            std::uint64_t count = shard.counts[i].load(std::memory_order_relaxed);
+            snapshot.counts[i] += count;
+            snapshot.count += count;
+        }
+        snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+LatencyHistogram::~LatencyHistogram() {
+    for (auto& shard : shards_) {
+        delete[] shard.counts.load(std::memory_order_relaxed);
+    }
+}
+
+std::size_t LatencyHistogram::bucketOf(std::uint64_t nanos) {
+    if (nanos < 128) {
+        return static_cast<std::size_t>(nanos);
+    }
+    nanos = std::min<std::uint64_t>(nanos, (std::uint64_t(1) << 36) - 1);
+    int msb = 63 - __builtin_clzll(nanos);
+    int shift = msb - 6;
+    return 128 + static_cast<std::size_t>(msb - 7) * 64 + static_cast<std::size_t>((nanos >> shift) - 64);
+}
+
+std::uint64_t LatencyHistogram::bucketUpper(std::size_t bucket) {
+    if (bucket < 128) {
+        return bucket;
+    }
+    std::size_t octave = (bucket - 128) / 64;
+    std::uint64_t step = bucket - 128 - octave * 64;
+    int shift = static_cast<int>(octave) + 1;
+    return ((64 + step) << shift) + (std::uint64_t(1) << shift) - 1;
+}
+
+void LatencyHistogram::record(std::chrono::nanoseconds elapsed) {
+    std::uint64_t nanos = elapsed.count() > 0 ? static_cast<std::uint64_t>(elapsed.count()) : 0;
+    Shard& shard = shards_[metricShard()];
+    std::atomic<std::uint64_t>* counts = shard.counts.load(std::memory_order_acquire);
+    if (!counts) {
+        auto* fresh = new std::atomic<std::uint64_t>[kBuckets];
+        for (std::size_t i = 0; i < kBuckets; ++i) {
+            fresh[i].store(0, std::memory_order_relaxed);
+        }
+        if (shard.counts.compare_exchange_strong(counts, fresh, std::memory_order_acq_rel)) {
+            counts = fresh;
+        } else {
+            delete[] fresh; // another thread sharing the slot won
+        }
+    }
+
+    counts[bucketOf(nanos)].fetch_add(1, std::memory_order_relaxed);
+    shard.sumNanos.fetch_add(nanos, std::memory_order_relaxed);
+    std::uint64_t max = shard.maxNanos.load(std::memory_order_relaxed);
+    while (nanos > max && !shard.maxNanos.compare_exchange_weak(max, nanos, std::memory_order_relaxed)) {
+    }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+    Snapshot snapshot;
+    snapshot.counts.assign(kBuckets, 0);
+    for (const auto& shard : shards_) {
+        const std::atomic<std::uint64_t>* counts = shard.counts.load(std::memory_order_acquire);
+        if (!counts) {
+            continue;
+        }
+        for (std::size_t i = 0; i < kBuckets; ++i) {
+            std::uint64_t count = counts[i].load(std::memory_order_relaxed);
+            snapshot.counts[i] += count;
+            snapshot.count += count;
+        }
+        snapshot.sumNanos += shard.sumNanos.load(std::memory_order_relaxed);
+        snapshot.maxNanos = std::max(snapshot.maxNanos, shard.maxNanos.load(std::memory_order_relaxed));
+    }
+    return snapshot;
+}
+
+std::uint64_t LatencyHistogram::Snapshot::quantile(double q) const {
+    if (count == 0) {
+        return 0;
+    }
+    auto rank = static_cast<std::uint64_t>(q * static_cast<double>(count));
+    rank = std::min(std::max<std::uint64_t>(rank, 1), count);
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return std::min(bucketUpper(i), maxNanos);
+        }
+    }
+    return maxNanos;
+}
+
+const char* MetricsRegistry::typeName(Type type) {
+    switch (type) {
+    case Type::Counter: return "counter";
+    case Type::Gauge: return "gauge";
+    case Type::Summary: return "summary";
+    default: return "histogram";
+    }
+}
+
+MetricsRegistry& MetricsRegistry::getInstance() {
+    static MetricsRegistry instance;
+    return instance;
+}
+
+MetricsRegistry::Series& MetricsRegistry::series(const std::string& name, const std::string& help, Type type,
+                                                 const std::string& labels) {
+    auto it = families_.find(name);
+    if (it == families_.end()) {
+        it = families_.emplace(name, Family{help, type, {}}).first;
+    } else if (it->second.type != type) {
+        Logging::error("Metric " + name + " registered again with a different type");
+    }
+    return it->second.series[labels];
+}
+
+Counter& MetricsRegistry::counter(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Series& entry = series(name, help, Type::Counter, labels);
+    if (!entry.counter) {
+        entry.counter = std::make_unique<Counter>();
+    }
+    return *entry.counter;
+}
+
+Gauge& MetricsRegistry::gauge(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Series& entry = series(name, help, Type::Gauge, labels);
+    if (!entry.gauge) {
+        entry.gauge = std::make_unique<Gauge>();
+    }
+    return *entry.gauge;
+}
+
+Histogram& MetricsRegistry::histogram(const std::string& name, const std::string& help,
+                                      const std::vector<double>& bounds, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Series& entry = series(name, help, Type::Histogram, labels);
+    if (!entry.histogram) {
+        entry.histogram = std::make_unique<Histogram>(bounds);
+    }
+    return *entry.histogram;
+}
+
+LatencyHistogram& MetricsRegistry::latency(const std::string& name, const std::string& help,
+                                          const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Series& entry = series(name, help, Type::Summary, labels);
+    if (!entry.latency) {
+        entry.latency = std::make_unique<LatencyHistogram>();
+    }
+    return *entry.latency;
+}
+
+void MetricsRegistry::callbackGauge(const std::string& name, const std::string& help,
+                                    std::function<double()> read, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    series(name, help, Type::Gauge, labels).read = std::move(read);
+}
+
+std::string MetricsRegistry::render() const {
+    std::ostringstream out;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& [name, family] : families_) {
+        out << "# HELP " << name << ' ' << family.help << '\n';
+        out << "# TYPE " << name << ' ' << typeName(family.type) << '\n';
+        for (const auto& [labels, entry] : family.series) {
+            if (entry.counter) {
+                writeSample(out, name, labels);
+                out << entry.counter->value() << '\n';
+            } else if (entry.gauge) {
+                writeSample(out, name, labels);
+                out << entry.gauge->value() << '\n';
+            } else if (entry.read) {
+                writeSample(out, name, labels);
+                out << entry.read() << '\n';
+            } else if (entry.histogram) {
+                auto snapshot = entry.histogram->snapshot();
+                std::uint64_t cumulative = 0;
+                for (std::size_t i = 0; i < snapshot.counts.size(); ++i) {
+                    cumulative += snapshot.counts[i];
+                    std::ostringstream le;
+                    le << "le=\"";
+                    if (i < snapshot.bounds.size()) {
+                        le << snapshot.bounds[i];
+                    } else {
+                        le << "+Inf";
+                    }
+                    le << '"';
+                    writeSample(out, name + "_bucket", labels, le.str());
+                    out << cumulative << '\n';
+                }
+                writeSample(out, name + "_sum", labels);
+                out << snapshot.sum << '\n';
+                writeSample(out, name + "_count", labels);
+                out << snapshot.count << '\n';
+            } else if (entry.latency) {
+                auto snapshot = entry.latency->snapshot();
+                for (const char* quantile : {"0.5", "0.9", "0.99", "0.999"}) {
+                    writeSample(out, name, labels, std::string("quantile=\"") + quantile + '"');
+                    out << snapshot.quantile(std::stod(quantile)) * 1e-9 << '\n';
+                }
+                writeSample(out, name + "_sum", labels);
+                out << snapshot.sumNanos * 1e-9 << '\n';
+                writeSample(out, name + "_count", labels);
+                out << snapshot.count << '\n';
+            }
+        }
+    }
+    return out.str();
+}
+
+std::vector<double> MetricsRegistry::exponentialBounds(double start, double factor, std::size_t count) {
+    std::vector<double> bounds;
+    bounds.reserve(count);
+    for (double bound = start; bounds.size() < count; bound *= factor) {
+        bounds.push_back(bound);
+    }
+    return bounds;
+}
+
+} // namespace ChatServer
@@ -0,0 +1,192 @@
+/**
+ * @file Metrics.hpp
+ * @brief Counters, gauges and histograms with Prometheus text export.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ChatServer {
+
+// Number of independent slots a counter is spread over
+constexpr std::size_t kMetricShards = 16;
+
+// The calling thread's slot; threads are assigned round-robin on first use
+std::size_t metricShard();
+
+/**
+ * @brief Monotonic 64-bit counter.
+ *
+ * Each thread adds to its own cache line, so io threads bumping the same
+ * counter never contend. Reading sums the slots.
+ */
+class Counter {
+public:
+    void inc(std::uint64_t n = 1) {
+        shards_[metricShard()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    std::uint64_t value() const;
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<std::uint64_t> value{0};
+    };
+
+    std::array<Slot, kMetricShards> shards_;
+};
+
+/**
+ * @brief Value that can go up and down.
+ */
+class alignas(64) Gauge {
+public:
+    void set(std::int64_t value) { value_.store(value, std::memory_order_relaxed); }
+    void add(std::int64_t delta) { value_.fetch_add(delta, std::memory_order_relaxed); }
+    std::int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<std::int64_t> value_{0};
+};
+
+/**
+ * @brief Distribution over fixed bucket upper bounds, sharded like Counter.
+ */
+class Histogram {
+public:
+    struct Snapshot {
+        std::vector<double> bounds;
+        std::vector<std::uint64_t> counts; // per bucket, the last one is +Inf
+        double sum = 0;
+        std::uint64_t count = 0;
+    };
+
+    explicit Histogram(std::vector<double> bounds);
+
+    void observe(double value);
+
+    Snapshot snapshot() const;
+
+private:
+    struct alignas(64) Shard {
+        std::unique_ptr<std::atomic<std::uint64_t>[]> counts;
+        std::atomic<double> sum{0};
+    };
+
+    std::vector<double> bounds_;
+    std::array<Shard, kMetricShards> shards_;
+};
+
+/**
+ * @brief High-dynamic-range latency distribution in nanoseconds.
+ *
+ * Log-linear buckets as in HdrHistogram: exact below 128 ns, then 64 steps
+ * per power of two, so a value and its bucket differ by under 1/64 (about
+ * 1.6%) up to 2^36 ns (about 69 s); longer values are clamped. Each thread
+ * records into its own bucket array, allocated on its first record, and
+ * scraping merges them.
+ */
+class LatencyHistogram {
+public:
+    static constexpr std::size_t kBuckets = 128 + 29 * 64;
+
+    struct Snapshot {
+        std::vector<std::uint64_t> counts;
+        std::uint64_t count = 0;
+        std::uint64_t sumNanos = 0;
+        std::uint64_t maxNanos = 0;
+
+        // Upper edge of the bucket holding quantile q (0..1), in nanoseconds
+        std::uint64_t quantile(double q) const;
+    };
+
+    LatencyHistogram() = default;
+    ~LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(std::chrono::nanoseconds elapsed);
+
+    Snapshot snapshot() const;
+
+    static std::size_t bucketOf(std::uint64_t nanos);
+    static std::uint64_t bucketUpper(std::size_t bucket);
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<std::atomic<std::uint64_t>*> counts{nullptr};
+        std::atomic<std::uint64_t> sumNanos{0};
+        std::atomic<std::uint64_t> maxNanos{0};
+    };
+
+    std::array<Shard, kMetricShards> shards_;
+};
+
+/**
+ * @brief Named metrics, rendered in the Prometheus text format on scrape.
+ *
+ * Registering takes a lock and returns a reference that stays valid for the
+ * life of the process; hot paths register once and keep the reference.
+ * Updating a metric never locks. Labels are given preformatted, e.g.
+ * command="join".
+ */
+class MetricsRegistry {
+public:
+    static MetricsRegistry& getInstance();
+
+    Counter& counter(const std::string& name, const std::string& help, const std::string& labels = "");
+    Gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+    Histogram& histogram(const std::string& name, const std::string& help, const std::vector<double>& bounds,
+                         const std::string& labels = "");
+
+    // Exported as a summary in seconds with the 0.5, 0.9, 0.99 and 0.999 quantiles
+    LatencyHistogram& latency(const std::string& name, const std::string& help, const std::string& labels = "");
+
+    // Gauge read from a callback at scrape time, for values owned elsewhere
+    void callbackGauge(const std::string& name, const std::string& help, std::function<double()> read,
+                       const std::string& labels = "");
+
+    // All metrics in the Prometheus text exposition format
+    std::string render() const;
+
+    // Bucket bounds growing by factor from start, count of them
+    static std::vector<double> exponentialBounds(double start, double factor, std::size_t count);
+
+private:
+    MetricsRegistry() = default;
+
+    enum class Type { Counter, Gauge, Histogram, Summary };
+
+    struct Series {
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+        std::unique_ptr<LatencyHistogram> latency;
+        std::function<double()> read;
+    };
+
+    struct Family {
+        std::string help;
+        Type type;
+        std::map<std::string, Series> series; // by labels
+    };
+
+    static const char* typeName(Type type);
+    Series& series(const std::string& name, const std::string& help, Type type, const std::string& labels);
+
+    std::map<std::string, Family> families_;
+    mutable std::mutex mutex_;
+};
+
+} // namespace ChatServer
@@ -0,0 +1,606 @@
+/**
+ * @file MicroBench.cpp
+ * @brief chat_microbench: timings of the server's hot paths, written as JSON.
+ *
+ * Each benchmark runs its operation in batches for at least --min-time
+ * seconds per repetition and reports the median ns/op over the repetitions.
+ * Only the batches are timed; setup and cleanup between them are not.
+ *
+ * No sockets are used. Sessions are created on sockets that are never
+ * connected, and their io_context is the sink: a broadcast goes through the
+ * real queueing path in Session::sendFrame, and the queued frames are
+ * dropped by polling that io_context between batches. The write to the
+ * unopened socket fails at once and discards the queue.
+ *
+ * Log output goes to a temporary file and console output is discarded. Only
+ * the logger benchmark runs at INFO; the others run at FATAL, so filtered
+ * log calls cost what they cost in a quiet deployment.
+ *
+ * The history benchmarks run the same workload through each HistoryStore
+ * backend, in a scratch directory under the temp directory: reads and scans
+ * over a preloaded room, then appends timed until they are durable.
+ *
+ * --compare old.json prints each benchmark's change against an earlier run,
+ * so a hot-path redesign can be checked against its parent commit.
+ */
+
+#include "ChatRoom.hpp"
+#include "Command.hpp"
+#include "Commands.hpp"
+#include "DatabaseExecutor.hpp"
+#include "HistoryStore.hpp"
+#include "Logging.hpp"
+#include "Metrics.hpp"
+#include "SegmentLog.hpp"
+#include "Session.hpp"
+#include "SessionManager.hpp"
+#include "ThreadPool.hpp"
+#include "UserManager.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+
+using namespace ChatServer;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Result {
+    std::string name;
+    std::uint64_t operations = 0;   // timed operations over all repetitions
+    double nsPerOp = 0;             // median over repetitions
+    double minNsPerOp = 0;
+    std::map<std::string, double> extra;
+};
+
+class Runner {
+public:
+    Runner(double minSeconds, int repetitions, std::string filter)
+        : minSeconds_(minSeconds), repetitions_(repetitions), filter_(std::move(filter)) {}
+
+    bool selected(const std::string& name) const {
+        return filter_.empty() || name.find(filter_) != std::string::npos;
+    }
+
+    // batch performs opsPerBatch operations; between runs untimed after each batch
+    Result& run(const std::string& name, std::uint64_t opsPerBatch, const std::function<void()>& batch,
+                const std::function<void()>& between = nullptr) {
+        Result result;
+        result.name = name;
+        std::vector<double> perRepetition;
+        for (int repetition = 0; repetition < repetitions_; ++repetition) {
+            Clock::duration timed{};
+            std::uint64_t operations = 0;
+            while (timed < std::chrono::duration<double>(minSeconds_) || operations == 0) {
+                auto started = Clock::now();
+                batch();
+                timed += Clock::now() - started;
+                operations += opsPerBatch;
+                if (between) {
+                    between();
+                }
+            }
+            perRepetition.push_back(std::chrono::duration<double, std::nano>(timed).count() /
+                                    static_cast<double>(operations));
+            result.operations += operations;
+        }
+        std::sort(perRepetition.begin(), perRepetition.end());
+        result.nsPerOp = perRepetition[perRepetition.size() / 2];
+        result.minNsPerOp = perRepetition.front();
+        std::cerr << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(14) << result.nsPerOp << " ns/op\n";
+        results_.push_back(std::move(result));
+        return results_.back();
+    }
+
+    const std::vector<Result>& results() const { return results_; }
+
+private:
+    double minSeconds_;
+    int repetitions_;
+    std::string filter_;
+    std::vector<Result> results_;
+};
+
+// Run fn(thread, i) perThread times on each of threads threads, started together
+void parallel(std::size_t threads, std::uint64_t perThread, const std::function<void(std::size_t, std::uint64_t)>& fn) {
+    std::atomic<bool> go{false};
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            for (std::uint64_t i = 0; i < perThread; ++i) {
+                fn(t, i);
+            }
+        });
+    }
+    go.store(true, std::memory_order_release);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+std::vector<std::size_t> threadCounts() {
+    std::size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::size_t> counts;
+    for (std::size_t threads = 1; threads <= std::max<std::size_t>(cores, 2) && threads <= 16; threads *= 2) {
+        counts.push_back(threads);
+    }
+    return counts;
+}
+
+// Discards everything written to it
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char* /*s*/, std::streamsize n) override { return n; }
+};
+
+/**
+ * @brief Sessions whose sockets never connect, registered with the
+ *        SessionManager under ids bench_0, bench_1, ...
+ */
+class SinkSessions {
+public:
+    ~SinkSessions() {
+        auto sessionManager = SessionManager::getInstance();
+        for (const auto& session : sessions_) {
+            sessionManager->removeSession(session);
+        }
+    }
+
+    void grow(std::size_t count) {
+        auto sessionManager = SessionManager::getInstance();
+        while (sessions_.size() < count) {
+            auto session = std::make_shared<Session>(boost::asio::ip::tcp::socket(io_),
+                                                     "bench_" + std::to_string(sessions_.size()));
+            sessionManager->addSession(session);
+            sessions_.push_back(std::move(session));
+        }
+    }
+
+    // Drop whatever the sessions queued
+    void drain() {
+        io_.restart();
+        io_.poll();
+    }
+
+    std::size_t size() const { return sessions_.size(); }
+    const std::shared_ptr<Session>& operator[](std::size_t i) const { return sessions_[i]; }
+
+private:
+    boost::asio::io_context io_;
+    std::vector<std::shared_ptr<Session>> sessions_;
+};
+
+void setLogLevel(Logging::detail::LogLevel level) {
+    Logging::detail::Logger::getInstance().setLevel(level);
+}
+
+void benchCommands(Runner& runner, SinkSessions& sinks) {
+    auto chatRoomManager = std::make_shared<ChatRoomManager>();
+    auto userManager = std::make_shared<UserManager>();
+    auto commandManager = std::make_shared<CommandManager>(chatRoomManager, userManager);
+    registerCommands(*commandManager, chatRoomManager, userManager, SessionManager::getInstance());
+    for (int i = 0; i < 10; ++i) {
+        chatRoomManager->createChatRoom("room" + std::to_string(i));
+    }
+    sinks.grow(1);
+    auto session = sinks[0];
+    userManager->createUser(session->getSessionId());
+
+    const std::uint64_t batch = 1000;
+    if (runner.selected("parse_command")) {
+        const std::string command = "whisper bench_1 hello there, how are you";
+        runner.run("parse_command", batch, [&]() {
+            for (std::uint64_t i = 0; i < batch; ++i) {
+                auto parsed = commandManager->parseCommand(command);
+                if (parsed.second.empty()) {
+                    std::abort();
+                }
+            }
+        });
+    }
+    for (const char* command : {"listrooms", "nickname benchmarker", "nosuchcommand"}) {
+        std::string name = std::string("process_command/") + std::string(command).substr(0, std::string(command).find(' '));
+        if (!runner.selected(name)) {
+            continue;
+        }
+        runner.run(name, batch, [&]() {
+            for (std::uint64_t i = 0; i < batch; ++i) {
+                if (commandManager->processCommand(session, command).empty()) {
+                    std::abort();
+                }
+            }
+        });
+    }
+}
+
+void benchBroadcast(Runner& runner, SinkSessions& sinks) {
+    for (std::size_t members : {10, 1000, 100000}) {
+        std::string name = "broadcast/members=" + std::to_string(members);
+        if (!runner.selected(name)) {
+            continue;
+        }
+        sinks.grow(members);
+        ChatRoom room("bench_" + std::to_string(members));
+        for (std::size_t i = 0; i < members; ++i) {
+            room.addSession(sinks[i]->getSessionId());
+        }
+        const std::string message = "[bench_0]: the quick brown fox jumps over the lazy dog";
+        std::uint64_t batch = std::max<std::uint64_t>(1, 10000 / members);
+        auto& result = runner.run(name, batch, [&]() {
+            for (std::uint64_t i = 0; i < batch; ++i) {
+                room.broadcastMessage(message, "bench_0");
+            }
+        }, [&]() { sinks.drain(); });
+        result.extra["ns_per_recipient"] = result.nsPerOp / static_cast<double>(members - 1);
+    }
+}
+
+void benchGetSession(Runner& runner, SinkSessions& sinks) {
+    sinks.grow(10000);
+    auto sessionManager = SessionManager::getInstance();
+    std::vector<std::string> ids;
+    std::mt19937 random(7);
+    for (int i = 0; i < 4096; ++i) {
+        ids.push_back("bench_" + std::to_string(std::uniform_int_distribution<std::size_t>(0, 9999)(random)));
+    }
+
+    for (std::size_t threads : threadCounts()) {
+        std::string name = "get_session/threads=" + std::to_string(threads);
+        if (!runner.selected(name)) {
+            continue;
+        }
+        const std::uint64_t perThread = 20000;
+        auto& result = runner.run(name, perThread * threads, [&]() {
+            parallel(threads, perThread, [&](std::size_t t, std::uint64_t i) {
+                if (!sessionManager->getSession(ids[(i + t * 997) & 4095])) {
+                    std::abort();
+                }
+            });
+        });
+        result.extra["ops_per_sec"] = 1e9 / result.nsPerOp;
+    }
+}
+
+void benchLogger(Runner& runner) {
+    auto& logger = Logging::detail::Logger::getInstance();
+    const std::string message = "Message broadcast in room general by session session_42";
+    for (std::size_t threads : threadCounts()) {
+        std::string name = "logger_log/threads=" + std::to_string(threads);
+        if (!runner.selected(name)) {
+            continue;
+        }
+        setLogLevel(Logging::detail::INFO_LEVEL);
+        const std::uint64_t perThread = 2000;
+        auto& result = runner.run(name, perThread * threads, [&]() {
+            parallel(threads, perThread, [&](std::size_t, std::uint64_t) {
+                logger.log(Logging::detail::INFO_LEVEL, message);
+            });
+        });
+        result.extra["lines_per_sec"] = 1e9 / result.nsPerOp;
+        setLogLevel(Logging::detail::FATAL_LEVEL);
+    }
+    if (runner.selected("logger_log_filtered")) {
+        const std::uint64_t batch = 100000;
+        runner.run("logger_log_filtered", batch, [&]() {
+            for (std::uint64_t i = 0; i < batch; ++i) {
+                logger.log(Logging::detail::INFO_LEVEL, message);
+            }
+        });
+    }
+}
+
+void benchThreadPool(Runner& runner) {
+    if (!runner.selected("threadpool_enqueue")) {
+        return;
+    }
+    ThreadPool pool(4);
+    LatencyHistogram startLatency;
+    std::vector<std::future<void>> futures;
+    const std::uint64_t batch = 1000;
+    futures.reserve(batch);
+
+    // Timed: the enqueue calls. Recorded by the tasks: enqueue-to-start delay.
+    auto& result = runner.run("threadpool_enqueue", batch, [&]() {
+        for (std::uint64_t i = 0; i < batch; ++i) {
+            auto submitted = Clock::now();
+            futures.push_back(pool.enqueue([&startLatency, submitted]() {
+                startLatency.record(Clock::now() - submitted);
+            }));
+        }
+    }, [&]() {
+        for (auto& future : futures) {
+            future.wait();
+        }
+        futures.clear();
+    });
+    auto snapshot = startLatency.snapshot();
+    result.extra["start_p50_ns"] = static_cast<double>(snapshot.quantile(0.5));
+    result.extra["start_p99_ns"] = static_cast<double>(snapshot.quantile(0.99));
+    result.extra["start_p999_ns"] = static_cast<double>(snapshot.quantile(0.999));
+}
+
+// Counts what a history store has made durable
+class StoredCounter : public HistoryObserver {
+public:
+    void messageStored(const std::string&, const HistoryEntry&) override {
+        stored_.fetch_add(1, std::memory_order_release);
+    }
+
+    void waitFor(std::uint64_t count) const {
+        while (stored_.load(std::memory_order_acquire) < count) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+private:
+    std::atomic<std::uint64_t> stored_{0};
+};
+
+void benchHistoryStore(Runner& runner, HistoryStore& store, const std::string& backend) {
+    const std::string room = "bench";
+    const std::uint64_t preload = 100000;
+    const std::string content(64, 'm');
+    auto counter = std::make_shared<StoredCounter>();
+    store.setObserver(counter);
+    std::uint64_t seq = 0;
+    std::uint64_t accepted = 0;
+    auto appendBatch = [&](std::uint64_t count) {
+        auto timestamp = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        for (std::uint64_t i = 0; i < count; ++i) {
+            if (!store.append({room, "bench_user", content, timestamp, ++seq})) {
+                std::this_thread::yield(); // queue full: let the writer catch up
+                --seq;
+                --i;
+                continue;
+            }
+            ++accepted;
+        }
+        counter->waitFor(accepted);
+    };
+    appendBatch(preload);
+
+    std::string name = "history_read_before/backend=" + backend;
+    if (runner.selected(name)) {
+        const std::uint64_t batch = 100;
+        const std::size_t limit = 50;
+        std::mt19937_64 random(42);
+        std::uniform_int_distribution<std::uint64_t> before(limit + 1, preload);
+        std::uint64_t visited = 0;
+        auto& result = runner.run(name, batch, [&]() {
+            for (std::uint64_t i = 0; i < batch; ++i) {
+                store.readBefore(room, before(random), limit, [&visited](const HistoryEntry&) { ++visited; });
+            }
+        });
+        result.extra["entries_per_read"] = static_cast<double>(visited) / static_cast<double>(result.operations);
+    }
+
+    // One operation per message visited
+    name = "history_scan/backend=" + backend;
+    if (runner.selected(name)) {
+        std::size_t visited = 0;
+        runner.run(name, preload, [&]() {
+            visited = 0;
+            store.scan([&visited](const std::string&, const HistoryEntry&) { ++visited; });
+            if (visited != preload) {
+                std::abort();
+            }
+        });
+    }
+
+    // Appends are counted once the store reports them durable
+    name = "history_append/backend=" + backend;
+    if (runner.selected(name)) {
+        const std::uint64_t batch = 8192;
+        auto& result = runner.run(name, batch, [&]() { appendBatch(batch); });
+        result.extra["messages_per_sec"] = 1e9 / result.nsPerOp;
+    }
+}
+
+void benchHistory(Runner& runner) {
+    bool any = false;
+    for (const char* backend : {"sqlite", "segment"}) {
+        for (const char* bench : {"history_read_before", "history_scan", "history_append"}) {
+            any = any || runner.selected(std::string(bench) + "/backend=" + backend);
+        }
+    }
+    if (!any) {
+        return;
+    }
+    auto directory = std::filesystem::temp_directory_path() / "chat_microbench_history";
+    std::error_code ignored;
+    std::filesystem::remove_all(directory, ignored);
+    std::filesystem::create_directories(directory);
+
+    {
+        DatabaseConfig config;
+        config.dbFile = (directory / "chat.db").string();
+        auto executor = std::make_shared<DatabaseExecutor>(config);
+        SqliteHistoryStore store(executor);
+        if (executor->start() && store.start()) {
+            benchHistoryStore(runner, store, store.backendName());
+            store.stop();
+        }
+        executor->stop();
+    }
+    {
+        SegmentLogConfig config;
+        config.directory = (directory / "segments").string();
+        SegmentLogStore store(config);
+        if (store.start()) {
+            benchHistoryStore(runner, store, store.backendName());
+            store.stop();
+        }
+    }
+    std::filesystem::remove_all(directory, ignored);
+}
+
+std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped.push_back('\\');
+        }
+        escaped.push_back(c);
+    }
+    return escaped;
+}
+
+// One benchmark per line, so --compare can read it back without a JSON parser
+void writeJson(std::ostream& out, const std::vector<Result>& results) {
+    auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    std::ostringstream date;
+    date << std::put_time(std::gmtime(&now), "%Y-%m-%dT%H:%M:%SZ");
+
+    out << "{\n";
+    out << "  \"context\": {\"date\": \"" << date.str() << "\", \"cpus\": " << std::thread::hardware_concurrency()
+#ifdef CHAT_LOCK_PROFILING
+        << ", \"lock_profiling\": true"
+#else
+        << ", \"lock_profiling\": false"
+#endif
+#ifdef NDEBUG
+        << ", \"build\": \"release\""
+#else
+        << ", \"build\": \"debug\""
+#endif
+        << "},\n";
+    out << "  \"benchmarks\": [\n";
+    out << std::fixed << std::setprecision(2);
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        out << "    {\"name\": \"" << jsonEscape(result.name) << "\", \"ns_per_op\": " << result.nsPerOp
+            << ", \"min_ns_per_op\": " << result.minNsPerOp << ", \"operations\": " << result.operations;
+        for (const auto& [key, value] : result.extra) {
+            out << ", \"" << key << "\": " << value;
+        }
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+std::map<std::string, double> readBaseline(const std::string& path) {
+    std::map<std::string, double> baseline;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        auto name = line.find("\"name\": \"");
+        auto ns = line.find("\"ns_per_op\": ");
+        if (name == std::string::npos || ns == std::string::npos) {
+            continue;
+        }
+        name += 9;
+        baseline[line.substr(name, line.find('"', name) - name)] = std::stod(line.substr(ns + 13));
+    }
+    return baseline;
+}
+
+void printComparison(const std::vector<Result>& results, const std::map<std::string, double>& baseline) {
+    std::cerr << "\n" << std::left << std::setw(36) << "benchmark" << std::right << std::setw(14) << "before"
+              << std::setw(14) << "after" << std::setw(10) << "change\n";
+    for (const Result& result : results) {
+        auto it = baseline.find(result.name);
+        if (it == baseline.end()) {
+            continue;
+        }
+        double change = (result.nsPerOp - it->second) / it->second * 100.0;
+        std::cerr << std::left << std::setw(36) << result.name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(14) << it->second << std::setw(14) << result.nsPerOp << std::showpos
+                  << std::setw(9) << change << "%" << std::noshowpos << "\n";
+    }
+}
+
+void printUsage() {
+    std::cerr <<
+        "Usage: chat_microbench [options]\n"
+        "  --filter TEXT       run only benchmarks whose name contains TEXT\n"
+        "  --min-time S        seconds per repetition (0.5)\n"
+        "  --repetitions N     repetitions, the median is reported (3)\n"
+        "  --out FILE          write JSON to FILE instead of stdout\n"
+        "  --compare FILE      print the change against an earlier JSON result\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    double minSeconds = 0.5;
+    int repetitions = 3;
+    std::string filter;
+    std::string outPath;
+    std::string comparePath;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h" || i + 1 >= argc) {
+            printUsage();
+            return arg == "--help" || arg == "-h" ? 0 : 2;
+        }
+        std::string value = argv[++i];
+        if (arg == "--filter") {
+            filter = value;
+        } else if (arg == "--min-time") {
+            minSeconds = std::stod(value);
+        } else if (arg == "--repetitions") {
+            repetitions = std::max(1, std::stoi(value));
+        } else if (arg == "--out") {
+            outPath = value;
+        } else if (arg == "--compare") {
+            comparePath = value;
+        } else {
+            printUsage();
+            return 2;
+        }
+    }
+
+    // The server logs to the console and a file; keep both out of the way
+    auto logPath = std::filesystem::temp_directory_path() / "chat_microbench.log";
+    Logging::init_logging(logPath.string());
+    setLogLevel(Logging::detail::FATAL_LEVEL);
+    NullBuffer nullBuffer;
+    std::streambuf* console = std::cout.rdbuf(&nullBuffer);
+
+    Runner runner(minSeconds, repetitions, filter);
+    {
+        SinkSessions sinks;
+        benchCommands(runner, sinks);
+        benchBroadcast(runner, sinks);
+        benchGetSession(runner, sinks);
+        benchLogger(runner);
+        benchThreadPool(runner);
+        benchHistory(runner);
+        sinks.drain();
+    }
+    std::cout.rdbuf(console);
+    std::error_code ignored;
+    std::filesystem::remove(logPath, ignored);
+
+    if (outPath.empty()) {
+        writeJson(std::cout, runner.results());
+    } else {
+        std::ofstream out(outPath);
+        writeJson(out, runner.results());
+    }
+    if (!comparePath.empty()) {
+        printComparison(runner.results(), readBaseline(comparePath));
+    }
+    return 0;
+}
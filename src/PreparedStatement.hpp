@@ -2,13 +2,57 @@
 #define PREPAREDSTATEMENT_HPP
 
 #include <sqlite3.h>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <stdexcept>
+#include <utility>
 
+/**
+ * @brief Borrowed binary value for binding or reading BLOB columns.
+ */
+struct Blob {
+    const void* data = nullptr;
+    std::size_t size = 0;
+};
+
+/**
+ * @brief A column-by-column view of the current result row.
+ *
+ * Text and blob values point into SQLite's row buffer and are only valid
+ * until the statement is stepped again or reset.
+ */
+class Row {
+public:
+    explicit Row(sqlite3_stmt* stmt) : stmt(stmt) {}
+
+    std::string_view text(int column) const {
+        auto data = reinterpret_cast<const char*>(sqlite3_column_text(stmt, column));
+        return data ? std::string_view(data, sqlite3_column_bytes(stmt, column)) : std::string_view();
+    }
+    std::int64_t int64(int column) const { return sqlite3_column_int64(stmt, column); }
+    Blob blob(int column) const {
+        const void* data = sqlite3_column_blob(stmt, column);
+        return {data, static_cast<std::size_t>(sqlite3_column_bytes(stmt, column))};
+    }
+    bool isNull(int column) const { return sqlite3_column_type(stmt, column) == SQLITE_NULL; }
+
+private:
+    sqlite3_stmt* stmt;
+};
+
+/**
+ * @brief RAII wrapper for a compiled SQLite statement with typed binding.
+ *
+ * Strings and blobs are bound without copying (SQLITE_STATIC), so the bound
+ * data must outlive the following step()/reset(). A statement is reused by
+ * calling reset() rather than preparing the SQL again.
+ */
 class PreparedStatement {
 public:
-    PreparedStatement(sqlite3* db, const std::string& query) : stmt(nullptr) {
-        if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    PreparedStatement(sqlite3* db, const std::string& query) : db(db), sql(query), stmt(nullptr) {
+        if (sqlite3_prepare_v2(db, sql.c_str(), static_cast<int>(sql.size()), &stmt, nullptr) != SQLITE_OK) {
             throw std::runtime_error(sqlite3_errmsg(db));
         }
     }
@@ -17,9 +61,110 @@ public:
             sqlite3_finalize(stmt);
         }
     }
+    PreparedStatement(const PreparedStatement&) = delete;
+    PreparedStatement& operator=(const PreparedStatement&) = delete;
+
     sqlite3_stmt* get() { return stmt; }
+    const std::string& getSql() const { return sql; }
+
+    // Bind every argument in order to parameters 1..N
+    template <typename... Args>
+    PreparedStatement& bind(const Args&... args) {
+        int index = 1;
+        int results[] = {0, (bindAt(index++, args), 0)...};
+        (void)results;
+        return *this;
+    }
+
+    PreparedStatement& bindAt(int index, std::string_view value) {
+        check(sqlite3_bind_text(stmt, index, value.data(), static_cast<int>(value.size()), SQLITE_STATIC));
+        return *this;
+    }
+    PreparedStatement& bindAt(int index, const std::string& value) {
+        return bindAt(index, std::string_view(value));
+    }
+    PreparedStatement& bindAt(int index, const char* value) {
+        return bindAt(index, std::string_view(value));
+    }
+    PreparedStatement& bindAt(int index, int value) {
+        check(sqlite3_bind_int(stmt, index, value));
+        return *this;
+    }
+    PreparedStatement& bindAt(int index, std::int64_t value) {
+        check(sqlite3_bind_int64(stmt, index, value));
+        return *this;
+    }
+    PreparedStatement& bindAt(int index, std::uint64_t value) {
+        return bindAt(index, static_cast<std::int64_t>(value));
+    }
+    PreparedStatement& bindAt(int index, double value) {
+        check(sqlite3_bind_double(stmt, index, value));
+        return *this;
+    }
+    PreparedStatement& bindAt(int index, const Blob& value) {
+        check(sqlite3_bind_blob(stmt, index, value.data, static_cast<int>(value.size), SQLITE_STATIC));
+        return *this;
+    }
+    PreparedStatement& bindAt(int index, std::nullptr_t) {
+        check(sqlite3_bind_null(stmt, index));
+        return *this;
+    }
+
+    /**
+     * @brief Advance to the next row.
+     * @return true if a row is available, false once the statement is done
+     */
+    bool step() {
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW) {
+            return true;
+        }
+        if (rc == SQLITE_DONE) {
+            return false;
+        }
+        throw std::runtime_error(sqlite3_errmsg(db));
+    }
+
+    Row row() const { return Row(stmt); }
+
+    // Step through every result row, handing each to f as a Row
+    template <typename F>
+    void forEachRow(F&& f) {
+        while (step()) {
+            f(row());
+        }
+    }
+
+    // Make the statement reusable and drop references to bound buffers
+    void reset() {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+
 private:
+    void check(int rc) {
+        if (rc != SQLITE_OK) {
+            throw std::runtime_error(sqlite3_errmsg(db));
+        }
+    }
+
+    sqlite3* db;
+    std::string sql;
     sqlite3_stmt* stmt;
 };
 
+/**
+ * @brief Resets a statement when leaving scope, even on exceptions.
+ */
+class StatementReset {
+public:
+    explicit StatementReset(PreparedStatement& statement) : statement(statement) {}
+    ~StatementReset() { statement.reset(); }
+    StatementReset(const StatementReset&) = delete;
+    StatementReset& operator=(const StatementReset&) = delete;
+
+private:
+    PreparedStatement& statement;
+};
+
 #endif // PREPAREDSTATEMENT_HPP
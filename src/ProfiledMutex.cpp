@@ -0,0 +1,140 @@
+/**
+ * @file ProfiledMutex.cpp
+ * @brief Implementation of the profiling mutex.
+ */
+
+#include "ProfiledMutex.hpp"
+
+#ifdef CHAT_LOCK_PROFILING
+
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+namespace ChatServer {
+
+namespace {
+
+std::mutex statsMutex;
+
+std::map<std::string, std::unique_ptr<LockStats>>& allStats() {
+    static std::map<std::string, std::unique_ptr<LockStats>> stats;
+    return stats;
+}
+
+LockStats* statsFor(const char* name) {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    auto& entry = allStats()[name];
+    if (!entry) {
+        auto& metrics = MetricsRegistry::getInstance();
+        std::string labels = std::string("lock=\"") + name + "\"";
+        entry = std::make_unique<LockStats>();
+        entry->name = name;
+        entry->acquisitions = &metrics.counter("chat_lock_acquisitions_total",
+                                               "Profiled mutex acquisitions", labels);
+        entry->contended = &metrics.counter("chat_lock_contended_total",
+                                            "Profiled mutex acquisitions that had to wait", labels);
+        entry->wait = &metrics.latency("chat_lock_wait_seconds",
+                                       "Time spent waiting for a contended mutex", labels);
+        entry->hold = &metrics.latency("chat_lock_hold_seconds", "Time a mutex was held", labels);
+    }
+    return entry.get();
+}
+
+} // namespace
+
+std::atomic<bool> ProfiledMutex::enabled_{false};
+
+ProfiledMutex::ProfiledMutex(const char* name)
+    : stats_(statsFor(name)) {}
+
+void ProfiledMutex::lock() {
+    if (!enabled()) {
+        mutex_.lock();
+        acquiredAt_ = std::chrono::steady_clock::time_point();
+        return;
+    }
+
+    if (mutex_.try_lock()) {
+        acquiredAt_ = std::chrono::steady_clock::now();
+    } else {
+        auto waitStart = std::chrono::steady_clock::now();
+        mutex_.lock();
+        acquiredAt_ = std::chrono::steady_clock::now();
+        stats_->contended->inc();
+        stats_->wait->record(acquiredAt_ - waitStart);
+    }
+    stats_->acquisitions->inc();
+}
+
+bool ProfiledMutex::try_lock() {
+    if (!mutex_.try_lock()) {
+        return false;
+    }
+    if (enabled()) {
+        acquiredAt_ = std::chrono::steady_clock::now();
+        stats_->acquisitions->inc();
+    } else {
+        acquiredAt_ = std::chrono::steady_clock::time_point();
+    }
+    return true;
+}
+
+void ProfiledMutex::unlock() {
+    auto acquiredAt = acquiredAt_;
+    mutex_.unlock();
+    if (acquiredAt != std::chrono::steady_clock::time_point()) {
+        stats_->hold->record(std::chrono::steady_clock::now() - acquiredAt);
+    }
+}
+
+void ProfiledMutex::setEnabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+std::string ProfiledMutex::report(std::size_t top) {
+    struct Row {
+        const LockStats* stats;
+        LatencyHistogram::Snapshot wait;
+        LatencyHistogram::Snapshot hold;
+    };
+
+    std::vector<Row> rows;
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        for (const auto& entry : allStats()) {
+            rows.push_back({entry.second.get(), entry.second->wait->snapshot(), entry.second->hold->snapshot()});
+        }
+    }
+    std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
+        return a.wait.sumNanos > b.wait.sumNanos;
+    });
+    if (rows.size() > top) {
+        rows.resize(top);
+    }
+
+    std::ostringstream out;
+    out << (enabled() ? "Lock profiling is on\n" : "Lock profiling is off (set CHAT_LOCK_PROFILING=1)\n");
+    out << std::left << std::setw(28) << "lock" << std::right
+        << std::setw(14) << "acquisitions" << std::setw(12) << "contended"
+        << std::setw(14) << "wait total ms" << std::setw(14) << "wait p99 us"
+        << std::setw(14) << "hold p99 us" << '\n';
+    for (const auto& row : rows) {
+        out << std::left << std::setw(28) << row.stats->name << std::right
+            << std::setw(14) << row.stats->acquisitions->value()
+            << std::setw(12) << row.stats->contended->value()
+            << std::setw(14) << std::fixed << std::setprecision(3) << row.wait.sumNanos / 1e6
+            << std::setw(14) << std::setprecision(1) << row.wait.quantile(0.99) / 1e3
+            << std::setw(14) << row.hold.quantile(0.99) / 1e3 << '\n';
+    }
+    return out.str();
+}
+
+} // namespace ChatServer
+
+#endif // CHAT_LOCK_PROFILING
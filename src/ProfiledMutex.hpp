@@ -0,0 +1,80 @@
+/**
+ * @file ProfiledMutex.hpp
+ * @brief Mutex that records acquisitions, contention and hold times per name.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+namespace ChatServer {
+
+class Counter;
+class LatencyHistogram;
+
+/**
+ * @brief Statistics shared by every mutex with the same name.
+ */
+struct LockStats {
+    std::string name;
+    Counter* acquisitions;
+    Counter* contended;
+    LatencyHistogram* wait;   // only acquisitions that had to wait
+    LatencyHistogram* hold;
+};
+
+#ifdef CHAT_LOCK_PROFILING
+
+/**
+ * @brief Drop-in std::mutex replacement that can profile itself.
+ *
+ * Profiling is off until setEnabled(true); until then lock() costs one
+ * relaxed load more than std::mutex. When on, an uncontended lock adds two
+ * clock reads (for the hold time) and a contended one also records how long
+ * it waited. Statistics are exported through the metrics registry with a
+ * lock="<name>" label.
+ */
+class ProfiledMutex {
+public:
+    explicit ProfiledMutex(const char* name);
+
+    ProfiledMutex(const ProfiledMutex&) = delete;
+    ProfiledMutex& operator=(const ProfiledMutex&) = delete;
+
+    void lock();
+    bool try_lock();
+    void unlock();
+
+    static void setEnabled(bool enabled);
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    // The top locks by total time spent waiting for them, one per line
+    static std::string report(std::size_t top);
+
+private:
+    std::mutex mutex_;
+    LockStats* stats_;
+    std::chrono::steady_clock::time_point acquiredAt_; // default when acquired unprofiled
+
+    static std::atomic<bool> enabled_;
+};
+
+#else
+
+// Profiling compiled out: a plain std::mutex that accepts a name
+class ProfiledMutex : public std::mutex {
+public:
+    explicit ProfiledMutex(const char* /*name*/) {}
+
+    static void setEnabled(bool /*enabled*/) {}
+    static bool enabled() { return false; }
+    static std::string report(std::size_t /*top*/) { return "Lock profiling is not compiled in\n"; }
+};
+
+#endif
+
+} // namespace ChatServer
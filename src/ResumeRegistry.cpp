@@ -0,0 +1,318 @@
+/**
+ * @file ResumeRegistry.cpp
+ * @brief Implementation of the resume token registry.
+ */
+
+#include "ResumeRegistry.hpp"
+#include "StateStore.hpp"
+#include "Logging.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <bcrypt.h>
+#elif defined(__linux__)
+#include <cerrno>
+#include <sys/random.h>
+#else
+#include <fstream>
+#endif
+
+namespace ChatServer {
+
+namespace {
+
+// Fill buffer from the operating system's CSPRNG. Tokens are bearer
+// credentials, so there is no fallback to a weaker generator.
+bool secureRandom(unsigned char* buffer, std::size_t size) {
+#ifdef _WIN32
+    return BCryptGenRandom(nullptr, buffer, static_cast<ULONG>(size), BCRYPT_USE_SYSTEM_PREFERRED_RNG) >= 0;
+#elif defined(__linux__)
+    while (size > 0) {
+        ssize_t got = getrandom(buffer, size, 0);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buffer += got;
+        size -= static_cast<std::size_t>(got);
+    }
+    return true;
+#else
+    std::ifstream device("/dev/urandom", std::ios::binary);
+    return device.read(reinterpret_cast<char*>(buffer), static_cast<std::streamsize>(size)).good();
+#endif
+}
+
+std::uint32_t rotateRight(std::uint32_t value, int bits) {
+    return (value >> bits) | (value << (32 - bits));
+}
+
+// FIPS 180-4 SHA-256; tokens are short, so this favours size over speed
+void sha256(const std::string& message, unsigned char digest[32]) {
+    static const std::uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+    std::uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                              0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+    // Pad to a whole number of 64-byte blocks: 0x80, zeros, then the bit length
+    std::string data = message;
+    std::uint64_t bitLength = static_cast<std::uint64_t>(message.size()) * 8;
+    data.push_back(static_cast<char>(0x80));
+    while (data.size() % 64 != 56) {
+        data.push_back('\0');
+    }
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        data.push_back(static_cast<char>((bitLength >> shift) & 0xff));
+    }
+
+    for (std::size_t block = 0; block < data.size(); block += 64) {
+        std::uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            const auto* bytes = reinterpret_cast<const unsigned char*>(data.data() + block + 4 * i);
+            w[i] = (std::uint32_t(bytes[0]) << 24) | (std::uint32_t(bytes[1]) << 16) |
+                   (std::uint32_t(bytes[2]) << 8) | std::uint32_t(bytes[3]);
+        }
+        for (int i = 16; i < 64; ++i) {
+            std::uint32_t s0 = rotateRight(w[i - 15], 7) ^ rotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            std::uint32_t s1 = rotateRight(w[i - 2], 17) ^ rotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        std::uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        std::uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            std::uint32_t s1 = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+            std::uint32_t choice = (e & f) ^ (~e & g);
+            std::uint32_t t1 = h + s1 + choice + k[i] + w[i];
+            std::uint32_t s0 = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+            std::uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            std::uint32_t t2 = s0 + majority;
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+
+    for (int i = 0; i < 8; ++i) {
+        digest[4 * i] = static_cast<unsigned char>(state[i] >> 24);
+        digest[4 * i + 1] = static_cast<unsigned char>(state[i] >> 16);
+        digest[4 * i + 2] = static_cast<unsigned char>(state[i] >> 8);
+        digest[4 * i + 3] = static_cast<unsigned char>(state[i]);
+    }
+}
+
+std::string toHex(const unsigned char* bytes, std::size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(2 * size);
+    for (std::size_t i = 0; i < size; ++i) {
+        hex.push_back(digits[bytes[i] >> 4]);
+        hex.push_back(digits[bytes[i] & 0x0f]);
+    }
+    return hex;
+}
+
+} // namespace
+
+std::string ResumeRegistry::hashToken(const std::string& token) {
+    unsigned char digest[32];
+    sha256(token, digest);
+    return toHex(digest, sizeof(digest));
+}
+
+ResumeRegistry::ResumeRegistry(const ResumeConfig& config)
+    : config_(config) {}
+
+std::string ResumeRegistry::issue(const std::string& sessionId, const Session* owner) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Identity& identity = identities_[sessionId];
+    if (!identity.tokenHash.empty()) {
+        tokens_.erase(identity.tokenHash);
+    }
+    std::string token = newToken();
+    identity.tokenHash = hashToken(token);
+    identity.state = State::Pending;
+    identity.owner = owner;
+    tokens_[identity.tokenHash] = sessionId;
+    if (journal_) {
+        journal_->identityIssued(sessionId, identity.tokenHash);
+    }
+    return token;
+}
+
+bool ResumeRegistry::settle(const std::string& sessionId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = identities_.find(sessionId);
+    if (it == identities_.end() || it->second.state != State::Pending) {
+        return false;
+    }
+    it->second.state = State::Active;
+    return true;
+}
+
+bool ResumeRegistry::park(const std::string& sessionId, const Session* owner,
+                          const std::function<void(RoomSeqs&)>& suspend) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = identities_.find(sessionId);
+    if (it == identities_.end() || it->second.owner != owner || it->second.state == State::Parked) {
+        return false;
+    }
+
+    Identity& identity = it->second;
+    identity.lastSeqs.clear();
+    suspend(identity.lastSeqs);
+    identity.state = State::Parked;
+    identity.owner = nullptr;
+    identity.parkedAt = std::chrono::steady_clock::now();
+    if (journal_) {
+        journal_->identityParked(sessionId, identity.lastSeqs);
+    }
+    return true;
+}
+
+std::optional<ResumeRegistry::Claim> ResumeRegistry::claim(
+        const std::string& token, const std::string& claimantId, const Session* claimant,
+        const std::function<void(const std::string& sessionId, RoomSeqs&)>& takeOver) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto tokenIt = tokens_.find(hashToken(token));
+    if (tokenIt == tokens_.end() || tokenIt->second == claimantId) {
+        return std::nullopt;
+    }
+    auto it = identities_.find(tokenIt->second);
+    if (it == identities_.end()) {
+        tokens_.erase(tokenIt);
+        return std::nullopt;
+    }
+
+    Claim claim;
+    claim.sessionId = it->first;
+    Identity& identity = it->second;
+    if (identity.state != State::Parked) {
+        // The old connection is probably dead but not yet noticed
+        identity.lastSeqs.clear();
+        takeOver(claim.sessionId, identity.lastSeqs);
+    }
+    claim.lastSeqs = std::move(identity.lastSeqs);
+    identity.lastSeqs.clear();
+
+    // Spend the presented token and hand out a fresh one
+    tokens_.erase(tokenIt);
+    claim.token = newToken();
+    identity.tokenHash = hashToken(claim.token);
+    identity.state = State::Active;
+    identity.owner = claimant;
+    tokens_[identity.tokenHash] = claim.sessionId;
+    if (journal_) {
+        journal_->identityIssued(claim.sessionId, identity.tokenHash);
+    }
+
+    // The claimant's own identity is dropped; its token dies with it
+    claim.claimantSettled = false;
+    auto claimantIt = identities_.find(claimantId);
+    if (claimantIt != identities_.end()) {
+        claim.claimantSettled = claimantIt->second.state == State::Active;
+        tokens_.erase(claimantIt->second.tokenHash);
+        identities_.erase(claimantIt);
+        if (journal_) {
+            journal_->identityRemoved(claimantId);
+        }
+    }
+    return claim;
+}
+
+std::vector<ResumeRegistry::Expired> ResumeRegistry::expire(std::chrono::steady_clock::time_point now) {
+    std::vector<Expired> expired;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = identities_.begin(); it != identities_.end();) {
+        const Identity& identity = it->second;
+        if (identity.state == State::Parked && now - identity.parkedAt >= config_.parkTimeout) {
+            Expired entry;
+            entry.sessionId = it->first;
+            for (const auto& room : identity.lastSeqs) {
+                entry.rooms.push_back(room.first);
+            }
+            expired.push_back(std::move(entry));
+            tokens_.erase(identity.tokenHash);
+            if (journal_) {
+                journal_->identityRemoved(it->first);
+            }
+            it = identities_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return expired;
+}
+
+std::size_t ResumeRegistry::parkedCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::size_t parked = 0;
+    for (const auto& entry : identities_) {
+        if (entry.second.state == State::Parked) {
+            ++parked;
+        }
+    }
+    return parked;
+}
+
+std::vector<ResumeRegistry::IdentitySnapshot> ResumeRegistry::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<IdentitySnapshot> identities;
+    identities.reserve(identities_.size());
+    for (const auto& entry : identities_) {
+        identities.push_back({entry.first, entry.second.tokenHash, entry.second.state,
+                              entry.second.parkedAt, entry.second.lastSeqs});
+    }
+    return identities;
+}
+
+void ResumeRegistry::restore(const std::vector<IdentitySnapshot>& identities) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    identities_.clear();
+    tokens_.clear();
+    for (const auto& snapshot : identities) {
+        Identity& identity = identities_[snapshot.sessionId];
+        identity.tokenHash = snapshot.tokenHash;
+        identity.state = snapshot.state;
+        identity.parkedAt = snapshot.parkedAt;
+        identity.lastSeqs = snapshot.lastSeqs;
+        tokens_[snapshot.tokenHash] = snapshot.sessionId;
+    }
+}
+
+void ResumeRegistry::adopt(const std::string& sessionId, const Session* owner) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = identities_.find(sessionId);
+    if (it != identities_.end() && it->second.state != State::Parked) {
+        it->second.owner = owner;
+    }
+}
+
+void ResumeRegistry::setJournal(std::shared_ptr<StateJournal> journal) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    journal_ = std::move(journal);
+}
+
+// Caller holds mutex_
+std::string ResumeRegistry::newToken() {
+    unsigned char bytes[16];
+    if (!secureRandom(bytes, sizeof(bytes))) {
+        Logging::error("No secure random source for resume tokens");
+        throw std::runtime_error("secure random source unavailable");
+    }
+    return toHex(bytes, sizeof(bytes));
+}
+
+} // namespace ChatServer
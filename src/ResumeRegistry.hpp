@@ -0,0 +1,140 @@
+/**
+ * @file ResumeRegistry.hpp
+ * @brief Resume tokens and parked session identities.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ChatServer {
+
+class Session;
+class StateJournal;
+
+struct ResumeConfig {
+    std::chrono::seconds parkTimeout{600};        // how long a dropped identity can be resumed
+    std::chrono::milliseconds freshGrace{300};    // wait for /resume before setting up a new user
+    std::size_t maxCatchUp = 500;                 // missed messages replayed per room
+};
+
+/**
+ * @brief Tracks which connection owns each session identity.
+ *
+ * Every connection gets an identity (its session id) and a resume token.
+ * When the connection drops, the identity is parked together with the last
+ * sequence number of each room it was in. A later connection presenting the
+ * token takes the identity over, whether it is parked or still attached to a
+ * connection the server has not yet noticed is dead.
+ *
+ * All transitions happen under one mutex. The callbacks given to park() and
+ * claim() run under it as well, so suspending and restoring room membership
+ * cannot interleave for the same identity.
+ *
+ * Only a SHA-256 hash of each token is kept, in memory and in the state
+ * journal, so the state files never hold a usable credential. Identities
+ * are journaled as they are issued, parked and dropped, which lets a cold
+ * restart offer every surviving identity for resumption again.
+ */
+class ResumeRegistry {
+public:
+    using RoomSeqs = std::map<std::string, std::uint64_t>;
+
+    enum class State : std::uint8_t { Pending, Active, Parked };
+
+    // One identity as carried over to a successor process or a cold restart
+    struct IdentitySnapshot {
+        std::string sessionId;
+        std::string tokenHash;
+        State state = State::Pending;
+        std::chrono::steady_clock::time_point parkedAt;
+        RoomSeqs lastSeqs;
+    };
+
+    struct Claim {
+        std::string sessionId;     // identity taken over
+        RoomSeqs lastSeqs;         // per room, the last message the old connection was sent
+        std::string token;         // replacement token; the presented one is spent
+        bool claimantSettled;      // the claiming connection already had a fresh user set up
+    };
+
+    struct Expired {
+        std::string sessionId;
+        std::vector<std::string> rooms;
+    };
+
+    explicit ResumeRegistry(const ResumeConfig& config = ResumeConfig());
+
+    const ResumeConfig& config() const { return config_; }
+
+    // Register a new connection's identity and return its token
+    std::string issue(const std::string& sessionId, const Session* owner);
+
+    // Mark a new connection's identity as set up; true only the first time
+    bool settle(const std::string& sessionId);
+
+    /**
+     * @brief Park an identity whose connection dropped.
+     * @param suspend Called under the registry lock to detach the identity from
+     *        its rooms and fill in their last sequence numbers
+     * @return false if owner no longer owns the identity (it was taken over)
+     */
+    bool park(const std::string& sessionId, const Session* owner,
+              const std::function<void(RoomSeqs&)>& suspend);
+
+    /**
+     * @brief Take over the identity behind token for claimantId.
+     * @param takeOver Called under the registry lock when the identity is still
+     *        attached to another connection, to detach it as park() would
+     */
+    std::optional<Claim> claim(const std::string& token, const std::string& claimantId, const Session* claimant,
+                               const std::function<void(const std::string& sessionId, RoomSeqs&)>& takeOver);
+
+    // Remove identities parked longer than parkTimeout
+    std::vector<Expired> expire(std::chrono::steady_clock::time_point now);
+
+    std::size_t parkedCount() const;
+
+    // Every identity, without its owning connection
+    std::vector<IdentitySnapshot> snapshot() const;
+
+    // Replace all identities with a predecessor's; owners are set by adopt()
+    void restore(const std::vector<IdentitySnapshot>& identities);
+
+    // Attach a restored identity to the connection that now carries it
+    void adopt(const std::string& sessionId, const Session* owner);
+
+    // Record identity changes to a journal from now on
+    void setJournal(std::shared_ptr<StateJournal> journal);
+
+    // Hex SHA-256 of a token, the form identities are stored under
+    static std::string hashToken(const std::string& token);
+
+private:
+    struct Identity {
+        std::string tokenHash;
+        State state = State::Pending;
+        const Session* owner = nullptr;
+        std::chrono::steady_clock::time_point parkedAt;
+        RoomSeqs lastSeqs;
+    };
+
+    std::string newToken();
+
+    ResumeConfig config_;
+    std::unordered_map<std::string, Identity> identities_;   // by session id
+    std::unordered_map<std::string, std::string> tokens_;    // token hash -> session id
+    std::shared_ptr<StateJournal> journal_;                  // never blocks, so called under mutex_
+    mutable std::mutex mutex_;
+};
+
+} // namespace ChatServer
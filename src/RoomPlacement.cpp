@@ -0,0 +1,726 @@
+/**
+ * @file RoomPlacement.cpp
+ * @brief Implementation of room ownership and migration between nodes.
+ */
+
+#include "RoomPlacement.hpp"
+#include "BusCodec.hpp"
+#include "ChatRoom.hpp"
+#include "Logging.hpp"
+#include "Metrics.hpp"
+
+#include <algorithm>
+
+namespace ChatServer {
+
+using namespace BusCodec;
+
+/*
+ * Placement messages travel as bus payloads next to the session directory's;
+ * their op bytes are upper case. Messages routed to a room's owner carry a
+ * hop count after the op byte, so one bounced between nodes that disagree
+ * about the owner is eventually dropped.
+ *
+ *   'P' hops, room, sender, message, timestamp   post, for the owner to number
+ *   'J' hops, room, node, count, sessions        members joined on node
+ *   'L' hops, room, node, count, sessions        members left on node
+ *   'S' room, lastSeq, count, (seq, frame)...,
+ *       count, (session, node)...                 hand the room over
+ *   'A' room                                      hand-over accepted
+ *   'F' room, count, messages                     held during the hand-over
+ *   'O' room, owner                               the room's owner changed
+ */
+
+namespace {
+
+std::string routed(char op, const std::string& room) {
+    std::string payload(1, op);
+    payload.push_back(0);
+    putString(payload, room);
+    return payload;
+}
+
+std::string members(char op, const std::string& room, const std::string& node,
+                    const std::vector<std::string>& sessions) {
+    std::string payload = routed(op, room);
+    putString(payload, node);
+    putVarint(payload, sessions.size());
+    for (const auto& session : sessions) {
+        putString(payload, session);
+    }
+    return payload;
+}
+
+} // namespace
+
+RoomPlacement::RoomPlacement(boost::asio::io_context& io, std::shared_ptr<MessageBus> bus,
+                             std::shared_ptr<ChatRoomManager> chatRoomManager, PostHandler post,
+                             const RoomPlacementConfig& config)
+    : io_(io),
+      bus_(std::move(bus)),
+      chatRoomManager_(std::move(chatRoomManager)),
+      post_(std::move(post)),
+      config_(config),
+      startTimer_(io),
+      ring_(config.virtualNodes),
+      previousRing_(config.virtualNodes),
+      forwarded_(MetricsRegistry::getInstance().counter(
+          "chat_room_forwarded_total", "Room messages forwarded to the room's owner node")),
+      migrations_(MetricsRegistry::getInstance().counter(
+          "chat_room_migrations_total", "Rooms handed from this node to another")) {}
+
+void RoomPlacement::start() {
+    startTimer_.expires_after(config_.takeoverTimeout);
+    std::weak_ptr<RoomPlacement> weakSelf = shared_from_this();
+    startTimer_.async_wait([weakSelf](boost::system::error_code ec) {
+        auto self = weakSelf.lock();
+        if (ec || !self) {
+            return;
+        }
+        bool ready = false;
+        {
+            std::lock_guard<ProfiledMutex> lock(self->mutex_);
+            ready = self->ready_;
+        }
+        if (!ready) {
+            Logging::warning("Message bus has not reported its nodes; owning every room here");
+            self->nodesChanged({self->nodeId()});
+        }
+    });
+}
+
+void RoomPlacement::nodesChanged(const std::vector<std::string>& nodes) {
+    auto rooms = chatRoomManager_->getAllRooms();
+    std::vector<std::pair<std::string, std::string>> moves;        // room, new owner
+    std::vector<std::pair<std::string, std::string>> overridden;   // room, owner to announce
+    std::vector<std::pair<std::string, std::vector<std::string>>> takeovers;
+    std::vector<std::pair<std::string, std::vector<std::string>>> released;
+    std::vector<std::shared_ptr<ChatRoom>> reports;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        startTimer_.cancel();
+        previousRing_ = ring_;
+        previousOverrides_ = overrides_;
+        if (!ready_) {
+            // A node joining a running cluster finds the rooms where the
+            // cluster placed them without it
+            std::vector<std::string> others;
+            for (const auto& node : nodes) {
+                if (node != nodeId()) {
+                    others.push_back(node);
+                }
+            }
+            previousRing_.assign(others);
+            ready_ = true;
+        }
+        ring_.assign(nodes);
+        settleUntil_ = std::chrono::steady_clock::now() + config_.takeoverTimeout;
+
+        for (auto it = overrides_.begin(); it != overrides_.end();) {
+            it = ring_.contains(it->second) ? std::next(it) : overrides_.erase(it);
+        }
+        for (auto& room : remoteMembers_) {
+            for (auto it = room.second.begin(); it != room.second.end();) {
+                it = ring_.contains(it->second) ? std::next(it) : room.second.erase(it);
+            }
+        }
+
+        for (const auto& room : owned_) {
+            const std::string& owner = ownerOfLocked(room);
+            if (owner != nodeId()) {
+                moves.emplace_back(room, owner);
+            } else if (overrides_.count(room)) {
+                overridden.emplace_back(room, owner); // nodes that just joined need to know
+            }
+        }
+
+        std::vector<std::string> waiting;
+        for (const auto& entry : awaiting_) {
+            waiting.push_back(entry.first);
+        }
+        for (const auto& room : waiting) {
+            auto it = awaiting_.find(room);
+            if (ownerOfLocked(room) != nodeId()) {
+                if (it->second.timer) {
+                    it->second.timer->cancel();
+                }
+                released.emplace_back(room, std::move(it->second.held));
+                awaiting_.erase(it);
+            } else if (!it->second.timer) {
+                // Held until the nodes were known
+                auto held = std::move(it->second.held);
+                awaiting_.erase(it);
+                if (claimLocked(room)) {
+                    takeovers.emplace_back(room, std::move(held));
+                } else {
+                    awaiting_[room].held = std::move(held);
+                }
+            }
+        }
+
+        for (const auto& chatRoom : rooms) {
+            const std::string& room = chatRoom->getName();
+            if (owned_.count(room) || migrating_.count(room) || awaiting_.count(room)) {
+                continue;
+            }
+            if (ownerOfLocked(room) != nodeId()) {
+                reports.push_back(chatRoom);
+            } else if (claimLocked(room)) {
+                takeovers.emplace_back(room, std::vector<std::string>());
+            }
+        }
+    }
+    Logging::info("Room placement spans " + std::to_string(nodes.size()) + " nodes; handing over " +
+                  std::to_string(moves.size()) + " rooms");
+
+    for (auto& takeover : takeovers) {
+        resume(takeover.first);
+        replay(takeover.first, std::move(takeover.second));
+    }
+    for (auto& room : released) {
+        replay(room.first, std::move(room.second));
+    }
+    for (const auto& move : moves) {
+        startMigration(move.first, move.second);
+    }
+    for (const auto& room : overridden) {
+        announce(room.first, room.second, "");
+    }
+    // The owners of rooms with members here may have changed
+    for (const auto& chatRoom : reports) {
+        auto sessions = chatRoom->getSessions();
+        if (!sessions.empty()) {
+            route(chatRoom->getName(), members('J', chatRoom->getName(), nodeId(),
+                                               std::vector<std::string>(sessions.begin(), sessions.end())));
+        }
+    }
+}
+
+bool RoomPlacement::handles(const std::string& payload) {
+    return !payload.empty() && std::string("PJLSAFO").find(payload[0]) != std::string::npos;
+}
+
+void RoomPlacement::received(const std::string& fromNode, const std::string& payload) {
+    std::size_t pos = 1;
+    std::string room;
+    std::string owner;
+
+    switch (payload.empty() ? 0 : payload[0]) {
+    case 'P':
+    case 'J':
+    case 'L':
+        pos = 2;
+        if (payload.size() > 1 && getString(payload, pos, room)) {
+            route(room, payload);
+            return;
+        }
+        break;
+    case 'S':
+        imported(fromNode, payload);
+        return;
+    case 'F':
+        flushed(fromNode, payload);
+        return;
+    case 'A':
+        if (getString(payload, pos, room)) {
+            migrationConfirmed(fromNode, room);
+            return;
+        }
+        break;
+    case 'O':
+        if (getString(payload, pos, room) && getString(payload, pos, owner)) {
+            announced(room, owner);
+            return;
+        }
+        break;
+    }
+    Logging::error("Malformed room placement message from " + fromNode + "; ignored");
+}
+
+void RoomPlacement::post(const std::string& room, const std::string& senderSessionId, const std::string& message,
+                         std::int64_t timestamp) {
+    std::string payload = routed('P', room);
+    putString(payload, senderSessionId);
+    putString(payload, message);
+    putVarint(payload, static_cast<std::uint64_t>(timestamp));
+    route(room, std::move(payload));
+}
+
+void RoomPlacement::memberChanged(const std::string& room, const std::string& sessionId, bool joined) {
+    route(room, members(joined ? 'J' : 'L', room, nodeId(), {sessionId}));
+}
+
+bool RoomPlacement::migrate(const std::string& room, const std::string& node, std::string& error) {
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        if (node == nodeId() || !ring_.contains(node)) {
+            error = "node " + node + " is not on the bus";
+            return false;
+        }
+        if (!owned_.count(room)) {
+            error = "room " + room + " is not owned by this node";
+            return false;
+        }
+    }
+    if (!startMigration(room, node)) {
+        error = "room " + room + " is already being handed over";
+        return false;
+    }
+    return true;
+}
+
+std::vector<RoomPlacement::RoomStatus> RoomPlacement::status() const {
+    std::map<std::string, RoomStatus> rooms;
+    for (const auto& chatRoom : chatRoomManager_->getAllRooms()) {
+        auto& status = rooms[chatRoom->getName()];
+        status.lastSeq = chatRoom->getLastSeq();
+        status.localMembers = chatRoom->getSessions().size();
+    }
+
+    std::lock_guard<ProfiledMutex> lock(mutex_);
+    for (const auto& room : owned_) {
+        rooms[room];
+    }
+    for (const auto& entry : migrating_) {
+        rooms[entry.first];
+    }
+    for (const auto& entry : awaiting_) {
+        rooms[entry.first];
+    }
+    std::vector<RoomStatus> result;
+    for (auto& entry : rooms) {
+        RoomStatus& status = entry.second;
+        status.room = entry.first;
+        status.owner = ownerOfLocked(entry.first);
+        if (owned_.count(entry.first)) {
+            status.state = "owned";
+        } else if (migrating_.count(entry.first)) {
+            status.state = "moving";
+        } else if (awaiting_.count(entry.first)) {
+            status.state = "awaiting";
+        } else {
+            status.state = "mirror";
+        }
+        auto members = remoteMembers_.find(entry.first);
+        if (members != remoteMembers_.end()) {
+            status.remoteMembers = members->second.size();
+        }
+        auto posted = posted_.find(entry.first);
+        if (posted != posted_.end()) {
+            status.posted = posted->second;
+        }
+        result.push_back(std::move(status));
+    }
+    return result;
+}
+
+// Caller holds mutex_
+const std::string& RoomPlacement::ownerOfLocked(const std::string& room) const {
+    auto it = overrides_.find(room);
+    return it != overrides_.end() ? it->second : ring_.ownerOf(room, nodeId());
+}
+
+// Caller holds mutex_. For a room placed here but not held: marks it owned
+// and returns true, unless its previous owner is still on the bus and may yet
+// hand it over, in which case the room waits for it.
+bool RoomPlacement::claimLocked(const std::string& room) {
+    if (std::chrono::steady_clock::now() < settleUntil_) {
+        auto it = previousOverrides_.find(room);
+        const std::string& previous =
+            it != previousOverrides_.end() ? it->second : previousRing_.ownerOf(room, nodeId());
+        if (previous != nodeId() && ring_.contains(previous)) {
+            awaitLocked(room, config_.takeoverTimeout);
+            return false;
+        }
+    }
+    owned_.insert(room);
+    return true;
+}
+
+// Caller holds mutex_. Messages for the room are held until it is handed
+// over, or until the timeout if it never is.
+void RoomPlacement::awaitLocked(const std::string& room, std::chrono::milliseconds timeout) {
+    auto& awaiting = awaiting_[room];
+    if (!ready_ || awaiting.timer) {
+        return; // settled once the bus reports the nodes
+    }
+    auto timer = std::make_shared<boost::asio::steady_timer>(io_, timeout);
+    awaiting.timer = timer;
+    std::weak_ptr<RoomPlacement> weakSelf = shared_from_this();
+    timer->async_wait([weakSelf, room, timer](boost::system::error_code ec) {
+        auto self = weakSelf.lock();
+        if (!ec && self) {
+            self->takeOverLocally(room, timer);
+        }
+    });
+}
+
+void RoomPlacement::route(const std::string& room, std::string payload) {
+    std::string owner;
+    bool claimed = false;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        auto moving = migrating_.find(room);
+        if (moving != migrating_.end()) {
+            moving->second.held.push_back(std::move(payload));
+            return;
+        }
+        auto waiting = awaiting_.find(room);
+        if (waiting != awaiting_.end()) {
+            waiting->second.held.push_back(std::move(payload));
+            return;
+        }
+        if (!owned_.count(room)) {
+            owner = ownerOfLocked(room);
+            if (owner == nodeId()) {
+                if (!ready_ || !claimLocked(room)) {
+                    awaitLocked(room, config_.takeoverTimeout);
+                    awaiting_[room].held.push_back(std::move(payload));
+                    return;
+                }
+                claimed = true;
+                owner.clear();
+            }
+        }
+    }
+
+    if (!owner.empty()) {
+        if (static_cast<unsigned char>(payload[1]) >= config_.maxHops) {
+            Logging::error("Message for room " + room + " was forwarded too often; dropped");
+            return;
+        }
+        ++payload[1];
+        forwarded_.inc();
+        bus_->sendTo(owner, payload);
+        return;
+    }
+    if (claimed) {
+        resume(room);
+    }
+    apply(room, payload);
+}
+
+// A message routed to a room owned here
+void RoomPlacement::apply(const std::string& room, const std::string& payload) {
+    std::size_t pos = 2;
+    std::string field;
+    getString(payload, pos, field); // the room, already read by route's caller
+
+    if (payload[0] == 'P') {
+        std::string sender;
+        std::string message;
+        std::uint64_t timestamp = 0;
+        if (!getString(payload, pos, sender) || !getString(payload, pos, message) ||
+            !getVarint(payload, pos, timestamp)) {
+            Logging::error("Malformed post for room " + room + "; ignored");
+            return;
+        }
+        bool posted = post_(room, sender, message, static_cast<std::int64_t>(timestamp));
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        if (posted) {
+            ++posted_[room];
+            return;
+        }
+        // Handed over between route's check and numbering it
+        auto moving = migrating_.find(room);
+        if (moving != migrating_.end()) {
+            moving->second.held.push_back(payload);
+            return;
+        }
+        Logging::error("Room " + room + " is not taking messages; one from " + sender + " dropped");
+        return;
+    }
+
+    std::string node;
+    std::uint64_t count = 0;
+    if (!getString(payload, pos, node) || !getVarint(payload, pos, count)) {
+        Logging::error("Malformed membership change for room " + room + "; ignored");
+        return;
+    }
+    if (node == nodeId()) {
+        return; // the room's own members are its sessions
+    }
+    bool rerouted = false;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        if (!owned_.count(room)) {
+            rerouted = true; // handed over since route's check
+        } else {
+            auto& remote = remoteMembers_[room];
+            for (std::uint64_t i = 0; i < count && getString(payload, pos, field); ++i) {
+                if (payload[0] == 'J') {
+                    remote[field] = node;
+                } else {
+                    remote.erase(field);
+                }
+            }
+        }
+    }
+    if (rerouted) {
+        route(room, payload);
+    }
+}
+
+// Number messages in a room claimed here
+void RoomPlacement::resume(const std::string& room) {
+    chatRoomManager_->createChatRoom(room)->resumeSequencing();
+}
+
+void RoomPlacement::takeOverLocally(const std::string& room, const std::shared_ptr<boost::asio::steady_timer>& timer) {
+    std::vector<std::string> held;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        auto it = awaiting_.find(room);
+        if (it == awaiting_.end() || it->second.timer != timer) {
+            return; // handed over after all
+        }
+        held = std::move(it->second.held);
+        awaiting_.erase(it);
+        owned_.insert(room);
+    }
+    Logging::warning("Room " + room + " was not handed over in time; continuing it from this node's mirror");
+    resume(room);
+    replay(room, std::move(held));
+}
+
+bool RoomPlacement::startMigration(const std::string& room, const std::string& target) {
+    std::map<std::string, std::string> roomMembers;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        if (!owned_.count(room) || migrating_.count(room)) {
+            return false;
+        }
+        owned_.erase(room);
+        auto& migration = migrating_[room];
+        migration.target = target;
+        auto remote = remoteMembers_.find(room);
+        if (remote != remoteMembers_.end()) {
+            migration.remoteMembers = std::move(remote->second);
+            remoteMembers_.erase(remote);
+        }
+        roomMembers = migration.remoteMembers;
+
+        migration.timer = std::make_shared<boost::asio::steady_timer>(io_, config_.migrationTimeout);
+        std::weak_ptr<RoomPlacement> weakSelf = shared_from_this();
+        migration.timer->async_wait([weakSelf, room, target](boost::system::error_code ec) {
+            auto self = weakSelf.lock();
+            if (!ec && self) {
+                self->migrationTimedOut(room, target);
+            }
+        });
+    }
+    migrations_.inc();
+
+    // Messages numbered before this are published ahead of the hand-over,
+    // so the new owner has them before it numbers any of its own
+    auto chatRoom = chatRoomManager_->createChatRoom(room);
+    RoomSnapshot snapshot = chatRoom->handOver();
+    for (const auto& session : chatRoom->getSessions()) {
+        roomMembers[session] = nodeId();
+    }
+
+    std::string payload("S");
+    putString(payload, room);
+    putVarint(payload, snapshot.lastSeq);
+    putVarint(payload, snapshot.recent.size());
+    for (const auto& entry : snapshot.recent) {
+        putVarint(payload, entry.seq);
+        putString(payload, *entry.frame);
+    }
+    putVarint(payload, roomMembers.size());
+    for (const auto& member : roomMembers) {
+        putString(payload, member.first);
+        putString(payload, member.second);
+    }
+    bus_->sendTo(target, payload);
+    Logging::info("Handing room " + room + " to " + target + " after message " + std::to_string(snapshot.lastSeq));
+    return true;
+}
+
+void RoomPlacement::migrationTimedOut(const std::string& room, const std::string& target) {
+    std::vector<std::string> held;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        auto it = migrating_.find(room);
+        if (it == migrating_.end() || it->second.target != target) {
+            return;
+        }
+        held = std::move(it->second.held);
+        remoteMembers_[room] = std::move(it->second.remoteMembers);
+        migrating_.erase(it);
+        owned_.insert(room);
+    }
+    Logging::error("Node " + target + " did not take over room " + room + " in time; keeping it here");
+    resume(room);
+    replay(room, std::move(held));
+}
+
+void RoomPlacement::migrationConfirmed(const std::string& fromNode, const std::string& room) {
+    std::vector<std::string> held;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        auto it = migrating_.find(room);
+        if (it == migrating_.end() || it->second.target != fromNode) {
+            return;
+        }
+        it->second.timer->cancel();
+        held = std::move(it->second.held);
+        migrating_.erase(it);
+        if (ring_.ownerOf(room, nodeId()) == fromNode) {
+            overrides_.erase(room);
+        } else {
+            overrides_[room] = fromNode;
+        }
+    }
+    std::string flush("F");
+    putString(flush, room);
+    putVarint(flush, held.size());
+    for (const auto& payload : held) {
+        putString(flush, payload);
+    }
+    bus_->sendTo(fromNode, flush);
+    Logging::info("Room " + room + " is now owned by " + fromNode);
+    announce(room, fromNode, fromNode);
+}
+
+void RoomPlacement::imported(const std::string& fromNode, const std::string& payload) {
+    std::size_t pos = 1;
+    std::string room;
+    RoomSnapshot snapshot;
+    std::uint64_t count = 0;
+    bool ok = getString(payload, pos, room) && getVarint(payload, pos, snapshot.lastSeq) &&
+              getVarint(payload, pos, count);
+    for (std::uint64_t i = 0; ok && i < count; ++i) {
+        RoomHistory::Entry entry;
+        std::string frame;
+        ok = getVarint(payload, pos, entry.seq) && getString(payload, pos, frame);
+        entry.frame = std::make_shared<const std::string>(std::move(frame));
+        snapshot.recent.push_back(std::move(entry));
+    }
+    std::map<std::string, std::string> roomMembers;
+    ok = ok && getVarint(payload, pos, count);
+    for (std::uint64_t i = 0; ok && i < count; ++i) {
+        std::string session;
+        std::string node;
+        ok = getString(payload, pos, session) && getString(payload, pos, node);
+        if (node != nodeId()) {
+            roomMembers[session] = node;
+        }
+    }
+    if (!ok) {
+        Logging::error("Malformed hand-over of a room from " + fromNode + "; ignored");
+        return;
+    }
+
+    chatRoomManager_->createChatRoom(room)->takeOver(snapshot);
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        auto& remote = remoteMembers_[room];
+        remote.insert(roomMembers.begin(), roomMembers.end());
+        if (ring_.ownerOf(room, nodeId()) == nodeId()) {
+            overrides_.erase(room);
+        } else {
+            overrides_[room] = nodeId();
+        }
+        // Hold what is posted here until the previous owner passes on what
+        // it held, which was posted earlier
+        auto it = awaiting_.find(room);
+        if (it != awaiting_.end() && it->second.timer) {
+            it->second.timer->cancel();
+            it->second.timer.reset();
+        }
+        awaitLocked(room, config_.migrationTimeout);
+    }
+
+    std::string accepted("A");
+    putString(accepted, room);
+    bus_->sendTo(fromNode, accepted);
+    Logging::info("Took over room " + room + " from " + fromNode + " after message " +
+                  std::to_string(snapshot.lastSeq));
+}
+
+void RoomPlacement::flushed(const std::string& fromNode, const std::string& payload) {
+    std::size_t pos = 1;
+    std::string room;
+    std::uint64_t count = 0;
+    std::vector<std::string> earlier;
+    bool ok = getString(payload, pos, room) && getVarint(payload, pos, count);
+    for (std::uint64_t i = 0; ok && i < count; ++i) {
+        earlier.emplace_back();
+        ok = getString(payload, pos, earlier.back());
+    }
+    if (!ok) {
+        Logging::error("Malformed hand-over of a room from " + fromNode + "; ignored");
+        return;
+    }
+
+    std::vector<std::string> held;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        auto it = awaiting_.find(room);
+        if (it != awaiting_.end()) {
+            if (it->second.timer) {
+                it->second.timer->cancel();
+            }
+            held = std::move(it->second.held);
+            awaiting_.erase(it);
+        }
+        owned_.insert(room);
+    }
+    replay(room, std::move(earlier));
+    replay(room, std::move(held));
+}
+
+void RoomPlacement::announced(const std::string& room, const std::string& owner) {
+    std::vector<std::string> held;
+    bool conflict = false;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        if (ring_.ownerOf(room, nodeId()) == owner) {
+            overrides_.erase(room);
+        } else {
+            overrides_[room] = owner;
+        }
+        auto it = awaiting_.find(room);
+        if (it != awaiting_.end() && owner != nodeId()) {
+            if (it->second.timer) {
+                it->second.timer->cancel();
+            }
+            held = std::move(it->second.held);
+            awaiting_.erase(it);
+        }
+        conflict = owned_.count(room) && owner != nodeId();
+    }
+    replay(room, std::move(held));
+    if (conflict) {
+        // Both continued the room while the bus was split; fold this copy
+        // into the announced owner's
+        Logging::warning("Room " + room + " is also owned by " + owner + "; handing it over");
+        startMigration(room, owner);
+    }
+}
+
+void RoomPlacement::announce(const std::string& room, const std::string& owner, const std::string& except) {
+    std::vector<std::string> nodes;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        nodes = ring_.nodes();
+    }
+    std::string payload("O");
+    putString(payload, room);
+    putString(payload, owner);
+    for (const auto& node : nodes) {
+        if (node != nodeId() && node != except) {
+            bus_->sendTo(node, payload);
+        }
+    }
+}
+
+// Route held messages again, in the order they arrived
+void RoomPlacement::replay(const std::string& room, std::vector<std::string> payloads) {
+    for (auto& payload : payloads) {
+        route(room, std::move(payload));
+    }
+}
+
+} // namespace ChatServer
@@ -0,0 +1,156 @@
+/**
+ * @file RoomPlacement.hpp
+ * @brief Which node of a cluster owns each room, and moving rooms between nodes.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/asio.hpp>
+
+#include "HashRing.hpp"
+#include "MessageBus.hpp"
+#include "ProfiledMutex.hpp"
+
+namespace ChatServer {
+
+class ChatRoomManager;
+class Counter;
+
+struct RoomPlacementConfig {
+    int virtualNodes = 64;                              // ring points per node
+    std::chrono::milliseconds takeoverTimeout{2000};    // wait this long for a room's previous owner to hand it over
+    std::chrono::milliseconds migrationTimeout{5000};   // take a room back if its new owner has not confirmed by then
+    int maxHops = 8;                                    // forwards before a message is given up on
+};
+
+/**
+ * @brief Gives every room one owner node, and moves rooms between owners
+ * without losing messages.
+ *
+ * The owner numbers the room's messages, keeps them in its history store
+ * and publishes them; every node fans them out to its own members and
+ * mirrors the recent ones. Members post on whichever node they are
+ * connected to, which forwards to the owner; joins and leaves are reported
+ * to the owner as well, so it holds the member list of the whole cluster.
+ *
+ * Owners are picked by consistent hashing over the nodes on the bus, unless
+ * a room was moved elsewhere explicitly. When nodes come or go, each owner
+ * hands the rooms that now hash elsewhere to their new owner: it stops
+ * numbering, sends the room's sequence number, ring and members, and holds
+ * anything posted meanwhile until the new owner confirms, then passes it on
+ * in one message. The new owner numbers those first and what was posted to
+ * it in the meantime after them, so each member's messages keep their
+ * order. A room whose owner left is continued by its new owner from the
+ * mirror it kept.
+ */
+class RoomPlacement : public std::enable_shared_from_this<RoomPlacement> {
+public:
+    // Number and fan out a message in a room owned here; false if the room
+    // is being handed over and the message must wait
+    using PostHandler = std::function<bool(const std::string& room, const std::string& senderSessionId,
+                                           const std::string& message, std::int64_t timestamp)>;
+
+    struct RoomStatus {
+        std::string room;
+        std::string owner;
+        std::string state;            // owned, moving, awaiting or mirror
+        std::uint64_t lastSeq = 0;
+        std::size_t localMembers = 0;
+        std::size_t remoteMembers = 0; // known here only while owned
+        std::uint64_t posted = 0;      // messages numbered here
+    };
+
+    RoomPlacement(boost::asio::io_context& io, std::shared_ptr<MessageBus> bus,
+                  std::shared_ptr<ChatRoomManager> chatRoomManager, PostHandler post,
+                  const RoomPlacementConfig& config = RoomPlacementConfig());
+
+    const std::string& nodeId() const { return bus_->nodeId(); }
+
+    // Own every room alone if the bus has not reported other nodes by the
+    // takeover timeout
+    void start();
+
+    // Bus handlers: the nodes now on the bus, and a message from one of them
+    void nodesChanged(const std::vector<std::string>& nodes);
+    void received(const std::string& fromNode, const std::string& payload);
+
+    // Whether a message from another node is for the room placement rather
+    // than the session directory
+    static bool handles(const std::string& payload);
+
+    // A member connected here posted to a room, or joined or left it
+    void post(const std::string& room, const std::string& senderSessionId, const std::string& message,
+              std::int64_t timestamp);
+    void memberChanged(const std::string& room, const std::string& sessionId, bool joined);
+
+    // Hand a room owned here to another node, e.g. to take load off this
+    // one. False with a reason if it cannot be moved now.
+    bool migrate(const std::string& room, const std::string& node, std::string& error);
+
+    std::vector<RoomStatus> status() const;
+
+private:
+    // A room this node owns by placement but has not been handed yet
+    struct Awaiting {
+        std::vector<std::string> held;   // messages for it, in arrival order
+        std::shared_ptr<boost::asio::steady_timer> timer;
+    };
+
+    // A room being handed to another node
+    struct Migration {
+        std::string target;
+        std::vector<std::string> held;
+        std::map<std::string, std::string> remoteMembers; // restored if it fails
+        std::shared_ptr<boost::asio::steady_timer> timer;
+    };
+
+    const std::string& ownerOfLocked(const std::string& room) const;
+    bool claimLocked(const std::string& room);
+    void awaitLocked(const std::string& room, std::chrono::milliseconds timeout);
+    void route(const std::string& room, std::string payload);
+    void apply(const std::string& room, const std::string& payload);
+    void resume(const std::string& room);
+    void takeOverLocally(const std::string& room, const std::shared_ptr<boost::asio::steady_timer>& timer);
+    bool startMigration(const std::string& room, const std::string& target);
+    void migrationTimedOut(const std::string& room, const std::string& target);
+    void migrationConfirmed(const std::string& fromNode, const std::string& room);
+    void imported(const std::string& fromNode, const std::string& payload);
+    void flushed(const std::string& fromNode, const std::string& payload);
+    void announced(const std::string& room, const std::string& owner);
+    void announce(const std::string& room, const std::string& owner, const std::string& except);
+    void replay(const std::string& room, std::vector<std::string> payloads);
+
+    boost::asio::io_context& io_;
+    std::shared_ptr<MessageBus> bus_;
+    std::shared_ptr<ChatRoomManager> chatRoomManager_;
+    PostHandler post_;
+    RoomPlacementConfig config_;
+    boost::asio::steady_timer startTimer_;
+
+    mutable ProfiledMutex mutex_{"RoomPlacement::mutex_"};
+    bool ready_ = false;                                          // the bus has reported the nodes
+    HashRing ring_;
+    HashRing previousRing_;                                       // before the last change of nodes
+    std::unordered_map<std::string, std::string> previousOverrides_;
+    std::chrono::steady_clock::time_point settleUntil_;           // rooms may still be handed over until then
+    std::unordered_map<std::string, std::string> overrides_;      // rooms moved off their ring owner
+    std::set<std::string> owned_;
+    std::map<std::string, Awaiting> awaiting_;
+    std::map<std::string, Migration> migrating_;
+    std::map<std::string, std::map<std::string, std::string>> remoteMembers_; // room -> session -> node
+    std::unordered_map<std::string, std::uint64_t> posted_;
+
+    Counter& forwarded_;
+    Counter& migrations_;
+};
+
+} // namespace ChatServer
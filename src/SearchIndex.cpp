@@ -0,0 +1,253 @@
+/**
+ * @file SearchIndex.cpp
+ * @brief Implementation of the incremental inverted index.
+ */
+
+#include "SearchIndex.hpp"
+#include "Logging.hpp"
+
+#include <algorithm>
+
+namespace ChatServer {
+
+namespace {
+
+// Longer runs are kept, but truncated so a pasted blob cannot bloat the dictionary
+const std::size_t kMaxTermLength = 64;
+
+bool isWordByte(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+}
+
+} // namespace
+
+void SearchIndex::Postings::add(std::uint64_t id) {
+    // Ids arrive ascending per room; anything else is a duplicate from rebuild()
+    if (count > 0 && id <= lastId) {
+        return;
+    }
+    std::uint64_t gap = id - lastId;
+    while (gap >= 0x80) {
+        deltas.push_back(static_cast<char>((gap & 0x7f) | 0x80));
+        gap >>= 7;
+    }
+    deltas.push_back(static_cast<char>(gap));
+    lastId = id;
+    ++count;
+}
+
+void SearchIndex::Postings::decode(std::vector<std::uint64_t>& ids) const {
+    ids.clear();
+    ids.reserve(count);
+    std::uint64_t id = 0;
+    std::uint64_t gap = 0;
+    int shift = 0;
+    for (char byte : deltas) {
+        auto c = static_cast<unsigned char>(byte);
+        gap |= static_cast<std::uint64_t>(c & 0x7f) << shift;
+        if (c & 0x80) {
+            shift += 7;
+            continue;
+        }
+        id += gap;
+        ids.push_back(id);
+        gap = 0;
+        shift = 0;
+    }
+}
+
+SearchIndex::SearchIndex(const SearchConfig& config)
+    : config_(config), stopping_(true), indexed_(0), skipped_(0) {}
+
+SearchIndex::~SearchIndex() {
+    stop();
+}
+
+void SearchIndex::rebuild(HistoryStore& store) {
+    auto started = std::chrono::steady_clock::now();
+    std::vector<PendingMessage> batch;
+    store.scan([this, &batch](const std::string& room, const HistoryEntry& entry) {
+        batch.push_back({room, entry.id, std::string(entry.content)});
+        if (batch.size() >= config_.maxPending) {
+            merge(batch);
+        }
+    });
+    merge(batch);
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started);
+    Logging::info("Search index rebuilt from " + std::string(store.backendName()) + " history: " +
+                  std::to_string(indexed_.load()) + " messages in " +
+                  std::to_string(elapsed.count()) + " ms");
+}
+
+void SearchIndex::start() {
+    std::lock_guard<std::mutex> lock(pendingMutex_);
+    if (!stopping_) {
+        return;
+    }
+    stopping_ = false;
+    merger_ = std::thread([this]() { run(); });
+}
+
+void SearchIndex::stop() {
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex_);
+        if (stopping_) {
+            return;
+        }
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    if (merger_.joinable()) {
+        merger_.join();
+    }
+}
+
+void SearchIndex::messageStored(const std::string& room, const HistoryEntry& entry) {
+    std::lock_guard<std::mutex> lock(pendingMutex_);
+    if (pending_.size() >= config_.maxPending) {
+        skipped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    pending_.push_back({room, entry.id, std::string(entry.content)});
+}
+
+void SearchIndex::run() {
+    std::vector<PendingMessage> batch;
+    for (;;) {
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(pendingMutex_);
+            wake_.wait_for(lock, config_.mergeInterval, [this] { return stopping_; });
+            stopping = stopping_;
+            batch.swap(pending_);
+        }
+        merge(batch);
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+void SearchIndex::merge(std::vector<PendingMessage>& batch) {
+    if (batch.empty()) {
+        return;
+    }
+
+    // Group by room and term first so each room is locked once per batch
+    std::unordered_map<std::string, std::unordered_map<std::string, std::vector<std::uint64_t>>> grouped;
+    for (const auto& message : batch) {
+        auto& terms = grouped[message.room];
+        auto tokens = tokenize(message.content);
+        std::sort(tokens.begin(), tokens.end());
+        tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+        for (auto& token : tokens) {
+            terms[std::move(token)].push_back(message.id);
+        }
+    }
+
+    for (auto& [room, terms] : grouped) {
+        RoomIndex& index = roomIndex(room);
+        std::unique_lock<std::shared_mutex> lock(index.mutex);
+        for (auto& [term, ids] : terms) {
+            Postings& postings = index.terms[term];
+            for (std::uint64_t id : ids) {
+                postings.add(id);
+            }
+        }
+    }
+
+    indexed_.fetch_add(batch.size(), std::memory_order_relaxed);
+    batch.clear();
+}
+
+SearchIndex::RoomIndex& SearchIndex::roomIndex(const std::string& room) {
+    {
+        std::shared_lock<std::shared_mutex> lock(roomsMutex_);
+        auto it = rooms_.find(room);
+        if (it != rooms_.end()) {
+            return *it->second;
+        }
+    }
+    std::unique_lock<std::shared_mutex> lock(roomsMutex_);
+    auto& index = rooms_[room];
+    if (!index) {
+        index = std::make_unique<RoomIndex>();
+    }
+    return *index;
+}
+
+const SearchIndex::RoomIndex* SearchIndex::findRoomIndex(const std::string& room) const {
+    std::shared_lock<std::shared_mutex> lock(roomsMutex_);
+    auto it = rooms_.find(room);
+    return it != rooms_.end() ? it->second.get() : nullptr;
+}
+
+std::vector<std::uint64_t> SearchIndex::search(const std::string& room, std::string_view query,
+                                               std::size_t limit) const {
+    std::vector<std::uint64_t> matches;
+    auto terms = tokenize(query);
+    const RoomIndex* index = findRoomIndex(room);
+    if (terms.empty() || !index || limit == 0) {
+        return matches;
+    }
+
+    std::vector<const Postings*> lists;
+    std::shared_lock<std::shared_mutex> lock(index->mutex);
+    for (const auto& term : terms) {
+        auto it = index->terms.find(term);
+        if (it == index->terms.end()) {
+            return matches;
+        }
+        lists.push_back(&it->second);
+    }
+
+    // Intersect starting from the rarest term to keep the candidate set small
+    std::sort(lists.begin(), lists.end(), [](const Postings* a, const Postings* b) {
+        return a->count < b->count;
+    });
+    lists[0]->decode(matches);
+    std::vector<std::uint64_t> ids;
+    std::vector<std::uint64_t> both;
+    for (std::size_t i = 1; i < lists.size() && !matches.empty(); ++i) {
+        lists[i]->decode(ids);
+        both.clear();
+        std::set_intersection(matches.begin(), matches.end(), ids.begin(), ids.end(),
+                              std::back_inserter(both));
+        matches.swap(both);
+    }
+    lock.unlock();
+
+    if (matches.size() > limit) {
+        matches.erase(matches.begin(), matches.end() - limit);
+    }
+    std::reverse(matches.begin(), matches.end());
+    return matches;
+}
+
+std::vector<std::string> SearchIndex::tokenize(std::string_view text) {
+    std::vector<std::string> tokens;
+    std::size_t i = 0;
+    while (i < text.size()) {
+        while (i < text.size() && !isWordByte(static_cast<unsigned char>(text[i]))) {
+            ++i;
+        }
+        std::size_t start = i;
+        while (i < text.size() && isWordByte(static_cast<unsigned char>(text[i]))) {
+            ++i;
+        }
+        if (i > start) {
+            std::string token(text.substr(start, std::min(i - start, kMaxTermLength)));
+            for (char& c : token) {
+                if (c >= 'A' && c <= 'Z') {
+                    c = static_cast<char>(c - 'A' + 'a');
+                }
+            }
+            tokens.push_back(std::move(token));
+        }
+    }
+    return tokens;
+}
+
+} // namespace ChatServer
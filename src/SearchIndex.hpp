@@ -0,0 +1,111 @@
+/**
+ * @file SearchIndex.hpp
+ * @brief Incremental inverted index over persisted room history.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "HistoryStore.hpp"
+
+namespace ChatServer {
+
+struct SearchConfig {
+    std::chrono::milliseconds mergeInterval{100}; // how long a stored message may wait to become searchable
+    std::size_t maxPending = 65536;               // pending messages beyond this are not indexed
+};
+
+/**
+ * @brief Per-room postings lists of history store message ids.
+ *
+ * The store reports each durable message through HistoryObserver; the
+ * message only gets copied into a pending batch there. A background thread
+ * tokenizes pending batches and merges them into the postings, which hold
+ * ascending ids as varint-encoded deltas. Queries intersect the postings
+ * of all their terms and return the newest matches first.
+ */
+class SearchIndex : public HistoryObserver {
+public:
+    explicit SearchIndex(const SearchConfig& config = SearchConfig());
+    ~SearchIndex() override;
+
+    SearchIndex(const SearchIndex&) = delete;
+    SearchIndex& operator=(const SearchIndex&) = delete;
+
+    // Index everything already in the store; call before the store gets this observer
+    void rebuild(HistoryStore& store);
+
+    // Start the background merge thread
+    void start();
+
+    // Merge what is pending and stop the background thread
+    void stop();
+
+    // HistoryObserver
+    void messageStored(const std::string& room, const HistoryEntry& entry) override;
+
+    /**
+     * @brief Find messages in a room that contain every term of the query.
+     * @return Up to limit message ids, newest first
+     */
+    std::vector<std::uint64_t> search(const std::string& room, std::string_view query, std::size_t limit) const;
+
+    // Lower-cased words of a text; bytes outside ASCII are kept as word characters
+    static std::vector<std::string> tokenize(std::string_view text);
+
+    std::uint64_t indexedCount() const { return indexed_.load(std::memory_order_relaxed); }
+    std::uint64_t skippedCount() const { return skipped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Postings {
+        std::string deltas;       // varint-encoded gaps between ascending ids
+        std::uint64_t lastId = 0;
+        std::uint32_t count = 0;
+
+        void add(std::uint64_t id);
+        void decode(std::vector<std::uint64_t>& ids) const;
+    };
+
+    struct RoomIndex {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, Postings> terms;
+    };
+
+    struct PendingMessage {
+        std::string room;
+        std::uint64_t id;
+        std::string content;
+    };
+
+    void run();
+    void merge(std::vector<PendingMessage>& batch);
+    RoomIndex& roomIndex(const std::string& room);
+    const RoomIndex* findRoomIndex(const std::string& room) const;
+
+    SearchConfig config_;
+
+    mutable std::shared_mutex roomsMutex_;
+    std::unordered_map<std::string, std::unique_ptr<RoomIndex>> rooms_;
+
+    std::mutex pendingMutex_;
+    std::vector<PendingMessage> pending_;
+
+    std::thread merger_;
+    std::condition_variable wake_;
+    bool stopping_;
+    std::atomic<std::uint64_t> indexed_;
+    std::atomic<std::uint64_t> skipped_;
+};
+
+} // namespace ChatServer
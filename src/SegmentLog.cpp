@@ -0,0 +1,767 @@
+/**
+ * @file SegmentLog.cpp
+ * @brief Implementation of the memory-mapped segment log history store.
+ */
+
+#include "SegmentLog.hpp"
+#include "Logging.hpp"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <vector>
+
+namespace ChatServer {
+
+namespace {
+
+namespace fs = std::filesystem;
+namespace bip = boost::interprocess;
+
+// Host-endian like the state files; segments are not meant to move between machines.
+const char kSegmentMagic[8] = {'C', 'H', 'S', 'E', 'G', '0', '0', '2'};
+
+/**
+ * @brief Fixed-size header at the start of every segment file.
+ *
+ * committedBytes and recordCount are refreshed on every flush; recovery
+ * re-validates the records of the active segment regardless.
+ */
+struct SegmentHeader {
+    char magic[8];
+    std::uint64_t baseSeq;
+    std::int64_t createdAt;      // seconds since the Unix epoch
+    std::uint64_t capacity;      // file size
+    std::uint64_t committedBytes;
+    std::uint64_t recordCount;
+    std::uint32_t sealed;        // no more appends once a newer segment exists
+    std::uint32_t reserved;
+    char padding[8];
+};
+static_assert(sizeof(SegmentHeader) == 64, "segment header layout changed");
+
+// Record: u32 bodySize, u32 checksum, then the body:
+// u64 seq, i64 timestamp, u16 userIdSize, userId, content.
+const std::size_t kRecordPrefix = 2 * sizeof(std::uint32_t);
+const std::size_t kBodyPrefix = sizeof(std::uint64_t) + sizeof(std::int64_t) + sizeof(std::uint16_t);
+
+std::uint32_t checksum(const char* data, std::size_t size) {
+    std::uint32_t hash = 2166136261u; // FNV-1a
+    for (std::size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+std::int64_t unixNow() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Room names are user input, so directories use their hex encoding
+std::string encodeRoom(const std::string& room) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(room.size() * 2);
+    for (unsigned char c : room) {
+        out.push_back(digits[c >> 4]);
+        out.push_back(digits[c & 0x0f]);
+    }
+    return out;
+}
+
+bool decodeRoom(const std::string& encoded, std::string& room) {
+    if (encoded.empty() || encoded.size() % 2 != 0) {
+        return false;
+    }
+    auto nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    };
+    room.clear();
+    for (std::size_t i = 0; i < encoded.size(); i += 2) {
+        int high = nibble(encoded[i]);
+        int low = nibble(encoded[i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        room.push_back(static_cast<char>((high << 4) | low));
+    }
+    return true;
+}
+
+std::string segmentFileName(std::uint64_t baseId) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%020llu.seg", static_cast<unsigned long long>(baseId));
+    return name;
+}
+
+} // namespace
+
+/**
+ * @brief One mapped segment file, named after the seq of its first record.
+ *
+ * Only the writer thread appends. Readers see a record once recordCount
+ * covers it; the release store on recordCount publishes the record bytes.
+ * Sequence numbers ascend within and across segments but may have gaps
+ * where messages were dropped before reaching the log.
+ */
+class SegmentLogStore::Segment {
+public:
+    Segment(std::string path, std::uint64_t baseSeq, std::int64_t createdAt, std::size_t indexInterval)
+        : path_(std::move(path)), baseSeq_(baseSeq), createdAt_(createdAt), indexInterval_(indexInterval),
+          data_(nullptr), capacity_(0), committed_(0), count_(0), lastSeq_(0), removeOnClose_(false) {}
+
+    ~Segment() {
+        region_ = bip::mapped_region();
+        if (removeOnClose_) {
+            std::error_code ec;
+            fs::remove(path_, ec);
+            if (ec) {
+                Logging::warning("Cannot delete segment " + path_ + ": " + ec.message());
+            }
+        }
+    }
+
+    // The file is only open while mapping; the region outlives it, so segments hold no descriptor
+    bool map() {
+        try {
+            bip::file_mapping mapping(path_.c_str(), bip::read_write);
+            region_ = bip::mapped_region(mapping, bip::read_write);
+        } catch (const std::exception& e) {
+            Logging::error("Cannot map segment " + path_ + ": " + e.what());
+            return false;
+        }
+        data_ = static_cast<char*>(region_.get_address());
+        capacity_ = region_.get_size();
+        return capacity_ >= sizeof(SegmentHeader);
+    }
+
+    void initHeader() {
+        SegmentHeader header{};
+        std::memcpy(header.magic, kSegmentMagic, sizeof(kSegmentMagic));
+        header.baseSeq = baseSeq_;
+        header.createdAt = createdAt_;
+        header.capacity = capacity_;
+        header.committedBytes = sizeof(SegmentHeader);
+        std::memcpy(data_, &header, sizeof(header));
+        committed_ = sizeof(SegmentHeader);
+    }
+
+    /**
+     * @brief Walk the records after the header, rebuilding the sparse index.
+     *
+     * Sealed segments are trusted up to their header; the active segment is
+     * scanned until the first zero or damaged record, which drops a torn tail.
+     */
+    bool recover() {
+        SegmentHeader header;
+        std::memcpy(&header, data_, sizeof(header));
+        if (std::memcmp(header.magic, kSegmentMagic, sizeof(kSegmentMagic)) != 0 ||
+            header.baseSeq != baseSeq_) {
+            return false;
+        }
+        createdAt_ = header.createdAt;
+        sealed_ = header.sealed != 0;
+
+        std::uint64_t end = sealed_ ? std::min<std::uint64_t>(header.committedBytes, capacity_) : capacity_;
+        std::uint64_t offset = sizeof(SegmentHeader);
+        std::uint64_t count = 0;
+        std::uint64_t lastSeq = 0;
+        while (offset + kRecordPrefix <= end) {
+            std::uint32_t size;
+            std::uint32_t sum;
+            std::memcpy(&size, data_ + offset, sizeof(size));
+            std::memcpy(&sum, data_ + offset + sizeof(size), sizeof(sum));
+            if (size < kBodyPrefix || offset + kRecordPrefix + size > end) {
+                break;
+            }
+            if (!sealed_ && sum != checksum(data_ + offset + kRecordPrefix, size)) {
+                break;
+            }
+            std::uint64_t seq = seqAt(offset);
+            if (seq < baseSeq_ || (count > 0 && seq <= lastSeq)) {
+                break;
+            }
+            if (count % indexInterval_ == 0) {
+                index_.push_back({seq, offset, count});
+            }
+            lastSeq = seq;
+            offset += kRecordPrefix + size;
+            ++count;
+        }
+        committed_ = offset;
+        lastSeq_.store(lastSeq, std::memory_order_relaxed);
+        count_.store(count, std::memory_order_release);
+        return true;
+    }
+
+    bool fits(std::size_t recordSize) const {
+        return committed_ + recordSize <= capacity_;
+    }
+
+    // Writer thread only; seq must be above lastSeq()
+    void append(const StoredMessage& message, std::uint64_t seq) {
+        auto userSize = static_cast<std::uint16_t>(message.userId.size());
+        auto bodySize = static_cast<std::uint32_t>(kBodyPrefix + userSize + message.content.size());
+
+        char* record = data_ + committed_;
+        char* body = record + kRecordPrefix;
+        std::memcpy(body, &seq, sizeof(seq));
+        std::memcpy(body + 8, &message.timestamp, sizeof(message.timestamp));
+        std::memcpy(body + 16, &userSize, sizeof(userSize));
+        std::memcpy(body + kBodyPrefix, message.userId.data(), userSize);
+        std::memcpy(body + kBodyPrefix + userSize, message.content.data(), message.content.size());
+        std::uint32_t sum = checksum(body, bodySize);
+        std::memcpy(record, &bodySize, sizeof(bodySize));
+        std::memcpy(record + sizeof(bodySize), &sum, sizeof(sum));
+
+        std::uint64_t count = count_.load(std::memory_order_relaxed);
+        if (count % indexInterval_ == 0) {
+            std::lock_guard<std::mutex> lock(indexMutex_);
+            index_.push_back({seq, committed_, count});
+        }
+        committed_ += kRecordPrefix + bodySize;
+        lastSeq_.store(seq, std::memory_order_relaxed);
+        count_.store(count + 1, std::memory_order_release);
+        dirty_ = true;
+    }
+
+    // Writer thread only: publish progress to the on-disk header
+    void flush(bool sync) {
+        if (!dirty_) {
+            return;
+        }
+        SegmentHeader* header = reinterpret_cast<SegmentHeader*>(data_);
+        header->committedBytes = committed_;
+        header->recordCount = count_.load(std::memory_order_relaxed);
+        header->sealed = sealed_ ? 1 : 0;
+        if (sync) {
+            region_.flush(0, static_cast<std::size_t>(committed_), false);
+        }
+        dirty_ = false;
+    }
+
+    void seal() {
+        sealed_ = true;
+        dirty_ = true;
+        flush(true);
+    }
+
+    /**
+     * @brief Visit up to limit records with seq >= firstSeq.
+     * @return number of records visited
+     */
+    std::size_t visitFrom(std::uint64_t firstSeq, std::size_t limit, const HistoryVisitor& visitor) const {
+        std::uint64_t count = count_.load(std::memory_order_acquire);
+        IndexEntry start = seek(firstSeq, 0);
+
+        std::size_t visited = 0;
+        std::uint64_t offset = start.offset;
+        for (std::uint64_t position = start.position; position < count && visited < limit; ++position) {
+            if (seqAt(offset) >= firstSeq) {
+                visitor(entryAt(offset));
+                ++visited;
+            }
+            offset = nextOffset(offset);
+        }
+        return visited;
+    }
+
+    /**
+     * @brief Offsets of the last limit records with seq < beforeSeq, oldest first.
+     *
+     * Starts a few index entries back from beforeSeq, so the scan covers about
+     * limit + 2 * indexInterval records however long the segment is.
+     */
+    void collectBefore(std::uint64_t beforeSeq, std::size_t limit, std::vector<std::uint64_t>& offsets) const {
+        offsets.clear();
+        std::uint64_t count = count_.load(std::memory_order_acquire);
+        IndexEntry start = seek(beforeSeq, limit / indexInterval_ + 1);
+
+        std::uint64_t offset = start.offset;
+        for (std::uint64_t position = start.position; position < count; ++position) {
+            if (seqAt(offset) >= beforeSeq) {
+                break;
+            }
+            offsets.push_back(offset);
+            offset = nextOffset(offset);
+        }
+        if (offsets.size() > limit) {
+            offsets.erase(offsets.begin(), offsets.end() - limit);
+        }
+    }
+
+    HistoryEntry entryAt(std::uint64_t offset) const {
+        std::uint32_t size;
+        std::memcpy(&size, data_ + offset, sizeof(size));
+        const char* body = data_ + offset + kRecordPrefix;
+        std::uint16_t userSize;
+        HistoryEntry entry;
+        std::memcpy(&entry.seq, body, sizeof(entry.seq));
+        std::memcpy(&entry.timestamp, body + 8, sizeof(entry.timestamp));
+        std::memcpy(&userSize, body + 16, sizeof(userSize));
+        entry.id = entry.seq;
+        entry.userId = std::string_view(body + kBodyPrefix, userSize);
+        entry.content = std::string_view(body + kBodyPrefix + userSize, size - kBodyPrefix - userSize);
+        return entry;
+    }
+
+    std::uint64_t baseSeq() const { return baseSeq_; }
+    std::uint64_t lastSeq() const { return lastSeq_.load(std::memory_order_relaxed); }
+    std::uint64_t count() const { return count_.load(std::memory_order_acquire); }
+    std::uint64_t bytes() const { return committed_; }
+    std::uint64_t capacity() const { return capacity_; }
+    std::int64_t createdAt() const { return createdAt_; }
+    void removeOnClose() { removeOnClose_ = true; }
+
+private:
+    struct IndexEntry {
+        std::uint64_t seq;
+        std::uint64_t offset;
+        std::uint64_t position;
+    };
+
+    // Index entry stepsBack entries before the last one with seq < target
+    IndexEntry seek(std::uint64_t target, std::size_t stepsBack) const {
+        std::lock_guard<std::mutex> lock(indexMutex_);
+        auto it = std::lower_bound(index_.begin(), index_.end(), target,
+            [](const IndexEntry& entry, std::uint64_t value) { return entry.seq < value; });
+        auto back = static_cast<std::size_t>(it - index_.begin());
+        back = back > stepsBack + 1 ? back - stepsBack - 1 : 0;
+        return back < index_.size() ? index_[back] : IndexEntry{baseSeq_, sizeof(SegmentHeader), 0};
+    }
+
+    std::uint64_t seqAt(std::uint64_t offset) const {
+        std::uint64_t seq;
+        std::memcpy(&seq, data_ + offset + kRecordPrefix, sizeof(seq));
+        return seq;
+    }
+
+    std::uint64_t nextOffset(std::uint64_t offset) const {
+        std::uint32_t size;
+        std::memcpy(&size, data_ + offset, sizeof(size));
+        return offset + kRecordPrefix + size;
+    }
+
+    std::string path_;
+    std::uint64_t baseSeq_;
+    std::int64_t createdAt_;
+    std::size_t indexInterval_;
+    bip::mapped_region region_;
+    char* data_;
+    std::uint64_t capacity_;
+    std::uint64_t committed_;            // writer thread only
+    std::atomic<std::uint64_t> count_;
+    std::atomic<std::uint64_t> lastSeq_;
+    bool sealed_ = false;
+    bool dirty_ = false;
+    bool removeOnClose_;
+
+    mutable std::mutex indexMutex_;
+    std::vector<IndexEntry> index_;      // one entry per indexInterval_ records
+};
+
+/**
+ * @brief The segments of one room, oldest first.
+ */
+struct SegmentLogStore::RoomLog {
+    std::string directory;
+    std::atomic<std::uint64_t> lastSeq{0};           // written by the writer thread only
+    mutable std::shared_mutex mutex;                 // guards segments
+    std::vector<std::shared_ptr<Segment>> segments;  // back() is the active segment
+};
+
+SegmentLogStore::SegmentLogStore(const SegmentLogConfig& config)
+    : config_(config), queue_(config.queueCapacity), running_(false), dropped_(0) {
+    if (config_.indexInterval == 0) {
+        config_.indexInterval = 1;
+    }
+}
+
+SegmentLogStore::~SegmentLogStore() {
+    stop();
+}
+
+bool SegmentLogStore::start() {
+    if (running_) {
+        return true;
+    }
+
+    std::error_code ec;
+    fs::create_directories(config_.directory, ec);
+    if (ec) {
+        Logging::error("Cannot create history directory " + config_.directory + ": " + ec.message());
+        return false;
+    }
+
+    std::size_t recovered = 0;
+    for (const auto& entry : fs::directory_iterator(config_.directory, ec)) {
+        std::string room;
+        if (!entry.is_directory() || !decodeRoom(entry.path().filename().string(), room)) {
+            continue;
+        }
+        if (recoverRoom(entry.path().string(), room)) {
+            ++recovered;
+        }
+    }
+
+    running_ = true;
+    writer_ = std::thread([this]() { run(); });
+    Logging::info("Segment log started in " + config_.directory + " with " +
+                  std::to_string(recovered) + " rooms");
+    return true;
+}
+
+void SegmentLogStore::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    wake_.notify_one();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+    flushSegments(true);
+}
+
+bool SegmentLogStore::append(StoredMessage message) {
+    if (!queue_.tryPush(std::move(message))) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        wake_.notify_one();
+        return false;
+    }
+    if (queue_.sizeApprox() == queue_.capacity() / 2) {
+        wake_.notify_one();
+    }
+    return true;
+}
+
+void SegmentLogStore::run() {
+    auto lastFlush = std::chrono::steady_clock::now();
+    auto lastRetention = lastFlush;
+    bool dirty = false;
+
+    for (;;) {
+        bool stopping = !running_.load();
+
+        StoredMessage message;
+        while (queue_.tryPop(message)) {
+            write(message);
+            dirty = true;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (dirty && (stopping || now - lastFlush >= config_.flushInterval)) {
+            flushSegments(config_.syncOnFlush);
+            dirty = false;
+            lastFlush = now;
+        }
+
+        if (stopping) {
+            break;
+        }
+
+        if (now - lastRetention >= std::chrono::seconds(60)) {
+            applyRetention();
+            lastRetention = now;
+        }
+
+        std::unique_lock<std::mutex> lock(wakeMutex_);
+        wake_.wait_until(lock, now + config_.flushInterval);
+    }
+}
+
+void SegmentLogStore::write(const StoredMessage& message) {
+    std::size_t recordSize = kRecordPrefix + kBodyPrefix + message.userId.size() + message.content.size();
+    if (message.userId.size() > UINT16_MAX ||
+        recordSize > config_.segmentBytes - sizeof(SegmentHeader)) {
+        Logging::warning("Segment log: message too large for a segment in room " + message.room);
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    auto log = findRoom(message.room);
+    if (!log) {
+        log = openRoom(message.room);
+        if (!log) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    // Messages from ChatRoom carry their seq; others continue the room's numbering
+    std::uint64_t lastSeq = log->lastSeq.load(std::memory_order_relaxed);
+    std::uint64_t seq = message.seq ? message.seq : lastSeq + 1;
+    if (seq <= lastSeq) {
+        Logging::warning("Segment log: out-of-order seq " + std::to_string(seq) + " in room " + message.room);
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    std::shared_ptr<Segment> active;
+    {
+        std::shared_lock<std::shared_mutex> lock(log->mutex);
+        if (!log->segments.empty()) {
+            active = log->segments.back();
+        }
+    }
+
+    if (!active || !active->fits(recordSize)) {
+        std::uint64_t bytes = active ? active->capacity() * 2 : config_.initialSegmentBytes;
+        bytes = std::max<std::uint64_t>(bytes, sizeof(SegmentHeader) + recordSize);
+        auto next = createSegment(*log, seq, std::min(bytes, config_.segmentBytes));
+        if (!next) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (active) {
+            active->seal();
+        }
+        std::unique_lock<std::shared_mutex> lock(log->mutex);
+        log->segments.push_back(next);
+        active = next;
+    }
+
+    active->append(message, seq);
+    log->lastSeq.store(seq, std::memory_order_relaxed);
+
+    HistoryEntry entry;
+    entry.id = seq;
+    entry.seq = seq;
+    entry.timestamp = message.timestamp;
+    entry.userId = message.userId;
+    entry.content = message.content;
+    notifyStored(message.room, entry);
+}
+
+std::vector<std::pair<std::string, std::shared_ptr<SegmentLogStore::RoomLog>>> SegmentLogStore::roomLogs() const {
+    std::shared_lock<std::shared_mutex> lock(roomsMutex_);
+    return {rooms_.begin(), rooms_.end()};
+}
+
+void SegmentLogStore::flushSegments(bool sync) {
+    for (const auto& [room, log] : roomLogs()) {
+        std::shared_lock<std::shared_mutex> lock(log->mutex);
+        if (!log->segments.empty()) {
+            log->segments.back()->flush(sync);
+        }
+    }
+}
+
+void SegmentLogStore::applyRetention() {
+    std::int64_t cutoff = config_.retentionAge.count() > 0
+        ? unixNow() - config_.retentionAge.count()
+        : INT64_MIN;
+
+    for (const auto& [room, log] : roomLogs()) {
+        std::unique_lock<std::shared_mutex> lock(log->mutex);
+        std::uint64_t total = 0;
+        for (const auto& segment : log->segments) {
+            total += segment->bytes();
+        }
+
+        // The active segment is never deleted
+        std::size_t expired = 0;
+        while (expired + 1 < log->segments.size()) {
+            const auto& oldest = log->segments[expired];
+            bool tooOld = oldest->createdAt() < cutoff;
+            bool tooBig = config_.retentionBytes > 0 && total > config_.retentionBytes;
+            if (!tooOld && !tooBig) {
+                break;
+            }
+            total -= oldest->bytes();
+            // Readers holding the segment keep its mapping until they finish
+            oldest->removeOnClose();
+            ++expired;
+        }
+        log->segments.erase(log->segments.begin(), log->segments.begin() + expired);
+    }
+}
+
+std::shared_ptr<SegmentLogStore::RoomLog> SegmentLogStore::findRoom(const std::string& room) const {
+    std::shared_lock<std::shared_mutex> lock(roomsMutex_);
+    auto it = rooms_.find(room);
+    return it != rooms_.end() ? it->second : nullptr;
+}
+
+std::shared_ptr<SegmentLogStore::RoomLog> SegmentLogStore::openRoom(const std::string& room) {
+    auto log = std::make_shared<RoomLog>();
+    log->directory = (fs::path(config_.directory) / encodeRoom(room)).string();
+
+    std::error_code ec;
+    fs::create_directories(log->directory, ec);
+    if (ec) {
+        Logging::error("Cannot create history directory for room " + room + ": " + ec.message());
+        return nullptr;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(roomsMutex_);
+    rooms_[room] = log;
+    return log;
+}
+
+bool SegmentLogStore::recoverRoom(const std::string& directory, const std::string& room) {
+    std::vector<std::uint64_t> baseSeqs;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(directory, ec)) {
+        if (!entry.is_regular_file() || entry.path().extension() != ".seg") {
+            continue;
+        }
+        try {
+            baseSeqs.push_back(std::stoull(entry.path().stem().string()));
+        } catch (const std::exception&) {
+            Logging::warning("Ignoring stray file in history: " + entry.path().string());
+        }
+    }
+    std::sort(baseSeqs.begin(), baseSeqs.end());
+
+    auto log = std::make_shared<RoomLog>();
+    log->directory = directory;
+    for (std::uint64_t baseSeq : baseSeqs) {
+        std::string path = (fs::path(directory) / segmentFileName(baseSeq)).string();
+        auto segment = std::make_shared<Segment>(path, baseSeq, 0, config_.indexInterval);
+        if (!segment->map() || !segment->recover()) {
+            Logging::error("Skipping unreadable segment " + path);
+            continue;
+        }
+        // Sequence numbers must keep ascending across segments
+        if (baseSeq <= log->lastSeq.load()) {
+            Logging::error("History segment " + path + " overlaps its predecessor, skipping");
+            continue;
+        }
+        if (segment->count() > 0) {
+            log->lastSeq.store(segment->lastSeq());
+        }
+        log->segments.push_back(segment);
+    }
+
+    if (log->segments.empty()) {
+        return false;
+    }
+    std::unique_lock<std::shared_mutex> lock(roomsMutex_);
+    rooms_[room] = log;
+    return true;
+}
+
+std::shared_ptr<SegmentLogStore::Segment> SegmentLogStore::createSegment(RoomLog& log, std::uint64_t baseSeq,
+                                                                       std::uint64_t bytes) {
+    std::string path = (fs::path(log.directory) / segmentFileName(baseSeq)).string();
+
+    std::error_code ec;
+    {
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file) {
+            Logging::error("Cannot create segment " + path);
+            return nullptr;
+        }
+        std::fclose(file);
+    }
+    // Sparse where the filesystem allows it; pages are only used as they are written
+    fs::resize_file(path, bytes, ec);
+    if (ec) {
+        Logging::error("Cannot size segment " + path + ": " + ec.message());
+        return nullptr;
+    }
+
+    auto segment = std::make_shared<Segment>(path, baseSeq, unixNow(), config_.indexInterval);
+    if (!segment->map()) {
+        return nullptr;
+    }
+    segment->initHeader();
+    return segment;
+}
+
+void SegmentLogStore::readBefore(const std::string& room, std::uint64_t beforeSeq, std::size_t limit,
+                                 const HistoryVisitor& visit) {
+    auto log = findRoom(room);
+    if (!log || limit == 0) {
+        return;
+    }
+
+    // Hold the segments, not the lock, while reading
+    std::vector<std::shared_ptr<Segment>> segments;
+    {
+        std::shared_lock<std::shared_mutex> lock(log->mutex);
+        segments = log->segments;
+    }
+
+    // Collect newest segment first until the page is full, then visit oldest first
+    std::vector<std::pair<const Segment*, std::vector<std::uint64_t>>> parts;
+    std::size_t remaining = limit;
+    for (auto it = segments.rbegin(); it != segments.rend() && remaining > 0; ++it) {
+        if ((*it)->baseSeq() >= beforeSeq) {
+            continue;
+        }
+        parts.emplace_back(it->get(), std::vector<std::uint64_t>());
+        (*it)->collectBefore(beforeSeq, remaining, parts.back().second);
+        remaining -= parts.back().second.size();
+    }
+    for (auto part = parts.rbegin(); part != parts.rend(); ++part) {
+        for (std::uint64_t offset : part->second) {
+            visit(part->first->entryAt(offset));
+        }
+    }
+}
+
+void SegmentLogStore::readFrom(const std::string& room, std::uint64_t firstSeq, std::size_t limit,
+                               const HistoryVisitor& visit) {
+    auto log = findRoom(room);
+    if (!log) {
+        return;
+    }
+
+    std::vector<std::shared_ptr<Segment>> segments;
+    {
+        std::shared_lock<std::shared_mutex> lock(log->mutex);
+        segments = log->segments;
+    }
+
+    auto it = std::upper_bound(segments.begin(), segments.end(), firstSeq,
+        [](std::uint64_t seq, const std::shared_ptr<Segment>& segment) {
+            return seq < segment->baseSeq();
+        });
+    if (it != segments.begin()) {
+        --it;
+    }
+
+    for (; it != segments.end() && limit > 0; ++it) {
+        limit -= (*it)->visitFrom(firstSeq, limit, visit);
+    }
+}
+
+std::unordered_map<std::string, std::uint64_t> SegmentLogStore::lastSequences() {
+    std::unordered_map<std::string, std::uint64_t> lastSeqs;
+    for (const auto& [room, log] : roomLogs()) {
+        lastSeqs[room] = log->lastSeq.load(std::memory_order_relaxed);
+    }
+    return lastSeqs;
+}
+
+void SegmentLogStore::readIds(const std::string& room, const std::vector<std::uint64_t>& ids,
+                              const HistoryVisitor& visit) {
+    // Ids are sequence numbers here
+    for (std::uint64_t id : ids) {
+        readFrom(room, id, 1, [id, &visit](const HistoryEntry& entry) {
+            if (entry.seq == id) {
+                visit(entry);
+            }
+        });
+    }
+}
+
+void SegmentLogStore::scan(const HistoryScanVisitor& visit) {
+    for (const auto& [room, log] : roomLogs()) {
+        const std::string& name = room;
+        readFrom(name, 0, SIZE_MAX, [&visit, &name](const HistoryEntry& entry) {
+            visit(name, entry);
+        });
+    }
+}
+
+} // namespace ChatServer
@@ -0,0 +1,103 @@
+/**
+ * @file SegmentLog.hpp
+ * @brief Memory-mapped, segmented per-room message log.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "HistoryStore.hpp"
+#include "LockFreeQueue.hpp"
+
+namespace ChatServer {
+
+struct SegmentLogConfig {
+    std::string directory = "history";
+    std::uint64_t initialSegmentBytes = 64 * 1024;         // size of a room's first segment file
+    std::uint64_t segmentBytes = 64 * 1024 * 1024;         // each later segment doubles up to this size
+    std::size_t indexInterval = 64;                        // records between sparse index entries
+    std::chrono::seconds retentionAge{7 * 24 * 3600};      // sealed segments older than this are deleted; 0 keeps all
+    std::uint64_t retentionBytes = 1024ull * 1024 * 1024;  // per-room cap on stored bytes; 0 means unbounded
+    std::chrono::milliseconds flushInterval{50};
+    bool syncOnFlush = false;                              // msync the active segment on every flush
+    std::size_t queueCapacity = 65536;
+};
+
+/**
+ * @brief HistoryStore that appends each room's messages to mapped segment files.
+ *
+ * Every room has a directory of preallocated segment files, named after the
+ * sequence number of their first record. A room's first segment is small and
+ * each one after it twice the size of its predecessor, up to segmentBytes, so
+ * quiet rooms cost little disk and address space. A background thread copies queued messages into the
+ * active segment's mapping, rolling to a new segment when it is full and
+ * deleting sealed segments that fall outside the retention limits. Readers
+ * locate records through a sparse in-memory offset index and get views
+ * straight into the mapping, so reading history copies nothing.
+ *
+ * Records are keyed by the room's sequence numbers, which also serve as
+ * their HistoryEntry ids.
+ */
+class SegmentLogStore : public HistoryStore {
+public:
+    explicit SegmentLogStore(const SegmentLogConfig& config = SegmentLogConfig());
+    ~SegmentLogStore() override;
+
+    SegmentLogStore(const SegmentLogStore&) = delete;
+    SegmentLogStore& operator=(const SegmentLogStore&) = delete;
+
+    // Recover existing segments and start the writer thread
+    bool start() override;
+    void stop() override;
+    bool append(StoredMessage message) override;
+    void readBefore(const std::string& room, std::uint64_t beforeSeq, std::size_t limit,
+                    const HistoryVisitor& visit) override;
+    std::unordered_map<std::string, std::uint64_t> lastSequences() override;
+    void readIds(const std::string& room, const std::vector<std::uint64_t>& ids,
+                 const HistoryVisitor& visit) override;
+    void scan(const HistoryScanVisitor& visit) override;
+    const char* backendName() const override { return "segment"; }
+
+    // Visit up to limit records of a room with seq >= firstSeq
+    void readFrom(const std::string& room, std::uint64_t firstSeq, std::size_t limit, const HistoryVisitor& visit);
+
+    std::uint64_t droppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+
+    class Segment;
+    struct RoomLog;
+
+private:
+    void run();
+    void write(const StoredMessage& message);
+    std::vector<std::pair<std::string, std::shared_ptr<RoomLog>>> roomLogs() const;
+    void flushSegments(bool sync);
+    void applyRetention();
+    std::shared_ptr<RoomLog> findRoom(const std::string& room) const;
+    std::shared_ptr<RoomLog> openRoom(const std::string& room);
+    bool recoverRoom(const std::string& directory, const std::string& room);
+    std::shared_ptr<Segment> createSegment(RoomLog& log, std::uint64_t baseSeq, std::uint64_t bytes);
+
+    SegmentLogConfig config_;
+    LockFreeQueue<StoredMessage> queue_;
+
+    mutable std::shared_mutex roomsMutex_;
+    std::unordered_map<std::string, std::shared_ptr<RoomLog>> rooms_;
+
+    std::thread writer_;
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    std::atomic<bool> running_;
+    std::atomic<std::uint64_t> dropped_;
+};
+
+} // namespace ChatServer
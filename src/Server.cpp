@@ -8,6 +8,7 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <future>
 #include <memory>
 
 namespace ChatServer {
@@ -31,6 +32,11 @@ public:
                           << socket->remote_endpoint() << std::endl;
                 // TODO: Create a new session and handle the connection.
             }
+            // A closed acceptor (drainAccepting) ends the loop; re-arming
+            // would fail at once, forever, and keep the io thread busy
+            if (ec == boost::asio::error::operation_aborted || !acceptor.is_open()) {
+                return;
+            }
             asyncAccept(); // Continue accepting connections.
         });
     }
@@ -53,6 +59,29 @@ public:
         }
     }
 
+    // Close the acceptor and drop the work guard, so the io thread returns
+    // once the handlers already queued have run
+    void drainAccepting(std::chrono::milliseconds deadline) {
+        auto drained = std::make_shared<std::promise<void>>();
+        auto done = drained->get_future();
+        boost::asio::post(io_context, [this]() {
+            boost::system::error_code ignored;
+            acceptor.close(ignored);
+        });
+        work.reset();
+        std::thread([this, drained]() {
+            if (ioThread.joinable()) {
+                ioThread.join();
+            }
+            drained->set_value();
+        }).detach();
+        if (done.wait_for(deadline) == std::future_status::timeout) {
+            std::cout << "Drain deadline passed; stopping." << std::endl;
+            io_context.stop();
+        }
+        done.wait();
+    }
+
     bool running;
     ThreadPool threadPool;
 
@@ -92,4 +121,11 @@ void Server::stop() {
     std::cout << "Server stopped." << std::endl;
 }
 
+void Server::drain(std::chrono::milliseconds deadline) {
+    std::cout << "Server draining." << std::endl;
+    pImpl->running = false;
+    pImpl->drainAccepting(deadline);
+    std::cout << "Server stopped." << std::endl;
+}
+
 } // namespace ChatServer
@@ -6,6 +6,7 @@
  #ifndef SERVER_HPP
  #define SERVER_HPP
  
+ #include <chrono>
  #include <memory>
  #include "ThreadPool.hpp"  // For background task execution
  
@@ -24,6 +25,10 @@
      void start();
      void stop();
  
+     // Stop accepting and let queued work finish, for at most deadline;
+     // whatever is still running then is stopped as by stop()
+     void drain(std::chrono::milliseconds deadline);
+ 
  private:
      class Impl;
      std::unique_ptr<Impl> pImpl;
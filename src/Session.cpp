@@ -5,37 +5,173 @@
 
 #include "Session.hpp"
 #include "Command.hpp"
+#include "GatewayLink.hpp"
 #include "Logging.hpp"
+#include "Metrics.hpp"
+#include "StallWatchdog.hpp"
+#include "TraceCapture.hpp"
+#ifdef CHAT_IO_URING
+#include "UringReactor.hpp"
+#endif
+#include <algorithm>
 #include <iostream>
 #include <chrono>
+#include <cstring>
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
 
 namespace ChatServer {
 
+namespace {
+
+// Non-owning view over the gathered write buffers. Asio copies the buffer
+// sequence into the write operation, so passing the vector itself would
+// allocate on every write.
+class ConstBufferView {
+public:
+    using value_type = boost::asio::const_buffer;
+    using const_iterator = const boost::asio::const_buffer*;
+
+    explicit ConstBufferView(const std::vector<boost::asio::const_buffer>& buffers)
+        : begin_(buffers.data()), end_(buffers.data() + buffers.size()) {}
+
+    const_iterator begin() const { return begin_; }
+    const_iterator end() const { return end_; }
+
+private:
+    const_iterator begin_;
+    const_iterator end_;
+};
+
+// Latency histograms and counters shared by all sessions, registered on first use
+struct SessionMetrics {
+    LatencyHistogram* ingestMessage;
+    LatencyHistogram* ingestCommand;
+    LatencyHistogram* delivery[5];
+    Counter* zeroCopySends;
+    Counter* zeroCopyCopied;
+    
+    SessionMetrics() {
+        auto& metrics = MetricsRegistry::getInstance();
+        zeroCopySends = &metrics.counter("chat_zerocopy_sends_total", "Sends made with MSG_ZEROCOPY");
+        zeroCopyCopied = &metrics.counter("chat_zerocopy_copied_total",
+                                          "Zero-copy sends the kernel completed by copying after all");
+        const std::string ingestHelp = "Time from a read completing to its message being routed or command executed";
+        ingestMessage = &metrics.latency("chat_ingest_to_dispatch_seconds", ingestHelp, "kind=\"message\"");
+        ingestCommand = &metrics.latency("chat_ingest_to_dispatch_seconds", ingestHelp, "kind=\"command\"");
+        
+        const char* fanouts[] = {"direct", "upto10", "upto100", "upto1000", "over1000"};
+        for (int i = 0; i < 5; ++i) {
+            delivery[i] = &metrics.latency("chat_dispatch_to_write_seconds",
+                                           "Time from a frame being queued for a recipient to its write completing",
+                                           std::string("fanout=\"") + fanouts[i] + "\"");
+        }
+    }
+};
+
+const SessionMetrics& sessionMetrics() {
+    static const SessionMetrics metrics;
+    return metrics;
+}
+
+std::atomic<std::size_t> zeroCopyThreshold{0};
+
+} // namespace
+
 Session::Session(boost::asio::ip::tcp::socket socket, const std::string& sessionId)
     : socket_(std::move(socket)), 
-      sessionId_(sessionId), 
+      sessionId_(std::make_shared<const std::string>(sessionId)), 
+      closed_(false),
       isWriting_(false),
       lastActive(std::chrono::steady_clock::now()) {
-    Logging::info("Session created: " + sessionId_);
+    Logging::info("Session created: " + getSessionId());
 }
 
 Session::~Session() {
-    Logging::info("Session destroyed: " + sessionId_);
+    Logging::info("Session destroyed: " + getSessionId());
 }
 
 void Session::start() {
-    Logging::info("Session started: " + sessionId_);
+    Logging::info("Session started: " + getSessionId());
+    if (gatewayLink_) {
+        return; // input arrives through gatewayInput()
+    }
+#ifdef __linux__
+    if (zeroCopyThreshold.load(std::memory_order_relaxed) > 0) {
+        int on = 1;
+        std::lock_guard<ProfiledMutex> lock(writeMutex_);
+        zeroCopy_ = setsockopt(socket_.native_handle(), SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0;
+    }
+#endif
     readMessage();
 }
 
+void Session::setZeroCopyThreshold(std::size_t bytes) {
+    zeroCopyThreshold.store(bytes, std::memory_order_relaxed);
+}
+
+Session::Frame Session::makeFrame(const std::string& message) {
+    auto frame = std::make_shared<std::string>();
+    frame->reserve(message.size() + 1);
+    frame->append(message);
+    frame->push_back('\n');
+    return frame;
+}
+
+Session::Fanout Session::fanoutFor(std::size_t recipients) {
+    if (recipients <= 10) {
+        return Fanout::Upto10;
+    }
+    if (recipients <= 100) {
+        return Fanout::Upto100;
+    }
+    return recipients <= 1000 ? Fanout::Upto1000 : Fanout::Over1000;
+}
+
 void Session::sendMessage(const std::string& message) {
-    boost::asio::post(socket_.get_executor(), [self = shared_from_this(), message]() {
-        self->writeMessage(message);
+    sendFrame(makeFrame(message));
+}
+
+void Session::sendFrame(Frame frame) {
+    sendFrame(std::move(frame), Fanout::Direct, std::chrono::steady_clock::now());
+}
+
+void Session::sendFrame(Frame frame, Fanout fanout, std::chrono::steady_clock::time_point queuedAt) {
+    if (gatewayLink_) {
+        // The link batches frames for all of its clients
+        gatewayLink_->send(gatewayChannel_, frame);
+        return;
+    }
+    
+    // Queue in call order; only the write itself is started on an io thread
+    std::lock_guard<ProfiledMutex> lock(writeMutex_);
+    pendingFrames_.push_back({std::move(frame), queuedAt, fanout});
+    if (isWriting_) {
+        return;
+    }
+    isWriting_ = true; // a write is scheduled; later frames join it
+    
+    auto task = makeRecyclingHandler([self = shared_from_this()]() {
+        StallWatchdog::HandlerScope scope(StallWatchdog::Handler::Write);
+        std::lock_guard<ProfiledMutex> lock(self->writeMutex_);
+        self->writePending();
     });
+    
+    // The polymorphic executor drops the handler's allocator, so post to the
+    // concrete io_context executor when that is what the socket runs on.
+    auto executor = socket_.get_executor();
+    if (auto* ioExecutor = executor.target<boost::asio::io_context::executor_type>()) {
+        boost::asio::post(*ioExecutor, std::move(task));
+    } else {
+        boost::asio::post(executor, std::move(task));
+    }
 }
 
-const std::string& Session::getSessionId() const {
-    return sessionId_;
+std::string Session::getSessionId() const {
+    return *std::atomic_load(&sessionId_);
 }
 
 void Session::setMessageHandler(MessageHandler handler) {
@@ -46,6 +182,97 @@ void Session::setCommandManager(std::shared_ptr<CommandManager> cmdManager) {
     commandManager_ = cmdManager;
 }
 
+void Session::setCloseHandler(CloseHandler handler) {
+    closeHandler_ = std::move(handler);
+}
+
+void Session::close() {
+    if (gatewayLink_) {
+        // No read is pending to report the close, so report it here; posted,
+        // as callers may hold locks the close handler takes
+        gatewayLink_->closeChannel(gatewayChannel_);
+        boost::asio::post(socket_.get_executor(), [self = shared_from_this()]() { self->notifyClosed(); });
+        return;
+    }
+    boost::system::error_code ignored;
+    socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+#ifdef CHAT_IO_URING
+    // The shutdown ends the io_uring receive; the fd must stay ours until it
+    // has, or a new connection reusing the number could be read instead
+    if (uringReceiving_) {
+        return;
+    }
+#endif
+    socket_.close(ignored);
+}
+
+void Session::pauseReading() {
+    std::lock_guard<ProfiledMutex> lock(writeMutex_);
+    readPaused_ = true;
+    if (gatewayLink_) {
+        readStopped_ = true; // gatewayInput() drops input from now on
+        return;
+    }
+    // cancel() aborts writes as well, so a write in flight cancels on completion
+    if (!isWriting_ && !readStopped_ && !readCancelled_.exchange(true)) {
+        boost::system::error_code ignored;
+        socket_.cancel(ignored);
+    }
+}
+
+void Session::resumeReading() {
+    readPaused_ = false;
+    if (readStopped_.exchange(false) && !gatewayLink_) {
+        readMessage();
+    }
+}
+
+bool Session::isQuiescent() {
+    if (gatewayLink_) {
+        return readStopped_ && gatewayLink_->isIdle();
+    }
+    std::lock_guard<ProfiledMutex> lock(writeMutex_);
+#ifdef CHAT_IO_URING
+    if (uringReactor_) {
+        return !isWriting_;
+    }
+#endif
+    return readStopped_ && !isWriting_;
+}
+
+int Session::nativeHandle() {
+    return socket_.native_handle();
+}
+
+#ifdef CHAT_IO_URING
+void Session::setUringReactor(UringReactor* reactor) {
+    uringReactor_ = reactor;
+}
+#endif
+
+void Session::setGatewayLink(std::shared_ptr<GatewayLink> link, std::uint32_t channel) {
+    gatewayLink_ = std::move(link);
+    gatewayChannel_ = channel;
+}
+
+void Session::gatewayInput(const char* data, std::size_t size) {
+    if (readPaused_) {
+        return; // draining or handing over; the session closes next
+    }
+    inbound_.assign(data, size);
+    handleMessage(inbound_);
+    updateLastActive();
+}
+
+void Session::gatewayClosed() {
+    notifyClosed();
+}
+
+void Session::resumeAs(const std::string& sessionId) {
+    auto previous = std::atomic_exchange(&sessionId_, std::make_shared<const std::string>(sessionId));
+    Logging::info("Session " + *previous + " resumed as " + sessionId);
+}
+
 void Session::updateLastActive() {
     lastActive = std::chrono::steady_clock::now();
 }
@@ -55,66 +282,276 @@ bool Session::isTimedOut(std::chrono::seconds timeout) const {
 }
 
 void Session::readMessage() {
+#ifdef CHAT_IO_URING
+    // One multishot receive for the life of the connection, into buffers
+    // the reactor shares between all sessions
+    if (uringReactor_) {
+        uringReceiving_ = true;
+        uringReactor_->receive(socket_.native_handle(),
+            [this, self = shared_from_this()](const char* data, std::size_t size, int error) {
+                if (size > 0) {
+                    StallWatchdog::HandlerScope scope(StallWatchdog::Handler::Read, std::atomic_load(&sessionId_));
+                    inbound_.assign(data, size);
+                    handleMessage(inbound_);
+                    updateLastActive();
+                    return;
+                }
+                if (error != 0 && error != ECANCELED) {
+                    Logging::error("Read error in session " + getSessionId() + ": " + std::strerror(error));
+                }
+                uringReceiving_ = false;
+                notifyClosed();
+                close();
+            });
+        return;
+    }
+#endif
     readBuffer_.resize(1024);
     
     socket_.async_read_some(
         boost::asio::buffer(readBuffer_),
+        makeCustomAllocHandler(readHandlerMemory_,
         [this, self = shared_from_this()](boost::system::error_code ec, std::size_t length) {
             if (!ec) {
-                std::string message(readBuffer_.data(), length);
-                handleMessage(message);
+                StallWatchdog::HandlerScope scope(StallWatchdog::Handler::Read, std::atomic_load(&sessionId_));
+                // Reuse the inbound string's capacity instead of allocating per read
+                inbound_.assign(readBuffer_.data(), length);
+                handleMessage(inbound_);
                 updateLastActive(); // Update last active time on read
+                if (readPaused_) {
+                    readCancelled_ = false; // the cancel, if any, found nothing pending
+                    readStopped_ = true;
+                    return;
+                }
                 readMessage(); // Continue reading
+            } else if (ec == boost::asio::error::operation_aborted && readCancelled_.exchange(false)) {
+                // Cancelled by pauseReading(), not closed; resumeReading() may have come first
+                readStopped_ = true;
+                if (!readPaused_) {
+                    resumeReading();
+                }
             } else {
-                Logging::error("Read error in session " + sessionId_ + ": " + ec.message());
-                // Handle disconnection
+                if (ec != boost::asio::error::eof && ec != boost::asio::error::operation_aborted) {
+                    Logging::error("Read error in session " + getSessionId() + ": " + ec.message());
+                }
+                notifyClosed();
             }
-        });
+        }));
 }
 
 void Session::handleMessage(const std::string& message) {
-    Logging::info("Message received from session " + sessionId_ + ": " + message);
+    auto received = std::chrono::steady_clock::now();
+    if (TraceRecorder::active()) {
+        TraceRecorder::getInstance().record(getSessionId(), TraceEvent::Frame, message);
+    }
+    if (Logging::debugEnabled()) {
+        Logging::debug("Message received from session " + getSessionId() + ": " + message);
+    }
     
     // Check if this is a command (starts with '/')
     if (!message.empty() && message[0] == '/') {
+        StallWatchdog::HandlerScope::annotate(
+            std::string_view(message).substr(1, message.find_first_of(" \r\n") - 1));
         if (commandManager_) {
             std::string response = commandManager_->processCommand(shared_from_this(), message.substr(1));
-            sendMessage(response);
+            // Asynchronous commands reply later and return nothing here
+            if (!response.empty()) {
+                sendMessage(response);
+            }
         } else {
             sendMessage("Command processing is not available.");
         }
+        sessionMetrics().ingestCommand->record(std::chrono::steady_clock::now() - received);
     } else if (messageHandler_) {
         // Handle as a regular message
         messageHandler_(message, shared_from_this());
+        sessionMetrics().ingestMessage->record(std::chrono::steady_clock::now() - received);
     }
 }
 
-void Session::writeMessage(const std::string& message) {
-    std::lock_guard<std::mutex> lock(writeMutex_);
+// Must be called with writeMutex_ held. Gathers every queued frame into a
+// single async_write; the vectors keep their capacity between writes.
+void Session::writePending() {
+    if (pendingFrames_.empty()) {
+        isWriting_ = false;
+        if (readPaused_ && !readStopped_ && !readCancelled_.exchange(true)) {
+            boost::system::error_code ignored;
+            socket_.cancel(ignored);
+        }
+        return;
+    }
     
-    bool writeInProgress = isWriting_;
-    if (!writeInProgress) {
-        isWriting_ = true;
+    isWriting_ = true;
+    writingFrames_.swap(pendingFrames_);
+    writeBuffers_.clear();
+    std::size_t largest = 0;
+    for (const auto& queued : writingFrames_) {
+        writeBuffers_.emplace_back(boost::asio::buffer(*queued.frame));
+        largest = std::max(largest, queued.frame->size());
     }
     
-    writeBuffer_ = message + "\n";
+#ifdef __linux__
+    // Large fan-out payloads go out without copying them into every socket
+    std::size_t threshold = zeroCopyThreshold.load(std::memory_order_relaxed);
+    if (zeroCopy_ && threshold > 0 && largest >= threshold) {
+        zeroCopyFirstId_ = zeroCopyNextId_;
+        sendZeroCopy();
+        return;
+    }
+#endif
     
-    if (!writeInProgress) {
-        boost::asio::async_write(
-            socket_,
-            boost::asio::buffer(writeBuffer_),
-            [this, self = shared_from_this()](boost::system::error_code ec, std::size_t /*length*/) {
-                std::lock_guard<std::mutex> lock(writeMutex_);
+    boost::asio::async_write(
+        socket_,
+        ConstBufferView(writeBuffers_),
+        makeCustomAllocHandler(writeHandlerMemory_,
+        [this, self = shared_from_this()](boost::system::error_code ec, std::size_t /*length*/) {
+            writeCompleted(ec);
+        }));
+}
+
+void Session::writeCompleted(const boost::system::error_code& ec) {
+    StallWatchdog::HandlerScope scope(StallWatchdog::Handler::Write);
+    {
+        std::lock_guard<ProfiledMutex> lock(writeMutex_);
+        if (!ec) {
+            auto written = std::chrono::steady_clock::now();
+            const auto& metrics = sessionMetrics();
+            for (const auto& queued : writingFrames_) {
+                metrics.delivery[static_cast<int>(queued.fanout)]->record(written - queued.queuedAt);
+            }
+        }
+        writingFrames_.clear();
+        
+        if (!ec) {
+            updateLastActive(); // Update last active time on write
+            writePending();
+            return;
+        }
+        isWriting_ = false;
+        pendingFrames_.clear();
+        Logging::error("Write error in session " + getSessionId() + ": " + ec.message());
+    }
+    close(); // wakes the pending read, which reports the disconnect
+}
+
+#ifdef __linux__
+// Must be called with writeMutex_ held. Each completion is one sendmsg, and
+// each sendmsg that moved bytes takes the socket's next notification id.
+void Session::sendZeroCopy() {
+    socket_.async_send(
+        ConstBufferView(writeBuffers_),
+        MSG_ZEROCOPY,
+        makeCustomAllocHandler(writeHandlerMemory_,
+        [this, self = shared_from_this()](boost::system::error_code ec, std::size_t length) {
+            if (!ec) {
+                std::lock_guard<ProfiledMutex> lock(writeMutex_);
+                ++zeroCopyNextId_;
+                sessionMetrics().zeroCopySends->inc();
+                
+                // Drop what went out and send the rest
+                auto sent = writeBuffers_.begin();
+                while (sent != writeBuffers_.end() && length >= sent->size()) {
+                    length -= sent->size();
+                    ++sent;
+                }
+                writeBuffers_.erase(writeBuffers_.begin(), sent);
+                if (!writeBuffers_.empty()) {
+                    writeBuffers_.front() += length;
+                    sendZeroCopy();
+                    return;
+                }
                 
-                if (!ec) {
-                    isWriting_ = false;
-                    updateLastActive(); // Update last active time on write
-                } else {
-                    Logging::error("Write error in session " + sessionId_ + ": " + ec.message());
-                    // Handle disconnection
+                // The kernel may still be reading these frames; they are
+                // released when the notifications for the sends arrive
+                ZeroCopyHold hold{zeroCopyFirstId_, zeroCopyNextId_ - 1, zeroCopyNextId_ - zeroCopyFirstId_, {}};
+                for (const auto& queued : writingFrames_) {
+                    hold.frames.push_back(queued.frame);
                 }
+                zeroCopyHolds_.push_back(std::move(hold));
+                watchZeroCopy();
+            }
+            writeCompleted(ec);
+        }));
+}
+
+// Must be called with writeMutex_ held. The wait is armed before the error
+// queue is read, since asio only reports notifications that arrive while
+// it is waiting.
+void Session::watchZeroCopy() {
+    if (!zeroCopyWaiting_ && !zeroCopyHolds_.empty()) {
+        zeroCopyWaiting_ = true;
+        socket_.async_wait(boost::asio::ip::tcp::socket::wait_error,
+            [this, self = shared_from_this()](boost::system::error_code ec) {
+                std::lock_guard<ProfiledMutex> lock(writeMutex_);
+                zeroCopyWaiting_ = false;
+                // pauseReading() cancels every wait; the kernel may still hold the frames
+                if (ec == boost::asio::error::operation_aborted && socket_.is_open()) {
+                    watchZeroCopy();
+                    return;
+                }
+                if (ec) {
+                    zeroCopyHolds_.clear(); // closed; nothing more will be reported
+                    return;
+                }
+                watchZeroCopy();
             });
     }
+    reapZeroCopy();
+}
+
+// Must be called with writeMutex_ held. A notification covers a range of
+// send ids; a hold is released once all of its sends are covered.
+void Session::reapZeroCopy() {
+    char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+    for (;;) {
+        msghdr message{};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        if (recvmsg(socket_.native_handle(), &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            return;
+        }
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+            if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+                !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            sock_extended_err error;
+            std::memcpy(&error, CMSG_DATA(cmsg), sizeof(error));
+            if (error.ee_errno != 0 || error.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            std::uint32_t first = error.ee_info;
+            std::uint32_t last = error.ee_data;
+            if (error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                sessionMetrics().zeroCopyCopied->inc(last - first + 1);
+            }
+            for (auto& hold : zeroCopyHolds_) {
+                std::uint32_t from = std::max(first, hold.firstId);
+                std::uint32_t to = std::min(last, hold.lastId);
+                if (from <= to) {
+                    hold.outstanding -= to - from + 1;
+                }
+            }
+            zeroCopyHolds_.erase(std::remove_if(zeroCopyHolds_.begin(), zeroCopyHolds_.end(),
+                                                [](const ZeroCopyHold& hold) { return hold.outstanding == 0; }),
+                                 zeroCopyHolds_.end());
+        }
+    }
+}
+#endif
+
+void Session::notifyClosed() {
+    if (closed_.exchange(true)) {
+        return;
+    }
+    Logging::info("Session disconnected: " + getSessionId());
+    if (TraceRecorder::active()) {
+        TraceRecorder::getInstance().record(getSessionId(), TraceEvent::Close, {});
+    }
+    close();
+    if (closeHandler_) {
+        closeHandler_(shared_from_this());
+    }
 }
 
 } // namespace ChatServer
@@ -9,12 +9,19 @@
 #include <memory>
 #include <functional>
 #include <mutex>
+#include <atomic>
 #include <chrono>
+#include <vector>
+#include <cstdint>
 #include <boost/asio.hpp>
+#include "HandlerAllocator.hpp"
+#include "ProfiledMutex.hpp"
 
 namespace ChatServer {
 
 class CommandManager;
+class GatewayLink;
+class UringReactor;
 
 /**
  * @brief Represents a client session.
@@ -22,6 +29,20 @@ class CommandManager;
 class Session : public std::enable_shared_from_this<Session> {
 public:
     using MessageHandler = std::function<void(const std::string&, std::shared_ptr<Session>)>;
+    using CloseHandler = std::function<void(std::shared_ptr<Session>)>;
+    // A newline-terminated payload that can be shared by many recipients
+    using Frame = std::shared_ptr<const std::string>;
+    
+    // How widely a frame was fanned out; labels the delivery latency metric
+    enum class Fanout : std::uint8_t { Direct, Upto10, Upto100, Upto1000, Over1000 };
+    static Fanout fanoutFor(std::size_t recipients);
+
+    // Build a frame from a message, appending the line terminator
+    static Frame makeFrame(const std::string& message);
+
+    // Send writes carrying a frame of at least this many bytes with
+    // MSG_ZEROCOPY where the platform has it; 0 (the default) turns it off
+    static void setZeroCopyThreshold(std::size_t bytes);
     
     Session(boost::asio::ip::tcp::socket socket, const std::string& sessionId);
     ~Session();
@@ -32,8 +53,14 @@ public:
     // Send a message to the client
     void sendMessage(const std::string& message);
     
-    // Get the session ID
-    const std::string& getSessionId() const;
+    // Send an already framed payload without copying it
+    void sendFrame(Frame frame);
+    
+    // Send a frame queued for delivery at queuedAt as part of a fan-out
+    void sendFrame(Frame frame, Fanout fanout, std::chrono::steady_clock::time_point queuedAt);
+    
+    // Get the session ID; safe from any thread, as resumeAs() may change it
+    std::string getSessionId() const;
     
     // Set the message handler
     void setMessageHandler(MessageHandler handler);
@@ -41,23 +68,104 @@ public:
     // Set the command manager
     void setCommandManager(std::shared_ptr<CommandManager> cmdManager);
 
+    // Set the handler called once when the connection drops or is closed
+    void setCloseHandler(CloseHandler handler);
+
+    // Close the connection; pending reads and writes fail
+    void close();
+
+    // Stop reading once the write in flight, if any, is done; the connection
+    // stays open and unread input stays in the kernel. For a hot restart or
+    // a drain. io_uring receives cannot be paused and carry on.
+    void pauseReading();
+
+    // Undo pauseReading()
+    void resumeReading();
+
+    // Reading has stopped (or cannot be paused) and nothing is being written
+    bool isQuiescent();
+
+    // The connection's descriptor, for handing it to another process
+    int nativeHandle();
+
+#ifdef CHAT_IO_URING
+    // Read through io_uring instead of asio; call before start()
+    void setUringReactor(UringReactor* reactor);
+#endif
+
+    // Talk to a client connected to chat_gateway through the gateway's
+    // link instead of the socket, which stays unopened; call before start()
+    void setGatewayLink(std::shared_ptr<GatewayLink> link, std::uint32_t channel);
+
+    // Called by the gateway link: a read of the client's input, and the
+    // client having disconnected
+    void gatewayInput(const char* data, std::size_t size);
+    void gatewayClosed();
+
+    // Take over another session's identity. Readers on other threads see
+    // either the old or the new id.
+    void resumeAs(const std::string& sessionId);
+
     // Advanced session handling.
     void updateLastActive();
     bool isTimedOut(std::chrono::seconds timeout) const;
 
 private:
+    struct QueuedFrame {
+        Frame frame;
+        std::chrono::steady_clock::time_point queuedAt;
+        Fanout fanout;
+    };
+    
+    // Frames of one zero-copy write, kept until the kernel reports it is
+    // done with every send that carried them
+    struct ZeroCopyHold {
+        std::uint32_t firstId;
+        std::uint32_t lastId;
+        std::uint32_t outstanding;
+        std::vector<Frame> frames;
+    };
+    
     void readMessage();
     void handleMessage(const std::string& message);
-    void writeMessage(const std::string& message);
+    void writePending();
+    void writeCompleted(const boost::system::error_code& ec);
+    void notifyClosed();
+#ifdef __linux__
+    void sendZeroCopy();
+    void watchZeroCopy();
+    void reapZeroCopy();
+#endif
     
     boost::asio::ip::tcp::socket socket_;
-    std::string sessionId_;
+    std::shared_ptr<const std::string> sessionId_; // std::atomic_load/atomic_store only
     std::string readBuffer_;
-    std::string writeBuffer_;
+    std::string inbound_;
+    std::vector<QueuedFrame> pendingFrames_;   // queued while a write is in flight
+    std::vector<QueuedFrame> writingFrames_;   // owned by the in-flight write
+    std::vector<boost::asio::const_buffer> writeBuffers_;
+    HandlerMemory readHandlerMemory_;
+    HandlerMemory writeHandlerMemory_;
     MessageHandler messageHandler_;
     std::shared_ptr<CommandManager> commandManager_;
-    std::mutex writeMutex_;
-    bool isWriting_;
+    CloseHandler closeHandler_;
+    std::atomic<bool> closed_;
+    std::atomic<bool> readPaused_{false};     // pauseReading() was called
+    std::atomic<bool> readCancelled_{false};  // the pending read was cancelled to pause
+    std::atomic<bool> readStopped_{false};    // no read is pending while paused
+#ifdef CHAT_IO_URING
+    UringReactor* uringReactor_ = nullptr;
+    std::atomic<bool> uringReceiving_{false};  // the reactor still reads this socket's fd
+#endif
+    std::shared_ptr<GatewayLink> gatewayLink_;
+    std::uint32_t gatewayChannel_ = 0;
+    ProfiledMutex writeMutex_{"Session::writeMutex_"};
+    bool isWriting_;                     // a write is in flight or scheduled
+    bool zeroCopy_ = false;              // SO_ZEROCOPY is on for this socket
+    bool zeroCopyWaiting_ = false;       // an error queue wait is armed
+    std::uint32_t zeroCopyNextId_ = 0;   // the kernel numbers zero-copy sends per socket
+    std::uint32_t zeroCopyFirstId_ = 0;  // first send of the write in flight
+    std::vector<ZeroCopyHold> zeroCopyHolds_;
     std::chrono::steady_clock::time_point lastActive;
 };
 
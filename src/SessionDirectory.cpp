@@ -0,0 +1,342 @@
+/**
+ * @file SessionDirectory.cpp
+ * @brief Implementation of the cluster-wide session directory.
+ */
+
+#include "SessionDirectory.hpp"
+#include "BusCodec.hpp"
+#include "Logging.hpp"
+#include "Metrics.hpp"
+#include "Session.hpp"
+#include "SessionManager.hpp"
+
+#include <algorithm>
+
+namespace ChatServer {
+
+using namespace BusCodec;
+
+/*
+ * Directory messages travel as bus payloads: an op byte and its fields.
+ *
+ *   'r' session      register: the sender serves the session
+ *   'u' session      unregister: it no longer does
+ *   'q' id, session  query the home for the serving node
+ *   'a' id, node     answer; empty when no node serves it
+ *   'i' session      invalidate a cached location
+ *   'm' id, session, message   hand a message to the session
+ *   'k' id, flag     acknowledge 'm'; "1" when delivered
+ */
+
+SessionDirectory::SessionDirectory(boost::asio::io_context& io, std::shared_ptr<MessageBus> bus,
+                                   std::shared_ptr<SessionManager> sessionManager,
+                                   const SessionDirectoryConfig& config)
+    : io_(io),
+      bus_(std::move(bus)),
+      sessionManager_(std::move(sessionManager)),
+      config_(config),
+      ring_(config.virtualNodes),
+      queries_(MetricsRegistry::getInstance().counter(
+          "chat_directory_queries_total", "Session locations asked of their home node")),
+      cacheHits_(MetricsRegistry::getInstance().counter(
+          "chat_directory_cache_hits_total", "Session locations answered from this node's cache")) {}
+
+void SessionDirectory::nodesChanged(const std::vector<std::string>& nodes) {
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        ring_.assign(nodes);
+        cache_.clear();
+        for (auto it = shard_.begin(); it != shard_.end();) {
+            if (homeOf(it->first) != nodeId() || !ring_.contains(it->second.node)) {
+                it = shard_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    Logging::info("Session directory spans " + std::to_string(nodes.size()) + " nodes");
+
+    // Homes may have moved, or a restarted node may have lost its shard
+    for (const auto& pair : sessionManager_->getAllSessions()) {
+        sessionChanged(pair.first, true);
+    }
+}
+
+void SessionDirectory::received(const std::string& fromNode, const std::string& payload) {
+    if (payload.empty()) {
+        return;
+    }
+    std::size_t pos = 1;
+    std::uint64_t requestId = 0;
+    std::string sessionId;
+    std::string field;
+
+    switch (payload[0]) {
+    case 'r':
+    case 'u': {
+        std::vector<std::string> watchers;
+        sessionId = payload.substr(pos);
+        {
+            std::lock_guard<ProfiledMutex> lock(mutex_);
+            setOwner(sessionId, fromNode, payload[0] == 'r', watchers);
+        }
+        invalidate(watchers, sessionId);
+        return;
+    }
+    case 'q':
+        if (getVarint(payload, pos, requestId) && getString(payload, pos, sessionId)) {
+            std::string answer("a");
+            putVarint(answer, requestId);
+            {
+                std::lock_guard<ProfiledMutex> lock(mutex_);
+                auto it = shard_.find(sessionId);
+                if (it != shard_.end()) {
+                    it->second.watchers.insert(fromNode);
+                    putString(answer, it->second.node);
+                } else {
+                    putString(answer, "");
+                }
+            }
+            bus_->sendTo(fromNode, answer);
+            return;
+        }
+        break;
+    case 'a':
+        if (getVarint(payload, pos, requestId) && getString(payload, pos, field)) {
+            complete(requestId, true, field);
+            return;
+        }
+        break;
+    case 'i': {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        cache_.erase(payload.substr(pos));
+        return;
+    }
+    case 'm':
+        if (getVarint(payload, pos, requestId) && getString(payload, pos, sessionId) &&
+            getString(payload, pos, field)) {
+            std::string ack("k");
+            putVarint(ack, requestId);
+            putString(ack, deliverLocal(sessionId, field) ? "1" : "");
+            bus_->sendTo(fromNode, ack);
+            return;
+        }
+        break;
+    case 'k':
+        if (getVarint(payload, pos, requestId) && getString(payload, pos, field)) {
+            complete(requestId, field == "1", "");
+            return;
+        }
+        break;
+    }
+    Logging::error("Malformed session directory message from " + fromNode + "; ignored");
+}
+
+void SessionDirectory::sessionChanged(const std::string& sessionId, bool online) {
+    std::vector<std::string> watchers;
+    std::string home;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        cache_.erase(sessionId);
+        home = homeOf(sessionId);
+        if (home == nodeId()) {
+            setOwner(sessionId, home, online, watchers);
+        }
+    }
+    if (home == nodeId()) {
+        invalidate(watchers, sessionId);
+    } else {
+        bus_->sendTo(home, std::string(online ? "r" : "u") + sessionId);
+    }
+}
+
+void SessionDirectory::lookup(const std::string& sessionId, LookupHandler handler) {
+    if (sessionManager_->getSession(sessionId)) {
+        handler(nodeId());
+        return;
+    }
+    std::string node;
+    bool known = true;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        if (homeOf(sessionId) == nodeId()) {
+            auto it = shard_.find(sessionId);
+            if (it != shard_.end()) {
+                node = it->second.node;
+            }
+        } else {
+            auto it = cache_.find(sessionId);
+            known = it != cache_.end();
+            if (known) {
+                node = it->second;
+                cacheHits_.inc();
+            }
+        }
+    }
+    if (known) {
+        handler(node);
+    } else {
+        query(sessionId, std::move(handler)); // not cached here; ask its home
+    }
+}
+
+void SessionDirectory::deliver(const std::string& sessionId, const std::string& message, DeliveryHandler handler) {
+    if (deliverLocal(sessionId, message)) {
+        handler(true);
+        return;
+    }
+    std::string cached;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        auto it = cache_.find(sessionId);
+        if (it != cache_.end()) {
+            cached = it->second;
+            cacheHits_.inc();
+        }
+    }
+    if (!cached.empty()) {
+        sendDirect(cached, sessionId, message, true, std::move(handler));
+        return;
+    }
+    auto self = shared_from_this();
+    lookup(sessionId, [self, sessionId, message, handler](const std::string& node) {
+        if (node.empty() || node == self->nodeId()) {
+            handler(false);
+        } else {
+            self->sendDirect(node, sessionId, message, false, handler);
+        }
+    });
+}
+
+// Caller holds mutex_
+const std::string& SessionDirectory::homeOf(const std::string& sessionId) const {
+    return ring_.ownerOf(sessionId, nodeId());
+}
+
+void SessionDirectory::request(const std::string& node, char op, const std::string& body, Completion done) {
+    auto timer = std::make_shared<boost::asio::steady_timer>(io_, config_.queryTimeout);
+    std::uint64_t requestId = 0;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        requestId = nextRequestId_++;
+        pending_[requestId] = Pending{std::move(done), timer};
+    }
+    std::weak_ptr<SessionDirectory> weakSelf = shared_from_this();
+    timer->async_wait([weakSelf, requestId](boost::system::error_code ec) {
+        auto self = weakSelf.lock();
+        if (!ec && self) {
+            self->complete(requestId, false, "");
+        }
+    });
+
+    std::string payload(1, op);
+    putVarint(payload, requestId);
+    payload.append(body);
+    bus_->sendTo(node, payload);
+}
+
+void SessionDirectory::complete(std::uint64_t requestId, bool ok, const std::string& answer) {
+    Pending pending;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        auto it = pending_.find(requestId);
+        if (it == pending_.end()) {
+            return; // answered after it timed out
+        }
+        pending = std::move(it->second);
+        pending_.erase(it);
+    }
+    pending.timer->cancel();
+    pending.done(ok, answer);
+}
+
+void SessionDirectory::query(const std::string& sessionId, LookupHandler handler) {
+    std::string home;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        home = homeOf(sessionId);
+    }
+    queries_.inc();
+    std::string body;
+    putString(body, sessionId);
+    auto self = shared_from_this();
+    request(home, 'q', body, [self, sessionId, handler](bool ok, const std::string& node) {
+        // Answers arrive in order with the home's invalidations, so one
+        // cached here is current until the next 'i' for it
+        if (ok && !node.empty() && node != self->nodeId()) {
+            std::lock_guard<ProfiledMutex> lock(self->mutex_);
+            if (self->cache_.size() >= self->config_.maxCached) {
+                self->cache_.erase(self->cache_.begin());
+            }
+            self->cache_[sessionId] = node;
+        }
+        handler(ok ? node : std::string());
+    });
+}
+
+void SessionDirectory::sendDirect(const std::string& node, const std::string& sessionId, const std::string& message,
+                                  bool retry, DeliveryHandler handler) {
+    std::string body;
+    putString(body, sessionId);
+    putString(body, message);
+    auto self = shared_from_this();
+    request(node, 'm', body, [self, node, sessionId, message, retry, handler](bool delivered, const std::string&) {
+        if (delivered || !retry) {
+            handler(delivered);
+            return;
+        }
+        // The cached location was stale: forget it and ask the home
+        {
+            std::lock_guard<ProfiledMutex> lock(self->mutex_);
+            auto it = self->cache_.find(sessionId);
+            if (it != self->cache_.end() && it->second == node) {
+                self->cache_.erase(it);
+            }
+        }
+        self->query(sessionId, [self, sessionId, message, handler](const std::string& owner) {
+            if (owner.empty() || owner == self->nodeId()) {
+                handler(self->deliverLocal(sessionId, message));
+            } else {
+                self->sendDirect(owner, sessionId, message, false, handler);
+            }
+        });
+    });
+}
+
+// Caller holds mutex_. Nodes that may have cached the old entry are added
+// to invalidate.
+void SessionDirectory::setOwner(const std::string& sessionId, const std::string& node, bool online,
+                                std::vector<std::string>& invalidate) {
+    auto it = shard_.find(sessionId);
+    if (online) {
+        if (it == shard_.end()) {
+            shard_[sessionId].node = node;
+        } else if (it->second.node != node) {
+            invalidate.assign(it->second.watchers.begin(), it->second.watchers.end());
+            it->second.watchers.clear();
+            it->second.node = node;
+        }
+    } else if (it != shard_.end() && it->second.node == node) {
+        invalidate.assign(it->second.watchers.begin(), it->second.watchers.end());
+        shard_.erase(it);
+    }
+}
+
+void SessionDirectory::invalidate(const std::vector<std::string>& nodes, const std::string& sessionId) {
+    for (const auto& node : nodes) {
+        if (node != nodeId()) {
+            bus_->sendTo(node, "i" + sessionId);
+        }
+    }
+}
+
+bool SessionDirectory::deliverLocal(const std::string& sessionId, const std::string& message) {
+    auto session = sessionManager_->getSession(sessionId);
+    if (!session) {
+        return false;
+    }
+    session->sendMessage(message);
+    return true;
+}
+
+} // namespace ChatServer
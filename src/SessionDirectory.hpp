@@ -0,0 +1,114 @@
+/**
+ * @file SessionDirectory.hpp
+ * @brief Cluster-wide map from session ID to the node serving it.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/asio.hpp>
+
+#include "HashRing.hpp"
+#include "MessageBus.hpp"
+#include "ProfiledMutex.hpp"
+
+namespace ChatServer {
+
+class Counter;
+class SessionManager;
+
+struct SessionDirectoryConfig {
+    std::chrono::milliseconds queryTimeout{2000};  // a node that has not answered by then is treated as gone
+    int virtualNodes = 64;                         // ring points per node
+    std::size_t maxCached = 100000;                // cached locations of other nodes' sessions
+};
+
+/**
+ * @brief Knows which node serves each session, without broadcasting.
+ *
+ * Every session ID has a home node, picked by consistent hashing over the
+ * nodes on the bus. The node serving a session registers it with its home;
+ * any node can ask the home where a session is and caches the answer. The
+ * home remembers who asked and tells them when the entry changes, so a
+ * cached location is either current or about to be invalidated. Messages
+ * for a session then go straight to the node serving it, one hop; if that
+ * node no longer has it the entry is dropped and the home is asked once more.
+ *
+ * When nodes join or leave, homes move: each node clears its cache, drops
+ * entries it is no longer home for or whose node has left, and registers
+ * its own sessions again with their homes.
+ */
+class SessionDirectory : public std::enable_shared_from_this<SessionDirectory> {
+public:
+    // The node serving the session, or empty if none is
+    using LookupHandler = std::function<void(const std::string& node)>;
+    using DeliveryHandler = std::function<void(bool delivered)>;
+
+    SessionDirectory(boost::asio::io_context& io, std::shared_ptr<MessageBus> bus,
+                     std::shared_ptr<SessionManager> sessionManager,
+                     const SessionDirectoryConfig& config = SessionDirectoryConfig());
+
+    const std::string& nodeId() const { return bus_->nodeId(); }
+
+    // Bus handlers: the nodes now on the bus, and a message from one of them
+    void nodesChanged(const std::vector<std::string>& nodes);
+    void received(const std::string& fromNode, const std::string& payload);
+
+    // A session started or stopped being served here
+    void sessionChanged(const std::string& sessionId, bool online);
+
+    // Handlers run on an io thread, possibly before these return
+    void lookup(const std::string& sessionId, LookupHandler handler);
+    void deliver(const std::string& sessionId, const std::string& message, DeliveryHandler handler);
+
+private:
+    // Home node's record of a session it is home for
+    struct Entry {
+        std::string node;                 // serving the session
+        std::set<std::string> watchers;   // nodes that may have cached it
+    };
+
+    // Completes a query or delivery with (ok, answer)
+    using Completion = std::function<void(bool ok, const std::string& answer)>;
+
+    struct Pending {
+        Completion done;
+        std::shared_ptr<boost::asio::steady_timer> timer;
+    };
+
+    const std::string& homeOf(const std::string& sessionId) const;
+    void request(const std::string& node, char op, const std::string& body, Completion done);
+    void complete(std::uint64_t requestId, bool ok, const std::string& answer);
+    void query(const std::string& sessionId, LookupHandler handler);
+    void sendDirect(const std::string& node, const std::string& sessionId, const std::string& message,
+                    bool retry, DeliveryHandler handler);
+    void setOwner(const std::string& sessionId, const std::string& node, bool online,
+                  std::vector<std::string>& invalidate);
+    void invalidate(const std::vector<std::string>& nodes, const std::string& sessionId);
+    bool deliverLocal(const std::string& sessionId, const std::string& message);
+
+    boost::asio::io_context& io_;
+    std::shared_ptr<MessageBus> bus_;
+    std::shared_ptr<SessionManager> sessionManager_;
+    SessionDirectoryConfig config_;
+
+    mutable ProfiledMutex mutex_{"SessionDirectory::mutex_"};
+    HashRing ring_;                                               // empty until the bus reports
+    std::unordered_map<std::string, Entry> shard_;                // sessions homed here
+    std::unordered_map<std::string, std::string> cache_;          // other nodes' sessions
+    std::unordered_map<std::uint64_t, Pending> pending_;
+    std::uint64_t nextRequestId_ = 1;
+
+    Counter& queries_;
+    Counter& cacheHits_;
+};
+
+} // namespace ChatServer
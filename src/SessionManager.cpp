@@ -24,22 +24,62 @@ SessionManager::SessionManager() {
 }
 
 void SessionManager::addSession(std::shared_ptr<Session> session) {
-    std::lock_guard<std::mutex> lock(mutex);
-    sessions[session->getSessionId()] = session;
-    Logging::info("Session added: " + session->getSessionId());
+    std::string sessionId = session->getSessionId();
+    std::shared_ptr<const PresenceObserver> observer;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex);
+        sessions[sessionId] = session;
+        observer = presenceObserver;
+    }
+    Logging::info("Session added: " + sessionId);
+    if (observer) {
+        (*observer)(sessionId, true);
+    }
 }
 
 void SessionManager::removeSession(const std::string& sessionId) {
-    std::lock_guard<std::mutex> lock(mutex);
-    auto it = sessions.find(sessionId);
-    if (it != sessions.end()) {
+    std::shared_ptr<const PresenceObserver> observer;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex);
+        auto it = sessions.find(sessionId);
+        if (it == sessions.end()) {
+            return;
+        }
+        sessions.erase(it);
+        observer = presenceObserver;
+    }
+    Logging::info("Session removed: " + sessionId);
+    if (observer) {
+        (*observer)(sessionId, false);
+    }
+}
+
+bool SessionManager::removeSession(const std::shared_ptr<Session>& session) {
+    std::string sessionId = session->getSessionId();
+    std::shared_ptr<const PresenceObserver> observer;
+    {
+        std::lock_guard<ProfiledMutex> lock(mutex);
+        auto it = sessions.find(sessionId);
+        if (it == sessions.end() || it->second != session) {
+            return false;
+        }
         sessions.erase(it);
-        Logging::info("Session removed: " + sessionId);
+        observer = presenceObserver;
     }
+    Logging::info("Session removed: " + sessionId);
+    if (observer) {
+        (*observer)(sessionId, false);
+    }
+    return true;
+}
+
+void SessionManager::setPresenceObserver(PresenceObserver observer) {
+    std::lock_guard<ProfiledMutex> lock(mutex);
+    presenceObserver = observer ? std::make_shared<const PresenceObserver>(std::move(observer)) : nullptr;
 }
 
 std::shared_ptr<Session> SessionManager::getSession(const std::string& sessionId) {
-    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<ProfiledMutex> lock(mutex);
     auto it = sessions.find(sessionId);
     if (it != sessions.end()) {
         return it->second;
@@ -48,21 +88,23 @@ std::shared_ptr<Session> SessionManager::getSession(const std::string& sessionId
 }
 
 std::map<std::string, std::shared_ptr<Session>> SessionManager::getAllSessions() const {
-    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<ProfiledMutex> lock(mutex);
     return sessions;
 }
 
 void SessionManager::broadcastMessage(const std::string& message, const std::string& senderSessionId) {
     std::map<std::string, std::shared_ptr<Session>> sessionsCopy;
     {
-        std::lock_guard<std::mutex> lock(mutex);
+        std::lock_guard<ProfiledMutex> lock(mutex);
         sessionsCopy = sessions;
     }
     
+    auto frame = Session::makeFrame(message);
+    
     for (const auto& pair : sessionsCopy) {
         // Don't send the message back to the sender
         if (pair.first != senderSessionId) {
-            pair.second->sendMessage(message);
+            pair.second->sendFrame(frame);
         }
     }
     
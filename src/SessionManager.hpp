@@ -5,11 +5,14 @@
 
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <map>
 #include <mutex>
 #include <string>
 
+#include "ProfiledMutex.hpp"
+
 namespace ChatServer {
 
 class Session;
@@ -30,6 +33,9 @@ private:
     };
     
 public:
+    // Told when a session ID starts or stops being served here
+    using PresenceObserver = std::function<void(const std::string& sessionId, bool online)>;
+    
     // Singleton instance
     static std::shared_ptr<SessionManager> getInstance();
     
@@ -39,6 +45,9 @@ public:
     // Remove a session
     void removeSession(const std::string& sessionId);
     
+    // Remove a session only if it is still the one registered under its ID
+    bool removeSession(const std::shared_ptr<Session>& session);
+    
     // Get a session by ID
     std::shared_ptr<Session> getSession(const std::string& sessionId);
     
@@ -48,13 +57,17 @@ public:
     // Broadcast a message to all sessions
     void broadcastMessage(const std::string& message, const std::string& senderSessionId = "");
     
+    // Called outside the lock after every add and remove from now on
+    void setPresenceObserver(PresenceObserver observer);
+    
     // Public destructor
     ~SessionManager() = default;
 
 private:
     static std::shared_ptr<SessionManager> instance;
     std::map<std::string, std::shared_ptr<Session>> sessions;
-    mutable std::mutex mutex;
+    std::shared_ptr<const PresenceObserver> presenceObserver;
+    mutable ProfiledMutex mutex{"SessionManager::mutex"};
     
     // Friend declaration for the creator
     friend struct SessionManagerCreator;
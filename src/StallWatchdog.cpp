@@ -0,0 +1,292 @@
+/**
+ * @file StallWatchdog.cpp
+ * @brief Implementation of the stall watchdog.
+ */
+
+#include "StallWatchdog.hpp"
+#include "Logging.hpp"
+#include "Metrics.hpp"
+
+#include <sstream>
+#include <boost/stacktrace.hpp>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+namespace ChatServer {
+
+namespace {
+
+std::int64_t nowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+// One per thread that ever ran a handler scope. The monitor thread only reads
+// the atomics and, once dumpReady is set, the dump; command is touched by the
+// owning thread alone.
+struct StallWatchdog::ThreadSlot {
+    std::atomic<std::int64_t> startedNanos{0};        // 0 while idle
+    std::atomic<int> handler{0};
+    std::atomic<std::int64_t> reportedNanos{0};       // start time already reported as in flight
+    std::string command;                              // annotated command of the running handler
+    std::thread::id thread = std::this_thread::get_id();
+#ifdef __linux__
+    pthread_t native = pthread_self();
+    std::atomic<bool> dumpReady{false};
+    char dump[8192];                                  // raw frames written by the signal handler
+#endif
+};
+
+#ifdef __linux__
+namespace {
+
+// The running thread's slot, for the stack dump signal handler
+thread_local StallWatchdog::ThreadSlot* signalSlot = nullptr;
+
+const int kDumpSignal = SIGUSR2;
+
+} // namespace
+
+// Runs on the stalled thread; only async-signal-safe work here
+void StallWatchdog::dumpStack(int /*signal*/) {
+    ThreadSlot* slot = signalSlot;
+    if (slot) {
+        boost::stacktrace::safe_dump_to(slot->dump, sizeof(slot->dump));
+        slot->dumpReady.store(true, std::memory_order_release);
+    }
+}
+#endif
+
+// Reschedules itself every tick and records how late each tick fires
+class StallWatchdog::LoopProbe : public std::enable_shared_from_this<LoopProbe> {
+public:
+    LoopProbe(boost::asio::io_context& io_context, StallWatchdog& watchdog)
+        : timer_(io_context), watchdog_(watchdog) {}
+
+    void schedule() {
+        expected_ = std::chrono::steady_clock::now() + watchdog_.tickInterval_;
+        timer_.expires_at(expected_);
+        timer_.async_wait([self = shared_from_this()](boost::system::error_code ec) {
+            if (ec) {
+                return;
+            }
+            auto lag = std::chrono::steady_clock::now() - self->expected_;
+            self->watchdog_.loopLag_.record(lag);
+            self->watchdog_.loopLagMicros_.set(
+                std::chrono::duration_cast<std::chrono::microseconds>(lag).count());
+            self->schedule();
+        });
+    }
+
+    void cancel() {
+        boost::asio::post(timer_.get_executor(), [self = shared_from_this()]() { self->timer_.cancel(); });
+    }
+
+private:
+    boost::asio::steady_timer timer_;
+    StallWatchdog& watchdog_;
+    std::chrono::steady_clock::time_point expected_;
+};
+
+StallWatchdog& StallWatchdog::getInstance() {
+    static StallWatchdog instance;
+    return instance;
+}
+
+StallWatchdog::StallWatchdog()
+    : thresholdNanos_(std::chrono::nanoseconds(WatchdogConfig().stallThreshold).count()),
+      captureBacktrace_(WatchdogConfig().captureBacktrace),
+      tickInterval_(WatchdogConfig().tickInterval),
+      stalls_(MetricsRegistry::getInstance().counter(
+          "chat_handler_stalls_total", "Completion handlers that ran past the stall threshold")),
+      loopLagMicros_(MetricsRegistry::getInstance().gauge(
+          "chat_event_loop_lag_microseconds", "How late the last loop probe tick fired")),
+      loopLag_(MetricsRegistry::getInstance().latency(
+          "chat_event_loop_lag_seconds", "How late loop probe ticks fire")),
+      stopping_(true) {
+    auto& metrics = MetricsRegistry::getInstance();
+    for (std::size_t i = 0; i < handlerLatency_.size(); ++i) {
+        handlerLatency_[i] = &metrics.latency(
+            "chat_handler_seconds", "Run time of io completion handlers",
+            std::string("handler=\"") + handlerName(static_cast<Handler>(i)) + "\"");
+    }
+}
+
+const char* StallWatchdog::handlerName(Handler handler) {
+    switch (handler) {
+    case Handler::Read: return "read";
+    case Handler::Write: return "write";
+    case Handler::Accept: return "accept";
+    case Handler::Timer: return "timer";
+    default: return "admin";
+    }
+}
+
+void StallWatchdog::configure(const WatchdogConfig& config) {
+    thresholdNanos_.store(std::chrono::nanoseconds(config.stallThreshold).count(), std::memory_order_relaxed);
+    captureBacktrace_.store(config.captureBacktrace, std::memory_order_relaxed);
+    tickInterval_ = config.tickInterval;
+}
+
+void StallWatchdog::start(boost::asio::io_context& io_context) {
+    std::lock_guard<std::mutex> lock(monitorMutex_);
+    if (!stopping_) {
+        return;
+    }
+    stopping_ = false;
+#ifdef __linux__
+    struct sigaction action = {};
+    action.sa_handler = &StallWatchdog::dumpStack;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(kDumpSignal, &action, nullptr);
+#endif
+    probe_ = std::make_shared<LoopProbe>(io_context, *this);
+    probe_->schedule();
+    monitor_ = std::thread([this]() { monitor(); });
+}
+
+void StallWatchdog::stop() {
+    {
+        std::lock_guard<std::mutex> lock(monitorMutex_);
+        if (stopping_) {
+            return;
+        }
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    if (monitor_.joinable()) {
+        monitor_.join();
+    }
+    probe_->cancel();
+    probe_.reset();
+}
+
+StallWatchdog::ThreadSlot* StallWatchdog::threadSlot() {
+    thread_local ThreadSlot* slot = nullptr;
+    if (!slot) {
+        auto owned = std::make_unique<ThreadSlot>();
+        slot = owned.get();
+#ifdef __linux__
+        signalSlot = slot;
+#endif
+        std::lock_guard<std::mutex> lock(slotsMutex_);
+        slots_.push_back(std::move(owned));
+    }
+    return slot;
+}
+
+// Polls at half the threshold so an in-flight stall is seen within 1.5x of it
+void StallWatchdog::monitor() {
+    std::unique_lock<std::mutex> lock(monitorMutex_);
+    while (!stopping_) {
+        auto threshold = std::chrono::nanoseconds(thresholdNanos_.load(std::memory_order_relaxed));
+        wake_.wait_for(lock, std::max<std::chrono::nanoseconds>(threshold / 2, std::chrono::milliseconds(1)));
+        if (stopping_) {
+            return;
+        }
+
+        std::int64_t now = nowNanos();
+        std::lock_guard<std::mutex> slotsLock(slotsMutex_);
+        for (auto& slot : slots_) {
+            std::int64_t started = slot->startedNanos.load(std::memory_order_acquire);
+            if (started == 0 || now - started < threshold.count() ||
+                slot->reportedNanos.load(std::memory_order_relaxed) == started) {
+                continue;
+            }
+            slot->reportedNanos.store(started, std::memory_order_relaxed);
+            std::ostringstream message;
+            message << "Handler " << handlerName(static_cast<Handler>(slot->handler.load()))
+                    << " on thread " << slot->thread << " still running after "
+                    << (now - started) / 1000000 << " ms";
+            if (captureBacktrace_.load(std::memory_order_relaxed)) {
+                message << captureStack(*slot);
+            }
+            Logging::warning(message.str());
+        }
+    }
+}
+
+// Where the thread is right now: signal it to dump its own stack and wait
+// briefly for the dump. Elsewhere there is no portable way to do this, and
+// the handler's own report carries the stack at the end of the handler.
+std::string StallWatchdog::captureStack(ThreadSlot& slot) {
+#ifdef __linux__
+    slot.dumpReady.store(false, std::memory_order_relaxed);
+    if (pthread_kill(slot.native, kDumpSignal) != 0) {
+        return "";
+    }
+    for (int waited = 0; waited < 50; ++waited) {
+        if (slot.dumpReady.load(std::memory_order_acquire)) {
+            return "\n" + boost::stacktrace::to_string(
+                boost::stacktrace::stacktrace::from_dump(slot.dump, sizeof(slot.dump)));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+#else
+    (void)slot;
+#endif
+    return "";
+}
+
+void StallWatchdog::reportStall(Handler handler, const std::string* sessionId, std::string_view command,
+                                std::chrono::nanoseconds elapsed, bool withStack) {
+    stalls_.inc();
+    std::string message = std::string("Stalled ") + handlerName(handler) + " handler ran " +
+                          std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()) +
+                          " us";
+    if (sessionId) {
+        message += " for session " + *sessionId;
+    }
+    if (!command.empty()) {
+        message += " running /" + std::string(command);
+    }
+    if (withStack && captureBacktrace_.load(std::memory_order_relaxed)) {
+        message += "\n" + boost::stacktrace::to_string(boost::stacktrace::stacktrace());
+    }
+    Logging::warning(message);
+}
+
+StallWatchdog::HandlerScope::HandlerScope(Handler handler, std::shared_ptr<const std::string> sessionId)
+    : slot_(StallWatchdog::getInstance().threadSlot()), handler_(handler), sessionId_(std::move(sessionId)) {
+    if (slot_->startedNanos.load(std::memory_order_relaxed) != 0) {
+        slot_ = nullptr; // nested inside another handler's scope
+        return;
+    }
+    started_ = std::chrono::steady_clock::now();
+    slot_->command.clear();
+    slot_->handler.store(static_cast<int>(handler), std::memory_order_relaxed);
+    slot_->startedNanos.store(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(started_.time_since_epoch()).count(),
+        std::memory_order_release);
+}
+
+StallWatchdog::HandlerScope::~HandlerScope() {
+    if (!slot_) {
+        return;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - started_;
+    std::int64_t started = slot_->startedNanos.exchange(0, std::memory_order_acq_rel);
+
+    StallWatchdog& watchdog = StallWatchdog::getInstance();
+    watchdog.handlerLatency_[static_cast<std::size_t>(handler_)]->record(elapsed);
+    if (elapsed.count() >= watchdog.thresholdNanos_.load(std::memory_order_relaxed)) {
+        // The monitor already logged where it was stuck if it caught it in flight
+        bool caughtInFlight = slot_->reportedNanos.load(std::memory_order_relaxed) == started;
+        watchdog.reportStall(handler_, sessionId_.get(), slot_->command, elapsed, !caughtInFlight);
+    }
+}
+
+void StallWatchdog::HandlerScope::annotate(std::string_view command) {
+    ThreadSlot* slot = StallWatchdog::getInstance().threadSlot();
+    if (slot->startedNanos.load(std::memory_order_relaxed) != 0) {
+        slot->command.assign(command.data(), command.size());
+    }
+}
+
+} // namespace ChatServer
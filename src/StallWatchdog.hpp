@@ -0,0 +1,118 @@
+/**
+ * @file StallWatchdog.hpp
+ * @brief Detects io handlers that block their thread and measures loop lag.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+
+namespace ChatServer {
+
+class Counter;
+class Gauge;
+class LatencyHistogram;
+
+struct WatchdogConfig {
+    std::chrono::milliseconds stallThreshold{50};  // handlers running longer are reported
+    std::chrono::milliseconds tickInterval{100};   // loop lag probe period
+    bool captureBacktrace = true;                  // attach a stack trace to stall reports
+};
+
+/**
+ * @brief Times io completion handlers and reports the ones that stall.
+ *
+ * Handlers mark their body with a HandlerScope. Each scope's run time goes
+ * into chat_handler_seconds{handler=...}. One that runs past the threshold
+ * is logged when it finishes, with its session, command and a backtrace.
+ * While it is still running, a monitor thread logs it once as in flight, so
+ * a handler that never returns is seen too. A timer on the io_context
+ * measures how late it fires (loop lag).
+ */
+class StallWatchdog {
+public:
+    struct ThreadSlot; // per-thread handler state, internal
+
+    enum class Handler { Read, Write, Accept, Timer, Admin };
+
+    static StallWatchdog& getInstance();
+
+    // Apply settings; call before start()
+    void configure(const WatchdogConfig& config);
+
+    // Start the loop lag probe on io_context and the monitor thread
+    void start(boost::asio::io_context& io_context);
+
+    void stop();
+
+    /**
+     * @brief Marks the body of a completion handler.
+     *
+     * Only the outermost scope on a thread counts. The session id is shared,
+     * not copied, so a stall report names the id the handler started with.
+     */
+    class HandlerScope {
+    public:
+        explicit HandlerScope(Handler handler, std::shared_ptr<const std::string> sessionId = nullptr);
+        ~HandlerScope();
+
+        HandlerScope(const HandlerScope&) = delete;
+        HandlerScope& operator=(const HandlerScope&) = delete;
+
+        // Name the command the current handler is running, for stall reports
+        static void annotate(std::string_view command);
+
+    private:
+        ThreadSlot* slot_;
+        std::chrono::steady_clock::time_point started_;
+        Handler handler_;
+        std::shared_ptr<const std::string> sessionId_;
+    };
+
+private:
+    StallWatchdog();
+
+    class LoopProbe;
+
+    void monitor();
+    void reportStall(Handler handler, const std::string* sessionId, std::string_view command,
+                     std::chrono::nanoseconds elapsed, bool withStack);
+    std::string captureStack(ThreadSlot& slot);
+    ThreadSlot* threadSlot();
+#ifdef __linux__
+    static void dumpStack(int signal);
+#endif
+
+    static const char* handlerName(Handler handler);
+
+    std::atomic<std::int64_t> thresholdNanos_;
+    std::atomic<bool> captureBacktrace_;
+    std::chrono::milliseconds tickInterval_;
+
+    std::mutex slotsMutex_;
+    std::vector<std::unique_ptr<ThreadSlot>> slots_;
+
+    std::array<LatencyHistogram*, 5> handlerLatency_;
+    Counter& stalls_;
+    Gauge& loopLagMicros_;
+    LatencyHistogram& loopLag_;
+
+    std::shared_ptr<LoopProbe> probe_;
+    std::thread monitor_;
+    std::mutex monitorMutex_;
+    std::condition_variable wake_;
+    bool stopping_;
+};
+
+} // namespace ChatServer
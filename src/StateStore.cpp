@@ -0,0 +1,657 @@
+/**
+ * @file StateStore.cpp
+ * @brief Implementation of the snapshot + journal state store.
+ */
+
+#include "StateStore.hpp"
+#include "ChatRoom.hpp"
+#include "ResumeRegistry.hpp"
+#include "UserManager.hpp"
+#include "Logging.hpp"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstring>
+#include <filesystem>
+#include <set>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace ChatServer {
+
+namespace {
+
+// Formats are host-endian; state files are not meant to move between machines.
+const char kSnapshotMagic[8] = {'C', 'H', 'S', 'N', 'A', 'P', '0', '2'};
+const char kSnapshotMagicV1[8] = {'C', 'H', 'S', 'N', 'A', 'P', '0', '1'}; // no identities
+const char kJournalMagic[8] = {'C', 'H', 'J', 'R', 'N', 'L', '0', '1'};
+
+std::uint32_t checksum(const char* data, std::size_t size) {
+    std::uint32_t hash = 2166136261u; // FNV-1a
+    for (std::size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+template <typename T>
+void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void putString(std::string& out, std::string_view value) {
+    put<std::uint16_t>(out, static_cast<std::uint16_t>(value.size()));
+    out.append(value.data(), value.size());
+}
+
+// Room seqs of a parked identity as one record field; rooms past the field's
+// 64 KB limit are left out and restored with seq 0, i.e. "replay what is left"
+std::string encodeSeqs(const std::map<std::string, std::uint64_t>& lastSeqs) {
+    std::string out;
+    for (const auto& [room, seq] : lastSeqs) {
+        if (out.size() + sizeof(std::uint16_t) + room.size() + sizeof(seq) > UINT16_MAX) {
+            break;
+        }
+        putString(out, room);
+        put<std::uint64_t>(out, seq);
+    }
+    return out;
+}
+
+/**
+ * @brief Bounds-checked cursor over a mapped file.
+ */
+class Reader {
+public:
+    Reader(const char* data, std::size_t size) : pos_(data), end_(data + size) {}
+
+    template <typename T>
+    bool get(T& value) {
+        if (static_cast<std::size_t>(end_ - pos_) < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return true;
+    }
+
+    bool getString(std::string_view& value) {
+        std::uint16_t size;
+        if (!get(size) || static_cast<std::size_t>(end_ - pos_) < size) {
+            return false;
+        }
+        value = std::string_view(pos_, size);
+        pos_ += size;
+        return true;
+    }
+
+    bool skip(std::size_t size) {
+        if (static_cast<std::size_t>(end_ - pos_) < size) {
+            return false;
+        }
+        pos_ += size;
+        return true;
+    }
+
+    const char* position() const { return pos_; }
+    std::size_t remaining() const { return static_cast<std::size_t>(end_ - pos_); }
+
+private:
+    const char* pos_;
+    const char* end_;
+};
+
+std::map<std::string, std::uint64_t> decodeSeqs(std::string_view encoded) {
+    std::map<std::string, std::uint64_t> lastSeqs;
+    Reader reader(encoded.data(), encoded.size());
+    std::string_view room;
+    std::uint64_t seq;
+    while (reader.getString(room) && reader.get(seq)) {
+        lastSeqs.emplace(room, seq);
+    }
+    return lastSeqs;
+}
+
+void syncFile(std::FILE* file) {
+#ifdef _WIN32
+    _commit(_fileno(file));
+#else
+    fsync(fileno(file));
+#endif
+}
+
+} // namespace
+
+StateStore::StateStore(const StateStoreConfig& config,
+                       std::weak_ptr<ChatRoomManager> chatRoomManager,
+                       std::weak_ptr<UserManager> userManager,
+                       std::weak_ptr<ResumeRegistry> resumeRegistry)
+    : config_(config),
+      chatRoomManager_(std::move(chatRoomManager)),
+      userManager_(std::move(userManager)),
+      resumeRegistry_(std::move(resumeRegistry)),
+      queue_(config.queueCapacity),
+      journal_(nullptr),
+      epoch_(0),
+      journalBytes_(0),
+      running_(false),
+      resyncNeeded_(false),
+      dropped_(0) {}
+
+StateStore::~StateStore() {
+    stop();
+}
+
+std::string StateStore::snapshotPath() const {
+    return (std::filesystem::path(config_.directory) / "state.snap").string();
+}
+
+std::string StateStore::journalPath() const {
+    return (std::filesystem::path(config_.directory) / "state.journal").string();
+}
+
+bool StateStore::restore() {
+    std::error_code ec;
+    std::filesystem::create_directories(config_.directory, ec);
+
+    auto started = std::chrono::steady_clock::now();
+    std::uint64_t coveredEpoch = 0;
+    if (!loadSnapshot(coveredEpoch)) {
+        return false;
+    }
+    epoch_ = coveredEpoch;
+    bool journalOk = replayJournal(coveredEpoch);
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started).count();
+    Logging::info("State restored from " + config_.directory + " in " + std::to_string(elapsed) + " ms");
+    return journalOk;
+}
+
+bool StateStore::loadSnapshot(std::uint64_t& coveredEpoch) {
+    namespace bip = boost::interprocess;
+
+    std::error_code ec;
+    auto size = std::filesystem::file_size(snapshotPath(), ec);
+    if (ec || size == 0) {
+        return true; // first start
+    }
+
+    auto rooms = chatRoomManager_.lock();
+    auto users = userManager_.lock();
+    if (!rooms || !users) {
+        return false;
+    }
+
+    try {
+        bip::file_mapping file(snapshotPath().c_str(), bip::read_only);
+        bip::mapped_region region(file, bip::read_only);
+        const char* data = static_cast<const char*>(region.get_address());
+        std::size_t length = region.get_size();
+
+        bool hasIdentities = length >= sizeof(kSnapshotMagic) &&
+                             std::memcmp(data, kSnapshotMagic, sizeof(kSnapshotMagic)) == 0;
+        if (length < sizeof(kSnapshotMagic) + sizeof(std::uint32_t) ||
+            (!hasIdentities && std::memcmp(data, kSnapshotMagicV1, sizeof(kSnapshotMagicV1)) != 0)) {
+            Logging::error("Snapshot " + snapshotPath() + " has an unknown format");
+            return false;
+        }
+        std::uint32_t expected;
+        std::memcpy(&expected, data + length - sizeof(expected), sizeof(expected));
+        if (checksum(data, length - sizeof(expected)) != expected) {
+            Logging::error("Snapshot " + snapshotPath() + " is corrupt");
+            return false;
+        }
+
+        Reader reader(data + sizeof(kSnapshotMagic), length - sizeof(kSnapshotMagic) - sizeof(expected));
+        std::uint64_t roomCount, userCount;
+        if (!reader.get(coveredEpoch) || !reader.get(roomCount) || !reader.get(userCount)) {
+            return false;
+        }
+
+        for (std::uint64_t i = 0; i < roomCount; ++i) {
+            std::string_view name;
+            std::uint32_t memberCount;
+            if (!reader.getString(name) || !reader.get(memberCount)) {
+                return false;
+            }
+            std::set<std::string> members;
+            for (std::uint32_t m = 0; m < memberCount; ++m) {
+                std::string_view member;
+                if (!reader.getString(member)) {
+                    return false;
+                }
+                members.emplace_hint(members.end(), member);
+            }
+            rooms->restoreChatRoom(std::string(name), std::move(members));
+        }
+
+        for (std::uint64_t i = 0; i < userCount; ++i) {
+            std::string_view userId, nickname;
+            if (!reader.getString(userId) || !reader.getString(nickname)) {
+                return false;
+            }
+            users->restoreUser(std::string(userId), std::string(nickname));
+        }
+
+        std::uint64_t identityCount = 0;
+        if (hasIdentities && !reader.get(identityCount)) {
+            return false;
+        }
+        for (std::uint64_t i = 0; i < identityCount; ++i) {
+            std::string_view sessionId, tokenHash, seqs;
+            if (!reader.getString(sessionId) || !reader.getString(tokenHash) || !reader.getString(seqs)) {
+                return false;
+            }
+            restoredIdentities_[std::string(sessionId)] = {std::string(tokenHash), decodeSeqs(seqs)};
+        }
+
+        Logging::info("Snapshot loaded: " + std::to_string(roomCount) + " rooms, " +
+                      std::to_string(userCount) + " users, " + std::to_string(identityCount) + " identities");
+    } catch (const std::exception& e) {
+        Logging::error(std::string("Cannot map snapshot: ") + e.what());
+        return false;
+    }
+    return true;
+}
+
+bool StateStore::replayJournal(std::uint64_t coveredEpoch) {
+    std::FILE* file = std::fopen(journalPath().c_str(), "rb");
+    if (!file) {
+        return true;
+    }
+
+    std::string contents;
+    char buffer[64 * 1024];
+    std::size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        contents.append(buffer, n);
+    }
+    std::fclose(file);
+
+    Reader reader(contents.data(), contents.size());
+    std::uint64_t journalEpoch = 0;
+    if (!reader.skip(sizeof(kJournalMagic)) ||
+        std::memcmp(contents.data(), kJournalMagic, sizeof(kJournalMagic)) != 0 ||
+        !reader.get(journalEpoch)) {
+        Logging::warning("Ignoring journal with an unknown format");
+        return true;
+    }
+    if (journalEpoch <= coveredEpoch) {
+        return true; // already folded into the snapshot
+    }
+    epoch_ = journalEpoch;
+
+    std::size_t replayed = 0;
+    for (;;) {
+        std::uint32_t size, expected;
+        if (!reader.get(size) || !reader.get(expected) || reader.remaining() < size) {
+            break; // end of journal or a torn final record
+        }
+        const char* payload = reader.position();
+        if (checksum(payload, size) != expected) {
+            Logging::warning("Journal record failed its checksum; stopping replay");
+            break;
+        }
+        reader.skip(size);
+
+        Reader record(payload, size);
+        std::uint8_t type;
+        std::string_view a, b;
+        if (record.get(type) && record.getString(a) && record.getString(b)) {
+            apply(static_cast<RecordType>(type), std::string(a), std::string(b));
+            ++replayed;
+        }
+    }
+
+    Logging::info("Replayed " + std::to_string(replayed) + " journal records");
+    return true;
+}
+
+void StateStore::apply(RecordType type, const std::string& a, const std::string& b) {
+    auto rooms = chatRoomManager_.lock();
+    auto users = userManager_.lock();
+    if (!rooms || !users) {
+        return;
+    }
+
+    switch (type) {
+        case RecordType::RoomCreated:
+            rooms->createChatRoom(a);
+            break;
+        case RecordType::RoomRemoved:
+            rooms->removeChatRoom(a);
+            break;
+        case RecordType::MemberJoined:
+            if (auto room = rooms->getChatRoom(a)) {
+                room->addSession(b);
+            }
+            break;
+        case RecordType::MemberLeft:
+            if (auto room = rooms->getChatRoom(a)) {
+                room->removeSession(b);
+            }
+            break;
+        case RecordType::UserCreated:
+            users->createUser(a, b);
+            break;
+        case RecordType::UserRemoved:
+            users->removeUser(a);
+            break;
+        case RecordType::NicknameChanged:
+            users->updateNickname(a, b);
+            break;
+        case RecordType::IdentityIssued:
+            restoredIdentities_[a] = {b, {}};
+            break;
+        case RecordType::IdentityParked: {
+            auto it = restoredIdentities_.find(a);
+            if (it != restoredIdentities_.end()) {
+                it->second.lastSeqs = decodeSeqs(b);
+            }
+            break;
+        }
+        case RecordType::IdentityRemoved:
+            restoredIdentities_.erase(a);
+            break;
+    }
+}
+
+void StateStore::dropUnresumable() {
+    auto rooms = chatRoomManager_.lock();
+    auto users = userManager_.lock();
+    auto registry = resumeRegistry_.lock();
+    if (!rooms || !users || !registry) {
+        return;
+    }
+
+    // An identity is resumable once it has a user; one never set up is not
+    std::set<std::string> resumable;
+    for (const auto& pair : users->getAllUsers()) {
+        if (restoredIdentities_.count(pair.first)) {
+            resumable.insert(pair.first);
+        }
+    }
+    std::size_t droppedUsers = users->retainUsers(resumable);
+
+    // Parked identities keep their rooms; seq 0 replays whatever the ring
+    // holds, since what a connection alive at shutdown was sent is unknown
+    std::size_t droppedMembers = 0;
+    for (const auto& room : rooms->getAllRooms()) {
+        std::set<std::string> members = room->getSessions();
+        std::set<std::string> kept;
+        for (const auto& member : members) {
+            if (resumable.count(member)) {
+                restoredIdentities_[member].lastSeqs.emplace(room->getName(), 0);
+                kept.insert(kept.end(), member);
+            }
+        }
+        if (kept.size() != members.size()) {
+            droppedMembers += members.size() - kept.size();
+            room->restoreSessions(std::move(kept));
+        }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    std::vector<ResumeRegistry::IdentitySnapshot> identities;
+    identities.reserve(resumable.size());
+    for (auto& [sessionId, identity] : restoredIdentities_) {
+        if (resumable.count(sessionId)) {
+            identities.push_back({sessionId, std::move(identity.tokenHash), ResumeRegistry::State::Parked,
+                                  now, std::move(identity.lastSeqs)});
+        }
+    }
+    restoredIdentities_.clear();
+    registry->restore(identities);
+
+    Logging::info("Restored " + std::to_string(identities.size()) + " resumable identities; dropped " +
+                  std::to_string(droppedUsers) + " users and " + std::to_string(droppedMembers) +
+                  " memberships nobody can resume");
+}
+
+bool StateStore::start() {
+    if (running_) {
+        return true;
+    }
+
+    // Fold whatever was restored into a fresh snapshot and journal epoch
+    if (!compact()) {
+        return false;
+    }
+
+    running_ = true;
+    worker_ = std::thread([this]() { run(); });
+    return true;
+}
+
+void StateStore::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+
+    wake_.notify_one();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+    if (resyncNeeded_.exchange(false)) {
+        compact();
+    }
+    if (journal_) {
+        std::fflush(journal_);
+        syncFile(journal_);
+        std::fclose(journal_);
+        journal_ = nullptr;
+    }
+}
+
+bool StateStore::openJournal(std::uint64_t epoch) {
+    if (journal_) {
+        std::fclose(journal_);
+    }
+    journal_ = std::fopen(journalPath().c_str(), "wb");
+    if (!journal_) {
+        Logging::error("Cannot open journal " + journalPath());
+        return false;
+    }
+
+    std::fwrite(kJournalMagic, 1, sizeof(kJournalMagic), journal_);
+    std::fwrite(&epoch, sizeof(epoch), 1, journal_);
+    std::fflush(journal_);
+    epoch_ = epoch;
+    journalBytes_ = 0;
+    return true;
+}
+
+bool StateStore::compact() {
+    auto started = std::chrono::steady_clock::now();
+
+    // Snapshot covers everything journaled in the current epoch; records
+    // still queued land in the next epoch and are safe to replay on top.
+    std::string temp = snapshotPath() + ".tmp";
+    if (!writeSnapshot(temp, epoch_)) {
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp, snapshotPath(), ec);
+    if (ec) {
+        Logging::error("Cannot install snapshot: " + ec.message());
+        return false;
+    }
+    if (!openJournal(epoch_ + 1)) {
+        return false;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started).count();
+    Logging::info("State snapshot written in " + std::to_string(elapsed) + " ms (epoch " +
+                  std::to_string(epoch_) + ")");
+    return true;
+}
+
+bool StateStore::writeSnapshot(const std::string& path, std::uint64_t coveredEpoch) {
+    auto rooms = chatRoomManager_.lock();
+    auto users = userManager_.lock();
+    if (!rooms || !users) {
+        return false;
+    }
+
+    auto allRooms = rooms->getAllRooms();
+    auto allUsers = users->getAllUsers();
+    std::vector<ResumeRegistry::IdentitySnapshot> identities;
+    if (auto registry = resumeRegistry_.lock()) {
+        identities = registry->snapshot();
+    }
+
+    std::string out;
+    out.reserve(64 + allRooms.size() * 32 + allUsers.size() * 32);
+    out.append(kSnapshotMagic, sizeof(kSnapshotMagic));
+    put<std::uint64_t>(out, coveredEpoch);
+    put<std::uint64_t>(out, allRooms.size());
+    put<std::uint64_t>(out, allUsers.size());
+
+    for (const auto& room : allRooms) {
+        auto members = room->getSessions();
+        putString(out, room->getName());
+        put<std::uint32_t>(out, static_cast<std::uint32_t>(members.size()));
+        for (const auto& member : members) {
+            putString(out, member);
+        }
+    }
+    for (const auto& pair : allUsers) {
+        putString(out, pair.first);
+        putString(out, pair.second->getNickname());
+    }
+    put<std::uint64_t>(out, identities.size());
+    for (const auto& identity : identities) {
+        putString(out, identity.sessionId);
+        putString(out, identity.tokenHash);
+        putString(out, encodeSeqs(identity.lastSeqs));
+    }
+    put<std::uint32_t>(out, checksum(out.data(), out.size()));
+
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        Logging::error("Cannot write snapshot " + path);
+        return false;
+    }
+    bool ok = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+    std::fflush(file);
+    syncFile(file);
+    std::fclose(file);
+    return ok;
+}
+
+void StateStore::append(RecordType type, const std::string& a, const std::string& b) {
+    if (!running_.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    std::string payload;
+    payload.reserve(1 + 4 + a.size() + b.size());
+    put<std::uint8_t>(payload, static_cast<std::uint8_t>(type));
+    putString(payload, a);
+    putString(payload, b);
+
+    std::string record;
+    record.reserve(8 + payload.size());
+    put<std::uint32_t>(record, static_cast<std::uint32_t>(payload.size()));
+    put<std::uint32_t>(record, checksum(payload.data(), payload.size()));
+    record.append(payload);
+
+    if (!queue_.tryPush(std::move(record))) {
+        // The change is already in memory, so a fresh snapshot recovers it
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        resyncNeeded_.store(true, std::memory_order_relaxed);
+        wake_.notify_one();
+    } else if (queue_.sizeApprox() == queue_.capacity() / 2) {
+        wake_.notify_one();
+    }
+}
+
+void StateStore::run() {
+    auto lastFlush = std::chrono::steady_clock::now();
+    bool dirty = false;
+
+    for (;;) {
+        bool stopping = !running_.load();
+
+        std::string record;
+        while (queue_.tryPop(record)) {
+            std::fwrite(record.data(), 1, record.size(), journal_);
+            journalBytes_ += record.size();
+            dirty = true;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (dirty && (stopping || now - lastFlush >= config_.flushInterval)) {
+            std::fflush(journal_);
+            if (config_.syncOnFlush) {
+                syncFile(journal_);
+            }
+            dirty = false;
+            lastFlush = now;
+        }
+
+        if (stopping) {
+            break;
+        }
+
+        if (journalBytes_ >= config_.compactThresholdBytes || resyncNeeded_.exchange(false)) {
+            compact();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wakeMutex_);
+        wake_.wait_until(lock, now + config_.flushInterval);
+    }
+}
+
+void StateStore::roomCreated(const std::string& room) {
+    append(RecordType::RoomCreated, room);
+}
+
+void StateStore::roomRemoved(const std::string& room) {
+    append(RecordType::RoomRemoved, room);
+}
+
+void StateStore::memberJoined(const std::string& room, const std::string& sessionId) {
+    append(RecordType::MemberJoined, room, sessionId);
+}
+
+void StateStore::memberLeft(const std::string& room, const std::string& sessionId) {
+    append(RecordType::MemberLeft, room, sessionId);
+}
+
+void StateStore::userCreated(const std::string& userId, const std::string& nickname) {
+    append(RecordType::UserCreated, userId, nickname);
+}
+
+void StateStore::userRemoved(const std::string& userId) {
+    append(RecordType::UserRemoved, userId);
+}
+
+void StateStore::nicknameChanged(const std::string& userId, const std::string& nickname) {
+    append(RecordType::NicknameChanged, userId, nickname);
+}
+
+void StateStore::identityIssued(const std::string& sessionId, const std::string& tokenHash) {
+    append(RecordType::IdentityIssued, sessionId, tokenHash);
+}
+
+void StateStore::identityParked(const std::string& sessionId,
+                                const std::map<std::string, std::uint64_t>& lastSeqs) {
+    append(RecordType::IdentityParked, sessionId, encodeSeqs(lastSeqs));
+}
+
+void StateStore::identityRemoved(const std::string& sessionId) {
+    append(RecordType::IdentityRemoved, sessionId);
+}
+
+} // namespace ChatServer
@@ -0,0 +1,177 @@
+/**
+ * @file StateStore.hpp
+ * @brief Snapshot and change journal for rooms, users, memberships and resume identities.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "LockFreeQueue.hpp"
+
+namespace ChatServer {
+
+class ChatRoomManager;
+class ResumeRegistry;
+class UserManager;
+
+/**
+ * @brief Receives every change to durable server state.
+ *
+ * ChatRoomManager, ChatRoom, UserManager and ResumeRegistry call these after
+ * applying a change in memory. Implementations must not block.
+ */
+class StateJournal {
+public:
+    virtual ~StateJournal() = default;
+
+    virtual void roomCreated(const std::string& room) = 0;
+    virtual void roomRemoved(const std::string& room) = 0;
+    virtual void memberJoined(const std::string& room, const std::string& sessionId) = 0;
+    virtual void memberLeft(const std::string& room, const std::string& sessionId) = 0;
+    virtual void userCreated(const std::string& userId, const std::string& nickname) = 0;
+    virtual void userRemoved(const std::string& userId) = 0;
+    virtual void nicknameChanged(const std::string& userId, const std::string& nickname) = 0;
+    // A resume token was issued for an identity; clears its recorded room seqs
+    virtual void identityIssued(const std::string& sessionId, const std::string& tokenHash) = 0;
+    virtual void identityParked(const std::string& sessionId,
+                                const std::map<std::string, std::uint64_t>& lastSeqs) = 0;
+    virtual void identityRemoved(const std::string& sessionId) = 0;
+};
+
+struct StateStoreConfig {
+    std::string directory = "state";
+    std::uint64_t compactThresholdBytes = 16 * 1024 * 1024; // journal size that triggers a snapshot
+    std::chrono::milliseconds flushInterval{100};
+    bool syncOnFlush = false;                                // fsync the journal on every flush
+    std::size_t queueCapacity = 65536;
+};
+
+/**
+ * @brief Persists room, user, membership and identity state as snapshot + journal.
+ *
+ * The snapshot is a compact binary image that restore() maps into memory
+ * and parses in place. Changes after it are appended to a journal by a
+ * background thread, which also compacts: once the journal passes
+ * compactThresholdBytes it writes a fresh snapshot and starts a new journal
+ * epoch. Every record is a last-writer-wins update to one key, so replaying
+ * a record whose effect is already in the snapshot is harmless.
+ *
+ * Users and memberships belong to session ids, which only a resume token
+ * can reclaim. The hashed tokens and last room seqs of every identity are
+ * therefore stored as well, and dropUnresumable() discards restored state
+ * no token can reach any more.
+ */
+class StateStore : public StateJournal {
+public:
+    StateStore(const StateStoreConfig& config,
+               std::weak_ptr<ChatRoomManager> chatRoomManager,
+               std::weak_ptr<UserManager> userManager,
+               std::weak_ptr<ResumeRegistry> resumeRegistry = std::weak_ptr<ResumeRegistry>());
+    ~StateStore() override;
+
+    StateStore(const StateStore&) = delete;
+    StateStore& operator=(const StateStore&) = delete;
+
+    /**
+     * @brief Load the snapshot and replay the journal into the managers.
+     *
+     * Call before the managers are given this journal, so restored state
+     * is not journaled again.
+     * @return false if existing state files are unreadable
+     */
+    bool restore();
+
+    /**
+     * @brief Hand restored identities to the ResumeRegistry, parked, and drop the rest.
+     *
+     * Users without an identity, memberships of session ids without one and
+     * identities without a user are removed in bulk, without journaling or
+     * per-item logging. Call after restore() and before start(), whose
+     * snapshot then records the result.
+     */
+    void dropUnresumable();
+
+    // Open the journal and start the background writer/compactor
+    bool start();
+
+    // Flush the journal and stop the background thread
+    void stop();
+
+    // StateJournal
+    void roomCreated(const std::string& room) override;
+    void roomRemoved(const std::string& room) override;
+    void memberJoined(const std::string& room, const std::string& sessionId) override;
+    void memberLeft(const std::string& room, const std::string& sessionId) override;
+    void userCreated(const std::string& userId, const std::string& nickname) override;
+    void userRemoved(const std::string& userId) override;
+    void nicknameChanged(const std::string& userId, const std::string& nickname) override;
+    void identityIssued(const std::string& sessionId, const std::string& tokenHash) override;
+    void identityParked(const std::string& sessionId,
+                        const std::map<std::string, std::uint64_t>& lastSeqs) override;
+    void identityRemoved(const std::string& sessionId) override;
+
+    std::uint64_t droppedRecords() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    enum class RecordType : std::uint8_t {
+        RoomCreated = 1,
+        RoomRemoved,
+        MemberJoined,
+        MemberLeft,
+        UserCreated,
+        UserRemoved,
+        NicknameChanged,
+        IdentityIssued,
+        IdentityParked,
+        IdentityRemoved
+    };
+
+    // An identity read back from the state files, until dropUnresumable()
+    struct RestoredIdentity {
+        std::string tokenHash;
+        std::map<std::string, std::uint64_t> lastSeqs;
+    };
+
+    void append(RecordType type, const std::string& a, const std::string& b = std::string());
+    void run();
+    bool openJournal(std::uint64_t epoch);
+    bool compact();
+    bool writeSnapshot(const std::string& path, std::uint64_t coveredEpoch);
+    bool loadSnapshot(std::uint64_t& coveredEpoch);
+    bool replayJournal(std::uint64_t coveredEpoch);
+    void apply(RecordType type, const std::string& a, const std::string& b);
+
+    std::string snapshotPath() const;
+    std::string journalPath() const;
+
+    StateStoreConfig config_;
+    std::weak_ptr<ChatRoomManager> chatRoomManager_;
+    std::weak_ptr<UserManager> userManager_;
+    std::weak_ptr<ResumeRegistry> resumeRegistry_;
+    std::unordered_map<std::string, RestoredIdentity> restoredIdentities_; // restore only
+
+    LockFreeQueue<std::string> queue_;
+    std::FILE* journal_;       // background thread only once started
+    std::uint64_t epoch_;
+    std::uint64_t journalBytes_;
+
+    std::thread worker_;
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    std::atomic<bool> running_;
+    std::atomic<bool> resyncNeeded_; // a record was dropped; next snapshot recaptures it
+    std::atomic<std::uint64_t> dropped_;
+};
+
+} // namespace ChatServer
@@ -6,7 +6,7 @@ ThreadPool::ThreadPool(size_t numThreads) : stop(false) {
             while (true) {
                 std::function<void()> task;
                 {
-                    std::unique_lock<std::mutex> lock(this->queueMutex);
+                    std::unique_lock<ChatServer::ProfiledMutex> lock(this->queueMutex);
                     this->condition.wait(lock, [this] {
                         return this->stop || !this->tasks.empty();
                     });
@@ -27,7 +27,7 @@ ThreadPool::ThreadPool(size_t numThreads) : stop(false) {
 
 ThreadPool::~ThreadPool() {
     {
-        std::lock_guard<std::mutex> lock(queueMutex);
+        std::lock_guard<ChatServer::ProfiledMutex> lock(queueMutex);
         stop = true;
     }
     condition.notify_all();
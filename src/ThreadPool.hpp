@@ -10,6 +10,8 @@
 #include <future>
 #include <utility>
 
+#include "ProfiledMutex.hpp"
+
 /**
  * @brief A minimal thread pool for executing background tasks.
  */
@@ -40,7 +42,7 @@ public:
 
         std::future<return_type> res = task->get_future();
         {
-            std::lock_guard<std::mutex> lock(queueMutex);
+            std::lock_guard<ChatServer::ProfiledMutex> lock(queueMutex);
             tasks.emplace([task]() { (*task)(); });
         }
         condition.notify_one();
@@ -55,8 +57,8 @@ public:
 private:
     std::vector<std::thread> workers;               ///< Worker threads.
     std::queue<std::function<void()>> tasks;        ///< Task queue.
-    std::mutex queueMutex;                          ///< Mutex for synchronizing access to tasks.
-    std::condition_variable condition;              ///< Condition variable for task notification.
+    ChatServer::ProfiledMutex queueMutex{"ThreadPool::queueMutex"}; ///< Mutex for synchronizing access to tasks.
+    std::condition_variable_any condition;          ///< Condition variable for task notification.
     bool stop;                                      ///< Flag to signal thread pool shutdown.
 };
 
@@ -0,0 +1,265 @@
+/**
+ * @file TraceCapture.cpp
+ * @brief Implementation of traffic capture and trace reading.
+ */
+
+#include "TraceCapture.hpp"
+#include "Logging.hpp"
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+
+namespace ChatServer {
+
+namespace {
+
+const char kMagic[8] = {'C', 'H', 'A', 'T', 'T', 'R', 'C', '1'};
+const std::uint64_t kVersion = 1;
+const std::size_t kFlushBytes = 1 << 20;
+const std::size_t kMaxBufferedBytes = 64 << 20;
+
+void putVarint(std::vector<char>& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Commands whose first argument is a session id
+bool takesSessionId(const std::string& command) {
+    return command == "whisper" || command == "whois";
+}
+
+std::uint64_t steadyMicros() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+} // namespace
+
+std::atomic<bool> TraceRecorder::active_{false};
+
+TraceRecorder& TraceRecorder::getInstance() {
+    static TraceRecorder instance;
+    return instance;
+}
+
+TraceRecorder::TraceRecorder()
+    : recordedTotal_(MetricsRegistry::getInstance().counter(
+          "chat_trace_records_total", "Records written to the traffic capture")),
+      droppedTotal_(MetricsRegistry::getInstance().counter(
+          "chat_trace_dropped_total", "Records dropped because the capture writer fell behind")) {}
+
+bool TraceRecorder::start(const std::string& path, bool redact) {
+    std::lock_guard<std::mutex> fileLock(fileMutex_);
+    if (active()) {
+        return false;
+    }
+    file_.open(path, std::ios::binary | std::ios::trunc);
+    if (!file_.is_open()) {
+        Logging::error("Cannot open trace file " + path);
+        return false;
+    }
+
+    std::vector<char> header(kMagic, kMagic + sizeof(kMagic));
+    putVarint(header, kVersion);
+    putVarint(header, static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count()));
+    file_.write(header.data(), static_cast<std::streamsize>(header.size()));
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffer_.clear();
+        sessions_.clear();
+        startedAt_ = steadyMicros();
+        lastMicros_ = 0;
+        redact_ = redact;
+        stopping_ = false;
+        path_ = path;
+        records_ = 0;
+        dropped_ = 0;
+    }
+    writer_ = std::thread([this]() { writeLoop(); });
+    active_.store(true, std::memory_order_release);
+    Logging::info("Capturing traffic to " + path + (redact ? " (chat text and command arguments redacted)" : ""));
+    return true;
+}
+
+void TraceRecorder::stop() {
+    std::lock_guard<std::mutex> fileLock(fileMutex_);
+    if (!active()) {
+        return;
+    }
+    active_.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+    file_.close();
+    Logging::info("Traffic capture to " + path_ + " stopped after " + std::to_string(records_) + " records");
+}
+
+void TraceRecorder::record(const std::string& sessionId, TraceEvent event, std::string_view payload) {
+    bool flush = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!active() || stopping_) {
+            return;
+        }
+        std::string redacted;
+        if (redact_ && !payload.empty()) {
+            redacted = payload[0] == '/' ? redactCommand(payload) : std::string(payload.size(), 'x');
+            payload = redacted;
+        }
+        if (buffer_.size() + payload.size() > kMaxBufferedBytes) {
+            ++dropped_;
+            droppedTotal_.inc();
+            return;
+        }
+
+        // Timestamp under the lock so deltas never go negative
+        std::uint64_t now = steadyMicros() - startedAt_;
+        putVarint(buffer_, now - lastMicros_);
+        lastMicros_ = now;
+        putVarint(buffer_, sessionIndex(sessionId));
+        buffer_.push_back(static_cast<char>(event));
+        putVarint(buffer_, payload.size());
+        buffer_.insert(buffer_.end(), payload.begin(), payload.end());
+        ++records_;
+        flush = buffer_.size() >= kFlushBytes;
+    }
+    recordedTotal_.inc();
+    if (flush) {
+        wake_.notify_one();
+    }
+}
+
+TraceRecorder::Status TraceRecorder::status() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Status status;
+    status.active = active();
+    status.path = path_;
+    status.records = records_;
+    status.dropped = dropped_;
+    status.sessions = sessions_.size();
+    return status;
+}
+
+// Caller holds mutex_
+std::uint32_t TraceRecorder::sessionIndex(const std::string& sessionId) {
+    auto it = sessions_.find(sessionId);
+    if (it == sessions_.end()) {
+        it = sessions_.emplace(sessionId, static_cast<std::uint32_t>(sessions_.size())).first;
+    }
+    return it->second;
+}
+
+// Caller holds mutex_. Spacing and quotes are kept so the command parses
+// into the same number of arguments.
+std::string TraceRecorder::redactCommand(std::string_view payload) {
+    std::size_t nameEnd = std::find_if(payload.begin(), payload.end(), isSpace) - payload.begin();
+    std::string command(payload.substr(1, nameEnd - 1));
+    std::transform(command.begin(), command.end(), command.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+
+    std::string redacted(payload.substr(0, nameEnd));
+    std::size_t pos = nameEnd;
+    bool first = true;
+    while (pos < payload.size()) {
+        if (isSpace(payload[pos])) {
+            redacted.push_back(payload[pos++]);
+            continue;
+        }
+        std::size_t end = std::find_if(payload.begin() + pos, payload.end(), isSpace) - payload.begin();
+        std::string_view argument = payload.substr(pos, end - pos);
+        if (first && takesSessionId(command)) {
+            redacted += "#" + std::to_string(sessionIndex(std::string(argument)));
+        } else if (std::all_of(argument.begin(), argument.end(),
+                               [](unsigned char c) { return std::isdigit(c); })) {
+            redacted += argument;
+        } else {
+            for (char c : argument) {
+                redacted.push_back(c == '"' ? '"' : 'x');
+            }
+        }
+        first = false;
+        pos = end;
+    }
+    return redacted;
+}
+
+// Swap the buffer out under the lock and write it without holding it
+void TraceRecorder::writeLoop() {
+    std::vector<char> writing;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        wake_.wait_for(lock, std::chrono::milliseconds(100),
+                       [this]() { return stopping_ || buffer_.size() >= kFlushBytes; });
+        bool last = stopping_;
+        writing.swap(buffer_);
+        lock.unlock();
+        if (!writing.empty()) {
+            file_.write(writing.data(), static_cast<std::streamsize>(writing.size()));
+            file_.flush();
+            writing.clear();
+        }
+        lock.lock();
+        if (last) {
+            return;
+        }
+    }
+}
+
+TraceReader::TraceReader(const std::string& path)
+    : in_(path, std::ios::binary) {
+    char magic[sizeof(kMagic)];
+    std::uint64_t version = 0;
+    ok_ = in_.read(magic, sizeof(magic)) && std::memcmp(magic, kMagic, sizeof(kMagic)) == 0 &&
+          readVarint(version) && version == kVersion && readVarint(startUnixMicros_);
+}
+
+bool TraceReader::next(TraceRecord& record) {
+    std::uint64_t delta = 0;
+    std::uint64_t session = 0;
+    std::uint64_t length = 0;
+    char event = 0;
+    if (!ok_ || !readVarint(delta) || !readVarint(session) || !in_.get(event) || !readVarint(length)) {
+        return false;
+    }
+    record.payload.resize(length);
+    if (length > 0 && !in_.read(&record.payload[0], static_cast<std::streamsize>(length))) {
+        return false;
+    }
+    micros_ += delta;
+    record.micros = micros_;
+    record.session = static_cast<std::uint32_t>(session);
+    record.event = static_cast<TraceEvent>(event);
+    return true;
+}
+
+bool TraceReader::readVarint(std::uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        char byte;
+        if (!in_.get(byte)) {
+            return false;
+        }
+        value |= static_cast<std::uint64_t>(static_cast<unsigned char>(byte) & 0x7f) << shift;
+        if (!(static_cast<unsigned char>(byte) & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace ChatServer
@@ -0,0 +1,135 @@
+/**
+ * @file TraceCapture.hpp
+ * @brief Binary capture of inbound client traffic and a reader for replaying it.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace ChatServer {
+
+class Counter;
+
+/*
+ * Trace file layout, all integers LEB128 varints:
+ *
+ *   header: "CHATTRC1" version startUnixMicros
+ *   record: deltaMicros session event length payload[length]
+ *
+ * deltaMicros is the time since the previous record (the first since
+ * startUnixMicros). Sessions are numbered 0, 1, 2, ... in order of first
+ * appearance, so server session ids never reach the file.
+ */
+enum class TraceEvent : std::uint8_t {
+    Frame = 0,  // bytes of one read, as given to Session::handleMessage
+    Close = 1   // the connection went away; no payload
+};
+
+struct TraceRecord {
+    std::uint64_t micros = 0;   // since the start of the capture
+    std::uint32_t session = 0;
+    TraceEvent event = TraceEvent::Frame;
+    std::string payload;
+};
+
+/**
+ * @brief Records inbound frames to a trace file while capture is on.
+ *
+ * When off, record sites cost one relaxed load. When on, a record is
+ * encoded into an in-memory buffer under a short lock, and a writer thread
+ * flushes the buffer to disk every 100 ms or every megabyte. If the disk
+ * falls behind by more than 64 MB, records are dropped and counted rather
+ * than stalling io threads. With redaction on, chat text is replaced by 'x'
+ * of the same length. Commands keep their name and arity: session id
+ * arguments become "#<capture index>", numbers are kept, and every other
+ * argument, whisper text and resume tokens included, is x'd out.
+ */
+class TraceRecorder {
+public:
+    struct Status {
+        bool active = false;
+        std::string path;
+        std::uint64_t records = 0;
+        std::uint64_t dropped = 0;
+        std::uint64_t sessions = 0;
+    };
+
+    static TraceRecorder& getInstance();
+
+    // True while a capture is running; cheap enough for every read
+    static bool active() { return active_.load(std::memory_order_relaxed); }
+
+    // Begin capturing to path (truncated); false if already capturing or unopenable
+    bool start(const std::string& path, bool redact);
+
+    // Flush and close the current capture
+    void stop();
+
+    void record(const std::string& sessionId, TraceEvent event, std::string_view payload);
+
+    Status status() const;
+
+private:
+    TraceRecorder();
+
+    void writeLoop();
+    std::uint32_t sessionIndex(const std::string& sessionId);
+    std::string redactCommand(std::string_view payload);
+
+    static std::atomic<bool> active_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<char> buffer_;                 // encoded records not yet written
+    std::unordered_map<std::string, std::uint32_t> sessions_;
+    std::uint64_t lastMicros_ = 0;
+    std::uint64_t startedAt_ = 0;              // steady clock, microseconds
+    bool redact_ = false;
+    bool stopping_ = false;
+    std::string path_;
+    std::uint64_t records_ = 0;
+    std::uint64_t dropped_ = 0;
+
+    std::mutex fileMutex_;                     // serializes start/stop
+    std::ofstream file_;
+    std::thread writer_;
+
+    Counter& recordedTotal_;
+    Counter& droppedTotal_;
+};
+
+/**
+ * @brief Reads a trace file record by record.
+ */
+class TraceReader {
+public:
+    explicit TraceReader(const std::string& path);
+
+    // False if the file could not be opened or is not a trace
+    bool ok() const { return ok_; }
+
+    std::uint64_t startUnixMicros() const { return startUnixMicros_; }
+
+    // Next record; false at the end or on a truncated record
+    bool next(TraceRecord& record);
+
+private:
+    bool readVarint(std::uint64_t& value);
+
+    std::ifstream in_;
+    bool ok_ = false;
+    std::uint64_t startUnixMicros_ = 0;
+    std::uint64_t micros_ = 0;
+};
+
+} // namespace ChatServer
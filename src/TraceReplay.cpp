@@ -0,0 +1,344 @@
+/**
+ * @file TraceReplay.cpp
+ * @brief chat_replay: drives a server with traffic captured by TraceRecorder.
+ *
+ * Every captured session gets its own connection, opened when its first
+ * record is due, and the captured frames are written as they were read, one
+ * write per frame. Records are due at their captured time divided by
+ * --speed; --asap ignores the timing and only keeps each session's order.
+ * A connection writes one frame at a time, so a frame that is due while the
+ * previous one is still being written waits for it. How late frames went out
+ * is reported as send lag, a measure of how well the server kept up.
+ */
+
+#include "Metrics.hpp"
+#include "TraceCapture.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <ctime>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/asio.hpp>
+
+using boost::asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+using ChatServer::TraceEvent;
+using ChatServer::TraceRecord;
+
+namespace {
+
+struct ReplayStats {
+    std::uint64_t framesSent = 0;
+    std::uint64_t bytesReceived = 0;
+    std::uint64_t linesReceived = 0;
+    std::uint64_t connectFailures = 0;
+    std::uint64_t dropped = 0;
+    std::size_t open = 0;                   // connections not yet finished
+    Clock::time_point lastWrite;
+    ChatServer::LatencyHistogram sendLag;
+};
+
+class ReplayConnection {
+public:
+    ReplayConnection(boost::asio::io_context& io, ReplayStats& stats)
+        : socket_(io), stats_(stats) {}
+
+    void connect(const tcp::endpoint& server) {
+        ++stats_.open;
+        socket_.async_connect(server, [this](boost::system::error_code ec) {
+            if (ec) {
+                ++stats_.connectFailures;
+                finished();
+                return;
+            }
+            socket_.set_option(tcp::no_delay(true), ec);
+            connected_ = true;
+            read();
+            writeNext();
+        });
+    }
+
+    void send(const std::string* payload, Clock::time_point due) {
+        pending_.push_back({payload, due});
+        if (connected_ && !writing_) {
+            writeNext();
+        }
+    }
+
+    // The captured connection closed; close once everything queued is out
+    void finish() {
+        closing_ = true;
+        if (connected_ && !writing_ && pending_.empty()) {
+            close();
+        }
+    }
+
+    void close() {
+        boost::system::error_code ignored;
+        socket_.shutdown(tcp::socket::shutdown_both, ignored);
+        socket_.close(ignored);
+    }
+
+private:
+    struct Pending {
+        const std::string* payload;
+        Clock::time_point due;
+    };
+
+    void writeNext() {
+        if (pending_.empty()) {
+            writing_ = false;
+            if (closing_) {
+                close();
+            }
+            return;
+        }
+        writing_ = true;
+        Pending next = pending_.front();
+        pending_.pop_front();
+        auto now = Clock::now();
+        stats_.sendLag.record(now > next.due ? now - next.due : Clock::duration::zero());
+        boost::asio::async_write(socket_, boost::asio::buffer(*next.payload),
+            [this](boost::system::error_code ec, std::size_t /*length*/) {
+                if (ec) {
+                    ++stats_.dropped;
+                    pending_.clear();
+                    writing_ = false;
+                    close();
+                    return;
+                }
+                ++stats_.framesSent;
+                stats_.lastWrite = Clock::now();
+                writeNext();
+            });
+    }
+
+    // Server output is only counted, so the server never blocks on us
+    void read() {
+        socket_.async_read_some(boost::asio::buffer(readBuffer_),
+            [this](boost::system::error_code ec, std::size_t length) {
+                if (ec) {
+                    finished();
+                    return;
+                }
+                stats_.bytesReceived += length;
+                stats_.linesReceived += static_cast<std::uint64_t>(
+                    std::count(readBuffer_.begin(), readBuffer_.begin() + length, '\n'));
+                read();
+            });
+    }
+
+    void finished() {
+        if (!done_) {
+            done_ = true;
+            --stats_.open;
+        }
+    }
+
+    tcp::socket socket_;
+    ReplayStats& stats_;
+    std::deque<Pending> pending_;
+    std::array<char, 4096> readBuffer_;
+    bool connected_ = false;
+    bool writing_ = false;
+    bool closing_ = false;
+    bool done_ = false;
+};
+
+class Replayer {
+public:
+    Replayer(boost::asio::io_context& io, const tcp::endpoint& server, const std::vector<TraceRecord>& records,
+             double speed, ReplayStats& stats)
+        : io_(io), server_(server), records_(records), speed_(speed), stats_(stats), timer_(io) {}
+
+    void start() {
+        started_ = Clock::now();
+        dispatch();
+    }
+
+    Clock::time_point started() const { return started_; }
+
+private:
+    Clock::time_point dueAt(const TraceRecord& record) const {
+        if (speed_ <= 0) {
+            return started_;
+        }
+        return started_ + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double, std::micro>(static_cast<double>(record.micros) / speed_));
+    }
+
+    // Hand out every record that is due, then sleep until the next one
+    void dispatch() {
+        auto now = Clock::now();
+        while (next_ < records_.size() && dueAt(records_[next_]) <= now) {
+            const TraceRecord& record = records_[next_++];
+            auto& connection = connections_[record.session];
+            if (!connection) {
+                connection = std::make_unique<ReplayConnection>(io_, stats_);
+                connection->connect(server_);
+            }
+            if (record.event == TraceEvent::Close) {
+                connection->finish();
+            } else {
+                connection->send(&record.payload, dueAt(record));
+            }
+        }
+        if (next_ < records_.size()) {
+            timer_.expires_at(dueAt(records_[next_]));
+            timer_.async_wait([this](boost::system::error_code ec) {
+                if (!ec) {
+                    dispatch();
+                }
+            });
+            return;
+        }
+
+        // Everything is handed out; let the last writes finish, then close
+        for (auto& entry : connections_) {
+            entry.second->finish();
+        }
+        timer_.expires_after(std::chrono::seconds(2));
+        timer_.async_wait([this](boost::system::error_code) {
+            for (auto& entry : connections_) {
+                entry.second->close();
+            }
+        });
+    }
+
+    boost::asio::io_context& io_;
+    tcp::endpoint server_;
+    const std::vector<TraceRecord>& records_;
+    double speed_;
+    ReplayStats& stats_;
+    boost::asio::steady_timer timer_;
+    Clock::time_point started_;
+    std::size_t next_ = 0;
+    std::unordered_map<std::uint32_t, std::unique_ptr<ReplayConnection>> connections_;
+};
+
+std::string formatNanos(std::uint64_t nanos) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    if (nanos < 1000000) {
+        out << nanos / 1e3 << " us";
+    } else {
+        out << nanos / 1e6 << " ms";
+    }
+    return out.str();
+}
+
+void printUsage() {
+    std::cerr <<
+        "Usage: chat_replay TRACE [options]\n"
+        "  --host ADDR     server address (127.0.0.1)\n"
+        "  --port N        server port (8080)\n"
+        "  --speed X       replay X times faster than captured (1)\n"
+        "  --asap          send as fast as possible, keeping each session's order\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string tracePath;
+    std::string host = "127.0.0.1";
+    std::string port = "8080";
+    double speed = 1.0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--asap") {
+            speed = 0;
+        } else if ((arg == "--host" || arg == "--port" || arg == "--speed") && i + 1 < argc) {
+            std::string value = argv[++i];
+            if (arg == "--host") {
+                host = value;
+            } else if (arg == "--port") {
+                port = value;
+            } else {
+                speed = std::stod(value);
+                if (speed <= 0) {
+                    std::cerr << "chat_replay: --speed must be positive; use --asap for no pacing\n";
+                    return 2;
+                }
+            }
+        } else if (arg[0] != '-' && tracePath.empty()) {
+            tracePath = arg;
+        } else {
+            printUsage();
+            return arg == "--help" || arg == "-h" ? 0 : 2;
+        }
+    }
+    if (tracePath.empty()) {
+        printUsage();
+        return 2;
+    }
+
+    ChatServer::TraceReader reader(tracePath);
+    if (!reader.ok()) {
+        std::cerr << "chat_replay: " << tracePath << " is not a readable trace\n";
+        return 1;
+    }
+    std::vector<TraceRecord> records;
+    std::unordered_map<std::uint32_t, bool> sessions;
+    for (TraceRecord record; reader.next(record);) {
+        sessions[record.session] = true;
+        records.push_back(std::move(record));
+    }
+    if (records.empty()) {
+        std::cerr << "chat_replay: " << tracePath << " has no records\n";
+        return 1;
+    }
+
+    boost::asio::io_context io;
+    tcp::endpoint server;
+    try {
+        tcp::resolver resolver(io);
+        server = *resolver.resolve(host, port).begin();
+    } catch (const std::exception& e) {
+        std::cerr << "chat_replay: cannot resolve " << host << ": " << e.what() << "\n";
+        return 1;
+    }
+
+    std::time_t captured = static_cast<std::time_t>(reader.startUnixMicros() / 1000000);
+    double tracedSeconds = static_cast<double>(records.back().micros) / 1e6;
+    std::cout << "chat_replay: " << records.size() << " records from " << sessions.size() << " sessions over "
+              << std::fixed << std::setprecision(2) << tracedSeconds << " s, captured "
+              << std::put_time(std::gmtime(&captured), "%Y-%m-%d %H:%M:%S UTC") << "\n";
+
+    ReplayStats stats;
+    Replayer replayer(io, server, records, speed, stats);
+    replayer.start();
+    io.run();
+    double seconds = std::chrono::duration<double>(std::max(stats.lastWrite, replayer.started()) -
+                                                   replayer.started()).count();
+
+    auto lag = stats.sendLag.snapshot();
+    std::cout << "replayed ";
+    if (speed > 0) {
+        std::cout << "at " << speed << "x";
+    } else {
+        std::cout << "as fast as possible";
+    }
+    std::cout << " in " << seconds << " s (" << stats.framesSent / seconds << " frames/s)";
+    if (speed > 0) {
+        std::cout << ", schedule " << tracedSeconds / speed << " s";
+    }
+    std::cout << "\n";
+    std::cout << "send lag behind schedule: p50 " << formatNanos(lag.quantile(0.5)) << "  p99 "
+              << formatNanos(lag.quantile(0.99)) << "  max " << formatNanos(lag.maxNanos) << "\n";
+    std::cout << "frames sent " << stats.framesSent << ", server sent " << stats.linesReceived << " lines ("
+              << stats.bytesReceived << " bytes)\n";
+    if (stats.connectFailures > 0 || stats.dropped > 0) {
+        std::cout << "connect failures " << stats.connectFailures << ", connections dropped while sending "
+                  << stats.dropped << "\n";
+        return 1;
+    }
+    return 0;
+}
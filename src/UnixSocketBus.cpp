@@ -0,0 +1,510 @@
+/**
+ * @file UnixSocketBus.cpp
+ * @brief Implementation of the Unix socket message bus and its broker.
+ */
+
+#include "UnixSocketBus.hpp"
+#include "BusCodec.hpp"
+#include "Logging.hpp"
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <unistd.h>
+
+namespace ChatServer {
+
+using namespace BusCodec;
+
+namespace {
+
+const std::uint32_t kMaxFrameBytes = 64 * 1024 * 1024;
+
+std::uint32_t frameLength(const std::uint8_t* header) {
+    return static_cast<std::uint32_t>(header[0]) | static_cast<std::uint32_t>(header[1]) << 8 |
+           static_cast<std::uint32_t>(header[2]) << 16 | static_cast<std::uint32_t>(header[3]) << 24;
+}
+
+void putFrame(std::string& out, char type, const std::string& body) {
+    auto length = static_cast<std::uint32_t>(body.size() + 1);
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>(length >> (8 * i)));
+    }
+    out.push_back(type);
+    out.append(body);
+}
+
+} // namespace
+
+// UnixSocketBus implementation
+UnixSocketBus::UnixSocketBus(boost::asio::io_context& io, const BusConfig& config)
+    : strand_(boost::asio::make_strand(io)),
+      config_(config),
+      socket_(strand_),
+      flushTimer_(strand_),
+      reconnectTimer_(strand_),
+      published_(MetricsRegistry::getInstance().counter(
+          "chat_bus_published_total", "Room messages published to other nodes")),
+      dropped_(MetricsRegistry::getInstance().counter(
+          "chat_bus_dropped_total", "Bus messages dropped because the bus broker was unreachable or behind")),
+      batchesSent_(MetricsRegistry::getInstance().counter(
+          "chat_bus_batches_sent_total", "Batches of bus messages written to the bus broker")),
+      received_(MetricsRegistry::getInstance().counter(
+          "chat_bus_received_total", "Room messages received from other nodes")),
+      directSent_(MetricsRegistry::getInstance().counter(
+          "chat_bus_direct_sent_total", "Messages sent to a single other node")) {}
+
+bool UnixSocketBus::start(Handlers handlers) {
+    handlers_ = std::move(handlers);
+    boost::asio::post(strand_, [self = shared_from_this()]() { self->connect(); });
+    return true;
+}
+
+void UnixSocketBus::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+    }
+    boost::asio::post(strand_, [self = shared_from_this()]() {
+        boost::system::error_code ignored;
+        self->flushTimer_.cancel();
+        self->reconnectTimer_.cancel();
+        self->socket_.close(ignored);
+    });
+}
+
+void UnixSocketBus::publish(const std::string& room, std::uint64_t seq, const std::string& senderSessionId,
+                            const std::string& message) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopped_) {
+        return;
+    }
+    if (pendingRecords_.size() + pendingFrames_.size() + room.size() + message.size() > config_.maxQueuedBytes) {
+        dropped_.inc();
+        return;
+    }
+    putString(pendingRecords_, room);
+    putVarint(pendingRecords_, seq);
+    putString(pendingRecords_, senderSessionId);
+    putString(pendingRecords_, message);
+    published_.inc();
+    scheduleFlush();
+}
+
+void UnixSocketBus::sendTo(const std::string& node, const std::string& payload) {
+    std::string body;
+    putString(body, node);
+    putString(body, config_.nodeId);
+    body.append(payload);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopped_) {
+        return;
+    }
+    if (pendingRecords_.size() + pendingFrames_.size() + body.size() > config_.maxQueuedBytes) {
+        dropped_.inc();
+        return;
+    }
+    closeRecords(); // broadcasts queued before it arrive first
+    putFrame(pendingFrames_, 'D', body);
+    directSent_.inc();
+    scheduleFlush();
+}
+
+// Called with mutex_ held
+void UnixSocketBus::closeRecords() {
+    if (!pendingRecords_.empty()) {
+        putFrame(pendingFrames_, 'R', pendingRecords_);
+        pendingRecords_.clear();
+    }
+}
+
+// Called with mutex_ held. The first message of a tick starts the clock;
+// the rest join its batch.
+void UnixSocketBus::scheduleFlush() {
+    if (flushScheduled_ || !connected_) {
+        return;
+    }
+    flushScheduled_ = true;
+    boost::asio::post(strand_, [self = shared_from_this()]() {
+        self->flushTimer_.expires_after(self->config_.tick);
+        self->flushTimer_.async_wait([self](boost::system::error_code ec) {
+            if (!ec) {
+                self->flush();
+            }
+        });
+    });
+}
+
+void UnixSocketBus::connect() {
+    socket_.async_connect(boost::asio::local::stream_protocol::endpoint(config_.path),
+        boost::asio::bind_executor(strand_, [self = shared_from_this()](boost::system::error_code ec) {
+            if (ec) {
+                self->disconnected(ec);
+                return;
+            }
+            Logging::info("Connected to the message bus at " + self->config_.path + " as " + self->config_.nodeId);
+            {
+                std::lock_guard<std::mutex> lock(self->mutex_);
+                std::string hello;
+                putFrame(hello, 'H', self->config_.nodeId);
+                self->pendingFrames_.insert(0, hello);
+                self->connected_ = true;
+                self->flushScheduled_ = true;
+            }
+            self->flush(); // the hello, then whatever queued while disconnected
+            self->readHeader();
+        }));
+}
+
+void UnixSocketBus::disconnected(const boost::system::error_code& ec) {
+    boost::system::error_code ignored;
+    socket_.close(ignored); // a write in flight fails and clears isWriting_
+    bool wasConnected = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopped_) {
+            return;
+        }
+        wasConnected = connected_;
+        connected_ = false;
+        flushScheduled_ = false;
+    }
+    if (wasConnected) {
+        Logging::error("Lost the message bus at " + config_.path + ": " + ec.message());
+        // Until the broker is back no other node is reachable
+        if (handlers_.membership) {
+            handlers_.membership({config_.nodeId});
+        }
+    }
+    reconnectTimer_.expires_after(config_.reconnectDelay);
+    reconnectTimer_.async_wait([self = shared_from_this()](boost::system::error_code ec) {
+        if (!ec) {
+            self->connect();
+        }
+    });
+}
+
+// Strand only. One write at a time; a tick that finds one in flight
+// leaves its messages for the next.
+void UnixSocketBus::flush() {
+    if (isWriting_) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if ((pendingFrames_.empty() && pendingRecords_.empty()) || !connected_) {
+            flushScheduled_ = false;
+            return;
+        }
+        closeRecords();
+        writing_.clear();
+        writing_.swap(pendingFrames_);
+    }
+    isWriting_ = true;
+    boost::asio::async_write(socket_, boost::asio::buffer(writing_),
+        boost::asio::bind_executor(strand_, [self = shared_from_this()](boost::system::error_code ec, std::size_t) {
+            self->isWriting_ = false;
+            if (ec) {
+                self->disconnected(ec);
+                return;
+            }
+            self->batchesSent_.inc();
+            self->flush(); // messages queued during the write go out now
+        }));
+}
+
+void UnixSocketBus::readHeader() {
+    boost::asio::async_read(socket_, boost::asio::buffer(header_),
+        boost::asio::bind_executor(strand_, [self = shared_from_this()](boost::system::error_code ec, std::size_t) {
+            if (ec) {
+                self->disconnected(ec);
+                return;
+            }
+            std::uint32_t size = frameLength(self->header_);
+            if (size == 0 || size > kMaxFrameBytes) {
+                self->disconnected(boost::asio::error::message_size);
+                return;
+            }
+            self->readBody(size);
+        }));
+}
+
+void UnixSocketBus::readBody(std::uint32_t size) {
+    inbound_.resize(size);
+    boost::asio::async_read(socket_, boost::asio::buffer(inbound_),
+        boost::asio::bind_executor(strand_, [self = shared_from_this()](boost::system::error_code ec, std::size_t) {
+            if (ec) {
+                self->disconnected(ec);
+                return;
+            }
+            self->received(self->inbound_);
+            self->readHeader();
+        }));
+}
+
+void UnixSocketBus::received(const std::string& frame) {
+    std::size_t pos = 1;
+    bool ok = true;
+    switch (frame[0]) {
+    case 'R': {
+        std::string room;
+        std::uint64_t seq = 0;
+        std::string sender;
+        std::string message;
+        while (ok && pos < frame.size()) {
+            ok = getString(frame, pos, room) && getVarint(frame, pos, seq) && getString(frame, pos, sender) &&
+                 getString(frame, pos, message);
+            if (ok && handlers_.deliver) {
+                received_.inc();
+                handlers_.deliver(room, seq, sender, message);
+            }
+        }
+        break;
+    }
+    case 'D': {
+        std::string target;
+        std::string origin;
+        ok = getString(frame, pos, target) && getString(frame, pos, origin);
+        if (ok && handlers_.direct) {
+            handlers_.direct(origin, frame.substr(pos));
+        }
+        break;
+    }
+    case 'N': {
+        std::uint64_t count = 0;
+        std::vector<std::string> nodes;
+        ok = getVarint(frame, pos, count);
+        for (std::uint64_t i = 0; ok && i < count; ++i) {
+            nodes.emplace_back();
+            ok = getString(frame, pos, nodes.back());
+        }
+        if (ok && handlers_.membership) {
+            handlers_.membership(nodes);
+        }
+        break;
+    }
+    default:
+        ok = false;
+    }
+    if (!ok) {
+        Logging::error("Malformed frame from the message bus; ignored");
+    }
+}
+
+// BusBroker implementation
+struct BusBroker::Peer {
+    explicit Peer(boost::asio::local::stream_protocol::socket socket, std::uint64_t id)
+        : socket(std::move(socket)), id(id) {}
+
+    boost::asio::local::stream_protocol::socket socket;
+    std::uint64_t id;
+    std::string nodeId;                 // empty until the node's hello
+    std::uint8_t header[4];
+    std::string body;
+    std::deque<std::shared_ptr<const std::string>> queued;
+    std::vector<std::shared_ptr<const std::string>> writing;
+    std::vector<boost::asio::const_buffer> buffers;
+    std::size_t queuedBytes = 0;
+    bool open = true;
+};
+
+BusBroker::BusBroker(boost::asio::io_context& io, const std::string& path, std::size_t maxQueuedBytes)
+    : acceptor_(io), path_(path), maxQueuedBytes_(maxQueuedBytes) {}
+
+bool BusBroker::start() {
+    ::unlink(path_.c_str());
+    boost::system::error_code ec;
+    boost::asio::local::stream_protocol::endpoint endpoint(path_);
+    acceptor_.open(endpoint.protocol(), ec);
+    if (!ec) {
+        acceptor_.bind(endpoint, ec);
+    }
+    if (!ec) {
+        acceptor_.listen(boost::asio::socket_base::max_listen_connections, ec);
+    }
+    if (ec) {
+        Logging::error("Cannot listen for bus nodes on " + path_ + ": " + ec.message());
+        return false;
+    }
+    Logging::info("Message bus broker listening on " + path_);
+    doAccept();
+    return true;
+}
+
+void BusBroker::stop() {
+    boost::system::error_code ignored;
+    acceptor_.close(ignored);
+    for (auto& peer : peers_) {
+        peer->socket.close(ignored);
+    }
+    peers_.clear();
+    ::unlink(path_.c_str());
+}
+
+void BusBroker::doAccept() {
+    acceptor_.async_accept([this](boost::system::error_code ec, boost::asio::local::stream_protocol::socket socket) {
+        if (ec == boost::asio::error::operation_aborted) {
+            return;
+        }
+        if (!ec) {
+            auto peer = std::make_shared<Peer>(std::move(socket), nextPeerId_++);
+            peers_.push_back(peer);
+            readHeader(peer);
+        }
+        doAccept();
+    });
+}
+
+void BusBroker::readHeader(const std::shared_ptr<Peer>& peer) {
+    boost::asio::async_read(peer->socket, boost::asio::buffer(peer->header),
+        [this, peer](boost::system::error_code ec, std::size_t) {
+            std::uint32_t size = ec ? 0 : frameLength(peer->header);
+            if (ec || size == 0 || size > kMaxFrameBytes) {
+                drop(peer);
+                return;
+            }
+            readBody(peer, size);
+        });
+}
+
+void BusBroker::readBody(const std::shared_ptr<Peer>& peer, std::uint32_t size) {
+    peer->body.resize(4 + size);
+    std::copy(peer->header, peer->header + 4, peer->body.begin());
+    boost::asio::async_read(peer->socket, boost::asio::buffer(&peer->body[4], size),
+        [this, peer](boost::system::error_code ec, std::size_t) {
+            if (ec) {
+                drop(peer);
+                return;
+            }
+            // Relayed as received, header included; every node shares the copy
+            received(peer, std::make_shared<const std::string>(std::move(peer->body)));
+            peer->body = std::string();
+            if (peer->open) {
+                readHeader(peer);
+            }
+        });
+}
+
+void BusBroker::received(const std::shared_ptr<Peer>& from, std::shared_ptr<const std::string> frame) {
+    const std::string& data = *frame;
+    std::size_t pos = 5;
+    char type = data[4];
+
+    if (type == 'H') {
+        from->nodeId = data.substr(pos);
+        auto peers = peers_; // drop() edits the list
+        for (const auto& peer : peers) {
+            if (peer != from && peer->nodeId == from->nodeId) {
+                Logging::info("Bus node " + from->nodeId + " reconnected; dropping its old connection");
+                peer->nodeId.clear(); // its leaving is not announced
+                drop(peer);
+            }
+        }
+        Logging::info("Bus node " + from->nodeId + " joined; " + std::to_string(peers_.size()) + " connected");
+        announceMembers();
+        return;
+    }
+    if (from->nodeId.empty()) {
+        return; // nothing is relayed for a node that has not named itself
+    }
+
+    ++framesRelayed_;
+    if (type == 'D') {
+        std::string target;
+        if (!getString(data, pos, target)) {
+            return;
+        }
+        for (const auto& peer : peers_) {
+            if (peer->nodeId == target) {
+                queue(peer, frame);
+                break;
+            }
+        }
+        return;
+    }
+
+    auto peers = peers_; // queue() may drop a peer
+    for (const auto& peer : peers) {
+        if (peer != from && !peer->nodeId.empty()) {
+            queue(peer, frame);
+        }
+    }
+}
+
+void BusBroker::queue(const std::shared_ptr<Peer>& peer, const std::shared_ptr<const std::string>& frame) {
+    if (!peer->open) {
+        return;
+    }
+    if (peer->queuedBytes + frame->size() > maxQueuedBytes_) {
+        Logging::error("Bus node " + peer->nodeId + " fell too far behind; disconnecting it");
+        drop(peer);
+        return;
+    }
+    peer->queuedBytes += frame->size();
+    peer->queued.push_back(frame);
+    if (peer->writing.empty()) {
+        write(peer);
+    }
+}
+
+void BusBroker::announceMembers() {
+    std::vector<std::string> names;
+    for (const auto& peer : peers_) {
+        if (!peer->nodeId.empty()) {
+            names.push_back(peer->nodeId);
+        }
+    }
+    std::string body;
+    putVarint(body, names.size());
+    for (const auto& name : names) {
+        putString(body, name);
+    }
+    auto frame = std::make_shared<std::string>();
+    putFrame(*frame, 'N', body);
+
+    auto peers = peers_; // queue() may drop a peer
+    for (const auto& peer : peers) {
+        if (!peer->nodeId.empty()) {
+            queue(peer, frame);
+        }
+    }
+}
+
+// Everything queued for a node goes out in one gathered write
+void BusBroker::write(const std::shared_ptr<Peer>& peer) {
+    peer->writing.assign(peer->queued.begin(), peer->queued.end());
+    peer->queued.clear();
+    peer->buffers.clear();
+    for (const auto& frame : peer->writing) {
+        peer->buffers.emplace_back(boost::asio::buffer(*frame));
+    }
+    boost::asio::async_write(peer->socket, peer->buffers, [this, peer](boost::system::error_code ec, std::size_t) {
+        for (const auto& frame : peer->writing) {
+            peer->queuedBytes -= frame->size();
+        }
+        peer->writing.clear();
+        if (ec) {
+            drop(peer);
+            return;
+        }
+        if (!peer->queued.empty()) {
+            write(peer);
+        }
+    });
+}
+
+void BusBroker::drop(const std::shared_ptr<Peer>& peer) {
+    if (!peer->open) {
+        return;
+    }
+    peer->open = false;
+    boost::system::error_code ignored;
+    peer->socket.close(ignored);
+    peers_.erase(std::remove(peers_.begin(), peers_.end(), peer), peers_.end());
+    if (!peer->nodeId.empty()) {
+        Logging::info("Bus node " + peer->nodeId + " left; " + std::to_string(peers_.size()) + " connected");
+        announceMembers();
+    }
+}
+
+} // namespace ChatServer
@@ -0,0 +1,139 @@
+/**
+ * @file UnixSocketBus.hpp
+ * @brief MessageBus over a Unix domain socket, and the broker it connects to.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+
+#include "MessageBus.hpp"
+
+namespace ChatServer {
+
+class Counter;
+
+/*
+ * Nodes and the broker exchange frames: a 4-byte little-endian length of
+ * the rest, a type byte and a body. Strings are a varint length and bytes.
+ *
+ *   'H' node name                 node to broker, first on every connection
+ *   'N' count, node names         broker to nodes, whenever a node comes or goes
+ *   'R' (room, seq, sender, message)...  broadcasts; relayed to every other node
+ *   'D' target, origin, payload   relayed to the target node only
+ *
+ * A node writes its broadcasts and addressed messages of a tick together,
+ * in the order they were queued: consecutive broadcasts share one 'R'
+ * frame. The broker relays frames unchanged and in order.
+ */
+
+struct BusConfig {
+    std::string path;                                  // the broker's socket
+    std::string nodeId;                                // unique in the cluster
+    std::chrono::milliseconds tick{2};                 // publishes are batched this long
+    std::size_t maxQueuedBytes = 16 * 1024 * 1024;     // dropped beyond this while the broker lags
+    std::chrono::milliseconds reconnectDelay{1000};
+};
+
+/**
+ * @brief Node side: batches published messages per tick and hands them to
+ * the broker; delivers what other nodes published.
+ *
+ * Messages published while the broker is unreachable queue up to
+ * maxQueuedBytes and go out once it is back; beyond that they are dropped.
+ */
+class UnixSocketBus : public MessageBus, public std::enable_shared_from_this<UnixSocketBus> {
+public:
+    UnixSocketBus(boost::asio::io_context& io, const BusConfig& config);
+
+    bool start(Handlers handlers) override;
+    void stop() override;
+    const std::string& nodeId() const override { return config_.nodeId; }
+    void publish(const std::string& room, std::uint64_t seq, const std::string& senderSessionId,
+                 const std::string& message) override;
+    void sendTo(const std::string& node, const std::string& payload) override;
+
+private:
+    void scheduleFlush();
+    void closeRecords();
+    void connect();
+    void readHeader();
+    void readBody(std::uint32_t size);
+    void received(const std::string& frame);
+    void flush();
+    void disconnected(const boost::system::error_code& ec);
+
+    boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+    BusConfig config_;
+    boost::asio::local::stream_protocol::socket socket_;
+    boost::asio::steady_timer flushTimer_;
+    boost::asio::steady_timer reconnectTimer_;
+    Handlers handlers_;
+    std::uint8_t header_[4];
+    std::string inbound_;
+
+    std::mutex mutex_;                 // publishes come from every io thread
+    std::string pendingRecords_;       // the next 'R' frame's body
+    std::string pendingFrames_;        // complete frames, sent ahead of it
+    bool flushScheduled_ = false;
+    bool connected_ = false;
+    bool stopped_ = false;
+
+    std::string writing_;              // frame owned by the write in flight
+    bool isWriting_ = false;           // strand only
+
+    Counter& published_;
+    Counter& dropped_;
+    Counter& batchesSent_;
+    Counter& received_;
+    Counter& directSent_;
+};
+
+/**
+ * @brief Relays broadcasts to all other connected nodes, and addressed
+ * frames to their target.
+ *
+ * Runs in chat_bus_broker, on a single thread. A frame is kept once and
+ * shared by every node it is queued for; a node that falls more than
+ * maxQueuedBytes behind is disconnected. A node that connects under a name
+ * already taken replaces the old connection.
+ */
+class BusBroker {
+public:
+    BusBroker(boost::asio::io_context& io, const std::string& path,
+              std::size_t maxQueuedBytes = 64 * 1024 * 1024);
+
+    bool start();
+    void stop();
+
+    std::uint64_t framesRelayed() const { return framesRelayed_; }
+
+private:
+    struct Peer;
+
+    void doAccept();
+    void readHeader(const std::shared_ptr<Peer>& peer);
+    void readBody(const std::shared_ptr<Peer>& peer, std::uint32_t size);
+    void received(const std::shared_ptr<Peer>& from, std::shared_ptr<const std::string> frame);
+    void queue(const std::shared_ptr<Peer>& peer, const std::shared_ptr<const std::string>& frame);
+    void announceMembers();
+    void write(const std::shared_ptr<Peer>& peer);
+    void drop(const std::shared_ptr<Peer>& peer);
+
+    boost::asio::local::stream_protocol::acceptor acceptor_;
+    std::string path_;
+    std::size_t maxQueuedBytes_;
+    std::vector<std::shared_ptr<Peer>> peers_;
+    std::uint64_t nextPeerId_ = 1;
+    std::uint64_t framesRelayed_ = 0;
+};
+
+} // namespace ChatServer
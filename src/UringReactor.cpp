@@ -0,0 +1,487 @@
+/**
+ * @file UringReactor.cpp
+ * @brief Implementation of the io_uring accept and receive path.
+ *
+ * Talks to the kernel through the raw io_uring system calls and the ring
+ * layout in <linux/io_uring.h>, so it needs no liburing.
+ */
+
+#include "UringReactor.hpp"
+#include "Logging.hpp"
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+namespace ChatServer {
+
+namespace {
+
+const std::uint16_t kBufferGroup = 0;
+
+int ioUringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int ioUringRegister(int fd, unsigned opcode, void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+// Multishot receive with provided buffer rings arrived in 6.0
+bool kernelSupported() {
+    utsname name;
+    int major = 0;
+    int minor = 0;
+    return uname(&name) == 0 && std::sscanf(name.release, "%d.%d", &major, &minor) == 2 && major >= 6;
+}
+
+bool powerOfTwo(unsigned value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+} // namespace
+
+// The mapped rings; everything here is owned by the thread that holds the
+// matching lock (submission: submitMutex_, buffers: bufferMutex_,
+// completions: the single pending eventfd read)
+struct UringReactor::Ring {
+    int fd = -1;
+    int eventFd = -1;
+
+    void* rings = nullptr;
+    std::size_t ringsSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    std::size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqFlags = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    unsigned cqMask = 0;
+
+    // Entries are addressed directly: in C++ the empty struct that
+    // __DECLARE_FLEX_ARRAY puts in front of io_uring_buf_ring::bufs takes a
+    // byte, moving bufs off the start of the ring where the kernel reads it
+    io_uring_buf_ring* buffers = nullptr;
+    io_uring_buf* bufferEntries = nullptr;
+    std::size_t buffersSize = 0;
+    char* bufferData = nullptr;
+    std::size_t bufferDataSize = 0;
+    unsigned bufferMask = 0;
+
+    ~Ring() {
+        if (fd >= 0) {
+            close(fd);  // also unregisters the buffer ring and the eventfd
+        }
+        if (eventFd >= 0) {
+            close(eventFd);
+        }
+        if (sqes) {
+            munmap(sqes, sqesSize);
+        }
+        if (rings) {
+            munmap(rings, ringsSize);
+        }
+        if (buffers) {
+            munmap(buffers, buffersSize);
+        }
+        if (bufferData) {
+            munmap(bufferData, bufferDataSize);
+        }
+    }
+};
+
+struct UringReactor::Operation {
+    enum class Kind { Accept, Receive };
+
+    Kind kind;
+    int fd;
+    AcceptHandler onAccept;
+    ReceiveHandler onReceive;
+
+    std::mutex mutex;
+    std::deque<Completion> completions;  // drained by one posted run() at a time
+    bool running = false;
+};
+
+std::unique_ptr<UringReactor> UringReactor::create(boost::asio::io_context& io, const UringConfig& config) {
+    if (!kernelSupported()) {
+        Logging::info("io_uring needs Linux 6.0 or later; using the epoll backend");
+        return nullptr;
+    }
+    if (!powerOfTwo(config.bufferCount) || config.bufferCount > 32768) {
+        Logging::error("io_uring buffer count must be a power of two up to 32768");
+        return nullptr;
+    }
+
+    auto ring = std::make_unique<Ring>();
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = config.completionEntries;
+    ring->fd = ioUringSetup(config.submissionEntries, &params);
+    if (ring->fd < 0) {
+        Logging::info(std::string("io_uring unavailable (") + std::strerror(errno) + "); using the epoll backend");
+        return nullptr;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)) {
+        Logging::info("io_uring lacks single mmap or no-drop completions; using the epoll backend");
+        return nullptr;
+    }
+
+    // Submission and completion rings share one mapping
+    std::size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    std::size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ring->ringsSize = std::max(sqSize, cqSize);
+    void* rings = mmap(nullptr, ring->ringsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring->fd, IORING_OFF_SQ_RING);
+    if (rings == MAP_FAILED) {
+        Logging::error(std::string("Cannot map the io_uring rings: ") + std::strerror(errno));
+        return nullptr;
+    }
+    ring->rings = rings;
+    ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        Logging::error(std::string("Cannot map the io_uring submission entries: ") + std::strerror(errno));
+        return nullptr;
+    }
+    ring->sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* base = static_cast<char*>(rings);
+    ring->sqHead = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    ring->sqTail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    ring->sqFlags = reinterpret_cast<unsigned*>(base + params.sq_off.flags);
+    ring->sqArray = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+    ring->sqMask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    ring->sqEntries = params.sq_entries;
+    ring->cqHead = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    ring->cqTail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    ring->cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+    ring->cqMask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+
+    // Provided buffers: the ring of descriptors and the memory it points into
+    ring->buffersSize = config.bufferCount * sizeof(io_uring_buf);
+    ring->bufferDataSize = static_cast<std::size_t>(config.bufferCount) * config.bufferSize;
+    void* buffers = mmap(nullptr, ring->buffersSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void* data = mmap(nullptr, ring->bufferDataSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers == MAP_FAILED || data == MAP_FAILED) {
+        if (buffers != MAP_FAILED) {
+            munmap(buffers, ring->buffersSize);
+        }
+        if (data != MAP_FAILED) {
+            munmap(data, ring->bufferDataSize);
+        }
+        Logging::error("Cannot allocate the io_uring receive buffers");
+        return nullptr;
+    }
+    ring->buffers = static_cast<io_uring_buf_ring*>(buffers);
+    ring->bufferEntries = static_cast<io_uring_buf*>(buffers);
+    ring->bufferData = static_cast<char*>(data);
+    ring->bufferMask = config.bufferCount - 1;
+
+    io_uring_buf_reg registration;
+    std::memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = reinterpret_cast<std::uint64_t>(ring->buffers);
+    registration.ring_entries = config.bufferCount;
+    registration.bgid = kBufferGroup;
+    if (ioUringRegister(ring->fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+        Logging::info(std::string("io_uring buffer rings unavailable (") + std::strerror(errno) +
+                      "); using the epoll backend");
+        return nullptr;
+    }
+    for (unsigned i = 0; i < config.bufferCount; ++i) {
+        io_uring_buf& buffer = ring->bufferEntries[i];
+        buffer.addr = reinterpret_cast<std::uint64_t>(ring->bufferData + static_cast<std::size_t>(i) * config.bufferSize);
+        buffer.len = config.bufferSize;
+        buffer.bid = static_cast<std::uint16_t>(i);
+    }
+    __atomic_store_n(&ring->buffers->tail, static_cast<std::uint16_t>(config.bufferCount), __ATOMIC_RELEASE);
+
+    ring->eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (ring->eventFd < 0 || ioUringRegister(ring->fd, IORING_REGISTER_EVENTFD, &ring->eventFd, 1) < 0) {
+        Logging::error(std::string("Cannot attach an eventfd to io_uring: ") + std::strerror(errno));
+        return nullptr;
+    }
+
+    Logging::info("io_uring backend ready: " + std::to_string(config.bufferCount) + " receive buffers of " +
+                  std::to_string(config.bufferSize) + " bytes");
+    return std::unique_ptr<UringReactor>(new UringReactor(io, config, std::move(ring)));
+}
+
+UringReactor::UringReactor(boost::asio::io_context& io, const UringConfig& config, std::unique_ptr<Ring> ring)
+    : io_(io),
+      config_(config),
+      ring_(std::move(ring)),
+      completionEvent_(io),
+      submitCalls_(MetricsRegistry::getInstance().counter(
+          "chat_uring_submit_calls_total", "io_uring_enter calls made to submit queued requests")),
+      completions_(MetricsRegistry::getInstance().counter(
+          "chat_uring_completions_total", "io_uring completions handled")),
+      buffersExhausted_(MetricsRegistry::getInstance().counter(
+          "chat_uring_buffers_exhausted_total", "Receives paused because every provided buffer was in use")) {
+    // The descriptor takes ownership of the eventfd
+    completionEvent_.assign(ring_->eventFd);
+    ring_->eventFd = -1;
+    waitForCompletions();
+}
+
+UringReactor::~UringReactor() {
+    stop();
+}
+
+void UringReactor::accept(int listenFd, AcceptHandler handler) {
+    auto* op = new Operation();
+    op->kind = Operation::Kind::Accept;
+    op->fd = listenFd;
+    op->onAccept = std::move(handler);
+    {
+        std::lock_guard<std::mutex> lock(operationsMutex_);
+        operations_.insert(op);
+    }
+    arm(op);
+}
+
+void UringReactor::receive(int fd, ReceiveHandler handler) {
+    auto* op = new Operation();
+    op->kind = Operation::Kind::Receive;
+    op->fd = fd;
+    op->onReceive = std::move(handler);
+    {
+        std::lock_guard<std::mutex> lock(operationsMutex_);
+        operations_.insert(op);
+    }
+    arm(op);
+}
+
+void UringReactor::stop() {
+    if (stopped_.exchange(true)) {
+        return;
+    }
+    boost::system::error_code ignored;
+    completionEvent_.close(ignored);
+
+    // Closing the ring cancels whatever is still armed; the handlers that
+    // never ran go with their operations
+    ring_.reset();
+    std::lock_guard<std::mutex> lock(operationsMutex_);
+    for (Operation* op : operations_) {
+        delete op;
+    }
+    operations_.clear();
+}
+
+// Queue a multishot request; the kernel sees it on the next submit()
+void UringReactor::arm(Operation* op) {
+    {
+        std::lock_guard<std::mutex> lock(submitMutex_);
+        if (stopped_) {
+            return;
+        }
+        Ring& ring = *ring_;
+        unsigned tail = *ring.sqTail;
+        if (tail - __atomic_load_n(ring.sqHead, __ATOMIC_ACQUIRE) == ring.sqEntries) {
+            // Full: hand the batch over now rather than wait for the posted submit
+            submitCalls_.inc();
+            ioUringEnter(ring.fd, unsubmitted_, 0, 0);
+            unsubmitted_ = 0;
+        }
+        unsigned index = tail & ring.sqMask;
+        io_uring_sqe& sqe = ring.sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.fd = op->fd;
+        sqe.user_data = reinterpret_cast<std::uint64_t>(op);
+        if (op->kind == Operation::Kind::Accept) {
+            sqe.opcode = IORING_OP_ACCEPT;
+            sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+            sqe.accept_flags = SOCK_CLOEXEC;
+        } else {
+            sqe.opcode = IORING_OP_RECV;
+            sqe.ioprio = IORING_RECV_MULTISHOT;
+            sqe.flags = IOSQE_BUFFER_SELECT;
+            sqe.buf_group = kBufferGroup;
+        }
+        ring.sqArray[index] = index;
+        __atomic_store_n(ring.sqTail, tail + 1, __ATOMIC_RELEASE);
+        ++unsubmitted_;
+    }
+    schedule();
+}
+
+// One submit per io_context turn covers everything queued in the meantime
+void UringReactor::schedule() {
+    if (!submitScheduled_.exchange(true)) {
+        boost::asio::post(io_, [this]() { submit(); });
+    }
+}
+
+void UringReactor::submit() {
+    submitScheduled_ = false;
+    std::lock_guard<std::mutex> lock(submitMutex_);
+    if (stopped_ || unsubmitted_ == 0) {
+        return;
+    }
+    submitCalls_.inc();
+    int submitted = ioUringEnter(ring_->fd, unsubmitted_, 0, 0);
+    if (submitted < 0) {
+        Logging::error(std::string("io_uring submit failed: ") + std::strerror(errno));
+        return; // still queued; the next submit retries
+    }
+    unsubmitted_ -= static_cast<unsigned>(submitted);
+}
+
+void UringReactor::waitForCompletions() {
+    completionEvent_.async_read_some(boost::asio::buffer(&eventCount_, sizeof(eventCount_)),
+        [this](boost::system::error_code ec, std::size_t /*length*/) {
+            if (ec == boost::asio::error::operation_aborted || stopped_) {
+                return;
+            }
+            drainCompletions();
+            waitForCompletions();
+        });
+}
+
+// Runs in the eventfd handler, so one drain at a time. Completions are
+// handed to their operations here; the handlers run from posted run() calls.
+void UringReactor::drainCompletions() {
+    Ring& ring = *ring_;
+    for (;;) {
+        unsigned head = *ring.cqHead;
+        unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = ring.cqes[head & ring.cqMask];
+            auto* op = reinterpret_cast<Operation*>(cqe.user_data);
+            Completion completion{cqe.res, cqe.flags, false};
+            completions_.inc();
+
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                buffersInUse_.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // A multishot request without F_MORE is over. Re-arm it unless
+            // the connection ended; running out of buffers is not an ending
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                if (stopped_) {
+                    completion.last = true;
+                } else if (cqe.res == -ENOBUFS) {
+                    buffersExhausted_.inc();
+                    std::unique_lock<std::mutex> lock(bufferMutex_);
+                    if (buffersInUse_.load(std::memory_order_relaxed) > 0) {
+                        starved_.push_back(op);
+                    } else {
+                        lock.unlock();
+                        arm(op);
+                    }
+                } else if (op->kind == Operation::Kind::Accept || cqe.res > 0) {
+                    arm(op);
+                } else {
+                    completion.last = true;
+                }
+            }
+
+            bool post = false;
+            {
+                std::lock_guard<std::mutex> lock(op->mutex);
+                op->completions.push_back(completion);
+                post = !op->running;
+                op->running = true;
+            }
+            if (post) {
+                boost::asio::post(io_, [this, op]() { run(op); });
+            }
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+
+        // Completions that did not fit were held back by the kernel; flush them in
+        if (!(__atomic_load_n(ring.sqFlags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW)) {
+            return;
+        }
+        ioUringEnter(ring.fd, 0, 0, IORING_ENTER_GETEVENTS);
+    }
+}
+
+void UringReactor::run(Operation* op) {
+    for (;;) {
+        Completion completion;
+        {
+            std::lock_guard<std::mutex> lock(op->mutex);
+            if (op->completions.empty()) {
+                op->running = false;
+                return;
+            }
+            completion = op->completions.front();
+            op->completions.pop_front();
+        }
+
+        if (op->kind == Operation::Kind::Accept) {
+            if (completion.result >= 0) {
+                op->onAccept(completion.result, 0);
+            } else {
+                op->onAccept(-1, -completion.result);
+            }
+        } else if (completion.flags & IORING_CQE_F_BUFFER) {
+            auto id = static_cast<std::uint16_t>(completion.flags >> IORING_CQE_BUFFER_SHIFT);
+            op->onReceive(ring_->bufferData + static_cast<std::size_t>(id) * config_.bufferSize,
+                          static_cast<std::size_t>(completion.result), 0);
+            recycleBuffer(id);
+        } else if (completion.result == 0) {
+            op->onReceive(nullptr, 0, 0);
+        } else if (completion.result != -ENOBUFS) {
+            op->onReceive(nullptr, 0, -completion.result);
+        }
+
+        if (completion.last) {
+            finish(op);
+            return;
+        }
+    }
+}
+
+void UringReactor::finish(Operation* op) {
+    {
+        std::lock_guard<std::mutex> lock(operationsMutex_);
+        operations_.erase(op);
+    }
+    delete op;
+}
+
+void UringReactor::recycleBuffer(std::uint16_t id) {
+    std::vector<Operation*> waiting;
+    {
+        std::lock_guard<std::mutex> lock(bufferMutex_);
+        io_uring_buf_ring* buffers = ring_->buffers;
+        std::uint16_t tail = buffers->tail;
+        io_uring_buf& buffer = ring_->bufferEntries[tail & ring_->bufferMask];
+        buffer.addr = reinterpret_cast<std::uint64_t>(ring_->bufferData + static_cast<std::size_t>(id) * config_.bufferSize);
+        buffer.len = config_.bufferSize;
+        buffer.bid = id;
+        __atomic_store_n(&buffers->tail, static_cast<std::uint16_t>(tail + 1), __ATOMIC_RELEASE);
+        buffersInUse_.fetch_sub(1, std::memory_order_relaxed);
+        waiting.swap(starved_);
+    }
+    for (Operation* op : waiting) {
+        arm(op);
+    }
+}
+
+} // namespace ChatServer
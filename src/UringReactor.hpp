@@ -0,0 +1,111 @@
+/**
+ * @file UringReactor.hpp
+ * @brief io_uring accept and receive path for Linux builds with CHAT_IO_URING.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+#include <boost/asio.hpp>
+
+namespace ChatServer {
+
+class Counter;
+
+struct UringConfig {
+    unsigned submissionEntries = 4096;
+    unsigned completionEntries = 16384;
+    unsigned bufferCount = 8192;         // power of two, shared by every connection
+    unsigned bufferSize = 1024;          // the size of Session's asio read buffer
+};
+
+/**
+ * @brief Multishot accept and receive on io_uring, completed on an io_context.
+ *
+ * One ring serves the whole server. Each connection has a single multishot
+ * receive armed for its lifetime; the kernel picks a buffer from a ring of
+ * provided buffers registered once at startup, so idle connections hold no
+ * read buffer at all; a receive that finds none left waits for the next
+ * buffer handed back. Submissions are queued and handed to the kernel in one
+ * io_uring_enter per io_context turn.
+ *
+ * Completions are signalled through an eventfd the io_context waits on. They
+ * are drained by one handler at a time and run as posted handlers, in order
+ * per connection and in parallel across connections.
+ */
+class UringReactor {
+public:
+    // data/size for a read; size 0 and error 0 for end of stream; error is an errno
+    using ReceiveHandler = std::function<void(const char* data, std::size_t size, int error)>;
+    // fd of the accepted socket, or -1 and an errno
+    using AcceptHandler = std::function<void(int fd, int error)>;
+
+    // nullptr if the kernel lacks anything the reactor needs (Linux 6.0 or later)
+    static std::unique_ptr<UringReactor> create(boost::asio::io_context& io, const UringConfig& config = UringConfig());
+
+    ~UringReactor();
+
+    UringReactor(const UringReactor&) = delete;
+    UringReactor& operator=(const UringReactor&) = delete;
+
+    // Accept on listenFd until stop(); accept errors are reported and accepting goes on
+    void accept(int listenFd, AcceptHandler handler);
+
+    // Receive on fd until end of stream or an error, which is the last call
+    void receive(int fd, ReceiveHandler handler);
+
+    // Cancel everything in flight; call once the io_context has stopped running
+    void stop();
+
+private:
+    struct Ring;
+    struct Operation;
+    struct Completion {
+        int result;
+        std::uint32_t flags;
+        bool last;                       // the operation ends with this one
+    };
+
+    UringReactor(boost::asio::io_context& io, const UringConfig& config, std::unique_ptr<Ring> ring);
+
+    void arm(Operation* op);
+    void schedule();
+    void submit();
+    void waitForCompletions();
+    void drainCompletions();
+    void run(Operation* op);
+    void finish(Operation* op);
+    void recycleBuffer(std::uint16_t id);
+
+    boost::asio::io_context& io_;
+    UringConfig config_;
+    std::unique_ptr<Ring> ring_;
+    boost::asio::posix::stream_descriptor completionEvent_;
+    std::uint64_t eventCount_ = 0;
+
+    std::mutex submitMutex_;
+    unsigned unsubmitted_ = 0;
+    std::atomic<bool> submitScheduled_{false};
+
+    std::mutex bufferMutex_;             // returns to the buffer ring come from any io thread
+    std::atomic<std::size_t> buffersInUse_{0};
+    std::vector<Operation*> starved_;    // receives waiting for a buffer to come back
+
+    std::mutex operationsMutex_;
+    std::unordered_set<Operation*> operations_;
+    std::atomic<bool> stopped_{false};
+
+    Counter& submitCalls_;
+    Counter& completions_;
+    Counter& buffersExhausted_;
+};
+
+} // namespace ChatServer
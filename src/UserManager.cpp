@@ -4,6 +4,7 @@
  */
 
 #include "UserManager.hpp"
+#include "StateStore.hpp"
 #include "Logging.hpp"
 #include <iostream>
 #include <mutex>
@@ -40,7 +41,7 @@ UserManager::UserManager() {
 }
 
 std::shared_ptr<User> UserManager::createUser(const std::string& userId, const std::string& nickname) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<ProfiledMutex> lock(mutex_);
     
     // Check if user already exists
     auto it = users_.find(userId);
@@ -52,12 +53,15 @@ std::shared_ptr<User> UserManager::createUser(const std::string& userId, const s
     auto user = std::make_shared<User>(userId, nickname);
     users_[userId] = user;
     
+    if (journal_) {
+        journal_->userCreated(userId, user->getNickname());
+    }
     Logging::info("User created: " + userId + (nickname.empty() ? "" : " with nickname " + nickname));
     return user;
 }
 
 std::shared_ptr<User> UserManager::getUser(const std::string& userId) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<ProfiledMutex> lock(mutex_);
     
     auto it = users_.find(userId);
     if (it != users_.end()) {
@@ -68,26 +72,32 @@ std::shared_ptr<User> UserManager::getUser(const std::string& userId) {
 }
 
 void UserManager::removeUser(const std::string& userId) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<ProfiledMutex> lock(mutex_);
     
     auto it = users_.find(userId);
     if (it != users_.end()) {
         users_.erase(it);
+        if (journal_) {
+            journal_->userRemoved(userId);
+        }
         Logging::info("User removed: " + userId);
     }
 }
 
 std::map<std::string, std::shared_ptr<User>> UserManager::getAllUsers() const {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<ProfiledMutex> lock(mutex_);
     return users_;
 }
 
 bool UserManager::updateNickname(const std::string& userId, const std::string& nickname) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<ProfiledMutex> lock(mutex_);
     
     auto it = users_.find(userId);
     if (it != users_.end()) {
         it->second->setNickname(nickname);
+        if (journal_) {
+            journal_->nicknameChanged(userId, nickname);
+        }
         Logging::info("User " + userId + " updated nickname to " + nickname);
         return true;
     }
@@ -95,4 +105,29 @@ bool UserManager::updateNickname(const std::string& userId, const std::string& n
     return false;
 }
 
+void UserManager::setJournal(std::shared_ptr<StateJournal> journal) {
+    std::lock_guard<ProfiledMutex> lock(mutex_);
+    journal_ = std::move(journal);
+}
+
+void UserManager::restoreUser(const std::string& userId, const std::string& nickname) {
+    auto user = std::make_shared<User>(userId, nickname);
+    std::lock_guard<ProfiledMutex> lock(mutex_);
+    users_[userId] = std::move(user);
+}
+
+std::size_t UserManager::retainUsers(const std::set<std::string>& userIds) {
+    std::lock_guard<ProfiledMutex> lock(mutex_);
+    std::size_t removed = 0;
+    for (auto it = users_.begin(); it != users_.end();) {
+        if (userIds.count(it->first) == 0) {
+            it = users_.erase(it);
+            ++removed;
+        } else {
+            ++it;
+        }
+    }
+    return removed;
+}
+
 } // namespace ChatServer
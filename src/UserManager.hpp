@@ -7,11 +7,16 @@
 
 #include <string>
 #include <map>
+#include <set>
 #include <mutex>
 #include <memory>
 
+#include "ProfiledMutex.hpp"
+
 namespace ChatServer {
 
+class StateJournal;
+
 class User {
 public:
     User(const std::string& userId, const std::string& nickname = "");
@@ -53,10 +58,21 @@ public:
     
     // Update a user's nickname
     bool updateNickname(const std::string& userId, const std::string& nickname);
+    
+    // Record user changes to a journal from now on
+    void setJournal(std::shared_ptr<StateJournal> journal);
+    
+    // Recreate a user during state restore, without journaling or logging
+    void restoreUser(const std::string& userId, const std::string& nickname);
+    
+    // Keep only the given users during state restore, without journaling or
+    // logging; returns how many were removed
+    std::size_t retainUsers(const std::set<std::string>& userIds);
 
 private:
     std::map<std::string, std::shared_ptr<User>> users_;
-    mutable std::mutex mutex_;
+    std::shared_ptr<StateJournal> journal_;
+    mutable ProfiledMutex mutex_{"UserManager::mutex_"};
 };
 
 } // namespace ChatServer
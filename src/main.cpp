@@ -14,10 +14,18 @@
 #include <sstream>
 #include <ctime>
 #include <deque>
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
 #include <atomic>
 #include <vector>
 #include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <csignal>
 
 #include "Logging.hpp"
 #include "ChatRoom.hpp"
@@ -27,6 +35,28 @@
 #include "Command.hpp"
 #include "Commands.hpp"
 #include "ThreadPool.hpp"
+#include "DatabaseExecutor.hpp"
+#include "HistoryStore.hpp"
+#include "SearchIndex.hpp"
+#include "ResumeRegistry.hpp"
+#include "Metrics.hpp"
+#include "AdminServer.hpp"
+#include "ProfiledMutex.hpp"
+#include "StallWatchdog.hpp"
+#include "TraceCapture.hpp"
+#include "StateStore.hpp"
+#include "MessageBus.hpp"
+#include "SessionDirectory.hpp"
+#include "RoomPlacement.hpp"
+#include "GatewayLink.hpp"
+#ifdef CHAT_IO_URING
+#include "UringReactor.hpp"
+#include <cstring>
+#endif
+#ifndef _WIN32
+#include "HotRestart.hpp"
+#include "UnixSocketBus.hpp"
+#endif
 
 using boost::asio::ip::tcp;
 
@@ -60,17 +90,24 @@ const std::string SERVER_ART = R"(
                  UNIFIED CHAT SERVER
 )";
 
-// Server stats
+// Server stats, kept in the metrics registry so /metrics exports them too
 struct ServerStats {
-    std::atomic<int> totalConnections{0};
-    std::atomic<int> activeConnections{0};
-    std::atomic<int> messagesProcessed{0};
-    std::atomic<int> bytesReceived{0};
-    std::atomic<int> bytesSent{0};
+    ChatServer::Counter& totalConnections;
+    ChatServer::Gauge& activeConnections;
+    ChatServer::Counter& messagesProcessed;
+    ChatServer::Counter& bytesReceived;
+    ChatServer::Counter& bytesSent;
     std::chrono::system_clock::time_point startTime;
     
-    ServerStats() {
+    explicit ServerStats(ChatServer::MetricsRegistry& metrics)
+        : totalConnections(metrics.counter("chat_connections_accepted_total", "Client connections accepted")),
+          activeConnections(metrics.gauge("chat_connections_active", "Client connections currently open")),
+          messagesProcessed(metrics.counter("chat_messages_received_total", "Chat messages received from clients")),
+          bytesReceived(metrics.counter("chat_received_bytes_total", "Bytes of chat messages received")),
+          bytesSent(metrics.counter("chat_sent_bytes_total", "Bytes of chat messages fanned out to recipients")) {
         startTime = std::chrono::system_clock::now();
+        metrics.gauge("chat_start_time_seconds", "Server start time in seconds since the epoch")
+            .set(std::chrono::duration_cast<std::chrono::seconds>(startTime.time_since_epoch()).count());
     }
     
     std::string getUptime() const {
@@ -94,6 +131,7 @@ struct ServerStats {
     }
 };
 
+#ifdef _WIN32
 // Console UI for the server
 class ConsoleUI {
 public:
@@ -185,10 +223,10 @@ public:
         // Format the status line
         std::stringstream ss;
         ss << "Uptime: " << stats.getUptime() 
-           << " | Connections: " << stats.activeConnections << "/" << stats.totalConnections
-           << " | Messages: " << stats.messagesProcessed
-           << " | Data: " << (stats.bytesReceived / 1024) << "KB in, " 
-           << (stats.bytesSent / 1024) << "KB out";
+           << " | Connections: " << stats.activeConnections.value() << "/" << stats.totalConnections.value()
+           << " | Messages: " << stats.messagesProcessed.value()
+           << " | Data: " << (stats.bytesReceived.value() / 1024) << "KB in, " 
+           << (stats.bytesSent.value() / 1024) << "KB out";
         
         std::string status = ss.str();
         
@@ -313,13 +351,159 @@ private:
     std::mutex messagesMutex;
     std::mutex statusMutex;
 };
+#else
+// Console UI for the server on POSIX terminals: messages scroll up and the
+// status line is redrawn under them. Without a terminal (a log file or a
+// pipe) only the messages are written, uncoloured.
+class ConsoleUI {
+public:
+    ConsoleUI() : interactive(isatty(STDOUT_FILENO) == 1) {
+        drawHeader();
+    }
+    
+    ~ConsoleUI() {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        if (interactive) {
+            std::cout << "\r\033[K\033[0m" << std::flush;
+        }
+    }
+    
+    void drawHeader() {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        setColor(Color::CYAN);
+        std::cout << SERVER_ART << std::endl;
+        setColor(Color::DARK_CYAN);
+        std::cout << std::string(terminalWidth(), '=') << std::endl;
+        resetColor();
+    }
+    
+    // The status line is the terminal's last line; nothing to draw around it
+    void drawStatusBar() {}
+    
+    void updateStatus(const ServerStats& stats) {
+        if (!interactive) {
+            return;
+        }
+        std::stringstream ss;
+        ss << "Uptime: " << stats.getUptime() 
+           << " | Connections: " << stats.activeConnections.value() << "/" << stats.totalConnections.value()
+           << " | Messages: " << stats.messagesProcessed.value()
+           << " | Data: " << (stats.bytesReceived.value() / 1024) << "KB in, " 
+           << (stats.bytesSent.value() / 1024) << "KB out";
+        
+        std::lock_guard<std::mutex> lock(outputMutex);
+        status = ss.str();
+        drawStatus();
+        std::cout << std::flush;
+    }
+    
+    void addMessage(const std::string& type, const std::string& message, bool isError = false) {
+        auto now = std::chrono::system_clock::now();
+        auto time = std::chrono::system_clock::to_time_t(now);
+        std::tm local{};
+        localtime_r(&time, &local);
+        
+        std::lock_guard<std::mutex> lock(outputMutex);
+        if (interactive) {
+            std::cout << "\r\033[K"; // the message takes the status line's place
+        }
+        
+        // Timestamp
+        setColor(Color::GRAY);
+        std::cout << "[" << std::put_time(&local, "%H:%M:%S") << "] ";
+        
+        // Message type
+        if (isError) {
+            setColor(Color::RED);
+        } else if (type == "INFO") {
+            setColor(Color::GREEN);
+        } else if (type == "SYSTEM") {
+            setColor(Color::YELLOW);
+        } else if (type == "DEBUG") {
+            setColor(Color::CYAN);
+        } else {
+            setColor(Color::WHITE);
+        }
+        std::cout << "[" << type << "] ";
+        
+        // Message content
+        if (isError) {
+            setColor(Color::RED);
+        } else {
+            resetColor();
+        }
+        std::cout << message;
+        resetColor();
+        std::cout << "\n";
+        
+        drawStatus();
+        std::cout << std::flush;
+    }
+    
+private:
+    // Must be called with outputMutex held
+    void drawStatus() {
+        if (!interactive || status.empty()) {
+            return;
+        }
+        std::string line = status;
+        std::size_t width = terminalWidth();
+        if (line.length() > width) {
+            line = line.substr(0, width - 3) + "...";
+        }
+        std::cout << "\r\033[K";
+        setColor(Color::YELLOW);
+        std::cout << line;
+        resetColor();
+    }
+    
+    // Console colours are Windows attribute bits (1 blue, 2 green, 4 red,
+    // 8 bright); ANSI numbers red, green and blue the other way round
+    void setColor(Color color) {
+        if (!interactive) {
+            return;
+        }
+        int bits = static_cast<int>(color);
+        int code = 30 + ((bits & 4) ? 1 : 0) + ((bits & 2) ? 2 : 0) + ((bits & 1) ? 4 : 0) + ((bits & 8) ? 60 : 0);
+        std::cout << "\033[" << code << "m";
+    }
+    
+    void resetColor() {
+        if (interactive) {
+            std::cout << "\033[0m";
+        }
+    }
+    
+    std::size_t terminalWidth() const {
+        winsize size{};
+        if (interactive && ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 3) {
+            return size.ws_col;
+        }
+        return 80;
+    }
+    
+    bool interactive;
+    std::string status;
+    std::mutex outputMutex;
+};
+#endif
+
+// Where a hot restart came from; nullptr for a normal start
+#ifndef _WIN32
+using InheritedState = ChatServer::HandoffState;
+#else
+struct InheritedState {};
+#endif
 
 class UnifiedChatServer {
 public:
-    UnifiedChatServer(boost::asio::io_context& io_context, short port)
-        : acceptor_(io_context, tcp::endpoint(tcp::v4(), port)),
+    UnifiedChatServer(boost::asio::io_context& io_context, short port, const InheritedState* inherited = nullptr)
+        : acceptor_(makeAcceptor(io_context, port, inherited)),
           socket_(io_context),
           io_context_(io_context),
+          expiryTimer_(io_context),
+          signals_(io_context, SIGINT, SIGTERM),
+          stats_(ChatServer::MetricsRegistry::getInstance()),
           running_(true) {
         
         // Initialize UI
@@ -333,18 +517,207 @@ public:
         // Initialize command manager
         commandManager_ = std::make_shared<ChatServer::CommandManager>(chatRoomManager_, userManager_);
         
+        // Message history backend (CHAT_HISTORY_BACKEND=sqlite|segment, sqlite by default)
+        // and the search index over it
+        dbExecutor_ = std::make_shared<ChatServer::DatabaseExecutor>();
+        const char* backend = std::getenv("CHAT_HISTORY_BACKEND");
+        historyStore_ = ChatServer::createHistoryStore(backend ? backend : "sqlite", dbExecutor_);
+        if (!historyStore_) {
+            historyStore_ = ChatServer::createHistoryStore("sqlite", dbExecutor_);
+        }
+        searchIndex_ = std::make_shared<ChatServer::SearchIndex>();
+        queryPool_ = std::make_shared<ThreadPool>(2);
+        resumeRegistry_ = std::make_shared<ChatServer::ResumeRegistry>();
+        
+#ifndef _WIN32
+        // Join a cluster: room broadcasts go to the other nodes through the
+        // broker on CHAT_BUS_SOCKET (see chat_bus_broker), batched every
+        // CHAT_BUS_TICK_MS (2), and theirs are fanned out to members here.
+        // CHAT_NODE_ID names this node (n<port> by default) and ends its
+        // session IDs, which keeps them unique across the cluster.
+        if (const char* busPath = std::getenv("CHAT_BUS_SOCKET")) {
+            ChatServer::BusConfig busConfig;
+            busConfig.path = busPath;
+            const char* nodeId = std::getenv("CHAT_NODE_ID");
+            busConfig.nodeId = nodeId && *nodeId ? std::string(nodeId) : "n" + std::to_string(port);
+            if (const char* tick = std::getenv("CHAT_BUS_TICK_MS")) {
+                busConfig.tick = std::chrono::milliseconds(std::max(0, std::atoi(tick)));
+            }
+            bus_ = std::make_shared<ChatServer::UnixSocketBus>(io_context_, busConfig);
+            sessionIdSuffix_ = "@" + busConfig.nodeId;
+        }
+#endif
+        // Find users served by other nodes for /whisper and /whois
+        if (bus_) {
+            sessionDirectory_ = std::make_shared<ChatServer::SessionDirectory>(io_context_, bus_, sessionManager_);
+            std::weak_ptr<ChatServer::SessionDirectory> weakDirectory = sessionDirectory_;
+            sessionManager_->setPresenceObserver([weakDirectory](const std::string& sessionId, bool online) {
+                if (auto directory = weakDirectory.lock()) {
+                    directory->sessionChanged(sessionId, online);
+                }
+            });
+            
+            // Each room is numbered by one owner node, which members' posts
+            // are forwarded to, and can be moved to another
+            roomPlacement_ = std::make_shared<ChatServer::RoomPlacement>(
+                io_context_, bus_, chatRoomManager_,
+                [this](const std::string& roomName, const std::string& senderId, const std::string& message,
+                       std::int64_t timestamp) {
+                    return postToRoom(chatRoomManager_->createChatRoom(roomName), senderId, message, timestamp);
+                });
+            std::weak_ptr<ChatServer::RoomPlacement> weakPlacement = roomPlacement_;
+            chatRoomManager_->setMembershipObserver(
+                [weakPlacement](const std::string& roomName, const std::string& sessionId, bool joined) {
+                    if (auto placement = weakPlacement.lock()) {
+                        placement->memberChanged(roomName, sessionId, joined);
+                    }
+                });
+        }
+        
         // Register commands
-        ChatServer::registerCommands(*commandManager_, chatRoomManager_, userManager_, sessionManager_);
+        ChatServer::registerCommands(*commandManager_, chatRoomManager_, userManager_, sessionManager_,
+                                     {historyStore_, searchIndex_, queryPool_}, resumeRegistry_,
+                                     sessionDirectory_);
+        
+        // Restore rooms, users, memberships and resumable identities, then
+        // journal further changes. Ids seen before are never handed out again,
+        // even those of users dropped because nobody can resume them.
+        stateStore_ = std::make_shared<ChatServer::StateStore>(
+            ChatServer::StateStoreConfig(), chatRoomManager_, userManager_, resumeRegistry_);
+        if (!stateStore_->restore()) {
+            ui_->addMessage("ERROR", "Saved state could not be fully restored", true);
+        }
+        skipRestoredSessionIds();
+        stateStore_->dropUnresumable();
+        if (stateStore_->start()) {
+            chatRoomManager_->setJournal(stateStore_);
+            userManager_->setJournal(stateStore_);
+            resumeRegistry_->setJournal(stateStore_);
+        } else {
+            ui_->addMessage("ERROR", "State journal unavailable; changes will not survive a restart", true);
+        }
         
         // Create a default chat room
         chatRoomManager_->createChatRoom("general");
         
+        // Start the database executor and the message history backend, then
+        // index existing history before new messages start arriving
+        if (!dbExecutor_->start() || !historyStore_->start()) {
+            ui_->addMessage("ERROR", "Message persistence unavailable", true);
+        } else {
+            ui_->addMessage("INFO", std::string("Message history stored by the ") +
+                            historyStore_->backendName() + " backend");
+            chatRoomManager_->seedSequences(historyStore_->lastSequences());
+            searchIndex_->rebuild(*historyStore_);
+            historyStore_->setObserver(searchIndex_);
+        }
+        searchIndex_->start();
+        
         // Log initialization
         Logging::info("Unified Chat Server initialized on port " + std::to_string(port));
         ui_->addMessage("INFO", "Server initialized on port " + std::to_string(port));
         
+        // Metrics for Prometheus on a loopback admin port (CHAT_ADMIN_PORT, 9100 by default; 0 disables)
+        startAdminServer();
+        
+        // Report handlers that block an io thread (CHAT_STALL_THRESHOLD_MS, 50 by default)
+        ChatServer::WatchdogConfig watchdogConfig;
+        if (const char* threshold = std::getenv("CHAT_STALL_THRESHOLD_MS")) {
+            watchdogConfig.stallThreshold = std::chrono::milliseconds(std::max(1, std::atoi(threshold)));
+        }
+        ChatServer::StallWatchdog::getInstance().configure(watchdogConfig);
+        ChatServer::StallWatchdog::getInstance().start(io_context_);
+        
+        // Capture inbound traffic for chat_replay from the start (CHAT_TRACE_FILE);
+        // the admin port can also start and stop captures later
+        if (const char* traceFile = std::getenv("CHAT_TRACE_FILE")) {
+            ChatServer::TraceRecorder::getInstance().start(traceFile, traceRedacted());
+        }
+        
+        // Send frames of CHAT_ZEROCOPY_MIN_BYTES or more with MSG_ZEROCOPY (Linux;
+        // off by default). Pinning pages costs more than copying below ~10 KB.
+        if (const char* zeroCopy = std::getenv("CHAT_ZEROCOPY_MIN_BYTES")) {
+            ChatServer::Session::setZeroCopyThreshold(std::strtoull(zeroCopy, nullptr, 10));
+        }
+        
+#ifdef CHAT_IO_URING
+        // Accept and read through io_uring unless CHAT_IO_URING=0; kernels
+        // without multishot receive and buffer rings stay on epoll
+        const char* uring = std::getenv("CHAT_IO_URING");
+        if (!uring || std::string(uring) != "0") {
+            uringReactor_ = ChatServer::UringReactor::create(io_context_);
+        }
+        ui_->addMessage("INFO", std::string("Network backend: ") + (uringReactor_ ? "io_uring" : "epoll"));
+#endif
+        
+#ifndef _WIN32
+        if (bus_) {
+            ChatServer::MessageBus::Handlers handlers;
+            handlers.deliver = [this](const std::string& roomName, std::uint64_t seq, const std::string& senderId,
+                                      const std::string& message) {
+                if (auto room = chatRoomManager_->getChatRoom(roomName)) {
+                    room->deliverRemote(seq, senderId, message);
+                }
+            };
+            handlers.direct = [directory = sessionDirectory_, placement = roomPlacement_](
+                                  const std::string& fromNode, const std::string& payload) {
+                if (ChatServer::RoomPlacement::handles(payload)) {
+                    placement->received(fromNode, payload);
+                } else {
+                    directory->received(fromNode, payload);
+                }
+            };
+            handlers.membership = [directory = sessionDirectory_, placement = roomPlacement_](
+                                      const std::vector<std::string>& nodes) {
+                directory->nodesChanged(nodes);
+                placement->nodesChanged(nodes);
+            };
+            bus_->start(std::move(handlers));
+            chatRoomManager_->setBus(bus_);
+            roomPlacement_->start();
+            ui_->addMessage("INFO", "Room traffic shared with the other nodes of the cluster as " + bus_->nodeId());
+        }
+        
+        // Serve the connections of the server this one replaces
+        if (inherited) {
+            adoptSessions(*inherited);
+        }
+        
+        // Let a later build take over without dropping connections: a new
+        // process started with the same CHAT_HANDOFF_SOCKET asks for them
+        if (const char* handoffPath = std::getenv("CHAT_HANDOFF_SOCKET")) {
+            handoffListener_ = std::make_unique<ChatServer::HandoffListener>(io_context_, handoffPath);
+            handoffListener_->start([this](std::shared_ptr<ChatServer::HandoffListener::Channel> channel) {
+                beginHandoff(std::move(channel));
+            });
+        }
+#endif
+        
+        // Members of parked identities stay out of delivery until they resume
+        suspendParkedMembers();
+        
+        // Drain on SIGINT/SIGTERM or POST /drain: wait up to CHAT_DRAIN_TIMEOUT_MS
+        // (10000) for output to flush; clients are told to reconnect after
+        // CHAT_DRAIN_RECONNECT_MS (1000) plus up to CHAT_DRAIN_SPREAD_MS (10000)
+        if (const char* timeout = std::getenv("CHAT_DRAIN_TIMEOUT_MS")) {
+            drainTimeout_ = std::chrono::milliseconds(std::max(0, std::atoi(timeout)));
+        }
+        if (const char* base = std::getenv("CHAT_DRAIN_RECONNECT_MS")) {
+            drainReconnectBase_ = std::chrono::milliseconds(std::max(0, std::atoi(base)));
+        }
+        if (const char* spread = std::getenv("CHAT_DRAIN_SPREAD_MS")) {
+            drainSpread_ = std::chrono::milliseconds(std::max(0, std::atoi(spread)));
+        }
+        waitForSignal();
+        
+        // Serve clients connected to chat_gateway over links accepted on
+        // CHAT_GATEWAY_PORT (unset by default), on CHAT_GATEWAY_ADDRESS
+        // (127.0.0.1); clients can still connect here directly
+        startGatewayListener();
+        
         // Start accepting connections
         doAccept();
+        scheduleExpiry();
         
         // Start status update thread
         status_thread_ = std::thread([this]() {
@@ -362,92 +735,698 @@ public:
             status_thread_.join();
         }
         ui_->addMessage("SYSTEM", "Server shutting down...");
+        if (adminServer_) {
+            adminServer_->stop();
+        }
+        if (gatewayListener_) {
+            gatewayListener_->stop();
+        }
+        ChatServer::StallWatchdog::getInstance().stop();
+        ChatServer::TraceRecorder::getInstance().stop();
+#ifdef CHAT_IO_URING
+        if (uringReactor_) {
+            uringReactor_->stop();
+        }
+#endif
+        if (bus_) {
+            sessionManager_->setPresenceObserver(nullptr);
+            bus_->stop();
+        }
+        historyStore_->stop();
+        searchIndex_->stop();
+        dbExecutor_->stop();
+        stateStore_->stop();
     }
 
 private:
+    static tcp::acceptor makeAcceptor(boost::asio::io_context& io_context, short port, const InheritedState* inherited) {
+#ifndef _WIN32
+        if (inherited) {
+            return tcp::acceptor(io_context, tcp::v4(), inherited->listenFd);
+        }
+#else
+        (void)inherited;
+#endif
+        return tcp::acceptor(io_context, tcp::endpoint(tcp::v4(), port));
+    }
+    
+    void startAdminServer() {
+        const char* portSetting = std::getenv("CHAT_ADMIN_PORT");
+        int port = portSetting ? std::atoi(portSetting) : 9100;
+        if (port <= 0 || port > 65535) {
+            return;
+        }
+        
+        auto& metrics = ChatServer::MetricsRegistry::getInstance();
+        metrics.callbackGauge("chat_rooms", "Chat rooms that exist", [this]() {
+            return static_cast<double>(chatRoomManager_->getAllRooms().size());
+        });
+        metrics.callbackGauge("chat_resume_parked_sessions", "Dropped sessions waiting to be resumed", [this]() {
+            return static_cast<double>(resumeRegistry_->parkedCount());
+        });
+        metrics.callbackGauge("chat_search_indexed_messages", "Messages merged into the search index", [this]() {
+            return static_cast<double>(searchIndex_->indexedCount());
+        });
+        
+        adminServer_ = std::make_unique<ChatServer::AdminServer>(io_context_, "127.0.0.1",
+                                                                 static_cast<unsigned short>(port));
+        adminServer_->addRoute("GET", "/metrics", [](const ChatServer::AdminRequest&) {
+            ChatServer::AdminResponse response;
+            response.contentType = "text/plain; version=0.0.4; charset=utf-8";
+            response.body = ChatServer::MetricsRegistry::getInstance().render();
+            return response;
+        });
+        adminServer_->addRoute("GET", "/locks", [](const ChatServer::AdminRequest&) {
+            ChatServer::AdminResponse response;
+            response.body = ChatServer::ProfiledMutex::report(20);
+            return response;
+        });
+        adminServer_->addRoute("POST", "/drain", [this](const ChatServer::AdminRequest&) {
+            // Answer first; the drain closes the admin port on its way out
+            boost::asio::post(io_context_, [this]() { beginDrain("admin request"); });
+            ChatServer::AdminResponse response;
+            response.status = 202;
+            response.body = "draining within " + std::to_string(drainTimeout_.count()) + " ms\n";
+            return response;
+        });
+        if (roomPlacement_) {
+            // Rooms known here with their owner and load; moving a busy one
+            // to another node takes load off this one
+            adminServer_->addRoute("GET", "/rooms", [this](const ChatServer::AdminRequest&) {
+                ChatServer::AdminResponse response;
+                for (const auto& room : roomPlacement_->status()) {
+                    response.body += room.room + " owner=" + room.owner + " state=" + room.state +
+                                     " seq=" + std::to_string(room.lastSeq) +
+                                     " local_members=" + std::to_string(room.localMembers) +
+                                     " remote_members=" + std::to_string(room.remoteMembers) +
+                                     " posted=" + std::to_string(room.posted) + "\n";
+                }
+                return response;
+            });
+            adminServer_->addRoute("POST", "/rooms/migrate", [this](const ChatServer::AdminRequest& request) {
+                ChatServer::AdminResponse response;
+                std::string room = queryParam(request.query, "room");
+                std::string node = queryParam(request.query, "to");
+                std::string error;
+                if (room.empty() || node.empty()) {
+                    response.status = 400;
+                    response.body = "usage: POST /rooms/migrate?room=<room>&to=<node>\n";
+                } else if (!roomPlacement_->migrate(room, node, error)) {
+                    response.status = 409;
+                    response.body = error + "\n";
+                } else {
+                    response.status = 202;
+                    response.body = "handing " + room + " to " + node + "\n";
+                }
+                return response;
+            });
+        }
+        adminServer_->addRoute("GET", "/trace", [](const ChatServer::AdminRequest&) {
+            return traceStatus();
+        });
+        adminServer_->addRoute("POST", "/trace/start", [](const ChatServer::AdminRequest&) {
+            // A new file per capture, in CHAT_TRACE_DIR or the working directory
+            const char* dir = std::getenv("CHAT_TRACE_DIR");
+            std::string path = std::string(dir ? dir : ".") + "/chat-" + std::to_string(std::time(nullptr)) + ".trace";
+            if (!ChatServer::TraceRecorder::getInstance().start(path, traceRedacted())) {
+                ChatServer::AdminResponse response = traceStatus();
+                response.status = 503;
+                return response;
+            }
+            return traceStatus();
+        });
+        adminServer_->addRoute("POST", "/trace/stop", [](const ChatServer::AdminRequest&) {
+            ChatServer::TraceRecorder::getInstance().stop();
+            return traceStatus();
+        });
+        if (adminServer_->start()) {
+            ui_->addMessage("INFO", "Metrics at http://127.0.0.1:" + std::to_string(port) + "/metrics");
+        } else {
+            ui_->addMessage("ERROR", "Admin port " + std::to_string(port) + " unavailable; metrics not exported", true);
+            adminServer_.reset();
+        }
+    }
+    
+    void startGatewayListener() {
+        const char* portSetting = std::getenv("CHAT_GATEWAY_PORT");
+        int port = portSetting ? std::atoi(portSetting) : 0;
+        if (port <= 0 || port > 65535) {
+            return;
+        }
+        const char* address = std::getenv("CHAT_GATEWAY_ADDRESS");
+        
+        gatewayListener_ = std::make_unique<ChatServer::GatewayListener>(
+            io_context_, address ? address : "127.0.0.1", static_cast<unsigned short>(port),
+            [this](const std::shared_ptr<ChatServer::GatewayLink>& link, std::uint32_t channel)
+                -> std::shared_ptr<ChatServer::Session> {
+                if (draining_ || handingOff_) {
+                    return nullptr;
+                }
+                return startSession(tcp::socket(io_context_), link, channel);
+            });
+        if (gatewayListener_->start()) {
+            ui_->addMessage("INFO", "Accepting gateway links on port " + std::to_string(port));
+        } else {
+            ui_->addMessage("ERROR", "Gateway port " + std::to_string(port) + " unavailable", true);
+            gatewayListener_.reset();
+        }
+    }
+    
+    // The value of name in an admin request's query string, or empty
+    static std::string queryParam(const std::string& query, const std::string& name) {
+        std::istringstream fields(query);
+        std::string field;
+        while (std::getline(fields, field, '&')) {
+            if (field.compare(0, name.size() + 1, name + "=") == 0) {
+                return field.substr(name.size() + 1);
+            }
+        }
+        return "";
+    }
+    
+    // Chat text and command arguments are replaced in captures unless CHAT_TRACE_REDACT=0
+    static bool traceRedacted() {
+        const char* redact = std::getenv("CHAT_TRACE_REDACT");
+        return !redact || std::string(redact) != "0";
+    }
+    
+    static ChatServer::AdminResponse traceStatus() {
+        auto status = ChatServer::TraceRecorder::getInstance().status();
+        ChatServer::AdminResponse response;
+        response.body = std::string(status.active ? "capturing" : "idle") +
+                        (status.path.empty() ? "" : " " + status.path) +
+                        "\nrecords " + std::to_string(status.records) +
+                        "\nsessions " + std::to_string(status.sessions) +
+                        "\ndropped " + std::to_string(status.dropped) + "\n";
+        return response;
+    }
+    
+    // Restored users keep their user_N ids; start numbering after them
+    void skipRestoredSessionIds() {
+        const std::string prefix = "user_";
+        for (const auto& pair : userManager_->getAllUsers()) {
+            if (pair.first.compare(0, prefix.size(), prefix) == 0) {
+                try {
+                    raiseNextSessionId(std::stoi(pair.first.substr(prefix.size())) + 1);
+                } catch (const std::exception&) {
+                }
+            }
+        }
+    }
+    
+    // Parked members, restored from disk or handed over, get no deliveries
+    // until they resume; the room ring replays what they missed
+    void suspendParkedMembers() {
+        for (const auto& identity : resumeRegistry_->snapshot()) {
+            if (identity.state != ChatServer::ResumeRegistry::State::Parked) {
+                continue;
+            }
+            for (const auto& [roomName, lastSeq] : identity.lastSeqs) {
+                std::uint64_t ignored;
+                if (auto room = chatRoomManager_->getChatRoom(roomName)) {
+                    room->suspendSession(identity.sessionId, ignored);
+                }
+            }
+        }
+    }
+    
+    // Never hand out an id below next again
+    void raiseNextSessionId(int next) {
+        int current = nextSessionId_.load();
+        while (current < next && !nextSessionId_.compare_exchange_weak(current, next)) {
+        }
+    }
+    
     void doAccept() {
-        acceptor_.async_accept(socket_, [this](boost::system::error_code ec) {
-            if (!ec) {
-                stats_.totalConnections++;
-                stats_.activeConnections++;
-                
-                // Create a unique session ID
-                std::string sessionId = "user_" + std::to_string(nextSessionId_++);
-                
-                ui_->addMessage("INFO", "New connection accepted: " + sessionId);
-                
-                // Create a new session
-                auto session = std::make_shared<ChatServer::Session>(std::move(socket_), sessionId);
-                
-                // Set the command manager for the session
-                session->setCommandManager(commandManager_);
-                
-                // Set the message handler
-                session->setMessageHandler([this](const std::string& message, std::shared_ptr<ChatServer::Session> sender) {
-                    handleMessage(message, sender);
-                });
-                
-                // Add the session to the session manager
-                sessionManager_->addSession(session);
-                
-                // Create a user for the session
-                userManager_->createUser(sessionId);
-                
-                // Start the session
-                session->start();
-                
-                // Send a welcome message
-                session->sendMessage("Welcome to the Unified Chat Server! Your session ID is " + sessionId);
-                session->sendMessage("Type /help to see available commands");
-                
-                // Add the user to the default chat room
-                auto defaultRoom = chatRoomManager_->getChatRoom("general");
-                if (defaultRoom) {
-                    defaultRoom->addSession(sessionId);
-                    session->sendMessage("You have been added to the 'general' chat room");
+#ifdef CHAT_IO_URING
+        // One multishot accept stays armed; the reactor re-arms it as needed
+        if (uringReactor_) {
+            uringReactor_->accept(acceptor_.native_handle(), [this](int fd, int error) {
+                ChatServer::StallWatchdog::HandlerScope scope(ChatServer::StallWatchdog::Handler::Accept);
+                if (draining_) {
+                    if (fd >= 0) {
+                        ::close(fd);
+                    }
+                    return;
                 }
-            } else {
+                if (fd < 0) {
+                    ui_->addMessage("ERROR", std::string("Accept error: ") + std::strerror(error), true);
+                    return;
+                }
+                tcp::socket socket(io_context_);
+                boost::system::error_code ec;
+                socket.assign(acceptor_.local_endpoint().protocol(), fd, ec);
+                if (ec) {
+                    ::close(fd);
+                    ui_->addMessage("ERROR", "Accept error: " + ec.message(), true);
+                    return;
+                }
+                startSession(std::move(socket));
+            });
+            return;
+        }
+#endif
+        acceptor_.async_accept(socket_, [this](boost::system::error_code ec) {
+            ChatServer::StallWatchdog::HandlerScope scope(ChatServer::StallWatchdog::Handler::Accept);
+            if (!ec && draining_) {
+                socket_.close(ec); // accepted as the drain began
+            } else if (!ec) {
+                startSession(std::move(socket_));
+            } else if (!handingOff_ && !draining_) {
                 ui_->addMessage("ERROR", "Accept error: " + ec.message(), true);
             }
             
+            // The listener belongs to the successor once a handoff starts,
+            // and is closed for a drain
+            if (handingOff_ || draining_) {
+                return;
+            }
+            
             // Continue accepting connections
             doAccept();
         });
     }
     
+    // A client of chat_gateway has a link and channel instead of a socket
+    std::shared_ptr<ChatServer::Session> startSession(tcp::socket socket,
+                                                      std::shared_ptr<ChatServer::GatewayLink> link = nullptr,
+                                                      std::uint32_t channel = 0) {
+        stats_.totalConnections.inc();
+        stats_.activeConnections.add(1);
+        
+        // Create a unique session ID
+        std::string sessionId = "user_" + std::to_string(nextSessionId_.fetch_add(1)) + sessionIdSuffix_;
+        
+        ui_->addMessage("INFO", "New connection accepted: " + sessionId);
+        
+        auto session = createSession(std::move(socket), sessionId, std::move(link), channel);
+        std::string token = resumeRegistry_->issue(sessionId, session.get());
+        
+        // Start the session
+        session->start();
+        if (handingOff_) {
+            session->pauseReading(); // accepted just before the handoff began
+        }
+        
+        // Send a welcome message
+        session->sendMessage("Welcome to the Unified Chat Server! Your session ID is " + sessionId);
+        session->sendMessage("Your resume token is " + token +
+                             "; after a dropped connection send /resume " + token + " to pick up where you left off");
+        session->sendMessage("Type /help to see available commands");
+        
+        scheduleSettle(session, sessionId);
+        return session;
+    }
+    
+    // Create a session with the server's handlers and register it
+    std::shared_ptr<ChatServer::Session> createSession(tcp::socket socket, const std::string& sessionId,
+                                                       std::shared_ptr<ChatServer::GatewayLink> link = nullptr,
+                                                       std::uint32_t channel = 0) {
+        auto session = std::make_shared<ChatServer::Session>(std::move(socket), sessionId);
+        
+        // Set the command manager for the session
+        session->setCommandManager(commandManager_);
+#ifdef CHAT_IO_URING
+        if (!link) {
+            session->setUringReactor(uringReactor_.get());
+        }
+#endif
+        if (link) {
+            session->setGatewayLink(std::move(link), channel);
+        }
+        
+        // Set the message handler
+        session->setMessageHandler([this](const std::string& message, std::shared_ptr<ChatServer::Session> sender) {
+            handleMessage(message, sender);
+        });
+        
+        // Park the identity when the connection drops so it can be resumed
+        session->setCloseHandler([this](std::shared_ptr<ChatServer::Session> closed) {
+            handleClose(closed);
+        });
+        
+        // Add the session to the session manager
+        sessionManager_->addSession(session);
+        return session;
+    }
+    
+    void scheduleSettle(const std::shared_ptr<ChatServer::Session>& session, const std::string& sessionId) {
+        // A reconnecting client sends /resume first; give it a moment
+        // before setting up a new user it would only throw away
+        auto grace = std::make_shared<boost::asio::steady_timer>(
+            io_context_, resumeRegistry_->config().freshGrace);
+        grace->async_wait([this, grace, session, sessionId](boost::system::error_code) {
+            ChatServer::StallWatchdog::HandlerScope scope(ChatServer::StallWatchdog::Handler::Timer);
+            settleSession(session, sessionId);
+        });
+    }
+    
+    // Set up a new connection as a fresh user in the default room, once
+    void settleSession(const std::shared_ptr<ChatServer::Session>& session, const std::string& sessionId) {
+        // The state journal is closed during a handoff; the successor settles instead
+        if (handingOff_ || !resumeRegistry_->settle(sessionId)) {
+            return; // already set up, resumed as another identity, or gone
+        }
+        
+        // Create a user for the session
+        userManager_->createUser(sessionId);
+        
+        // Add the user to the default chat room
+        auto defaultRoom = chatRoomManager_->getChatRoom("general");
+        if (defaultRoom) {
+            session->sendMessage("You have been added to the 'general' chat room");
+            defaultRoom->join(sessionId, [&session](const ChatServer::Session::Frame& frame) {
+                session->sendFrame(frame);
+            });
+        }
+    }
+    
+    void handleClose(const std::shared_ptr<ChatServer::Session>& session) {
+        // A session whose identity was resumed elsewhere has nothing to park
+        if (!sessionManager_->removeSession(session)) {
+            return;
+        }
+        stats_.activeConnections.add(-1);
+        
+        const std::string sessionId = session->getSessionId();
+        resumeRegistry_->park(sessionId, session.get(), [&](ChatServer::ResumeRegistry::RoomSeqs& lastSeqs) {
+            for (const auto& room : chatRoomManager_->getAllRooms()) {
+                std::uint64_t seq;
+                if (room->suspendSession(sessionId, seq)) {
+                    lastSeqs[room->getName()] = seq;
+                }
+            }
+        });
+        ui_->addMessage("INFO", "Connection closed: " + sessionId);
+    }
+    
+    // Drop identities nobody resumed in time
+    void scheduleExpiry() {
+        expiryTimer_.expires_after(std::chrono::seconds(30));
+        expiryTimer_.async_wait([this](boost::system::error_code ec) {
+            if (ec) {
+                return;
+            }
+            ChatServer::StallWatchdog::HandlerScope scope(ChatServer::StallWatchdog::Handler::Timer);
+            for (const auto& expired : resumeRegistry_->expire(std::chrono::steady_clock::now())) {
+                for (const auto& roomName : expired.rooms) {
+                    if (auto room = chatRoomManager_->getChatRoom(roomName)) {
+                        room->removeSession(expired.sessionId);
+                    }
+                }
+                userManager_->removeUser(expired.sessionId);
+            }
+            scheduleExpiry();
+        });
+    }
+    
+#ifndef _WIN32
+    // Take over the connections and resume state a predecessor handed over
+    void adoptSessions(const ChatServer::HandoffState& inherited) {
+        resumeRegistry_->restore(inherited.identities);
+        raiseNextSessionId(inherited.nextSessionId);
+        
+        for (const auto& handed : inherited.sessions) {
+            tcp::socket socket(io_context_);
+            boost::system::error_code ec;
+            socket.assign(acceptor_.local_endpoint().protocol(), handed.fd, ec);
+            if (ec) {
+                ::close(handed.fd);
+                ui_->addMessage("ERROR", "Cannot adopt " + handed.sessionId + ": " + ec.message(), true);
+                continue;
+            }
+            stats_.activeConnections.add(1);
+            auto session = createSession(std::move(socket), handed.sessionId);
+            resumeRegistry_->adopt(handed.sessionId, session.get());
+            session->start();
+            scheduleSettle(session, handed.sessionId); // only still-pending sessions settle
+        }
+        ui_->addMessage("INFO", "Took over " + std::to_string(inherited.sessions.size()) +
+                        " connections from the previous server");
+    }
+    
+    // A successor asked for the connections: stop reading everywhere, let
+    // writes in flight finish, then hand everything over
+    void beginHandoff(std::shared_ptr<ChatServer::HandoffListener::Channel> channel) {
+#ifdef CHAT_IO_URING
+        // Reads armed on the ring cannot be paused; closing the channel tells the successor
+        if (uringReactor_) {
+            ui_->addMessage("ERROR", "Hot restart is not supported with the io_uring backend", true);
+            return;
+        }
+#endif
+        if (draining_ || handingOff_.exchange(true)) {
+            return;
+        }
+        ui_->addMessage("INFO", "Hot restart requested; pausing connections");
+        
+        boost::system::error_code ignored;
+        acceptor_.cancel(ignored);
+        if (gatewayListener_) {
+            gatewayListener_->stop();
+        }
+        expiryTimer_.cancel();
+        for (const auto& pair : sessionManager_->getAllSessions()) {
+            pair.second->pauseReading();
+        }
+        whenQuiescent(std::chrono::steady_clock::now() + std::chrono::seconds(5),
+            [this, channel](const std::vector<std::shared_ptr<ChatServer::Session>>& busy) {
+                // Clients that would not drain are dropped; they can resume on the successor
+                for (const auto& session : busy) {
+                    ui_->addMessage("ERROR", "Dropping " + session->getSessionId() + " which did not drain in time", true);
+                    session->close();
+                    handleClose(session);
+                }
+                completeHandoff(channel);
+            });
+    }
+    
+    void completeHandoff(std::shared_ptr<ChatServer::HandoffListener::Channel> channel) {
+        // The successor loads rooms, users, memberships and history from
+        // disk, so flush them first; the admin port is freed for it too
+        historyStore_->stop();
+        stateStore_->stop();
+        if (adminServer_) {
+            adminServer_->stop();
+            adminServer_.reset();
+        }
+        
+        ChatServer::HandoffState state;
+        state.listenFd = acceptor_.native_handle();
+        state.nextSessionId = nextSessionId_.load();
+        for (const auto& pair : sessionManager_->getAllSessions()) {
+            if (pair.second->nativeHandle() < 0) {
+                // A gateway client has no socket to pass; parked, it resumes
+                // on the successor once its gateway links up again
+                pair.second->close();
+                handleClose(pair.second);
+                continue;
+            }
+            state.sessions.push_back({pair.second->getSessionId(), pair.second->nativeHandle()});
+        }
+        state.identities = resumeRegistry_->snapshot();
+        if (!ChatServer::HandoffListener::send(*channel, state)) {
+            abortHandoff();
+            return;
+        }
+        
+        ChatServer::HandoffListener::awaitReady(channel, std::chrono::seconds(30), [this](bool ready) {
+            if (!ready) {
+                abortHandoff();
+                return;
+            }
+            // Exit without shutting down a single connection; the successor
+            // has bound the handoff path again, so leave the file alone
+            ui_->addMessage("INFO", "Connections handed to the new server; exiting");
+            handoffListener_->stop(false);
+            io_context_.stop();
+        });
+    }
+    
+    // The successor failed before taking over; carry on serving
+    void abortHandoff() {
+        ui_->addMessage("ERROR", "Hot restart failed; resuming service", true);
+        if (!stateStore_->start()) {
+            ui_->addMessage("ERROR", "State journal unavailable; changes will not survive a restart", true);
+        }
+        if (!historyStore_->start()) {
+            ui_->addMessage("ERROR", "Message persistence unavailable", true);
+        }
+        startAdminServer();
+        if (gatewayListener_ && !gatewayListener_->start()) {
+            gatewayListener_.reset();
+        }
+        
+        handingOff_ = false;
+        for (const auto& pair : sessionManager_->getAllSessions()) {
+            pair.second->resumeReading();
+        }
+        doAccept();
+        scheduleExpiry();
+    }
+#endif
+    
+    // Run done once every session has paused reading and written all it
+    // had queued, or at the deadline with the sessions still busy
+    using QuiescentHandler = std::function<void(const std::vector<std::shared_ptr<ChatServer::Session>>& busy)>;
+    void whenQuiescent(std::chrono::steady_clock::time_point deadline, QuiescentHandler done) {
+        std::vector<std::shared_ptr<ChatServer::Session>> busy;
+        for (const auto& pair : sessionManager_->getAllSessions()) {
+            if (!pair.second->isQuiescent()) {
+                busy.push_back(pair.second);
+            }
+        }
+        if (!busy.empty() && std::chrono::steady_clock::now() < deadline) {
+            auto poll = std::make_shared<boost::asio::steady_timer>(io_context_, std::chrono::milliseconds(10));
+            poll->async_wait([this, poll, deadline, done = std::move(done)](boost::system::error_code) mutable {
+                whenQuiescent(deadline, std::move(done));
+            });
+            return;
+        }
+        done(busy);
+    }
+    
+    // Second SIGINT or SIGTERM during a drain stops at once
+    void waitForSignal() {
+        signals_.async_wait([this](boost::system::error_code ec, int signal) {
+            if (ec) {
+                return;
+            }
+            if (draining_) {
+                ui_->addMessage("SYSTEM", "Stopping without waiting for the drain");
+                io_context_.stop();
+                return;
+            }
+            beginDrain("signal " + std::to_string(signal));
+            waitForSignal();
+        });
+    }
+    
+    // Shut down without losing what is in flight: stop accepting, tell
+    // every client when to reconnect (spread out so they do not all come
+    // back at once), flush outbound frames and the history queue, then exit
+    void beginDrain(const std::string& reason) {
+        if (handingOff_ || draining_.exchange(true)) {
+            return;
+        }
+        ui_->addMessage("SYSTEM", "Draining (" + reason + "); shutting down within " +
+                        std::to_string(drainTimeout_.count()) + " ms");
+        
+        boost::system::error_code ignored;
+        acceptor_.close(ignored);
+        if (gatewayListener_) {
+            gatewayListener_->stop();
+        }
+        expiryTimer_.cancel();
+        
+        std::mt19937 random(std::random_device{}());
+        std::uniform_int_distribution<long long> spread(0, drainSpread_.count());
+        for (const auto& pair : sessionManager_->getAllSessions()) {
+            auto delay = drainReconnectBase_.count() + spread(random);
+            pair.second->sendMessage("Server is shutting down; reconnect in " + std::to_string(delay) +
+                                     " ms and send /resume with your token to pick up where you left off");
+            pair.second->pauseReading();
+        }
+        
+        auto started = std::chrono::steady_clock::now();
+        whenQuiescent(started + drainTimeout_,
+            [this, started](const std::vector<std::shared_ptr<ChatServer::Session>>& busy) {
+                if (!busy.empty()) {
+                    ui_->addMessage("ERROR", std::to_string(busy.size()) +
+                                    " connections still had output queued at the drain deadline", true);
+                }
+                for (const auto& pair : sessionManager_->getAllSessions()) {
+                    pair.second->close();
+                }
+                
+                // Messages already accepted are written before exiting
+                historyStore_->stop();
+                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - started);
+                ui_->addMessage("SYSTEM", "Drained in " + std::to_string(elapsed.count()) + " ms");
+                io_context_.stop();
+            });
+    }
+    
     void handleMessage(const std::string& message, std::shared_ptr<ChatServer::Session> sender) {
-        stats_.messagesProcessed++;
-        stats_.bytesReceived += message.length();
+        const std::string senderId = sender->getSessionId();
+        
+        // Talking before the grace period ends opts out of resuming
+        settleSession(sender, senderId);
+        
+        stats_.messagesProcessed.inc();
+        stats_.bytesReceived.inc(message.length());
         
         // Log the message
-        ui_->addMessage("MESSAGE", sender->getSessionId() + ": " + message);
+        ui_->addMessage("MESSAGE", senderId + ": " + message);
+        
+        auto timestamp = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
         
         // Find which rooms the user is in
         auto rooms = chatRoomManager_->getAllRooms();
         for (const auto& room : rooms) {
             auto sessions = room->getSessions();
-            if (sessions.find(sender->getSessionId()) != sessions.end()) {
-                // User is in this room, broadcast the message
-                std::string formattedMessage = "[" + sender->getSessionId() + "]: " + message;
-                room->broadcastMessage(formattedMessage, sender->getSessionId());
+            if (sessions.find(senderId) != sessions.end()) {
+                // In a cluster the room's owner numbers the message
+                if (roomPlacement_) {
+                    roomPlacement_->post(room->getName(), senderId, message, timestamp);
+                } else {
+                    postToRoom(room, senderId, message, timestamp);
+                }
                 
                 // Update bytes sent
-                stats_.bytesSent += formattedMessage.length() * (sessions.size() - 1);
+                stats_.bytesSent.inc((message.length() + senderId.length() + 4) * (sessions.size() - 1));
             }
         }
     }
+    
+    // Broadcast a message and hand it to the history writer in sequence
+    // order; neither blocks. False while the room is handed to another node.
+    bool postToRoom(const std::shared_ptr<ChatServer::ChatRoom>& room, const std::string& senderId,
+                    const std::string& message, std::int64_t timestamp) {
+        std::string formattedMessage = "[" + senderId + "]: " + message;
+        return room->broadcastMessage(formattedMessage, senderId, [&](std::uint64_t seq) {
+            historyStore_->append({room->getName(), senderId, message, timestamp, seq});
+        }) != 0;
+    }
 
     tcp::acceptor acceptor_;
     tcp::socket socket_;
     boost::asio::io_context& io_context_;
+    boost::asio::steady_timer expiryTimer_;
     
     std::unique_ptr<ConsoleUI> ui_;
     std::shared_ptr<ChatServer::ChatRoomManager> chatRoomManager_;
     std::shared_ptr<ChatServer::UserManager> userManager_;
     std::shared_ptr<ChatServer::SessionManager> sessionManager_;
     std::shared_ptr<ChatServer::CommandManager> commandManager_;
+    std::shared_ptr<ChatServer::DatabaseExecutor> dbExecutor_;
+    std::shared_ptr<ChatServer::HistoryStore> historyStore_;
+    std::shared_ptr<ChatServer::SearchIndex> searchIndex_;
+    std::shared_ptr<ThreadPool> queryPool_;
+    std::shared_ptr<ChatServer::StateStore> stateStore_;
+    std::shared_ptr<ChatServer::ResumeRegistry> resumeRegistry_;
+    std::unique_ptr<ChatServer::AdminServer> adminServer_;
+    std::unique_ptr<ChatServer::GatewayListener> gatewayListener_;
+    std::shared_ptr<ChatServer::MessageBus> bus_;
+    std::shared_ptr<ChatServer::SessionDirectory> sessionDirectory_;
+    std::shared_ptr<ChatServer::RoomPlacement> roomPlacement_;
+    std::string sessionIdSuffix_;          // "@<node>" in a cluster
+#ifdef CHAT_IO_URING
+    std::unique_ptr<ChatServer::UringReactor> uringReactor_;
+#endif
+#ifndef _WIN32
+    std::unique_ptr<ChatServer::HandoffListener> handoffListener_;
+#endif
+    std::atomic<bool> handingOff_{false};  // connections are being handed to a successor
+    std::atomic<bool> draining_{false};    // shutting down; no new connections or input
+    boost::asio::signal_set signals_;
+    std::chrono::milliseconds drainTimeout_{10000};
+    std::chrono::milliseconds drainReconnectBase_{1000};
+    std::chrono::milliseconds drainSpread_{10000};
     
-    int nextSessionId_ = 1;
+    std::atomic<int> nextSessionId_{1};    // taken on any io thread, by direct and gateway clients
     ServerStats stats_;
     
     std::thread status_thread_;
@@ -460,9 +1439,41 @@ int main() {
         Logging::init_logging("build/server.log");
         Logging::info("Starting Unified Chat Server");
         
+        // Mutex contention profiling (report at /locks on the admin port)
+        const char* lockProfiling = std::getenv("CHAT_LOCK_PROFILING");
+        if (lockProfiling && std::string(lockProfiling) == "1") {
+            ChatServer::ProfiledMutex::setEnabled(true);
+            Logging::info("Lock profiling enabled");
+        }
+        
+        // CHAT_PORT (8080) lets several nodes of a cluster share a host
+        short port = 8080;
+        if (const char* portSetting = std::getenv("CHAT_PORT")) {
+            port = static_cast<short>(std::atoi(portSetting));
+        }
+        
         // Create and run the server
         boost::asio::io_context io_context;
-        UnifiedChatServer server(io_context, 8080);
+#ifndef _WIN32
+        // Take over from a server running with the same CHAT_HANDOFF_SOCKET, if one is
+        ChatServer::HandoffClient handoff;
+        InheritedState inherited;
+        const char* handoffPath = std::getenv("CHAT_HANDOFF_SOCKET");
+        bool takingOver = handoffPath && handoff.connect(handoffPath);
+        if (takingOver) {
+            Logging::info("Taking over from the running server");
+            if (!handoff.receive(inherited)) {
+                Logging::fatal("Hot restart failed; the running server carries on");
+                return 1;
+            }
+        }
+        UnifiedChatServer server(io_context, port, takingOver ? &inherited : nullptr);
+        if (takingOver) {
+            handoff.confirm();
+        }
+#else
+        UnifiedChatServer server(io_context, port);
+#endif
         
         // Run the server with multiple threads
         const int num_threads = 4;
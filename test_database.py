@@ -36,11 +36,17 @@ def init_database():
         user_id TEXT,
         content TEXT,
         timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+        seq INTEGER,
         FOREIGN KEY (room_id) REFERENCES chat_rooms(room_id),
         FOREIGN KEY (user_id) REFERENCES users(user_id)
     )
     ''')
     
+    # Per-room sequence numbers; history pages seek on (room_id, seq)
+    db_handler.execute('''
+    CREATE INDEX IF NOT EXISTS idx_messages_room_seq ON messages (room_id, seq)
+    ''')
+    
     db_handler.execute('''
     CREATE TABLE IF NOT EXISTS room_members (
         room_id INTEGER,
@@ -76,11 +82,11 @@ def insert_test_data():
     
     # Insert sample messages
     messages = [
-        (1, 'user_1', 'Hello everyone!'),
-        (1, 'user_2', 'Hi Alice!'),
-        (2, 'user_3', 'This is a random message.')
+        (1, 'user_1', 'Hello everyone!', 1),
+        (1, 'user_2', 'Hi Alice!', 2),
+        (2, 'user_3', 'This is a random message.', 1)
     ]
-    db_handler.executemany('INSERT INTO messages (room_id, user_id, content) VALUES (?, ?, ?)', messages)
+    db_handler.executemany('INSERT INTO messages (room_id, user_id, content, seq) VALUES (?, ?, ?, ?)', messages)
     
     # Insert sample room members
     members = [